@@ -1611,6 +1611,10 @@ void DkActionManager::createActions(QWidget *parent)
     mHiddenActions[sc_delete_silent]->setStatusTip(QObject::tr("Deletes a file without warning"));
     mHiddenActions[sc_delete_silent]->setShortcut(QKeySequence(shortcut_delete_silent));
 
+    mHiddenActions[sc_switch_sibling] = new QAction(QObject::tr("Switch RAW/JPG"), parent);
+    mHiddenActions[sc_switch_sibling]->setStatusTip(QObject::tr("Shows the next file with the same name but a different extension"));
+    mHiddenActions[sc_switch_sibling]->setShortcut(QKeySequence(shortcut_switch_sibling));
+
     mHiddenActions[sc_star_rating_0] = new QAction(QObject::tr("Star Rating 0"), parent);
     mHiddenActions[sc_star_rating_0]->setStatusTip(QObject::tr("Star rating which is saved to an image's metadata"));
     mHiddenActions[sc_star_rating_0]->setShortcut(QKeySequence(shortcut_star_rating_0));
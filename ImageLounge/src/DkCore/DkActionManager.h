@@ -288,6 +288,7 @@ public:
         sc_first_file_sync,
         sc_last_file_sync,
         sc_delete_silent,
+        sc_switch_sibling,
 
         sc_star_rating_0,
         sc_star_rating_1,
@@ -388,6 +389,7 @@ public:
         shortcut_goto = Qt::CTRL | Qt::Key_G,
         shortcut_extract = Qt::CTRL | Qt::Key_E,
         shortcut_reload = Qt::Key_F5,
+        shortcut_switch_sibling = Qt::Key_X,
 
         shortcut_first_file_sync = Qt::ALT | Qt::Key_Home,
         shortcut_last_file_sync = Qt::ALT | Qt::Key_End,
@@ -341,11 +341,13 @@ void DkBaseViewPort::paintEvent(QPaintEvent *event)
     if (!mImgStorage.isEmpty()) {
         painter.setWorldTransform(mWorldMatrix);
 
+        double scale = mImgMatrix.m11() * mWorldMatrix.m11();
+
         // don't interpolate - we have a sophisticated anti-aliasing methods
         //// don't interpolate if we are forced to, at 100% or we exceed the maximal interpolation level
         if (!mForceFastRendering && // force?
-            mImgMatrix.m11() * mWorldMatrix.m11() - DBL_EPSILON > 1.0 && // @100% ?
-            mImgMatrix.m11() * mWorldMatrix.m11() <= DkSettingsManager::param().display().interpolateZoomLevel / 100.0) { // > max zoom level
+            scale > 1.0 && !qFuzzyCompare(scale, 1.0) && // @100% ?
+            scale <= DkSettingsManager::param().display().interpolateZoomLevel / 100.0) { // > max zoom level
             painter.setRenderHints(QPainter::SmoothPixmapTransform | QPainter::Antialiasing);
         }
 
@@ -535,7 +537,10 @@ void DkBaseViewPort::draw(QPainter &painter, double opacity)
     }
 
     QRect displayRect = mWorldMatrix.mapRect(mImgViewRect).toRect();
-    QImage img = mImgStorage.image(displayRect.size());
+    bool tiled = mImgStorage.useTiles();
+
+    // tiled images are rendered from the pyramid - don't trigger a full resize
+    QImage img = tiled ? mImgStorage.imageConst() : mImgStorage.image(displayRect.size());
 
     // opacity == 1.0f -> do not show pattern if we crossfade two images
     if (DkSettingsManager::param().display().tpPattern && img.hasAlphaChannel() && opacity == 1.0)
@@ -548,6 +553,8 @@ void DkBaseViewPort::draw(QPainter &painter, double opacity)
         mSvg->render(&painter, mImgViewRect);
     } else if (mMovie && mMovie->isValid()) {
         painter.drawPixmap(mImgViewRect, mMovie->currentPixmap(), mMovie->frameRect());
+    } else if (tiled) {
+        drawTiles(painter);
     } else {
         // if we have the exact level cached: render it directly
         if (displayRect.width() == img.width() && displayRect.height() == img.height()) {
@@ -565,6 +572,70 @@ void DkBaseViewPort::draw(QPainter &painter, double opacity)
     painter.setOpacity(oldOp);
 }
 
+/**
+ * Renders the visible tiles of huge images.
+ * The tiles are taken from the pyramid level that best fits the current zoom.
+ * Tiles that are still read from the file are drawn from the coarsest level.
+ * @param painter the painter (with the world transform set)
+ **/
+void DkBaseViewPort::drawTiles(QPainter &painter)
+{
+    QSize imgSize = mImgStorage.size();
+    double scale = mImgMatrix.m11() * painter.worldTransform().m11() * devicePixelRatioF();
+    int level = mImgStorage.tileLevel(scale);
+
+    const DkImagePyramid &pyramid = mImgStorage.pyramid();
+    QImage lImg = pyramid.level(level); // keeps computed tiles alive
+    QSize lSize = pyramid.levelSize(level);
+
+    if (lSize.isEmpty())
+        return;
+
+    // visible part of the image in image coordinates
+    QRectF visRect = painter.worldTransform().inverted().mapRect(QRectF(QPoint(), size()));
+    visRect = mImgMatrix.inverted().mapRect(visRect).intersected(QRectF(QPoint(), imgSize));
+
+    double sx = (double)imgSize.width() / lSize.width();
+    double sy = (double)imgSize.height() / lSize.height();
+
+    if (scale * sx < 1.0 || qFuzzyCompare(scale * sx, 1.0))
+        painter.setRenderHint(QPainter::SmoothPixmapTransform, true);
+
+    // the coarsest level is a single tile - it is shown until the level's tiles are read
+    int topLevel = pyramid.numLevels() - 1;
+    QImage topImg = mImgStorage.tile(topLevel, QRect(QPoint(), pyramid.levelSize(topLevel)));
+
+    // tiles are snapped to device pixels - otherwise neighbouring tiles leave (antialiased) seams
+    QTransform t = mImgMatrix * painter.worldTransform();
+    double dpr = devicePixelRatioF();
+
+    auto snap = [dpr](double v) {
+        return qRound(v * dpr) / dpr;
+    };
+
+    auto deviceRect = [&](const QRectF &r) {
+        QRectF dr = t.mapRect(r);
+        return QRectF(QPointF(snap(dr.left()), snap(dr.top())), QPointF(snap(dr.right()), snap(dr.bottom())));
+    };
+
+    painter.setWorldMatrixEnabled(false);
+
+    for (const QRect &tr : pyramid.tiles(level, visRect)) {
+        QRectF ir(tr.x() * sx, tr.y() * sy, tr.width() * sx, tr.height() * sy);
+        QImage tile = mImgStorage.tile(level, tr);
+
+        if (!tile.isNull()) {
+            painter.drawImage(deviceRect(ir), tile, tile.rect());
+        } else if (!topImg.isNull()) {
+            double tx = (double)topImg.width() / imgSize.width();
+            double ty = (double)topImg.height() / imgSize.height();
+            painter.drawImage(deviceRect(ir), topImg, QRectF(ir.x() * tx, ir.y() * ty, ir.width() * tx, ir.height() * ty));
+        }
+    }
+
+    painter.setWorldMatrixEnabled(true);
+}
+
 void DkBaseViewPort::drawPattern(QPainter &painter) const
 {
     QBrush pt = mPattern;
@@ -198,6 +198,7 @@ protected:
 
     // functions
     virtual void draw(QPainter &painter, double opacity = 1.0);
+    void drawTiles(QPainter &painter);
     virtual void drawPattern(QPainter &painter) const;
     virtual void updateImageMatrix();
     virtual QTransform getScaledImageMatrix() const;
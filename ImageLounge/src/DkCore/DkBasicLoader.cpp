@@ -30,6 +30,7 @@
 #include "DkImageContainer.h"
 #include "DkImageStorage.h"
 #include "DkMath.h"
+#include "DkMemoryGovernor.h"
 #include "DkMetaData.h"
 #include "DkSettings.h"
 #include "DkTimer.h"
@@ -48,10 +49,17 @@
 #include <QNetworkReply>
 #include <QObject>
 #include <QPixmap>
+#include <QMutex>
 #include <QRegularExpression>
+#include <QSaveFile>
+#include <QSet>
+#include <QStorageInfo>
+#include <QThread>
 #include <QtConcurrentRun>
 
+#include <algorithm>
 #include <assert.h>
+#include <limits>
 #include <qmath.h>
 
 // quazip
@@ -88,7 +96,6 @@
 #define int64 int64_hack_
 
 #include <tiffio.h>
-#include <tiffio.hxx> // this is needed if you want to load tiffs from the buffer
 
 #undef uint64
 #undef int64
@@ -186,6 +193,1408 @@ int DkEditImage::size() const
     return qRound(DkImage::getBufferSizeFloat(mImg.size(), mImg.depth()));
 }
 
+/**
+ * Returns true if suffix is one of the RAW formats we load with LibRaw.
+ **/
+static bool isRawSuffix(const QString &suffix)
+{
+    static const QRegularExpression rawSuffix("(nef|nrw|crw|cr2|cr3|arw|dng|raw|rw2|mrw|srw|orf|3fr|x3f|mos|pef|iiq|raf)",
+                                              QRegularExpression::CaseInsensitiveOption);
+
+    return suffix.contains(rawSuffix);
+}
+
+/**
+ * Returns the first bytes of the file which are needed to identify its decoder.
+ **/
+static QByteArray fileHeader(const QString &filePath, const QSharedPointer<QByteArray> &ba)
+{
+    if (ba && !ba->isEmpty())
+        return ba->left(DkImageDecoder::header_size);
+
+    QFile file(filePath);
+
+    if (!file.open(QIODevice::ReadOnly))
+        return QByteArray();
+
+    return file.read(DkImageDecoder::header_size);
+}
+
+// DkFileBuffer --------------------------------------------------------------------
+static QMutex mappedBuffersMutex;
+static QSet<const char *> mappedBuffers; // data of all buffers that are mapped
+
+/**
+ * Loads the file to a buffer - local files are memory mapped if possible.
+ * Note: zip members must be extracted by the caller.
+ * @param filePath the file
+ * @return QSharedPointer<QByteArray> the file's buffer (empty if the file could not be read)
+ **/
+QSharedPointer<QByteArray> DkFileBuffer::load(const QString &filePath)
+{
+    QSharedPointer<QByteArray> ba = map(filePath);
+
+    if (ba)
+        return ba;
+
+    QFile file(filePath);
+    file.open(QIODevice::ReadOnly);
+
+    ba = QSharedPointer<QByteArray>(new QByteArray(file.readAll()));
+    file.close();
+
+    return ba;
+}
+
+/**
+ * Maps the file to a read-only buffer.
+ * @param filePath the file
+ * @return QSharedPointer<QByteArray> the mapped buffer or a null pointer if the file cannot be mapped
+ **/
+QSharedPointer<QByteArray> DkFileBuffer::map(const QString &filePath)
+{
+    if (!canMap(filePath))
+        return QSharedPointer<QByteArray>();
+
+    // the file stays open as long as it is mapped
+    QFile *file = new QFile(filePath);
+    const uchar *data = 0;
+
+    if (file->open(QIODevice::ReadOnly))
+        data = file->map(0, file->size());
+
+    if (!data) {
+        delete file;
+        return QSharedPointer<QByteArray>();
+    }
+
+    QByteArray *ba = new QByteArray(QByteArray::fromRawData(reinterpret_cast<const char *>(data), file->size()));
+    const char *key = ba->constData();
+
+    {
+        QMutexLocker locker(&mappedBuffersMutex);
+        mappedBuffers.insert(key);
+    }
+
+    return QSharedPointer<QByteArray>(ba, [file, key](QByteArray *ba) {
+        {
+            QMutexLocker locker(&mappedBuffersMutex);
+            mappedBuffers.remove(key);
+        }
+
+        delete ba;
+        delete file; // unmaps the file
+    });
+}
+
+/**
+ * Returns true if the buffer's data is (still) memory mapped.
+ **/
+bool DkFileBuffer::isMapped(const QSharedPointer<QByteArray> &ba)
+{
+    if (!ba || ba->isEmpty())
+        return false;
+
+    QMutexLocker locker(&mappedBuffersMutex);
+    return mappedBuffers.contains(ba->constData());
+}
+
+/**
+ * Returns the heap memory in MB that is allocated by the buffer.
+ **/
+float DkFileBuffer::heapSize(const QSharedPointer<QByteArray> &ba)
+{
+    if (!ba || isMapped(ba))
+        return 0.0f;
+
+    return ba->size() / (1024.0f * 1024.0f);
+}
+
+/**
+ * Returns the size of the mapped file in MB (0 if the buffer is not mapped).
+ **/
+float DkFileBuffer::mappedSize(const QSharedPointer<QByteArray> &ba)
+{
+    if (!isMapped(ba))
+        return 0.0f;
+
+    return ba->size() / (1024.0f * 1024.0f);
+}
+
+bool DkFileBuffer::canMap(const QString &filePath)
+{
+#ifdef Q_OS_WIN
+    // windows locks mapped files - they could not be renamed or deleted anymore
+    Q_UNUSED(filePath);
+    return false;
+#else
+    QFileInfo fi(filePath);
+
+    // copying small files is cheaper than mapping them
+    if (!fi.isFile() || fi.size() < min_map_size)
+        return false;
+
+    // a mapped file that vanishes from a network drive crashes us
+    static const QStringList networkFileSystems = {"nfs", "nfs4", "cifs", "smbfs", "smb3", "afpfs", "webdav", "fuse.sshfs", "9p"};
+    QString fs = QString::fromLatin1(QStorageInfo(fi.absolutePath()).fileSystemType());
+
+    return !networkFileSystems.contains(fs, Qt::CaseInsensitive);
+#endif
+}
+
+// DkTiffFile --------------------------------------------------------------------
+#ifdef WITH_LIBTIFF
+// libtiff's warning/error handlers are process-global
+// so its dialogs are turned off once at startup - we do the GUI
+Q_DECL_UNUSED static const bool tiffSilenced = [] {
+    TIFFSetWarningHandler(NULL);
+    TIFFSetErrorHandler(NULL);
+    return true;
+}();
+
+// libtiff client functions - they read from DkTiffFile::Stream
+static tmsize_t tiffRead(thandle_t handle, void *data, tmsize_t size)
+{
+    DkTiffFile::Stream *s = static_cast<DkTiffFile::Stream *>(handle);
+    qint64 numBytes = qBound<qint64>(0, s->ba->size() - s->pos, size);
+
+    memcpy(data, s->ba->constData() + s->pos, numBytes);
+    s->pos += numBytes;
+
+    return numBytes;
+}
+
+static tmsize_t tiffWrite(thandle_t, void *, tmsize_t)
+{
+    return 0;
+}
+
+static toff_t tiffSeek(thandle_t handle, toff_t offset, int whence)
+{
+    DkTiffFile::Stream *s = static_cast<DkTiffFile::Stream *>(handle);
+    qint64 pos = static_cast<qint64>(offset);
+
+    if (whence == SEEK_CUR)
+        pos += s->pos;
+    else if (whence == SEEK_END)
+        pos += s->ba->size();
+
+    if (pos < 0)
+        return static_cast<toff_t>(-1);
+
+    s->pos = pos;
+
+    return static_cast<toff_t>(pos);
+}
+
+static int tiffClose(thandle_t)
+{
+    return 0;
+}
+
+static toff_t tiffSize(thandle_t handle)
+{
+    return static_cast<DkTiffFile::Stream *>(handle)->ba->size();
+}
+
+// the buffer is in memory already - so libtiff can read strips & tiles without copying
+static int tiffMap(thandle_t handle, void **base, toff_t *size)
+{
+    DkTiffFile::Stream *s = static_cast<DkTiffFile::Stream *>(handle);
+    *base = const_cast<char *>(s->ba->constData());
+    *size = s->ba->size();
+
+    return 1;
+}
+
+static void tiffUnmap(thandle_t, void *, toff_t)
+{
+}
+
+// native decoding ------------------------------------------------------------------
+/**
+ * The sample layout of a TIFF directory and the destination of its decoding.
+ **/
+struct DkTiffLayout {
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint16_t spp = 1; // samples per pixel
+    uint16_t bps = 8; // bits per sample
+    uint16_t photometric = PHOTOMETRIC_MINISBLACK;
+    int colors = 1; // 1 (gray) or 3 (RGB) - followed by an alpha or an ignored sample
+    bool alpha = false;
+    bool premultiplied = false;
+    bool jpegRgb = false; // JPEG compressed YCbCr that libjpeg converts to RGB
+
+    // tiles or strips
+    bool tiled = false;
+    uint32_t unitWidth = 0;
+    uint32_t unitHeight = 0;
+    tmsize_t unitBytes = 0;
+    tmsize_t unitBpl = 0;
+
+    // the destination - only every step-th pixel of region is decoded
+    QRect region;
+    int step = 1;
+    QImage::Format format = QImage::Format_Invalid;
+    uchar *dstBits = nullptr;
+    qsizetype dstBpl = 0;
+    int dstPixelBytes = 0;
+};
+
+/**
+ * Reads the layout of the current directory.
+ * @return bool false if the layout cannot be decoded natively - TIFFReadRGBAImage() is needed then.
+ **/
+static bool readTiffLayout(TIFF *tiff, DkTiffLayout &l)
+{
+    uint16_t planar = PLANARCONFIG_CONTIG;
+    uint16_t sampleFormat = SAMPLEFORMAT_UINT;
+    uint16_t orientation = ORIENTATION_TOPLEFT;
+    uint16_t compression = COMPRESSION_NONE;
+
+    TIFFGetField(tiff, TIFFTAG_IMAGEWIDTH, &l.width);
+    TIFFGetField(tiff, TIFFTAG_IMAGELENGTH, &l.height);
+    TIFFGetFieldDefaulted(tiff, TIFFTAG_SAMPLESPERPIXEL, &l.spp);
+    TIFFGetFieldDefaulted(tiff, TIFFTAG_BITSPERSAMPLE, &l.bps);
+    TIFFGetFieldDefaulted(tiff, TIFFTAG_PLANARCONFIG, &planar);
+    TIFFGetFieldDefaulted(tiff, TIFFTAG_SAMPLEFORMAT, &sampleFormat);
+    TIFFGetFieldDefaulted(tiff, TIFFTAG_ORIENTATION, &orientation);
+    TIFFGetFieldDefaulted(tiff, TIFFTAG_COMPRESSION, &compression);
+
+    if (!TIFFGetField(tiff, TIFFTAG_PHOTOMETRIC, &l.photometric))
+        return false;
+
+    if (l.width == 0 || l.height == 0 || (l.bps != 8 && l.bps != 16) || sampleFormat != SAMPLEFORMAT_UINT)
+        return false;
+
+    // palette, YCbCr, CMYK, Lab... and rotated images are left to libtiff's RGBA interface
+    if (orientation != ORIENTATION_TOPLEFT || compression == COMPRESSION_OJPEG || !TIFFIsCODECConfigured(compression))
+        return false;
+
+    // JPEG compressed YCbCr (e.g. most whole slide images) is converted to RGB by libjpeg
+    // this changes the strip/tile sizes - so it is set before they are read
+    if (l.photometric == PHOTOMETRIC_YCBCR && compression == COMPRESSION_JPEG && l.bps == 8) {
+        TIFFSetField(tiff, TIFFTAG_JPEGCOLORMODE, JPEGCOLORMODE_RGB);
+        l.jpegRgb = true;
+    }
+
+    if (l.photometric == PHOTOMETRIC_MINISBLACK || l.photometric == PHOTOMETRIC_MINISWHITE)
+        l.colors = 1;
+    else if (l.photometric == PHOTOMETRIC_RGB || l.jpegRgb)
+        l.colors = 3;
+    else
+        return false;
+
+    if (l.spp < l.colors || l.spp > l.colors + 1 || (l.spp > 1 && planar != PLANARCONFIG_CONTIG))
+        return false;
+
+    if (l.spp > l.colors) {
+        uint16_t numExtra = 0;
+        uint16_t *extra = nullptr;
+        TIFFGetFieldDefaulted(tiff, TIFFTAG_EXTRASAMPLES, &numExtra, &extra);
+
+        // like libtiff, we assume associated alpha if the extra sample is not described
+        uint16_t type = (numExtra > 0 && extra) ? extra[0] : EXTRASAMPLE_ASSOCALPHA;
+        l.alpha = type != EXTRASAMPLE_UNSPECIFIED;
+        l.premultiplied = type == EXTRASAMPLE_ASSOCALPHA;
+    }
+
+    l.tiled = TIFFIsTiled(tiff) != 0;
+
+    if (l.tiled) {
+        TIFFGetField(tiff, TIFFTAG_TILEWIDTH, &l.unitWidth);
+        TIFFGetField(tiff, TIFFTAG_TILELENGTH, &l.unitHeight);
+        l.unitBytes = TIFFTileSize(tiff);
+        l.unitBpl = TIFFTileRowSize(tiff);
+    } else {
+        uint32_t rowsPerStrip = l.height;
+        TIFFGetFieldDefaulted(tiff, TIFFTAG_ROWSPERSTRIP, &rowsPerStrip);
+
+        l.unitWidth = l.width;
+        l.unitHeight = qBound<uint32_t>(1, rowsPerStrip, l.height);
+        l.unitBytes = TIFFStripSize(tiff);
+        l.unitBpl = TIFFScanlineSize(tiff);
+    }
+
+    return l.unitWidth > 0 && l.unitHeight > 0 && l.unitBytes > 0 && l.unitBpl > 0;
+}
+
+/**
+ * Reads the layout of the directory at offset with its own handle.
+ * @param iccProfile if not null, the directory's ICC profile is returned
+ * @return bool false if the layout cannot be decoded natively
+ **/
+static bool readTiffLayout(QSharedPointer<QByteArray> ba, uint64_t offset, DkTiffLayout &l, QByteArray *iccProfile = nullptr)
+{
+    DkTiffFile::Stream stream;
+    stream.ba = ba;
+
+    TIFF *tiff = TIFFClientOpen("DkTiffFile", "rO", &stream, tiffRead, tiffWrite, tiffSeek, tiffClose, tiffSize, tiffMap, tiffUnmap);
+
+    if (!tiff)
+        return false;
+
+    bool supported = TIFFSetSubDirectory(tiff, offset) && readTiffLayout(tiff, l);
+
+    uint32_t iccSize = 0;
+    void *iccData = nullptr;
+    if (supported && iccProfile && TIFFGetField(tiff, TIFFTAG_ICCPROFILE, &iccSize, &iccData) && iccData)
+        *iccProfile = QByteArray(static_cast<const char *>(iccData), iccSize);
+
+    TIFFClose(tiff);
+
+    return supported;
+}
+
+/**
+ * The QImage format that holds the samples of a layout.
+ * 16 bit samples are reduced to 8 bit unless keep16Bit is true.
+ **/
+static QImage::Format tiffImageFormat(const DkTiffLayout &l, bool keep16Bit)
+{
+    bool deep = keep16Bit && l.bps == 16;
+
+    if (l.colors == 1 && !l.alpha)
+        return deep ? QImage::Format_Grayscale16 : QImage::Format_Grayscale8;
+    else if (!l.alpha)
+        return deep ? QImage::Format_RGBX64 : QImage::Format_RGB32;
+    else if (l.premultiplied)
+        return deep ? QImage::Format_RGBA64_Premultiplied : QImage::Format_ARGB32_Premultiplied;
+
+    return deep ? QImage::Format_RGBA64 : QImage::Format_ARGB32;
+}
+
+/**
+ * Converts numPixels pixels (every srcStep-th pixel of src) to the layout's QImage format.
+ **/
+template<typename T>
+static void convertTiffPixels(const T *src, int srcStep, int numPixels, const DkTiffLayout &l, uchar *dst)
+{
+    const int shift = static_cast<int>(sizeof(T)) * 8 - 8; // to 8 bit
+    const int srcInc = srcStep * l.spp;
+    const int gIdx = l.colors == 3 ? 1 : 0;
+    const int bIdx = l.colors == 3 ? 2 : 0;
+    const T maxVal = std::numeric_limits<T>::max();
+    const bool invert = l.photometric == PHOTOMETRIC_MINISWHITE;
+
+    // white is 0 - alpha is never inverted
+    auto color = [invert, maxVal](T v) {
+        return invert ? static_cast<T>(maxVal - v) : v;
+    };
+
+    switch (l.format) {
+    case QImage::Format_Grayscale8: {
+        for (int x = 0; x < numPixels; x++, src += srcInc)
+            dst[x] = static_cast<uchar>(color(src[0]) >> shift);
+        break;
+    }
+    case QImage::Format_Grayscale16: {
+        quint16 *d = reinterpret_cast<quint16 *>(dst);
+        for (int x = 0; x < numPixels; x++, src += srcInc)
+            d[x] = static_cast<quint16>(color(src[0]));
+        break;
+    }
+    case QImage::Format_RGB32:
+    case QImage::Format_ARGB32:
+    case QImage::Format_ARGB32_Premultiplied: {
+        QRgb *d = reinterpret_cast<QRgb *>(dst);
+        for (int x = 0; x < numPixels; x++, src += srcInc) {
+            T a = l.alpha ? src[l.colors] : maxVal;
+            d[x] = qRgba(color(src[0]) >> shift, color(src[gIdx]) >> shift, color(src[bIdx]) >> shift, a >> shift);
+        }
+        break;
+    }
+    case QImage::Format_RGBX64:
+    case QImage::Format_RGBA64:
+    case QImage::Format_RGBA64_Premultiplied: {
+        QRgba64 *d = reinterpret_cast<QRgba64 *>(dst);
+        for (int x = 0; x < numPixels; x++, src += srcInc) {
+            T a = l.alpha ? src[l.colors] : maxVal;
+            d[x] = QRgba64::fromRgba64(color(src[0]), color(src[gIdx]), color(src[bIdx]), a);
+        }
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+/**
+ * Decodes the strips/tiles units of the directory at offset into the destination of l.
+ * Each worker opens its own handle on the (shared) file buffer.
+ * @return bool false if a unit could not be decoded
+ **/
+static bool decodeTiffUnits(QSharedPointer<QByteArray> ba,
+                            uint64_t offset,
+                            const DkTiffLayout &l,
+                            const QVector<QRect> &units,
+                            QAtomicInt &failed,
+                            const std::function<bool()> &isCanceled)
+{
+    DkTiffFile::Stream stream;
+    stream.ba = ba;
+
+    // O: the strip/tile offsets are read on demand - we only need a few of them
+    TIFF *tiff = TIFFClientOpen("DkTiffFile", "rO", &stream, tiffRead, tiffWrite, tiffSeek, tiffClose, tiffSize, tiffMap, tiffUnmap);
+
+    if (!tiff)
+        return false;
+
+    bool success = TIFFSetSubDirectory(tiff, offset) != 0;
+
+    // the pseudo tag is reset with every directory
+    if (success && l.jpegRgb)
+        TIFFSetField(tiff, TIFFTAG_JPEGCOLORMODE, JPEGCOLORMODE_RGB);
+
+    QByteArray buffer(l.unitBytes, Qt::Uninitialized);
+    const int pixelBytes = l.spp * l.bps / 8;
+    const QRect &r = l.region;
+
+    for (int idx = 0; success && idx < units.size(); idx++) {
+        if (failed.loadRelaxed())
+            break;
+
+        if (isCanceled && isCanceled()) {
+            success = false;
+            break;
+        }
+
+        const QRect &unit = units[idx];
+        QRect ur = unit.intersected(r);
+
+        if (ur.isEmpty())
+            continue;
+
+        // the first pixels that are sampled in this unit
+        QPoint p0 = DkTiffFile::firstSample(r, ur, l.step);
+        int x0 = p0.x();
+        int y0 = p0.y();
+
+        // don't decode units that are skipped
+        if (x0 > ur.right() || y0 > ur.bottom())
+            continue;
+
+        tmsize_t numBytes = l.tiled ? TIFFReadEncodedTile(tiff, TIFFComputeTile(tiff, unit.x(), unit.y(), 0, 0), buffer.data(), l.unitBytes)
+                                    : TIFFReadEncodedStrip(tiff, TIFFComputeStrip(tiff, unit.y(), 0), buffer.data(), l.unitBytes);
+
+        if (numBytes < 0) {
+            success = false;
+            break;
+        }
+
+        int numPixels = (ur.right() - x0) / l.step + 1;
+
+        for (int y = y0; y <= ur.bottom(); y += l.step) {
+            const uchar *src = reinterpret_cast<const uchar *>(buffer.constData()) + (y - unit.y()) * l.unitBpl + (x0 - unit.x()) * pixelBytes;
+            uchar *dst = l.dstBits + ((y - r.y()) / l.step) * l.dstBpl + ((x0 - r.x()) / l.step) * l.dstPixelBytes;
+
+            if (l.bps == 16)
+                convertTiffPixels(reinterpret_cast<const quint16 *>(src), l.step, numPixels, l, dst);
+            else
+                convertTiffPixels(src, l.step, numPixels, l, dst);
+        }
+    }
+
+    TIFFClose(tiff);
+
+    return success;
+}
+
+/**
+ * Decodes a directory without libtiff's RGBA interface.
+ * Strips/tiles are read natively with TIFFReadEncodedStrip/Tile in parallel
+ * and written straight to the final QImage format.
+ * Only strips/tiles that intersect the region are decoded.
+ * @param ba the file buffer
+ * @param offset the directory's offset
+ * @param img the decoded image - it has the size of region / step
+ * @param region the region (in directory coordinates) - a null rect decodes all pixels
+ * @param step only every step-th pixel is decoded (nearest neighbor downsampling)
+ * @param keep16Bit if true, 16 bit samples are kept
+ * @param isCanceled if it returns true, decoding stops and false is returned
+ * @return bool false if the directory's layout is not supported (use decodeTiffRGBA() then) or decoding failed
+ **/
+static bool decodeTiffDirectory(QSharedPointer<QByteArray> ba,
+                                uint64_t offset,
+                                QImage &img,
+                                const QRect &region = QRect(),
+                                int step = 1,
+                                bool keep16Bit = false,
+                                const std::function<bool()> &isCanceled = std::function<bool()>())
+{
+    DkTiffLayout l;
+    QByteArray iccProfile;
+
+    if (!readTiffLayout(ba, offset, l, &iccProfile))
+        return false;
+
+    QRect imgRect(0, 0, l.width, l.height);
+    l.region = region.isNull() ? imgRect : region.intersected(imgRect);
+    l.step = qMax(step, 1);
+
+    if (l.region.isEmpty())
+        return false;
+
+    l.format = tiffImageFormat(l, keep16Bit);
+    img = QImage(DkTiffFile::sampledSize(l.region, l.step), l.format);
+
+    if (img.isNull())
+        return false;
+
+    if (!iccProfile.isEmpty())
+        img.setColorSpace(QColorSpace::fromIccProfile(iccProfile));
+
+    // get the pointer here - scanLine() is not thread-safe
+    l.dstBits = img.bits();
+    l.dstBpl = img.bytesPerLine();
+    l.dstPixelBytes = img.depth() / 8;
+
+    // the strips/tiles that intersect the region
+    QVector<QRect> units = DkTiffFile::units(l.region, QSize(l.unitWidth, l.unitHeight));
+
+    // consecutive units are decoded in parallel - each chunk has its own handle & buffer
+    // we are called from tasks of the global pool - so the chunks run in the stripe pool
+    const int numChunks = qBound(1, QThread::idealThreadCount() * 2, static_cast<int>(units.size()));
+    const int chunkSize = (units.size() + numChunks - 1) / numChunks;
+
+    QAtomicInt failed(0);
+    QVector<QFuture<void>> chunks;
+
+    for (int idx = 0; idx < units.size(); idx += chunkSize) {
+        QVector<QRect> chunk = units.mid(idx, chunkSize);
+
+        chunks << QtConcurrent::run(DkImage::stripePool(), [&, chunk] {
+            if (!decodeTiffUnits(ba, offset, l, chunk, failed, isCanceled))
+                failed.storeRelaxed(1);
+        });
+    }
+
+    for (QFuture<void> &f : chunks)
+        f.waitForFinished();
+
+    // free the memory before the fallback allocates it again
+    if (failed.loadRelaxed()) {
+        img = QImage();
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Decodes the current directory with libtiff's RGBA interface - it supports all layouts.
+ **/
+static bool decodeTiffRGBA(TIFF *tiff, QImage &img)
+{
+    uint32_t width = 0;
+    uint32_t height = 0;
+
+    TIFFGetField(tiff, TIFFTAG_IMAGEWIDTH, &width);
+    TIFFGetField(tiff, TIFFTAG_IMAGELENGTH, &height);
+
+    img = QImage(width, height, QImage::Format_ARGB32);
+
+    if (img.isNull())
+        return false;
+
+    const int stopOnError = 1;
+    bool success = TIFFReadRGBAImageOriented(tiff, width, height, reinterpret_cast<uint32_t *>(img.bits()), ORIENTATION_TOPLEFT, stopOnError) != 0;
+
+    if (success) {
+        for (uint32_t y = 0; y < height; ++y)
+            DkBasicLoader::convert32BitOrder(img.scanLine(y), width);
+    }
+
+    return success;
+}
+
+/**
+ * Decodes the directory at offset with libtiff's RGBA interface.
+ * It opens its own handle, so DkTiffFile's handle needs no lock.
+ **/
+static bool decodeTiffRGBA(QSharedPointer<QByteArray> ba, uint64_t offset, QImage &img)
+{
+    DkTiffFile::Stream stream;
+    stream.ba = ba;
+
+    TIFF *tiff = TIFFClientOpen("DkTiffFile", "r", &stream, tiffRead, tiffWrite, tiffSeek, tiffClose, tiffSize, tiffMap, tiffUnmap);
+
+    if (!tiff)
+        return false;
+
+    bool success = TIFFSetSubDirectory(tiff, offset) && decodeTiffRGBA(tiff, img);
+    TIFFClose(tiff);
+
+    return success;
+}
+
+/**
+ * Returns the reduced-resolution images (SubIFDs or reduced IFDs) of the current directory.
+ * The current directory changes.
+ * @param tiff the handle - its current directory is the page
+ * @param topLevel if true, reduced images stored as top level IFDs are returned too
+ **/
+static QVector<DkTiffFile::Directory> reducedTiffImages(TIFF *tiff, bool topLevel)
+{
+    QVector<DkTiffFile::Directory> images;
+
+    auto checkCurrent = [&](uint64_t offset) {
+        uint32_t type = 0, width = 0, height = 0;
+        TIFFGetField(tiff, TIFFTAG_SUBFILETYPE, &type);
+        TIFFGetField(tiff, TIFFTAG_IMAGEWIDTH, &width);
+        TIFFGetField(tiff, TIFFTAG_IMAGELENGTH, &height);
+
+        if (type & FILETYPE_REDUCEDIMAGE) {
+            DkTiffFile::Directory d;
+            d.offset = offset;
+            d.size = QSize(width, height);
+            images << d;
+        }
+    };
+
+    // collect SubIFD offsets of the main image first - reading them invalidates the tag memory
+    QVector<uint64_t> subIfds;
+    uint16_t numSubIfds = 0;
+    uint64_t *subIfdOffsets = nullptr;
+
+    if (TIFFGetField(tiff, TIFFTAG_SUBIFD, &numSubIfds, &subIfdOffsets) && subIfdOffsets) {
+        for (int idx = 0; idx < numSubIfds; idx++)
+            subIfds << subIfdOffsets[idx];
+    }
+
+    for (uint64_t offset : subIfds) {
+        if (TIFFSetSubDirectory(tiff, offset))
+            checkCurrent(offset);
+    }
+
+    if (topLevel) {
+        TIFFSetDirectory(tiff, 0);
+        while (TIFFReadDirectory(tiff))
+            checkCurrent(TIFFCurrentDirOffset(tiff));
+    }
+
+    return images;
+}
+#endif
+
+/**
+ * Opens the TIFF.
+ * @param filePath the file
+ * @param ba the file's buffer - if it is empty, the file is loaded (or mapped)
+ **/
+DkTiffFile::DkTiffFile(const QString &filePath, QSharedPointer<QByteArray> ba)
+{
+    mFilePath = filePath;
+    mStream.ba = (ba && !ba->isEmpty()) ? ba : DkFileBuffer::load(filePath);
+
+#ifdef WITH_LIBTIFF
+    if (mStream.ba->isEmpty())
+        return;
+
+    mTiff = TIFFClientOpen("DkTiffFile", "r", &mStream, tiffRead, tiffWrite, tiffSeek, tiffClose, tiffSize, tiffMap, tiffUnmap);
+
+    if (!mTiff)
+        return;
+
+    // the current page shares its memory with the shown image - the adjacent pages are ours
+    mMemoryId = DkMemoryGovernor::instance().registerAllocation(
+        DkMemoryGovernor::priority_cached,
+        [this]() {
+            QMutexLocker locker(&mMutex);
+
+            double mem = 0;
+            for (auto it = mPrefetched.constBegin(); it != mPrefetched.constEnd(); it++) {
+                if (it.key() != mCurrentPage.loadRelaxed())
+                    mem += DkImage::getBufferSizeFloat(it->size(), it->depth());
+            }
+
+            return mem;
+        },
+        [this](double) {
+            QMutexLocker locker(&mMutex);
+
+            for (auto it = mPrefetched.begin(); it != mPrefetched.end();) {
+                if (it.key() != mCurrentPage.loadRelaxed())
+                    it = mPrefetched.erase(it);
+                else
+                    it++;
+            }
+        });
+#endif
+}
+
+DkTiffFile::~DkTiffFile()
+{
+#ifdef WITH_LIBTIFF
+    if (mMemoryId != -1)
+        DkMemoryGovernor::instance().unregisterAllocation(mMemoryId);
+
+    QMutexLocker locker(&mMutex);
+
+    if (mTiff)
+        TIFFClose(mTiff);
+#endif
+}
+
+bool DkTiffFile::isOpen() const
+{
+    return mTiff != nullptr;
+}
+
+QString DkTiffFile::filePath() const
+{
+    return mFilePath;
+}
+
+int DkTiffFile::numPages()
+{
+    QMutexLocker locker(&mMutex);
+    indexPages();
+
+    return mPageOffsets.size();
+}
+
+/**
+ * Reads the page pageIdx (1 is the first page).
+ * Pages that were prefetched are returned without decoding them.
+ * If the page is prefetched right now, we wait for it.
+ * The current and its adjacent pages are kept.
+ * @param pageIdx the page
+ * @param img the decoded page
+ * @return bool true if the page was decoded
+ **/
+bool DkTiffFile::readPage(int pageIdx, QImage &img)
+{
+    quint64 offset = 0;
+
+    {
+        QMutexLocker locker(&mMutex);
+
+        // a prefetch of other pages stops
+        mCurrentPage.storeRelaxed(pageIdx);
+
+        // forget pages that are not next to the current page anymore
+        for (auto it = mPrefetched.begin(); it != mPrefetched.end();) {
+            if (qAbs(it.key() - pageIdx) > 1)
+                it = mPrefetched.erase(it);
+            else
+                it++;
+        }
+
+        while (mDecodingPages.contains(pageIdx))
+            mPageDecoded.wait(&mMutex);
+
+        if (mPrefetched.contains(pageIdx)) {
+            img = mPrefetched.value(pageIdx);
+            return true;
+        }
+
+        indexPages();
+
+        if (pageIdx < 1 || pageIdx > mPageOffsets.size())
+            return false;
+
+        offset = mPageOffsets[pageIdx - 1];
+    }
+
+    bool success = decodePage(pageIdx, offset, img);
+
+    // keep it - it is the previous page of the next one (the memory is shared with img)
+    if (success) {
+        QMutexLocker locker(&mMutex);
+
+        if (qAbs(pageIdx - mCurrentPage.loadRelaxed()) <= 1)
+            mPrefetched.insert(pageIdx, img);
+    }
+
+    return success;
+}
+
+/**
+ * Decodes the pages next to pageIdx - the following page first.
+ * Nothing is decoded if another page was read in the meantime and decoding
+ * stops as soon as the page is not next to the current page anymore.
+ * The lock is not held while decoding, so readPage() never waits for pages that are not needed.
+ * This function is called from a worker thread.
+ **/
+void DkTiffFile::prefetch(int pageIdx)
+{
+    // no page was read yet - the first page was decoded by another decoder (e.g. Qt)
+    mCurrentPage.testAndSetRelaxed(-1, pageIdx);
+
+    // the first page is decoded by DkBasicLoader::decode()
+    for (int idx : {pageIdx + 1, pageIdx - 1}) {
+        quint64 offset = 0;
+
+        {
+            QMutexLocker locker(&mMutex);
+
+            if (mCurrentPage.loadRelaxed() != pageIdx)
+                return;
+
+            indexPages();
+
+            // another prefetch decodes it already
+            if (idx <= 1 || idx > mPageOffsets.size() || mPrefetched.contains(idx) || mDecodingPages.contains(idx))
+                continue;
+
+            offset = mPageOffsets[idx - 1];
+            mDecodingPages.insert(idx);
+        }
+
+        auto isCanceled = [this, idx]() {
+            return qAbs(idx - mCurrentPage.loadRelaxed()) > 1;
+        };
+
+        QImage img;
+        bool success = decodePage(idx, offset, img, isCanceled);
+
+        {
+            QMutexLocker locker(&mMutex);
+
+            if (success && qAbs(idx - mCurrentPage.loadRelaxed()) <= 1)
+                mPrefetched.insert(idx, img);
+
+            mDecodingPages.remove(idx);
+            mPageDecoded.wakeAll();
+        }
+
+        if (success)
+            DkMemoryGovernor::instance().requestUpdate();
+    }
+}
+
+/**
+ * Reads the smallest reduced-resolution image (SubIFD or reduced IFD) of the first page
+ * whose longer side is at least the longer side of reducedSize.
+ * @param reducedSize the size that is needed
+ * @param img the decoded image
+ * @return bool false if there is no such image or it could not be decoded
+ **/
+bool DkTiffFile::readReduced(const QSize &reducedSize, QImage &img)
+{
+#ifdef WITH_LIBTIFF
+    QVector<Directory> dirs;
+
+    {
+        QMutexLocker locker(&mMutex);
+        dirs = directories(1);
+    }
+
+    int minEdge = qMax(reducedSize.width(), reducedSize.height());
+    quint64 bestOffset = 0;
+    int bestEdge = std::numeric_limits<int>::max();
+
+    // the first directory is the page itself
+    for (int idx = 1; idx < dirs.size(); idx++) {
+        int edge = qMax(dirs[idx].size.width(), dirs[idx].size.height());
+
+        if (edge >= minEdge && edge < bestEdge) {
+            bestEdge = edge;
+            bestOffset = dirs[idx].offset;
+        }
+    }
+
+    if (!bestOffset)
+        return false;
+
+    return decodeTiffDirectory(mStream.ba, bestOffset, img) || decodeTiffRGBA(mStream.ba, bestOffset, img);
+#else
+    Q_UNUSED(reducedSize);
+    Q_UNUSED(img);
+    return false;
+#endif
+}
+
+/**
+ * Reads a region of a page at a pyramid level (see DkImagePyramid).
+ * The smallest reduced-resolution image that is large enough for the level is decoded -
+ * only every 2^n-th pixel is decoded if it is (at least) twice as large.
+ * Only the strips/tiles that intersect the region are decoded and only directories
+ * that are decoded natively are used (see regionDirectories()). Hence, the viewport's
+ * tiles are read without decoding (or converting) whole directories.
+ * @param pageIdx the page (1 is the first page)
+ * @param img the decoded region
+ * @param region the region in coordinates of the level - a null rect reads the whole level
+ * @param level the pyramid level - the page is scaled by 1/2^level
+ * @return bool false if no directory can be decoded for this level
+ **/
+bool DkTiffFile::readRegion(int pageIdx, QImage &img, const QRect &region, int level)
+{
+#ifdef WITH_LIBTIFF
+    DkTimer dt;
+
+    QSize pSize = pageSize(pageIdx);
+    QVector<Directory> dirs = regionDirectories(pageIdx);
+
+    if (pSize.isEmpty() || dirs.isEmpty())
+        return false;
+
+    QSize lSize = levelSize(pSize, level);
+    QRect levelRect = region.isNull() ? QRect(QPoint(), lSize) : region.intersected(QRect(QPoint(), lSize));
+
+    int dirIdx = levelDirectory(dirs, lSize);
+
+    if (levelRect.isEmpty() || dirIdx == -1)
+        return false;
+
+    const Directory &dir = dirs[dirIdx];
+    QRect dirRect = directoryRect(levelRect, lSize, dir.size);
+    int step = levelStep(dir.size, lSize);
+
+    if (!decodeTiffDirectory(mStream.ba, dir.offset, img, dirRect, step))
+        return false;
+
+    if (img.size() != levelRect.size())
+        img = DkImage::resizeImage(img, levelRect.size(), 1.0, DkImage::ipl_area, false);
+
+    qDebug() << "[DkTiffFile]" << levelRect << "of level" << level << "decoded in" << dt;
+
+    return !img.isNull();
+#else
+    Q_UNUSED(pageIdx);
+    Q_UNUSED(img);
+    Q_UNUSED(region);
+    Q_UNUSED(level);
+    return false;
+#endif
+}
+
+/**
+ * Returns the size of a page.
+ * @param pageIdx the page (1 is the first page)
+ **/
+QSize DkTiffFile::pageSize(int pageIdx)
+{
+    QMutexLocker locker(&mMutex);
+    QVector<Directory> dirs = directories(pageIdx);
+
+    return dirs.isEmpty() ? QSize() : dirs.first().size;
+}
+
+/**
+ * Returns true if regions of a page can be read (see readRegion()).
+ * This is the case if the page or one of its reduced-resolution images is decoded natively.
+ * @param pageIdx the page (1 is the first page)
+ **/
+bool DkTiffFile::canReadRegions(int pageIdx)
+{
+    return !regionDirectories(pageIdx).isEmpty();
+}
+
+/**
+ * Returns the size of a pyramid level (see DkImagePyramid::levelSize()).
+ * @param size the size of the page
+ * @param level the pyramid level - the page is scaled by 1/2^level
+ **/
+QSize DkTiffFile::levelSize(const QSize &size, int level)
+{
+    QSize s = size;
+
+    for (int idx = 0; idx < level; idx++)
+        s = QSize((s.width() + 1) / 2, (s.height() + 1) / 2);
+
+    return s;
+}
+
+/**
+ * Returns the index of the smallest directory that is large enough for a level.
+ * @param dirs the page's directory followed by its reduced-resolution images - the largest first
+ * @param levelSize the level's size
+ * @return int the directory's index or -1 if no directory is large enough
+ **/
+int DkTiffFile::levelDirectory(const QVector<Directory> &dirs, const QSize &levelSize)
+{
+    int dirIdx = -1;
+
+    for (int idx = 0; idx < dirs.size(); idx++) {
+        if (dirs[idx].size.width() >= levelSize.width() && dirs[idx].size.height() >= levelSize.height())
+            dirIdx = idx;
+    }
+
+    return dirIdx;
+}
+
+/**
+ * Maps a rectangle of a level to the pixels of a directory that cover it.
+ **/
+QRect DkTiffFile::directoryRect(const QRect &levelRect, const QSize &levelSize, const QSize &dirSize)
+{
+    double sx = static_cast<double>(dirSize.width()) / levelSize.width();
+    double sy = static_cast<double>(dirSize.height()) / levelSize.height();
+
+    return QRect(QPoint(qFloor(levelRect.left() * sx), qFloor(levelRect.top() * sy)),
+                 QPoint(qCeil((levelRect.right() + 1) * sx) - 1, qCeil((levelRect.bottom() + 1) * sy) - 1));
+}
+
+/**
+ * Returns the (power of two) step that samples a directory as long as it is still larger than the level.
+ **/
+int DkTiffFile::levelStep(const QSize &dirSize, const QSize &levelSize)
+{
+    int step = 1;
+
+    while ((dirSize.width() + step * 2 - 1) / (step * 2) >= levelSize.width()
+           && (dirSize.height() + step * 2 - 1) / (step * 2) >= levelSize.height())
+        step *= 2;
+
+    return step;
+}
+
+/**
+ * Returns the strips/tiles that intersect region.
+ * @param region the region in directory coordinates
+ * @param unitSize the size of a tile (or the image width and the rows per strip)
+ **/
+QVector<QRect> DkTiffFile::units(const QRect &region, const QSize &unitSize)
+{
+    QVector<QRect> units;
+
+    if (region.isEmpty() || unitSize.isEmpty())
+        return units;
+
+    int yStart = (region.y() / unitSize.height()) * unitSize.height();
+    int xStart = (region.x() / unitSize.width()) * unitSize.width();
+
+    for (int y = yStart; y <= region.bottom(); y += unitSize.height()) {
+        for (int x = xStart; x <= region.right(); x += unitSize.width())
+            units << QRect(QPoint(x, y), unitSize);
+    }
+
+    return units;
+}
+
+/**
+ * Returns the first pixel in rect that is sampled if every step-th pixel of region is decoded.
+ * The pixel is outside rect if none of its pixels is sampled.
+ **/
+QPoint DkTiffFile::firstSample(const QRect &region, const QRect &rect, int step)
+{
+    return QPoint(region.x() + ((rect.x() - region.x() + step - 1) / step) * step, region.y() + ((rect.y() - region.y() + step - 1) / step) * step);
+}
+
+/**
+ * Returns the size of region if every step-th pixel is decoded.
+ **/
+QSize DkTiffFile::sampledSize(const QRect &region, int step)
+{
+    return QSize((region.width() + step - 1) / step, (region.height() + step - 1) / step);
+}
+
+/**
+ * Stores the directory offsets of all pages.
+ * The mutex must be locked.
+ **/
+void DkTiffFile::indexPages()
+{
+#ifdef WITH_LIBTIFF
+    if (mIndexed || !mTiff)
+        return;
+
+    mIndexed = true;
+
+    DkTimer dt;
+
+    TIFFSetDirectory(mTiff, 0);
+
+    do {
+        mPageOffsets << TIFFCurrentDirOffset(mTiff);
+    } while (TIFFReadDirectory(mTiff));
+
+    qDebug() << "[DkTiffFile]" << mPageOffsets.size() << "pages indexed in" << dt;
+#endif
+}
+
+/**
+ * Returns the page's directory followed by its reduced-resolution images - the largest first.
+ * The mutex must be locked.
+ **/
+QVector<DkTiffFile::Directory> DkTiffFile::directories(int pageIdx)
+{
+#ifdef WITH_LIBTIFF
+    indexPages();
+
+    if (pageIdx < 1 || pageIdx > mPageOffsets.size())
+        return QVector<Directory>();
+
+    if (mDirectories.contains(pageIdx))
+        return mDirectories.value(pageIdx);
+
+    QVector<Directory> dirs;
+
+    if (TIFFSetSubDirectory(mTiff, mPageOffsets[pageIdx - 1])) {
+        uint32_t width = 0;
+        uint32_t height = 0;
+
+        TIFFGetField(mTiff, TIFFTAG_IMAGEWIDTH, &width);
+        TIFFGetField(mTiff, TIFFTAG_IMAGELENGTH, &height);
+
+        Directory page;
+        page.offset = mPageOffsets[pageIdx - 1];
+        page.size = QSize(width, height);
+        dirs << page;
+
+        // reduced images of the first page might be stored as top level IFDs
+        QVector<Directory> reduced = reducedTiffImages(mTiff, pageIdx == 1);
+        std::sort(reduced.begin(), reduced.end(), [](const Directory &d1, const Directory &d2) {
+            return d1.size.width() > d2.size.width();
+        });
+        dirs << reduced;
+    }
+
+    mDirectories.insert(pageIdx, dirs);
+
+    return dirs;
+#else
+    Q_UNUSED(pageIdx);
+    return QVector<Directory>();
+#endif
+}
+
+/**
+ * Returns the directories of a page that regions are read from - the largest first.
+ * These are the directories that are decoded natively (without libtiff's RGBA interface)
+ * and whose strips/tiles are small - so reading a region never decodes a whole directory.
+ * The mutex must not be locked.
+ * @param pageIdx the page (1 is the first page)
+ **/
+QVector<DkTiffFile::Directory> DkTiffFile::regionDirectories(int pageIdx)
+{
+    QVector<Directory> dirs;
+
+    {
+        QMutexLocker locker(&mMutex);
+
+        if (mRegionDirectories.contains(pageIdx))
+            return mRegionDirectories.value(pageIdx);
+
+        dirs = directories(pageIdx);
+    }
+
+    QVector<Directory> regionDirs;
+
+#ifdef WITH_LIBTIFF
+    // larger strips are decoded for every tile of the viewport
+    const tmsize_t maxUnitBytes = 16 * 1024 * 1024;
+
+    for (const Directory &d : dirs) {
+        DkTiffLayout l;
+
+        if (readTiffLayout(mStream.ba, d.offset, l) && l.unitBytes <= maxUnitBytes)
+            regionDirs << d;
+    }
+#endif
+
+    QMutexLocker locker(&mMutex);
+    mRegionDirectories.insert(pageIdx, regionDirs);
+
+    return regionDirs;
+}
+
+/**
+ * Decodes a page.
+ * The mutex need not be locked - the decoders open their own handles.
+ * @param pageIdx the page (for debugging)
+ * @param offset the page's directory offset
+ * @param img the decoded page
+ * @param isCanceled if it returns true, decoding stops and false is returned
+ **/
+bool DkTiffFile::decodePage(int pageIdx, quint64 offset, QImage &img, const std::function<bool()> &isCanceled) const
+{
+#ifdef WITH_LIBTIFF
+    DkTimer dt;
+
+    // strips & tiles are decoded in parallel - other layouts are converted by libtiff
+    bool keep16Bit = DkSettingsManager::param().resources().keep16BitTiff;
+    bool success = decodeTiffDirectory(mStream.ba, offset, img, QRect(), 1, keep16Bit, isCanceled);
+
+    if (!success && !(isCanceled && isCanceled()))
+        success = decodeTiffRGBA(mStream.ba, offset, img);
+
+    if (success)
+        qDebug() << "[DkTiffFile] page" << pageIdx << "decoded in" << dt;
+
+    return success;
+#else
+    Q_UNUSED(pageIdx);
+    Q_UNUSED(offset);
+    Q_UNUSED(img);
+    Q_UNUSED(isCanceled);
+    return false;
+#endif
+}
+
+// DkImageDecoder --------------------------------------------------------------------
+DkImageDecoder::DkImageDecoder(int loader, const QByteArray &format, int capabilities)
+{
+    mLoader = loader;
+    mFormat = format;
+    mCapabilities = capabilities;
+}
+
+bool DkImageDecoder::isNull() const
+{
+    return mLoader == DkBasicLoader::no_loader;
+}
+
+int DkImageDecoder::loader() const
+{
+    return mLoader;
+}
+
+QByteArray DkImageDecoder::format() const
+{
+    return mFormat;
+}
+
+bool DkImageDecoder::hasCapability(Capability cap) const
+{
+    return (mCapabilities & cap) != 0;
+}
+
+/**
+ * Returns the image formats supported by Qt's plugins.
+ * The list is queried once since it is needed for every image loaded.
+ **/
+QList<QByteArray> DkImageDecoder::qtFormats()
+{
+    static const QList<QByteArray> formats = [] {
+        QList<QByteArray> f = QImageReader::supportedImageFormats();
+        f << "jpe"; // fixes #435 - thumbnail gets loaded in the RAW loader
+        return f;
+    }();
+
+    return formats;
+}
+
+struct DkSignature {
+    QByteArray magic; // '?' matches any byte
+    DkImageDecoder decoder;
+
+    bool matches(const QByteArray &header) const
+    {
+        if (header.size() < magic.size())
+            return false;
+
+        for (int idx = 0; idx < magic.size(); idx++) {
+            if (magic[idx] != '?' && magic[idx] != header[idx])
+                return false;
+        }
+
+        return true;
+    }
+};
+
+/**
+ * Returns the brands of an ISO base media file (e.g. HEIF, AVIF).
+ * The major brand comes first, followed by the compatible brands found in the header.
+ **/
+static QList<QByteArray> ftypBrands(const QByteArray &header)
+{
+    QList<QByteArray> brands;
+
+    if (header.size() < 12 || header.mid(4, 4) != "ftyp")
+        return brands;
+
+    const uchar *h = reinterpret_cast<const uchar *>(header.constData());
+    qint64 boxSize = ((qint64)h[0] << 24) | (h[1] << 16) | (h[2] << 8) | h[3];
+    int end = (int)qMin(boxSize, (qint64)header.size());
+
+    brands << header.mid(8, 4);
+
+    // skip the minor version
+    for (int idx = 16; idx + 4 <= end; idx += 4)
+        brands << header.mid(idx, 4);
+
+    return brands;
+}
+
+/**
+ * Identifies the decoder of an image.
+ * @param header the first (header_size) bytes of the file
+ * @param suffix the file's suffix, used if formats share their signature
+ * @return DkImageDecoder the decoder or a null decoder if the signature is unknown or not supported
+ **/
+DkImageDecoder DkImageDecoder::identify(const QByteArray &header, const QString &suffix)
+{
+    const int meta = cap_metadata;
+    static const DkImageDecoder tiffDecoder(DkBasicLoader::tif_loader, "tiff", cap_multi_page | cap_scaled | cap_region | meta);
+    static const DkImageDecoder rawDecoder(DkBasicLoader::raw_loader, "", cap_scaled | meta);
+
+    // more specific signatures first
+    static const QVector<DkSignature> signatures = {
+        {QByteArray("\xFF\xD8\xFF", 3), DkImageDecoder(DkBasicLoader::qt_loader, "jpg", cap_scaled | meta)},
+        {QByteArray("\x89PNG\r\n\x1A\n", 8), DkImageDecoder(DkBasicLoader::qt_loader, "png", meta)},
+        {"GIF87a", DkImageDecoder(DkBasicLoader::qt_loader, "gif", cap_multi_page)},
+        {"GIF89a", DkImageDecoder(DkBasicLoader::qt_loader, "gif", cap_multi_page)},
+        {"RIFF????WEBP", DkImageDecoder(DkBasicLoader::qt_loader, "webp", cap_multi_page | cap_scaled | meta)},
+        {"????ftypavif", DkImageDecoder(DkBasicLoader::qt_loader, "avif", meta)},
+        {"????ftypavis", DkImageDecoder(DkBasicLoader::qt_loader, "avif", cap_multi_page | meta)},
+        {"????ftypheic", DkImageDecoder(DkBasicLoader::qt_loader, "heif", meta)},
+        {"????ftypheix", DkImageDecoder(DkBasicLoader::qt_loader, "heif", meta)},
+        {"????ftypmif1", DkImageDecoder(DkBasicLoader::qt_loader, "heif", meta)},
+        {"????ftypmsf1", DkImageDecoder(DkBasicLoader::qt_loader, "heif", cap_multi_page | meta)},
+        {QByteArray("\x00\x00\x00\x0CJXL \r\n\x87\n", 12), DkImageDecoder(DkBasicLoader::qt_loader, "jxl", meta)},
+        {QByteArray("\xFF\x0A", 2), DkImageDecoder(DkBasicLoader::qt_loader, "jxl", meta)},
+        {QByteArray("\x00\x00\x00\x0CjP  \r\n\x87\n", 12), DkImageDecoder(DkBasicLoader::qt_loader, "jp2", cap_scaled)},
+        {QByteArray("\xFF\x4F\xFF\x51", 4), DkImageDecoder(DkBasicLoader::qt_loader, "jp2", cap_scaled)},
+        {QByteArray("\x76\x2F\x31\x01", 4), DkImageDecoder(DkBasicLoader::qt_loader, "exr", cap_none)},
+        {QByteArray("\x00\x00\x01\x00", 4), DkImageDecoder(DkBasicLoader::qt_loader, "ico", cap_multi_page)},
+        {"8BPS", DkImageDecoder(DkBasicLoader::psd_loader, "psd", cap_none)},
+        {"BM", DkImageDecoder(DkBasicLoader::qt_loader, "bmp", cap_none)},
+#ifdef WITH_LIBRAW
+        {"????ftypcrx ", rawDecoder},
+        {QByteArray("II*\x00????CR", 10), rawDecoder},
+        {QByteArray("II\x1A\x00\x00\x00HEAPCCDR", 14), rawDecoder},
+        {"FUJIFILMCCD-RAW", rawDecoder},
+        {"FOVb", rawDecoder},
+        {QByteArray("\x00MRM", 4), rawDecoder},
+        {"IIRO", rawDecoder},
+        {"IIRS", rawDecoder},
+        {"MMOR", rawDecoder},
+        {QByteArray("IIU\x00", 4), rawDecoder},
+#endif
+        {QByteArray("II*\x00", 4), tiffDecoder},
+        {QByteArray("MM\x00*", 4), tiffDecoder},
+        {QByteArray("II+\x00", 4), tiffDecoder},
+        {QByteArray("MM\x00+", 4), tiffDecoder},
+    };
+
+    // mif1 and msf1 are generic HEIF brands - AVIF files list avif (avis) in their compatible brands
+    static const DkImageDecoder avifDecoder(DkBasicLoader::qt_loader, "avif", meta);
+    static const DkImageDecoder avisDecoder(DkBasicLoader::qt_loader, "avif", cap_multi_page | meta);
+    QList<QByteArray> brands = ftypBrands(header);
+
+    if (!brands.isEmpty() && (brands.first() == "mif1" || brands.first() == "msf1")) {
+        const DkImageDecoder &d = brands.contains("avis") && brands.first() == "msf1" ? avisDecoder : avifDecoder;
+
+        if (brands.contains("avif") || brands.contains("avis"))
+            return qtFormats().contains(d.format()) ? d : DkImageDecoder();
+    }
+
+    for (const DkSignature &s : signatures) {
+        if (!s.matches(header))
+            continue;
+
+#ifdef WITH_LIBRAW
+        // most RAW formats are tiffs - the suffix tells them apart
+        if (s.decoder.loader() == DkBasicLoader::tif_loader && isRawSuffix(suffix))
+            return rawDecoder;
+#else
+        Q_UNUSED(suffix);
+#endif
+
+        // the Qt plugin is not available
+        if (s.decoder.loader() == DkBasicLoader::qt_loader && !qtFormats().contains(s.decoder.format()))
+            return DkImageDecoder();
+
+        return s.decoder;
+    }
+
+    return DkImageDecoder();
+}
+
 // Basic loader and image edit class --------------------------------------------------------------------
 DkBasicLoader::DkBasicLoader(int mode)
 {
@@ -199,6 +1608,60 @@ DkBasicLoader::DkBasicLoader(int mode)
     mMetaData = QSharedPointer<DkMetaDataT>(new DkMetaDataT());
 }
 
+/**
+ * Returns the angle the image needs to be rotated by according to its exif orientation.
+ * Formats that handle the orientation themselves return 0.
+ **/
+static int exifRotation(const DkMetaDataT &metaData)
+{
+    int orientation = metaData.getOrientationDegree();
+
+    if (orientation != -1 && !metaData.isTiff() && !metaData.isAVIF() && !metaData.isHEIF() && !metaData.isJXL()
+        && !DkSettingsManager::param().metaData().ignoreExifOrientation)
+        return orientation;
+
+    return 0;
+}
+
+/**
+ * Returns the size a decoder should scale imgSize to, so that its longer side is still
+ * at least the longer side of targetSize. Only power-of-two fractions (up to 1/8) are used
+ * since jpg decoders scale by these natively (DCT scaling) - sizes are rounded up like libjpeg does.
+ * Returns an invalid size if the image should be decoded with its full size.
+ **/
+static QSize reducedDecodeSize(const QSize &imgSize, const QSize &targetSize)
+{
+    if (imgSize.isEmpty() || targetSize.isEmpty())
+        return QSize();
+
+    int minEdge = qMax(targetSize.width(), targetSize.height());
+    int edge = qMax(imgSize.width(), imgSize.height());
+    int denom = 1;
+
+    while (denom < 8 && (edge + denom * 2 - 1) / (denom * 2) >= minEdge)
+        denom *= 2;
+
+    if (denom == 1)
+        return QSize();
+
+    return QSize((imgSize.width() + denom - 1) / denom, (imgSize.height() + denom - 1) / denom);
+}
+
+/**
+ * Reads the image with a reduced scale if the reader supports it.
+ **/
+static bool readReducedImage(QImageReader &reader, QImage &img, const QSize &targetSize)
+{
+    if (reader.supportsOption(QImageIOHandler::ScaledSize)) {
+        QSize s = reducedDecodeSize(reader.size(), targetSize);
+
+        if (s.isValid())
+            reader.setScaledSize(s);
+    }
+
+    return reader.read(&img);
+}
+
 bool DkBasicLoader::loadGeneral(const QString &filePath, bool loadMetaData, bool fast)
 {
     return loadGeneral(filePath, QSharedPointer<QByteArray>(), loadMetaData, fast);
@@ -208,41 +1671,218 @@ bool DkBasicLoader::loadGeneral(const QString &filePath, bool loadMetaData, bool
  * @param file the image file that should be loaded.
  * @return bool true if the image could be loaded.
  **/
-bool DkBasicLoader::loadGeneral(const QString &filePath, QSharedPointer<QByteArray> ba, bool loadMetaData, bool fast)
+bool DkBasicLoader::loadGeneral(const QString &filePath, QSharedPointer<QByteArray> ba, bool loadMetaData, bool fast, const QSize &targetSize)
 {
     DkTimer dt;
     bool imgLoaded = false;
 
     mFile = DkUtils::resolveSymLink(filePath);
     QFileInfo fInfo(mFile); // resolved lnk
-    QString newSuffix = fInfo.suffix();
 
-    release();
+    release(mTiffFile && mTiffFile->filePath() == mFile);
+
+    if (mPageIdxDirty)
+        imgLoaded = loadPage();
+
+    // this fixes an issue with the new jpg loader
+    // Qt considers an orientation of 0 as wrong and fails to load these jpgs
+    // however, the old nomacs wrote 0 if the orientation should be cleared
+    // so we simply adopt the memory here
+    if (loadMetaData && mMetaData) {
+        try {
+            mMetaData->readMetaData(filePath, ba);
+        } catch (...) {
+        } // ignore if we cannot read the metadata
+    } else if (!mMetaData) {
+        qDebug() << "metaData is NULL!";
+    }
+
+    QString suf = fInfo.suffix().toLower();
+
+    QImage img;
+
+    // identify the decoder by the file's signature - wrongly named files are decoded right away
+    DkImageDecoder decoder;
+
+    if (!imgLoaded) {
+        decoder = DkImageDecoder::identify(fileHeader(mFile, ba), suf);
+
+        if (!decoder.isNull())
+            imgLoaded = decode(decoder, img, ba, fast, targetSize);
+    }
+
+    // formats without a (known) signature or files the identified decoder failed on
+    if (!imgLoaded)
+        imgLoaded = loadBySuffix(img, ba, fast, targetSize);
+
+    // tiff things
+    if (imgLoaded && !mPageIdxDirty) {
+        indexPages(mFile, ba);
+
+        // thumbnails (fast) never flip pages
+        if (!fast)
+            prefetchPages(1);
+    }
+    mPageIdxDirty = false;
+
+    bool rotated = false;
+
+    if (imgLoaded && loadMetaData && mMetaData) {
+        try {
+            mMetaData->setQtValues(img);
+            int orientation = exifRotation(*mMetaData);
+
+            if (orientation != 0) {
+                img = DkImage::rotateImage(img, orientation);
+                rotated = true;
+            }
+
+        } catch (...) {
+        } // ignore if we cannot read the metadata
+    } else if (!mMetaData) {
+        qDebug() << "metaData is NULL!";
+    }
+
+    if (imgLoaded)
+        setEditImage(img, tr("Original Image"));
+
+    // the file's pixels are not rotated
+    if (imgLoaded && !fast && !rotated)
+        updateRegionReader(img);
+
+    if (imgLoaded)
+        qInfo() << "[Basic Loader]" << filePath << "loaded in" << dt;
+    else
+        qWarning() << "[Basic Loader] could not load" << filePath;
+
+    return imgLoaded;
+}
+
+/**
+ * Sets an image that was decoded before (see DkImageCache).
+ * Only the metadata is read from the file.
+ * @param filePath the image's file path
+ * @param ba the file buffer (may be empty)
+ * @param img the decoded (and rotated) image
+ * @param numPages the number of pages
+ * @param pageIdx the page of img
+ * @param loaderId the loader that decoded img
+ **/
+void DkBasicLoader::loadCached(const QString &filePath, QSharedPointer<QByteArray> ba, const QImage &img, int numPages, int pageIdx, int loaderId)
+{
+    mFile = DkUtils::resolveSymLink(filePath);
+
+    release(mTiffFile && mTiffFile->filePath() == mFile);
+
+    try {
+        mMetaData->readMetaData(filePath, ba);
+        mMetaData->setQtValues(img);
+    } catch (...) {
+    } // ignore if we cannot read the metadata
+
+    mNumPages = numPages;
+    mPageIdx = pageIdx;
+    mPageIdxDirty = false;
+    mLoader = loaderId;
+
+    setEditImage(img, tr("Original Image"));
+
+    qInfo() << "[Basic Loader]" << filePath << "shared from the image cache";
+}
+
+/**
+ * Decodes the image with the decoder identified by the file's signature.
+ * @return bool true if the image could be decoded.
+ **/
+bool DkBasicLoader::decode(const DkImageDecoder &decoder, QImage &img, QSharedPointer<QByteArray> ba, bool fast, const QSize &targetSize)
+{
+    bool imgLoaded = false;
+    int loader = decoder.loader();
+
+    switch (loader) {
+    case raw_loader:
+        imgLoaded = loadRawFile(mFile, img, ba, fast, targetSize);
+        break;
+    case tif_loader:
+        // pyramid tiffs: load the smallest reduced-resolution image that is large enough
+        if (targetSize.isValid())
+            imgLoaded = loadTIFFile(mFile, img, ba, targetSize);
+
+        if (!imgLoaded && DkImageDecoder::qtFormats().contains(decoder.format())) {
+            imgLoaded = loadQtImage(decoder.format(), img, ba);
+            loader = qt_loader;
+        }
+
+        // libtiff supports jpg compressed tiffs
+        if (!imgLoaded) {
+            imgLoaded = loadTIFFile(mFile, img, ba);
+            loader = tif_loader;
+        }
+        break;
+    case psd_loader:
+        imgLoaded = loadPSDFile(mFile, img, ba);
+
+        if (!imgLoaded && DkImageDecoder::qtFormats().contains(decoder.format())) {
+            imgLoaded = loadQtImage(decoder.format(), img, ba);
+            loader = qt_loader;
+        }
+        break;
+    case qt_loader:
+        // load large icons
+        if (decoder.format() == "ico" && QFileInfo(mFile).exists()) {
+            QIcon icon(mFile);
+
+            if (!icon.isNull()) {
+                img = icon.pixmap(QSize(256, 256)).toImage();
+                imgLoaded = true;
+            }
+        }
+
+        if (!imgLoaded)
+            imgLoaded = loadQtImage(decoder.format(), img, ba, decoder.hasCapability(DkImageDecoder::cap_scaled) ? targetSize : QSize());
+
+        // add marker to fix broken panorama images from SAMSUNG
+        // see: https://github.com/nomacs/nomacs/issues/254
+        if (!imgLoaded && decoder.format() == "jpg") {
+            QByteArray lba;
 
-    if (mPageIdxDirty)
-        imgLoaded = loadPage();
+            // prefer external buffer
+            if (!ba || ba->isEmpty())
+                loadFileToBuffer(mFile, lba);
 
-    // identify raw images:
-    // newSuffix.contains(QRegExp("(nef|crw|cr2|arw|rw2|mrw|dng)", Qt::CaseInsensitive)))
+            QByteArray baf = DkImage::fixSamsungPanorama(ba && !ba->isEmpty() ? *ba : lba);
 
-    // this fixes an issue with the new jpg loader
-    // Qt considers an orientation of 0 as wrong and fails to load these jpgs
-    // however, the old nomacs wrote 0 if the orientation should be cleared
-    // so we simply adopt the memory here
-    if (loadMetaData && mMetaData) {
-        try {
-            mMetaData->readMetaData(filePath, ba);
-        } catch (...) {
-        } // ignore if we cannot read the metadata
-    } else if (!mMetaData) {
-        qDebug() << "metaData is NULL!";
+            if (!baf.isEmpty())
+                imgLoaded = img.loadFromData(baf, "jpg");
+        }
+        break;
     }
 
-    QList<QByteArray> qtFormats = QImageReader::supportedImageFormats();
-    qtFormats << "jpe"; // fixes #435 - thumbnail gets loaded in the RAW loader
-    QString suf = fInfo.suffix().toLower();
+    if (imgLoaded)
+        mLoader = loader;
 
-    QImage img;
+    return imgLoaded;
+}
+
+/**
+ * Loads images that could not be identified by their signature.
+ * The loaders are selected by the file's suffix.
+ * @return bool true if the image could be loaded.
+ **/
+bool DkBasicLoader::loadBySuffix(QImage &img, QSharedPointer<QByteArray> ba, bool fast, const QSize &targetSize)
+{
+    static const QRegularExpression tifSuffix("(tif|tiff)", QRegularExpression::CaseInsensitiveOption);
+    static const QRegularExpression tgaSuffix("(tga)", QRegularExpression::CaseInsensitiveOption);
+    static const QRegularExpression rohSuffix("(roh)", QRegularExpression::CaseInsensitiveOption);
+    static const QRegularExpression vecSuffix("(vec)", QRegularExpression::CaseInsensitiveOption);
+
+    bool imgLoaded = false;
+
+    QFileInfo fInfo(mFile);
+    QString newSuffix = fInfo.suffix();
+    QString suf = newSuffix.toLower();
+    QByteArray qtSuffix = suf.toLatin1(); // 1 byte per char
+    QList<QByteArray> qtFormats = DkImageDecoder::qtFormats();
 
     // load drif file
     if (!imgLoaded && ("drif" == suf || "yuv" == suf || "raw" == suf))
@@ -255,25 +1895,13 @@ bool DkBasicLoader::loadGeneral(const QString &filePath, QSharedPointer<QByteArr
             mLoader = qt_loader;
     }
 
-    // load large icons
-    if (!imgLoaded && suf == "ico") {
-        QIcon icon(mFile);
-
-        if (!icon.isNull()) {
-            img = icon.pixmap(QSize(256, 256)).toImage();
-            imgLoaded = true;
-        }
-    }
-
 #ifdef WITH_LIBRAW
     bool rawloaderused(false);
 
-    if (!imgLoaded
-        && newSuffix.contains(
-            QRegularExpression("(nef|nrw|crw|cr2|cr3|arw|dng|raw|rw2|mrw|srw|orf|3fr|x3f|mos|pef|iiq|raf)", QRegularExpression::CaseInsensitiveOption))) {
+    if (!imgLoaded && isRawSuffix(newSuffix)) {
         // prefer our RAW loader rather that Qt’s plug-in kimg_raw from KImageFormats
         rawloaderused = true;
-        imgLoaded = loadRawFile(mFile, img, ba, fast);
+        imgLoaded = loadRawFile(mFile, img, ba, fast, targetSize);
         if (imgLoaded)
             mLoader = raw_loader;
     }
@@ -281,57 +1909,44 @@ bool DkBasicLoader::loadGeneral(const QString &filePath, QSharedPointer<QByteArr
 
     // default Qt loader
     // here we just try those formats that are officially supported
-    if (!imgLoaded && qtFormats.contains(suf.toStdString().c_str()) || suf.isEmpty()) {
-        // if image has Indexed8 + alpha channel -> we crash... sorry for that
-        if (!ba || ba->isEmpty())
-            imgLoaded = img.load(mFile, suf.toStdString().c_str());
-        else
-            imgLoaded = img.loadFromData(*ba.data(), suf.toStdString().c_str()); // toStdString() in order get 1 byte per char
+    if (!imgLoaded && qtFormats.contains(qtSuffix) || suf.isEmpty()) {
+        imgLoaded = loadQtImage(qtSuffix, img, ba, targetSize);
 
         if (imgLoaded)
             mLoader = qt_loader;
     }
 
     // OpenCV Tiff loader - supports jpg compressed tiffs
-    if (!imgLoaded && newSuffix.contains(QRegularExpression("(tif|tiff)", QRegularExpression::CaseInsensitiveOption))) {
+    if (!imgLoaded && newSuffix.contains(tifSuffix)) {
         imgLoaded = loadTIFFile(mFile, img, ba);
 
         if (imgLoaded)
             mLoader = tif_loader;
     }
 
-    // PSD loader
-    if (!imgLoaded) {
-        imgLoaded = loadPSDFile(mFile, img, ba);
-        if (imgLoaded)
-            mLoader = psd_loader;
-    }
-
 #ifdef WITH_LIBRAW
     // RAW loader (try only formats not handled before)
-    if (!imgLoaded && !qtFormats.contains(suf.toStdString().c_str()) && !rawloaderused) {
+    if (!imgLoaded && !qtFormats.contains(qtSuffix) && !rawloaderused) {
         // TODO: sometimes (e.g. _DSC6289.tif) strange opencv errors are thrown - catch them!
         // load raw files
-        imgLoaded = loadRawFile(mFile, img, ba, fast);
+        imgLoaded = loadRawFile(mFile, img, ba, fast, targetSize);
         if (imgLoaded)
             mLoader = raw_loader;
     }
 #endif
 
     // TGA loader
-    if (!imgLoaded && newSuffix.contains(QRegularExpression("(tga)", QRegularExpression::CaseInsensitiveOption))) {
+    if (!imgLoaded && newSuffix.contains(tgaSuffix)) {
         imgLoaded = loadTgaFile(mFile, img, ba);
 
         if (imgLoaded)
             mLoader = tga_loader; // TODO: add tga loader
     }
 
-    QByteArray lba;
-
     // default Qt loader
-    if (!imgLoaded && !newSuffix.contains(QRegularExpression("(roh)", QRegularExpression::CaseInsensitiveOption))) {
+    if (!imgLoaded && !newSuffix.contains(rohSuffix)) {
         // if we first load files to buffers, we can additionally load images with wrong extensions (rainer bugfix : )
-        // TODO: add warning here
+        QByteArray lba;
         loadFileToBuffer(mFile, lba);
         imgLoaded = img.loadFromData(lba);
 
@@ -342,63 +1957,123 @@ bool DkBasicLoader::loadGeneral(const QString &filePath, QSharedPointer<QByteArr
             mLoader = qt_loader;
     }
 
-    // add marker to fix broken panorama images from SAMSUNG
-    // see: https://github.com/nomacs/nomacs/issues/254
-    if (!imgLoaded && newSuffix.contains(QRegularExpression("(jpg|jpeg|jpe)", QRegularExpression::CaseInsensitiveOption))) {
-        // prefer external buffer
-        QByteArray baf = DkImage::fixSamsungPanorama(ba && !ba->isEmpty() ? *ba : lba);
-
-        if (!baf.isEmpty())
-            imgLoaded = img.loadFromData(baf, suf.toStdString().c_str());
-
-        if (imgLoaded)
-            mLoader = qt_loader;
-    }
-
     // this loader is a bit buggy -> be carefull
-    if (!imgLoaded && newSuffix.contains(QRegularExpression("(roh)", QRegularExpression::CaseInsensitiveOption))) {
+    if (!imgLoaded && newSuffix.contains(rohSuffix)) {
         imgLoaded = loadRohFile(mFile, img, ba);
         if (imgLoaded)
             mLoader = roh_loader;
     }
 
     // this loader is for OpenCV cascade training files
-    if (!imgLoaded && newSuffix.contains(QRegularExpression("(vec)", QRegularExpression::CaseInsensitiveOption))) {
+    if (!imgLoaded && newSuffix.contains(vecSuffix)) {
         imgLoaded = loadOpenCVVecFile(mFile, img, ba);
         if (imgLoaded)
             mLoader = roh_loader;
     }
 
-    // tiff things
-    if (imgLoaded && !mPageIdxDirty)
-        indexPages(mFile, ba);
-    mPageIdxDirty = false;
+    return imgLoaded;
+}
 
-    if (imgLoaded && loadMetaData && mMetaData) {
-        try {
-            mMetaData->setQtValues(img);
-            int orientation = mMetaData->getOrientationDegree();
+/**
+ * Loads the image with Qt's image plugins.
+ * @param format the Qt image format (empty for auto detection)
+ * @param targetSize if valid, the image is decoded with a reduced scale (if the plugin supports it)
+ * @return bool true if the image could be loaded.
+ **/
+bool DkBasicLoader::loadQtImage(const QByteArray &format, QImage &img, QSharedPointer<QByteArray> ba, const QSize &targetSize) const
+{
+    // reduced-scale decoding (if the plugin supports it)
+    if (targetSize.isValid()) {
+        QBuffer buffer;
+        QImageReader reader;
 
-            if (orientation != -1 && !mMetaData->isTiff() && !mMetaData->isAVIF() && !mMetaData->isHEIF() && !mMetaData->isJXL()
-                && !DkSettingsManager::param().metaData().ignoreExifOrientation) {
-                img = DkImage::rotateImage(img, orientation);
-            }
+        if (ba && !ba->isEmpty()) {
+            buffer.setData(*ba);
+            buffer.open(QIODevice::ReadOnly);
+            reader.setDevice(&buffer);
+        } else
+            reader.setFileName(mFile);
 
-        } catch (...) {
-        } // ignore if we cannot read the metadata
-    } else if (!mMetaData) {
-        qDebug() << "metaData is NULL!";
+        reader.setFormat(format);
+        return readReducedImage(reader, img, targetSize);
     }
 
-    if (imgLoaded)
-        setEditImage(img, tr("Original Image"));
+    // if image has Indexed8 + alpha channel -> we crash... sorry for that
+    if (!ba || ba->isEmpty())
+        return img.load(mFile, format.constData());
 
-    if (imgLoaded)
-        qInfo() << "[Basic Loader]" << filePath << "loaded in" << dt;
-    else
-        qWarning() << "[Basic Loader] could not load" << filePath;
+    return img.loadFromData(*ba.data(), format.constData());
+}
 
-    return imgLoaded;
+/**
+ * Loads a preview of large images that is shown while the image is decoded.
+ * The preview is the largest embedded preview or - if there is none - a reduced-scale decode.
+ * Images that are small enough to be decoded fast get no preview.
+ * @param filePath the image file
+ * @param ba the file buffer (optional)
+ * @param imgSize is set to the size of the full (oriented) image, or the preview's size if unknown
+ * @return QImage the preview (null if the image needs no preview)
+ **/
+QImage DkBasicLoader::loadPreview(const QString &filePath, const QSharedPointer<QByteArray> ba, QSize &imgSize)
+{
+    DkTimer dt;
+
+    // decoding smaller images is fast enough
+    const double minPreviewPixels = 12e6;
+
+    DkMetaDataT metaData;
+
+    try {
+        metaData.readMetaData(filePath, ba);
+    } catch (...) {
+    } // ignore if we cannot read the metadata
+
+    QBuffer buffer;
+    QImageReader reader;
+
+    if (ba && !ba->isEmpty()) {
+        buffer.setData(*ba);
+        buffer.open(QIODevice::ReadOnly);
+        reader.setDevice(&buffer);
+    } else
+        reader.setFileName(filePath);
+
+    // the image size is read from the header (or the exif data)
+    QSize readerSize = reader.canRead() ? reader.size() : QSize();
+    QSize s = readerSize.isValid() ? readerSize : metaData.getImageSize();
+
+    bool isRaw = isRawSuffix(QFileInfo(filePath).suffix());
+
+    if ((s.isValid() && (double)s.width() * s.height() < minPreviewPixels) || (!s.isValid() && !isRaw))
+        return QImage();
+
+    QImage preview = metaData.getPreviewImage(640);
+
+    // no embedded preview: decode with a reduced scale (e.g. DCT scaling for jpgs)
+    if (preview.isNull() && readerSize.isValid() && reader.supportsOption(QImageIOHandler::ScaledSize))
+        readReducedImage(reader, preview, QSize(1920, 1920));
+
+    if (preview.isNull())
+        return preview;
+
+    int orientation = exifRotation(metaData);
+
+    if (orientation != 0) {
+        preview = DkImage::rotateImage(preview, orientation);
+
+        if (orientation != 180)
+            s.transpose();
+    }
+
+    // previews with a different aspect ratio (or unknown image sizes) are shown with their own size
+    if (!s.isValid() || qAbs((double)s.width() / s.height() - (double)preview.width() / preview.height()) > 0.02)
+        s = preview.size();
+
+    imgSize = s;
+
+    qInfo() << "[Basic Loader] preview" << preview.size() << "of" << QFileInfo(filePath).fileName() << "loaded in" << dt;
+
+    return preview;
 }
 
 /**
@@ -484,10 +2159,11 @@ bool nmc::DkBasicLoader::loadTgaFile(const QString &filePath, QImage &img, QShar
  * @param ba the file loaded into a bytearray.
  * @return bool true if the file could be loaded.
  **/
-bool DkBasicLoader::loadRawFile(const QString &filePath, QImage &img, QSharedPointer<QByteArray> ba, bool fast) const
+bool DkBasicLoader::loadRawFile(const QString &filePath, QImage &img, QSharedPointer<QByteArray> ba, bool fast, const QSize &targetSize) const
 {
     DkRawLoader rawLoader(filePath, mMetaData);
     rawLoader.setLoadFast(fast);
+    rawLoader.setTargetSize(targetSize);
 
     bool success = rawLoader.load(ba);
 
@@ -540,70 +2216,28 @@ bool DkBasicLoader::loadPSDFile(const QString &filePath, QImage &img, QSharedPoi
 }
 
 #ifndef WITH_LIBTIFF
-bool DkBasicLoader::loadTIFFile(const QString &, QImage &, QSharedPointer<QByteArray>) const
+bool DkBasicLoader::loadTIFFile(const QString &, QImage &, QSharedPointer<QByteArray>, const QSize &)
 {
 #else
-bool DkBasicLoader::loadTIFFile(const QString &filePath, QImage &img, QSharedPointer<QByteArray> ba) const
+bool DkBasicLoader::loadTIFFile(const QString &filePath, QImage &img, QSharedPointer<QByteArray> ba, const QSize &reducedSize)
 {
-    bool success = false;
-
-    // first turn off nasty warning/error dialogs - (we do the GUI : )
-    TIFFErrorHandler oldErrorHandler, oldWarningHandler;
-    oldWarningHandler = TIFFSetWarningHandler(NULL);
-    oldErrorHandler = TIFFSetErrorHandler(NULL);
-
     DkTimer dt;
-    TIFF *tiff = 0;
-
-// TODO: currently TIFFStreamOpen can only be linked on Windows?!
-#if defined(Q_OS_WIN)
-
-    std::istringstream is(ba ? ba->toStdString() : "");
-
-    if (ba)
-        tiff = TIFFStreamOpen("MemTIFF", &is);
-
-    // fallback to direct loading
-    if (!tiff)
-        tiff = TIFFOpen(filePath.toLatin1(), "r");
-
-    // loading from buffer allows us to load files with non-latin names
-    QSharedPointer<QByteArray> bal;
-    if (!tiff)
-        bal = loadFileToBuffer(filePath);
-
-    std::istringstream isl(bal ? bal->toStdString() : "");
-
-    if (bal)
-        tiff = TIFFStreamOpen("MemTIFF", &isl);
-#else
-    tiff = TIFFOpen(filePath.toLatin1(), "r");
-#endif
-
-    if (!tiff)
-        return success;
-
-    uint32_t width = 0;
-    uint32_t height = 0;
-
-    TIFFGetField(tiff, TIFFTAG_IMAGEWIDTH, &width);
-    TIFFGetField(tiff, TIFFTAG_IMAGELENGTH, &height);
-
-    // init the qImage
-    img = QImage(width, height, QImage::Format_ARGB32);
 
-    const int stopOnError = 1;
-    success = TIFFReadRGBAImageOriented(tiff, width, height, reinterpret_cast<uint32_t *>(img.bits()), ORIENTATION_TOPLEFT, stopOnError) != 0;
+    // libtiff reads from the buffer - this allows us to load files with non-latin names
+    // the file stays open, so that indexPages() and loadPageAt() do not open it again
+    if (!mTiffFile || mTiffFile->filePath() != filePath)
+        mTiffFile = QSharedPointer<DkTiffFile>(new DkTiffFile(filePath, (ba && !ba->isEmpty()) ? ba : loadFileToBuffer(filePath)));
 
-    if (success) {
-        for (uint32_t y = 0; y < height; ++y)
-            convert32BitOrder(img.scanLine(y), width);
+    if (!mTiffFile->isOpen()) {
+        mTiffFile.reset();
+        return false;
     }
 
-    TIFFClose(tiff);
+    // only reduced-resolution images are loaded if a size is requested
+    bool success = reducedSize.isValid() ? mTiffFile->readReduced(reducedSize, img) : mTiffFile->readPage(1, img);
 
-    TIFFSetWarningHandler(oldWarningHandler);
-    TIFFSetWarningHandler(oldErrorHandler);
+    if (success)
+        qDebug() << "[Basic Loader] TIFF decoded in" << dt;
 
     return success;
 
@@ -807,6 +2441,9 @@ void DkBasicLoader::setEditImage(const QImage &img, const QString &editName)
 
     mImages.append(newImg);
     mImageIndex = mImages.size() - 1; // set the index again to the last
+
+    // the history is limited by the global budget too
+    DkMemoryGovernor::instance().requestUpdate();
 }
 
 void DkBasicLoader::setEditMetaData(const QSharedPointer<DkMetaDataT> &metaData, const QImage &img, const QString &editName)
@@ -992,6 +2629,29 @@ void DkBasicLoader::setHistoryIndex(int idx)
     // TODO update mMetaData, see undo()
 }
 
+/**
+ * Returns the memory (MB) of all history images except the current one.
+ * Images that are shared between edits (e.g. metadata edits) are counted once.
+ **/
+double DkBasicLoader::historyMemoryUsage() const
+{
+    QSet<qint64> counted;
+    counted << image().cacheKey();
+
+    double mem = 0;
+    for (const DkEditImage &e : mImages) {
+        QImage img = e.image();
+
+        if (img.isNull() || counted.contains(img.cacheKey()))
+            continue;
+
+        counted << img.cacheKey();
+        mem += DkImage::getBufferSizeFloat(img.size(), img.depth());
+    }
+
+    return mem;
+}
+
 void DkBasicLoader::loadFileToBuffer(const QString &filePath, QByteArray &ba) const
 {
     QFileInfo fi(filePath);
@@ -1019,13 +2679,7 @@ QSharedPointer<QByteArray> DkBasicLoader::loadFileToBuffer(const QString &filePa
         return DkZipContainer::extractImage(DkZipContainer::decodeZipFile(filePath), DkZipContainer::decodeImageFile(filePath));
 #endif
 
-    QFile file(filePath);
-    file.open(QIODevice::ReadOnly);
-
-    QSharedPointer<QByteArray> ba(new QByteArray(file.readAll()));
-    file.close();
-
-    return ba;
+    return DkFileBuffer::load(filePath);
 }
 
 /**
@@ -1042,10 +2696,13 @@ bool DkBasicLoader::writeBufferToFile(const QString &fileInfo, const QSharedPoin
     if (!ba || ba->isEmpty())
         return false;
 
-    QFile file(fileInfo);
+    // QSaveFile replaces the file (instead of truncating it) - so buffers mapped from the old file stay valid
+    QSaveFile file(fileInfo);
     file.open(QIODevice::WriteOnly);
     qint64 bytesWritten = file.write(*ba.data(), ba->size());
-    file.close();
+
+    if (!file.commit())
+        bytesWritten = -1;
     qDebug() << "[DkBasicLoader] buffer saved, bytes written: " << bytesWritten;
 
     if (!bytesWritten || bytesWritten == -1)
@@ -1068,61 +2725,20 @@ void DkBasicLoader::indexPages(const QString &filePath, const QSharedPointer<QBy
     if (!fInfo.suffix().contains(QRegularExpression("(tif|tiff)", QRegularExpression::CaseInsensitiveOption)))
         return;
 
-    // first turn off nasty warning/error dialogs - (we do the GUI : )
-    TIFFErrorHandler oldErrorHandler, oldWarningHandler;
-    oldWarningHandler = TIFFSetWarningHandler(NULL);
-    oldErrorHandler = TIFFSetErrorHandler(NULL);
-
-    DkTimer dt;
-    TIFF *tiff = 0;
-
-#if defined(Q_OS_WIN)
-    std::istringstream is(ba ? ba->toStdString() : "");
-
-    if (ba)
-        tiff = TIFFStreamOpen("MemTIFF", &is);
-
-    // read from file
-    if (!tiff)
-        tiff = TIFFOpen(filePath.toLatin1(), "r"); // this->mFile was here before - not sure why
-
-    // loading from buffer allows us to load files with non-latin names
-    QSharedPointer<QByteArray> bal;
-    if (!tiff)
-        bal = loadFileToBuffer(filePath);
-    ;
-    std::istringstream isl(bal ? bal->toStdString() : "");
-
-    if (bal)
-        tiff = TIFFStreamOpen("MemTIFF", &isl);
-#else
-    // read from file
-    tiff = TIFFOpen(filePath.toLatin1(), "r"); // this->mFile was here before - not sure why
-#endif
-
-    if (!tiff)
-        return;
-
-    // libtiff example
-    int dircount = 0;
-
-    do {
-        dircount++;
-
-    } while (TIFFReadDirectory(tiff));
+    // the file's pages are indexed once and it stays open for loading other pages
+    if (!mTiffFile || mTiffFile->filePath() != filePath)
+        mTiffFile = QSharedPointer<DkTiffFile>(new DkTiffFile(filePath, ba));
 
-    mNumPages = dircount;
+    mNumPages = qMax(mTiffFile->numPages(), 1);
 
-    if (mNumPages > 1)
-        mPageIdx = 1;
-
-    qDebug() << dircount << " TIFF directories... " << dt;
-    TIFFClose(tiff);
+    // single page files do not need to be open - unless huge pages are tiled from the file
+    if (mNumPages <= 1 && !DkImagePyramid::isRequired(mTiffFile->pageSize(1)))
+        mTiffFile.reset();
 
-    TIFFSetWarningHandler(oldWarningHandler);
-    TIFFSetWarningHandler(oldErrorHandler);
+    qDebug() << mNumPages << " TIFF directories... ";
 #else
     Q_UNUSED(filePath);
+    Q_UNUSED(ba);
 #endif
 }
 
@@ -1149,62 +2765,97 @@ bool DkBasicLoader::loadPageAt(int pageIdx)
     if (pageIdx > mNumPages || pageIdx < 1)
         return imgLoaded;
 
-    // first turn off nasty warning/error dialogs - (we do the GUI : )
-    TIFFErrorHandler oldErrorHandler, oldWarningHandler;
-    oldWarningHandler = TIFFSetWarningHandler(NULL);
-    oldErrorHandler = TIFFSetErrorHandler(NULL);
-
     DkTimer dt;
-    TIFF *tiff = TIFFOpen(mFile.toLatin1(), "r");
 
-#if defined(Q_OS_WIN)
+    // the file stays open while we flip through its pages
+    if (!mTiffFile || mTiffFile->filePath() != mFile)
+        mTiffFile = QSharedPointer<DkTiffFile>(new DkTiffFile(mFile, loadFileToBuffer(mFile)));
 
-    // loading from buffer allows us to load files with non-latin names
-    QSharedPointer<QByteArray> ba;
-    if (!tiff)
-        ba = loadFileToBuffer(mFile);
+    QImage img;
+    imgLoaded = mTiffFile->readPage(pageIdx, img);
 
-    std::istringstream is(ba ? ba->toStdString() : "");
-    if (ba)
-        tiff = TIFFStreamOpen("MemTIFF", &is);
+    if (imgLoaded) {
+        setEditImage(img, tr("Original Image"));
+        updateRegionReader(img);
+        prefetchPages(pageIdx);
+
+        qInfo() << "[Basic Loader] page" << pageIdx << "loaded in" << dt;
+    }
+#else
+    Q_UNUSED(pageIdx);
 #endif
 
-    if (!tiff)
-        return imgLoaded;
+    return imgLoaded;
+}
 
-    uint32_t width = 0;
-    uint32_t height = 0;
+/**
+ * Decodes the pages next to pageIdx in the background while the user looks at pageIdx.
+ **/
+void DkBasicLoader::prefetchPages(int pageIdx)
+{
+#ifdef WITH_LIBTIFF
+    // single page files are not kept open
+    if (!mTiffFile || mNumPages <= 1)
+        return;
 
-    // go to current directory
-    for (int idx = 1; idx < pageIdx; idx++) {
-        if (!TIFFReadDirectory(tiff))
-            return false;
-    }
-    TIFFGetField(tiff, TIFFTAG_IMAGEWIDTH, &width);
-    TIFFGetField(tiff, TIFFTAG_IMAGELENGTH, &height);
+    QSharedPointer<DkTiffFile> tiffFile = mTiffFile;
+    QFuture<void> future = QtConcurrent::run([tiffFile, pageIdx] {
+        tiffFile->prefetch(pageIdx);
+    });
+#else
+    Q_UNUSED(pageIdx);
+#endif
+}
 
-    // init the qImage
-    QImage img = QImage(width, height, QImage::Format_ARGB32);
+/**
+ * Prepares the region reader of a huge image that was just loaded (see regionReader()).
+ * It is called while loading - so the file's directories are not read on the main thread.
+ * @param img the loaded (unrotated) image
+ **/
+void DkBasicLoader::updateRegionReader(const QImage &img)
+{
+    // nothing was loaded (e.g. the page was loaded before)
+    if (img.isNull())
+        return;
 
-    const int stopOnError = 1;
-    imgLoaded = TIFFReadRGBAImageOriented(tiff, width, height, reinterpret_cast<uint32_t *>(img.bits()), ORIENTATION_TOPLEFT, stopOnError) != 0;
+    mRegionReader = std::function<QImage(const QRect &, int)>();
+    mRegionReaderKey = 0;
 
-    if (imgLoaded) {
-        for (uint32_t y = 0; y < height; ++y)
-            convert32BitOrder(img.scanLine(y), width);
-    }
+#ifdef WITH_LIBTIFF
+    // only huge images are tiled (see DkImagePyramid::isRequired()) - the file is still open for them
+    if (!mTiffFile || mTiffFile->filePath() != mFile || !DkImagePyramid::isRequired(img.size()))
+        return;
 
-    TIFFClose(tiff);
+    if (mTiffFile->pageSize(mPageIdx) != img.size() || !mTiffFile->canReadRegions(mPageIdx))
+        return;
 
-    TIFFSetWarningHandler(oldWarningHandler);
-    TIFFSetWarningHandler(oldErrorHandler);
+    QSharedPointer<DkTiffFile> tiffFile = mTiffFile;
+    int pageIdx = mPageIdx;
 
-    setEditImage(img, tr("Original Image"));
-#else
-    Q_UNUSED(pageIdx);
+    mRegionReader = [tiffFile, pageIdx](const QRect &region, int level) {
+        QImage regionImg;
+        tiffFile->readRegion(pageIdx, regionImg, region, level);
+        return regionImg;
+    };
+    mRegionReaderKey = img.cacheKey();
 #endif
+}
 
-    return imgLoaded;
+/**
+ * Returns a function that decodes regions of the current page at pyramid levels
+ * without decoding the whole page (see DkTiffFile::readRegion()).
+ * The function is thread-safe and keeps the file open, so that the tiles
+ * of huge images are read from the file (see DkImageStorage::setRegionReader()).
+ * It is prepared while loading - so calling this function is cheap.
+ * @param img the image that is shown - no reader is returned if it differs from the file's page (e.g. edits)
+ * @return a null function if the regions cannot be read from the file
+ **/
+std::function<QImage(const QRect &, int)> DkBasicLoader::regionReader(const QImage &img) const
+{
+    if (img.isNull() || img.cacheKey() != mRegionReaderKey)
+        return std::function<QImage(const QRect &, int)>();
+
+    return mRegionReader;
 }
 
 bool DkBasicLoader::setPageIdx(int skipIdx)
@@ -1231,7 +2882,7 @@ void DkBasicLoader::resetPageIdx()
     mPageIdx = 1;
 }
 
-void DkBasicLoader::convert32BitOrder(void *buffer, int width) const
+void DkBasicLoader::convert32BitOrder(void *buffer, int width)
 {
 #ifdef WITH_LIBTIFF
     // code from Qt QTiffHandler
@@ -1461,6 +3112,7 @@ bool DkBasicLoader::isContainer(const QString &filePath)
  *
  * Clears the history.
  * Called by loadGeneral() and ImageContainer::clear().
+ * @param keepFile if true, an open TIFF stays open (e.g. to load another page)
  *
  * @note This will *not* silently auto-save your beautiful images.
  * It was apparently intended to be used that way (it called saveMetaData(), like ~DkImageContainerT()).
@@ -1468,7 +3120,7 @@ bool DkBasicLoader::isContainer(const QString &filePath)
  * If you think this is wrong, a comment would be appreciated. See issue #799. PSE, 2022.
  *
  **/
-void DkBasicLoader::release()
+void DkBasicLoader::release(bool keepFile)
 {
     // TODO: auto save routines here?
     // answer: no.
@@ -1476,6 +3128,12 @@ void DkBasicLoader::release()
     mImages.clear(); // clear history
     mImageIndex = -1;
 
+    if (!keepFile)
+        mTiffFile.reset();
+
+    mRegionReader = std::function<QImage(const QRect &, int)>();
+    mRegionReaderKey = 0;
+
     // Unload metadata
     mMetaData = QSharedPointer<DkMetaDataT>(new DkMetaDataT());
 }
@@ -2030,6 +3688,15 @@ void DkRawLoader::setLoadFast(bool fast)
     mLoadFast = fast;
 }
 
+/**
+ * If size is valid, the RAW is decoded with a reduced scale if the longer side
+ * of the result is still at least the longer side of size.
+ **/
+void DkRawLoader::setTargetSize(const QSize &size)
+{
+    mTargetSize = size;
+}
+
 bool DkRawLoader::load(const QSharedPointer<QByteArray> ba)
 {
     DkTimer dt;
@@ -2060,43 +3727,72 @@ bool DkRawLoader::load(const QSharedPointer<QByteArray> ba)
             iProcessor.imgdata.params.fbdd_noiserd = 0;
         }
 
-        if (!openBuffer(ba, iProcessor)) {
-            qDebug() << "could not open buffer for" << mFilePath;
-            return false;
-        }
+        // half_size decoding is retried with the full resolution (using the same LibRaw instance)
+        while (true) {
+            if (!openBuffer(ba, iProcessor)) {
+                qDebug() << "could not open buffer for" << mFilePath;
+                return false;
+            }
 
-        // check camera models for specific hacks
-        detectSpecialCamera(iProcessor);
+            // check camera models for specific hacks
+            detectSpecialCamera(iProcessor);
 
-        // try loading RAW preview
-        if (mLoadFast) {
-            mImg = loadPreviewRaw(iProcessor);
+            // try loading RAW preview
+            if (mLoadFast) {
+                mImg = loadPreviewRaw(iProcessor);
 
-            // are we done already?
-            if (!mImg.isNull())
-                return true;
-        }
+                // are we done already?
+                if (!mImg.isNull())
+                    return true;
+            }
 
-        // unpack the data
-        int error = iProcessor.unpack();
-        if (std::strcmp(iProcessor.version(), "0.13.5") != 0) // fixes a bug specific to libraw 13 - version call is UNTESTED
-            iProcessor.raw2image();
+            if (mTargetSize.isValid()) {
+                int minEdge = qMax(mTargetSize.width(), mTargetSize.height());
+                const libraw_thumbnail_t &thumb = iProcessor.imgdata.thumbnail;
 
-        if (error != LIBRAW_SUCCESS)
-            return false;
+                // the embedded thumbnail is large enough
+                if (qMax(thumb.twidth, thumb.theight) >= minEdge) {
+                    mImg = loadPreviewRaw(iProcessor, true);
 
-        // develop using libraw
-        error = iProcessor.dcraw_process();
+                    if (!mImg.isNull())
+                        return true;
+                }
+
+                // half_size skips demosaicing (each 2x2 bayer block becomes a pixel)
+                if (qMax(iProcessor.imgdata.sizes.width, iProcessor.imgdata.sizes.height) >= 2 * minEdge)
+                    iProcessor.imgdata.params.half_size = 1;
+            }
 
-        auto rimg = iProcessor.dcraw_make_mem_image();
+            // unpack the data
+            int error = iProcessor.unpack();
+            if (std::strcmp(iProcessor.version(), "0.13.5") != 0) // fixes a bug specific to libraw 13 - version call is UNTESTED
+                iProcessor.raw2image();
 
-        if (rimg) {
-            mImg = QImage(rimg->data, rimg->width, rimg->height, rimg->width * 3, QImage::Format_RGB888);
-            mImg = mImg.copy(); // make a deep copy...
-            mImg.setColorSpace(QColorSpace(QColorSpace::SRgb));
-            LibRaw::dcraw_clear_mem(rimg);
+            if (error != LIBRAW_SUCCESS)
+                return false;
 
-            return true;
+            // develop using libraw
+            error = iProcessor.dcraw_process();
+
+            auto rimg = iProcessor.dcraw_make_mem_image();
+
+            if (rimg) {
+                mImg = QImage(rimg->data, rimg->width, rimg->height, rimg->width * 3, QImage::Format_RGB888);
+                mImg = mImg.copy(); // make a deep copy...
+                mImg.setColorSpace(QColorSpace(QColorSpace::SRgb));
+                LibRaw::dcraw_clear_mem(rimg);
+
+                return true;
+            }
+
+            // our own pipeline needs the full resolution - so retry without half_size
+            if (!iProcessor.imgdata.params.half_size)
+                break;
+
+            qInfo() << "[RAW] half size decoding failed, decoding the full resolution";
+            iProcessor.recycle();
+            iProcessor.imgdata.params.half_size = 0;
+            mTargetSize = QSize();
         }
 
         // demosaic image
@@ -2147,7 +3843,7 @@ bool DkRawLoader::loadPreview(const QSharedPointer<QByteArray> &ba)
     try {
         // try to get preview image from exiv2
         if (mMetaData) {
-            if (mLoadFast || DkSettingsManager::param().resources().loadRawThumb == DkSettings::raw_thumb_always
+            if (mLoadFast || mTargetSize.isValid() || DkSettingsManager::param().resources().loadRawThumb == DkSettings::raw_thumb_always
                 || DkSettingsManager::param().resources().loadRawThumb == DkSettings::raw_thumb_if_large) {
                 mMetaData->readMetaData(mFilePath, ba);
 
@@ -2157,6 +3853,10 @@ bool DkRawLoader::loadPreview(const QSharedPointer<QByteArray> &ba)
                 if (DkSettingsManager::param().resources().loadRawThumb == DkSettings::raw_thumb_if_large)
                     minWidth = 1920;
 #endif
+                // reduced-scale decoding: any preview that is large enough is fine
+                if (mTargetSize.isValid())
+                    minWidth = qMax(mTargetSize.width(), mTargetSize.height()) - 1;
+
                 mImg = mMetaData->getPreviewImage(minWidth);
 
                 if (!mImg.isNull()) {
@@ -2187,11 +3887,11 @@ bool DkRawLoader::loadPreview(const QSharedPointer<QByteArray> &ba)
 //// RAW data filtration mode during data unpacking and post-processing
 // iProcessor.imgdata.params.filtering_mode = LIBRAW_FILTERING_AUTOMATIC;
 
-QImage DkRawLoader::loadPreviewRaw(LibRaw &iProcessor) const
+QImage DkRawLoader::loadPreviewRaw(LibRaw &iProcessor, bool force) const
 {
     int tW = iProcessor.imgdata.thumbnail.twidth;
 
-    if (DkSettingsManager::param().resources().loadRawThumb == DkSettings::raw_thumb_always
+    if (force || DkSettingsManager::param().resources().loadRawThumb == DkSettings::raw_thumb_always
         || (DkSettingsManager::param().resources().loadRawThumb == DkSettings::raw_thumb_if_large && tW >= 1920)) {
         // crashes here if image is broken
         int err = iProcessor.unpack_thumb();
@@ -2489,7 +4189,8 @@ QImage DkRawLoader::raw2Img(const LibRaw &iProcessor, cv::Mat &img) const
     if (img.channels() == 1)
         cv::cvtColor(img, img, CV_GRAY2RGB);
 
-    return DkImage::mat2QImage(img);
+    // the image takes over the Mat's buffer
+    return DkMatView::toImage(img);
 }
 
 #endif
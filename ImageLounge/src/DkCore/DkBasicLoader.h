@@ -28,11 +28,17 @@
 #pragma once
 
 #pragma warning(push, 0)
+#include <QAtomicInt>
 #include <QFutureWatcher>
+#include <QHash>
 #include <QImage>
+#include <QMutex>
 #include <QNetworkAccessManager>
+#include <QSet>
 #include <QSharedPointer>
 #include <QUrl>
+#include <QWaitCondition>
+#include <functional>
 #pragma warning(pop)
 
 #pragma warning(disable : 4251) // TODO: remove
@@ -65,6 +71,7 @@
 // Qt defines
 class QNetworkReply;
 class LibRaw;
+struct tiff;
 
 namespace nmc
 {
@@ -128,6 +135,7 @@ public:
 
     bool isEmpty() const;
     void setLoadFast(bool fast);
+    void setTargetSize(const QSize &size);
 
     bool load(const QSharedPointer<QByteArray> ba = QSharedPointer<QByteArray>());
 
@@ -148,6 +156,7 @@ protected:
     };
 
     bool mLoadFast = false;
+    QSize mTargetSize; // reduced-scale decoding if valid
     bool mIsChromatic = true;
     Cam mCamType = camera_unknown;
 
@@ -157,7 +166,7 @@ protected:
     cv::Mat mColorMat;
     cv::Mat mGammaTable;
 
-    QImage loadPreviewRaw(LibRaw &iProcessor) const;
+    QImage loadPreviewRaw(LibRaw &iProcessor, bool force = false) const;
     bool openBuffer(const QSharedPointer<QByteArray> &ba, LibRaw &iProcessor) const;
     void detectSpecialCamera(const LibRaw &iProcessor);
 
@@ -192,6 +201,134 @@ protected:
 #endif
 };
 
+/**
+ * DkFileBuffer loads files to read-only buffers that can be passed to all decoders and Exiv2.
+ * Local files are memory mapped, so the file is not copied to the heap. Small files, zip members
+ * and files on network drives are read to the heap. The mapping is released with the last reference.
+ * Writing to a mapped buffer detaches it, the file itself is never modified.
+ **/
+class DllCoreExport DkFileBuffer
+{
+public:
+    enum { min_map_size = 1024 * 1024 };
+
+    static QSharedPointer<QByteArray> load(const QString &filePath);
+    static QSharedPointer<QByteArray> map(const QString &filePath);
+
+    static bool isMapped(const QSharedPointer<QByteArray> &ba);
+    static float heapSize(const QSharedPointer<QByteArray> &ba);
+    static float mappedSize(const QSharedPointer<QByteArray> &ba);
+
+protected:
+    static bool canMap(const QString &filePath);
+};
+
+/**
+ * DkTiffFile keeps a (multi-page) TIFF open while it is shown.
+ * It is read from the memory (or mapped) file buffer on all platforms.
+ * The offsets of all pages are indexed once, so that any page is
+ * read without walking the directories of the previous pages.
+ * prefetch() decodes the adjacent pages in advance - without blocking readPage().
+ * Prefetched pages are registered with the DkMemoryGovernor.
+ * Strips and tiles are decoded in parallel and regions of
+ * huge (pyramidal) TIFFs can be read without decoding the whole page.
+ * Regions are only read from directories that are decoded natively (see canReadRegions()).
+ * @threadsafe
+ **/
+class DllCoreExport DkTiffFile
+{
+public:
+    // the file buffer that libtiff reads from
+    struct Stream {
+        QSharedPointer<QByteArray> ba;
+        qint64 pos = 0;
+    };
+
+    // a directory that holds a page or one of its reduced-resolution images
+    struct Directory {
+        quint64 offset = 0;
+        QSize size;
+    };
+
+    DkTiffFile(const QString &filePath, QSharedPointer<QByteArray> ba = QSharedPointer<QByteArray>());
+    ~DkTiffFile();
+
+    bool isOpen() const;
+    QString filePath() const;
+    int numPages();
+    QSize pageSize(int pageIdx);
+    bool canReadRegions(int pageIdx);
+
+    bool readPage(int pageIdx, QImage &img);
+    bool readReduced(const QSize &reducedSize, QImage &img);
+    bool readRegion(int pageIdx, QImage &img, const QRect &region = QRect(), int level = 0);
+    void prefetch(int pageIdx);
+
+    // the geometry of readRegion() and of decoding strips/tiles
+    static QSize levelSize(const QSize &size, int level);
+    static int levelDirectory(const QVector<Directory> &dirs, const QSize &levelSize);
+    static QRect directoryRect(const QRect &levelRect, const QSize &levelSize, const QSize &dirSize);
+    static int levelStep(const QSize &dirSize, const QSize &levelSize);
+    static QVector<QRect> units(const QRect &region, const QSize &unitSize);
+    static QPoint firstSample(const QRect &region, const QRect &rect, int step);
+    static QSize sampledSize(const QRect &region, int step);
+
+protected:
+    void indexPages();
+    QVector<Directory> directories(int pageIdx);
+    QVector<Directory> regionDirectories(int pageIdx);
+    bool decodePage(int pageIdx, quint64 offset, QImage &img, const std::function<bool()> &isCanceled = std::function<bool()>()) const;
+
+    QMutex mMutex;
+    QString mFilePath;
+    Stream mStream;
+    tiff *mTiff = nullptr;
+    QVector<quint64> mPageOffsets; // IFD offset of each page
+    bool mIndexed = false;
+
+    QAtomicInt mCurrentPage = -1; // read by prefetch() without the lock
+    QSet<int> mDecodingPages; // the pages that prefetch() decodes right now
+    QWaitCondition mPageDecoded;
+    QHash<int, QImage> mPrefetched; // decoded current and adjacent pages
+    int mMemoryId = -1; // see DkMemoryGovernor
+    QHash<int, QVector<Directory>> mDirectories; // full and reduced-resolution images of a page - largest first
+    QHash<int, QVector<Directory>> mRegionDirectories; // the directories of a page that regions are read from
+};
+
+/**
+ * DkImageDecoder describes one of the decoders of DkBasicLoader.
+ * Decoders are identified by the file's signature (magic bytes). The suffix
+ * is only a hint for signatures shared by several formats (e.g. tiff based RAWs).
+ **/
+class DllCoreExport DkImageDecoder
+{
+public:
+    enum Capability {
+        cap_none = 0x0,
+        cap_multi_page = 0x1, // pages or frames
+        cap_scaled = 0x2, // reduced-scale decoding
+        cap_region = 0x4, // decoding of image regions
+        cap_metadata = 0x8, // exif metadata
+    };
+
+    enum { header_size = 64 };
+
+    DkImageDecoder(int loader = 0, const QByteArray &format = QByteArray(), int capabilities = cap_none);
+
+    bool isNull() const;
+    int loader() const;
+    QByteArray format() const;
+    bool hasCapability(Capability cap) const;
+
+    static DkImageDecoder identify(const QByteArray &header, const QString &suffix = QString());
+    static QList<QByteArray> qtFormats();
+
+protected:
+    int mLoader = 0; // DkBasicLoader::loaderID
+    QByteArray mFormat; // the Qt image format
+    int mCapabilities = cap_none;
+};
+
 /**
  * This class provides image loading and editing capabilities.
  * It additionally stores the currently loaded image.
@@ -231,9 +368,15 @@ public:
      * Loads the image for the given file
      * @param file an image file
      * @param skipIdx the number of (internal) pages to be skipped
+     * @param targetSize if valid, decoders may return a reduced-scale image whose longer side is at least
+     * the longer side of targetSize (e.g. for thumbnails) - use it with temporary loaders only
      * @return bool true if the image was loaded
      **/
-    bool loadGeneral(const QString &filePath, const QSharedPointer<QByteArray> ba, bool loadMetaData = false, bool fast = true);
+    bool loadGeneral(const QString &filePath,
+                     const QSharedPointer<QByteArray> ba,
+                     bool loadMetaData = false,
+                     bool fast = true,
+                     const QSize &targetSize = QSize());
 
     /**
      * Loads the page requested (with respect to the current page)
@@ -242,6 +385,8 @@ public:
      **/
     bool loadPage(int skipIdx = 0);
     bool loadPageAt(int pageIdx = 0);
+    std::function<QImage(const QRect &, int)> regionReader(const QImage &img) const;
+    void loadCached(const QString &filePath, QSharedPointer<QByteArray> ba, const QImage &img, int numPages, int pageIdx, int loaderId);
 
     int getNumPages() const
     {
@@ -264,6 +409,7 @@ public:
     void saveMetaData(const QString &filePath);
 
     static bool isContainer(const QString &filePath);
+    static QImage loadPreview(const QString &filePath, const QSharedPointer<QByteArray> ba, QSize &imgSize);
 
     /**
      * Sets a new image (if edited outside the basicLoader class)
@@ -343,12 +489,13 @@ public:
     void setMinHistorySize(int size);
     void setHistoryIndex(int idx);
     int historyIndex() const;
+    double historyMemoryUsage() const;
 
     void loadFileToBuffer(const QString &filePath, QByteArray &ba) const;
     QSharedPointer<QByteArray> loadFileToBuffer(const QString &filePath) const;
     bool writeBufferToFile(const QString &fileInfo, const QSharedPointer<QByteArray> ba) const;
 
-    void release();
+    void release(bool keepFile = false);
 
 #ifdef WITH_OPENCV
     cv::Mat getImageCv();
@@ -375,8 +522,12 @@ public:
 #endif
 
     bool loadPSDFile(const QString &filePath, QImage &img, QSharedPointer<QByteArray> ba = QSharedPointer<QByteArray>()) const;
-    bool loadTIFFile(const QString &filePath, QImage &img, QSharedPointer<QByteArray> ba = QSharedPointer<QByteArray>()) const;
+    bool loadTIFFile(const QString &filePath,
+                     QImage &img,
+                     QSharedPointer<QByteArray> ba = QSharedPointer<QByteArray>(),
+                     const QSize &reducedSize = QSize());
     bool loadDrifFile(const QString &filePath, QImage &img, QSharedPointer<QByteArray> ba = QSharedPointer<QByteArray>()) const;
+    static void convert32BitOrder(void *buffer, int width);
 
 #ifdef Q_OS_WIN
     bool saveWindowsIcon(const QString &filePath, const QImage &img) const;
@@ -402,9 +553,17 @@ signals:
 protected:
     bool loadRohFile(const QString &filePath, QImage &img, QSharedPointer<QByteArray> ba = QSharedPointer<QByteArray>()) const;
     bool loadTgaFile(const QString &filePath, QImage &img, QSharedPointer<QByteArray> ba = QSharedPointer<QByteArray>()) const;
-    bool loadRawFile(const QString &filePath, QImage &img, QSharedPointer<QByteArray> ba = QSharedPointer<QByteArray>(), bool fast = false) const;
+    bool loadRawFile(const QString &filePath,
+                     QImage &img,
+                     QSharedPointer<QByteArray> ba = QSharedPointer<QByteArray>(),
+                     bool fast = false,
+                     const QSize &targetSize = QSize()) const;
     void indexPages(const QString &filePath, const QSharedPointer<QByteArray> ba = QSharedPointer<QByteArray>());
-    void convert32BitOrder(void *buffer, int width) const;
+    void prefetchPages(int pageIdx);
+    void updateRegionReader(const QImage &img);
+    bool decode(const DkImageDecoder &decoder, QImage &img, QSharedPointer<QByteArray> ba, bool fast, const QSize &targetSize);
+    bool loadBySuffix(QImage &img, QSharedPointer<QByteArray> ba, bool fast, const QSize &targetSize);
+    bool loadQtImage(const QByteArray &format, QImage &img, QSharedPointer<QByteArray> ba, const QSize &targetSize = QSize()) const;
 
     int mLoader;
     bool mTraining;
@@ -418,6 +577,10 @@ protected:
     QVector<DkEditImage> mImages;
     int mMinHistorySize = 2;
     int mImageIndex = 0;
+
+    QSharedPointer<DkTiffFile> mTiffFile; // open while we flip through the pages of a TIFF
+    std::function<QImage(const QRect &, int)> mRegionReader; // see regionReader()
+    qint64 mRegionReaderKey = 0; // cache key of the image that mRegionReader reads
 };
 
 namespace tga
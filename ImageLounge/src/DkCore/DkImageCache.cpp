@@ -0,0 +1,351 @@
+/*******************************************************************************************************
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2026 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2026 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2026 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ related links:
+ [1] https://nomacs.org/
+ [2] https://github.com/nomacs/
+ [3] http://download.nomacs.org
+ *******************************************************************************************************/
+
+
+#include "DkImageCache.h"
+#include "DkImageStorage.h"
+#include "DkMemoryGovernor.h"
+#include "DkSettings.h"
+#include "DkUtils.h"
+
+#pragma warning(push, 0) // no warnings from includes - begin
+#include <QDateTime>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QThread>
+#include <QThreadPool>
+#include <QVector>
+#include <algorithm>
+#pragma warning(pop) // no warnings from includes - end
+
+namespace nmc
+{
+
+// ms - we decode the image ourselves if another thread takes longer
+static const qint64 maxDecodeWait = 30000;
+
+/**
+ * Returns true if the current thread belongs to the global thread pool.
+ **/
+static bool isGlobalPoolThread()
+{
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+    return QThreadPool::globalInstance()->contains(QThread::currentThread());
+#else
+    return false; // Qt 5 cannot tell - so we do not lend the thread
+#endif
+}
+
+// DkImageCache::FinishGuard --------------------------------------------------------------------
+DkImageCache::FinishGuard::FinishGuard(const QString &key)
+    : mKey(key)
+{
+}
+
+DkImageCache::FinishGuard::~FinishGuard()
+{
+    DkImageCache::instance().finish(mKey, mEntry);
+}
+
+void DkImageCache::FinishGuard::setEntry(const Entry &entry)
+{
+    mEntry = entry;
+}
+
+// DkImageCache --------------------------------------------------------------------
+DkImageCache::DkImageCache()
+{
+    DkMemoryGovernor::instance().registerAllocation(
+        DkMemoryGovernor::priority_unused,
+        [this]() {
+            return memoryUsage();
+        },
+        [this](double memory) {
+            QMutexLocker locker(&mMutex);
+            evict(memory);
+        });
+}
+
+DkImageCache &DkImageCache::instance()
+{
+    static DkImageCache inst;
+    return inst;
+}
+
+/**
+ * Returns the cache key of an image.
+ * An empty key is returned for images that cannot be cached (e.g. downloads or zip archives).
+ * @param filePath the image's file path
+ * @param pageIdx the page of multi-page images
+ **/
+QString DkImageCache::key(const QString &filePath, int pageIdx)
+{
+    QFileInfo fileInfo(DkUtils::resolveSymLink(filePath));
+
+    if (!fileInfo.isFile())
+        return QString();
+
+    // the settings that change the decoded image
+    const auto &p = DkSettingsManager::param();
+
+    return QString("%1|%2|%3|%4|%5|%6")
+        .arg(fileInfo.absoluteFilePath())
+        .arg(fileInfo.lastModified().toMSecsSinceEpoch())
+        .arg(fileInfo.size())
+        .arg(pageIdx)
+        .arg(p.resources().loadRawThumb)
+        .arg(p.metaData().ignoreExifOrientation);
+}
+
+/**
+ * Returns the cached image of key.
+ * If another thread is decoding the image, we wait until it is done
+ * (but not longer than maxDecodeWait).
+ * If acquire_decode is returned, the caller has to decode the image and call finish() (see FinishGuard).
+ * If the other thread takes too long, acquire_decode_only is returned: the caller decodes
+ * the image too, but the key still belongs to the other thread.
+ * @param key the image's key (see key())
+ * @param entry the cached image
+ * @return AcquireState acquire_cached if the image is cached
+ **/
+DkImageCache::AcquireState DkImageCache::acquire(const QString &key, Entry &entry)
+{
+    if (key.isEmpty())
+        return acquire_decode_only;
+
+    QMutexLocker locker(&mMutex);
+
+    if (mDecoding.contains(key)) {
+        // another tab decodes this image - let the global pool start a thread for other tasks while we wait
+        bool lendThread = isGlobalPoolThread();
+
+        if (lendThread)
+            QThreadPool::globalInstance()->releaseThread();
+
+        QElapsedTimer dt;
+        dt.start();
+
+        while (mDecoding.contains(key) && dt.elapsed() < maxDecodeWait)
+            mDecoded.wait(&mMutex, (unsigned long)qMax(maxDecodeWait - dt.elapsed(), (qint64)1));
+
+        if (lendThread)
+            QThreadPool::globalInstance()->reserveThread();
+
+        if (mDecoding.contains(key)) {
+            qWarning() << "[DkImageCache] waited" << dt.elapsed() << "ms for" << key.section('|', 0, -6) << "- decoding it again";
+            mMisses++;
+            return acquire_decode_only;
+        }
+    }
+
+    auto it = mEntries.find(key);
+
+    if (it != mEntries.end()) {
+        it->lastAccess = ++mAccessCounter;
+        entry = *it;
+        mHits++;
+        return acquire_cached;
+    }
+
+    mDecoding.insert(key);
+    mMisses++;
+
+    return acquire_decode;
+}
+
+/**
+ * Adds the decoded image and wakes up threads that wait for it.
+ * Must be called after acquire() returned acquire_decode - even if the image could not be decoded.
+ * @param key the image's key
+ * @param entry the decoded image (a null image if decoding failed)
+ **/
+void DkImageCache::finish(const QString &key, const Entry &entry)
+{
+    if (key.isEmpty())
+        return;
+
+    {
+        QMutexLocker locker(&mMutex);
+        mDecoding.remove(key);
+
+        if (!entry.img.isNull()) {
+            Entry e = entry;
+            e.filePath = key.section('|', 0, -6);
+            e.lastAccess = ++mAccessCounter;
+            e.owner = 0;
+            mEntries.insert(key, e);
+        }
+
+        double maxMemory = DkSettingsManager::param().resources().cacheMemory;
+        double mem = unusedMemory();
+
+        if (mem > maxMemory)
+            evict(mem - maxMemory);
+
+        mDecoded.wakeAll();
+    }
+
+    DkMemoryGovernor::instance().requestUpdate();
+}
+
+/**
+ * Removes all images of a file (e.g. if it was saved).
+ **/
+void DkImageCache::invalidate(const QString &filePath)
+{
+    QString path = QFileInfo(DkUtils::resolveSymLink(filePath)).absoluteFilePath();
+
+    QMutexLocker locker(&mMutex);
+
+    for (auto it = mEntries.begin(); it != mEntries.end();) {
+        if (it->filePath == path)
+            it = mEntries.erase(it);
+        else
+            it++;
+    }
+}
+
+/**
+ * Returns true if user has to count img in its memory usage.
+ * An image that is shared by several tabs is counted by one of them (its owner) only.
+ * The first user that asks becomes the owner - until it releases the image.
+ * @param key the image's key (see key())
+ * @param img the user's image
+ * @param user the image container that uses img
+ **/
+bool DkImageCache::countImage(const QString &key, const QImage &img, const void *user)
+{
+    if (key.isEmpty())
+        return true;
+
+    QMutexLocker locker(&mMutex);
+
+    auto it = mEntries.find(key);
+
+    if (it == mEntries.end())
+        return true;
+
+    // the user edited its image - it is not shared anymore
+    if (it->img.cacheKey() != img.cacheKey()) {
+        if (it->owner == user)
+            it->owner = 0;
+
+        return true;
+    }
+
+    if (!it->owner)
+        it->owner = user;
+
+    return it->owner == user;
+}
+
+/**
+ * Another user counts the image from now on (see countImage()).
+ * Must be called if user drops the image or is deleted.
+ **/
+void DkImageCache::release(const QString &key, const void *user)
+{
+    if (key.isEmpty())
+        return;
+
+    QMutexLocker locker(&mMutex);
+
+    auto it = mEntries.find(key);
+
+    if (it != mEntries.end() && it->owner == user)
+        it->owner = 0;
+}
+
+/**
+ * Returns the memory (MB) of images that are not used by any tab.
+ * Images that are used share their memory with the tab.
+ **/
+double DkImageCache::memoryUsage() const
+{
+    QMutexLocker locker(&mMutex);
+    return unusedMemory();
+}
+
+/**
+ * Returns how often a decoded image was shared.
+ **/
+qint64 DkImageCache::hits() const
+{
+    return mHits;
+}
+
+qint64 DkImageCache::misses() const
+{
+    return mMisses;
+}
+
+double DkImageCache::unusedMemory() const
+{
+    double mem = 0;
+
+    for (const Entry &e : mEntries) {
+        if (e.img.isDetached())
+            mem += DkImage::getBufferSizeFloat(e.img.size(), e.img.depth());
+    }
+
+    return mem;
+}
+
+/**
+ * Removes the least recently used images that are not used by any tab.
+ * The mutex must be locked.
+ * @param memory the memory (MB) to free
+ **/
+void DkImageCache::evict(double memory)
+{
+    QVector<QPair<quint64, QString>> unused;
+
+    for (auto it = mEntries.constBegin(); it != mEntries.constEnd(); it++) {
+        if (it->img.isDetached())
+            unused << qMakePair(it->lastAccess, it.key());
+    }
+
+    std::sort(unused.begin(), unused.end());
+
+    double freed = 0;
+    int numEvicted = 0;
+
+    for (const auto &u : unused) {
+        if (freed >= memory)
+            break;
+
+        QImage img = mEntries.take(u.second).img;
+        freed += DkImage::getBufferSizeFloat(img.size(), img.depth());
+        numEvicted++;
+    }
+
+    qDebug() << "[DkImageCache]" << numEvicted << "images removed -" << qRound(freed) << "MB freed";
+}
+
+}
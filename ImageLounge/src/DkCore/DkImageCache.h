@@ -0,0 +1,136 @@
+/*******************************************************************************************************
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2026 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2026 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2026 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ related links:
+ [1] https://nomacs.org/
+ [2] https://github.com/nomacs/
+ [3] http://download.nomacs.org
+ *******************************************************************************************************/
+
+
+#pragma once
+
+#pragma warning(push, 0) // no warnings from includes - begin
+#include <QHash>
+#include <QImage>
+#include <QMutex>
+#include <QSet>
+#include <QString>
+#include <QWaitCondition>
+#pragma warning(pop) // no warnings from includes - end
+
+#ifndef DllCoreExport
+#ifdef DK_CORE_DLL_EXPORT
+#define DllCoreExport Q_DECL_EXPORT
+#elif DK_DLL_IMPORT
+#define DllCoreExport Q_DECL_IMPORT
+#else
+#define DllCoreExport Q_DECL_IMPORT
+#endif
+#endif
+
+namespace nmc
+{
+
+/**
+ * DkImageCache shares decoded images between all tabs.
+ * Images are keyed by their file path, modification date, size, page and
+ * the settings that change decoding (see key()). The images are implicitly
+ * shared - editing them detaches the editor's copy, so that edits
+ * are never shared. Only freshly decoded images are added.
+ * If an image is requested while another thread decodes it, acquire()
+ * waits for the decoder instead of decoding it twice.
+ * Images that are not used by any tab are kept within
+ * DkSettings::Resources::cacheMemory and registered with the DkMemoryGovernor.
+ * Images that are used by several tabs are counted by one of them (see countImage()).
+ * @threadsafe
+ **/
+class DllCoreExport DkImageCache
+{
+public:
+    enum AcquireState {
+        acquire_cached, // the image is cached
+        acquire_decode, // the caller decodes the image and must call finish()
+        acquire_decode_only, // the caller decodes the image but must not call finish() - another thread still decodes it
+    };
+
+    struct Entry {
+        QString filePath;
+        QImage img;
+        int numPages = 1;
+        int pageIdx = 1;
+        int loaderId = 0;
+        quint64 lastAccess = 0;
+        const void *owner = 0; // the user that counts the image's memory
+    };
+
+    /**
+     * Calls finish() when it goes out of scope - so that waiting threads
+     * are woken up even if decoding fails with an exception.
+     * A guard with an empty key does nothing.
+     **/
+    class DllCoreExport FinishGuard
+    {
+    public:
+        FinishGuard(const QString &key);
+        ~FinishGuard();
+
+        void setEntry(const Entry &entry);
+
+    private:
+        FinishGuard(const FinishGuard &);
+
+        QString mKey;
+        Entry mEntry;
+    };
+
+    static DkImageCache &instance();
+    static QString key(const QString &filePath, int pageIdx);
+
+    AcquireState acquire(const QString &key, Entry &entry);
+    void finish(const QString &key, const Entry &entry = Entry());
+    void invalidate(const QString &filePath);
+    bool countImage(const QString &key, const QImage &img, const void *user);
+    void release(const QString &key, const void *user);
+
+    double memoryUsage() const;
+    qint64 hits() const;
+    qint64 misses() const;
+
+private:
+    DkImageCache();
+    DkImageCache(const DkImageCache &);
+
+    double unusedMemory() const;
+    void evict(double memory);
+
+    mutable QMutex mMutex;
+    QWaitCondition mDecoded;
+    QHash<QString, Entry> mEntries;
+    QSet<QString> mDecoding; // keys that are currently decoded
+    quint64 mAccessCounter = 0;
+
+    qint64 mHits = 0;
+    qint64 mMisses = 0;
+};
+
+}
@@ -27,6 +27,7 @@
 
 #include "DkImageContainer.h"
 #include "DkBasicLoader.h"
+#include "DkImageCache.h"
 #include "DkImageStorage.h"
 #include "DkMetaData.h"
 #include "DkSettings.h"
@@ -35,11 +36,15 @@
 #include "DkUtils.h"
 
 #pragma warning(push, 0) // no warnings from includes - begin
+#include <QDateTime>
 #include <QImage>
 #include <QObject>
 #include <QRegularExpression>
 #include <QtConcurrentRun>
 
+#include <algorithm>
+#include <limits>
+
 // quazip
 #ifdef WITH_QUAZIP
 #ifdef WITH_QUAZIP1
@@ -58,6 +63,47 @@ namespace nmc
 QString DkZipContainer::mZipMarker = "dIrChAr";
 #endif
 
+// DkSortKey --------------------------------------------------------------------
+DkSortKey::DkSortKey(const QFileInfo &fileInfo, int sortMode, quint32 seed)
+{
+    auto msecs = [](const QDateTime &dt) {
+        return dt.isValid() ? dt.toMSecsSinceEpoch() : std::numeric_limits<qint64>::min();
+    };
+
+    mFileName = fileInfo.fileName();
+
+    switch ((DkSettings::sortMode)sortMode) {
+    case DkSettings::sort_date_created:
+        mValue = msecs(fileInfo.birthTime());
+        break;
+    case DkSettings::sort_date_modified:
+        mValue = msecs(fileInfo.lastModified());
+        break;
+    case DkSettings::sort_file_size:
+        mValue = fileInfo.size();
+        break;
+    case DkSettings::sort_random:
+        mValue = (qint64)DkUtils::randomSortKey(fileInfo.absoluteFilePath(), seed);
+        return; // no need for the name key
+    default:
+        break;
+    }
+
+    mName = DkNaturalSortKey(mFileName);
+}
+
+bool DkSortKey::operator<(const DkSortKey &o) const
+{
+    // avoid equality because we keep our directory position/index using the sorted position
+    if (mValue != o.mValue)
+        return mValue < o.mValue;
+    int c = mName.compare(o.mName);
+    if (c != 0)
+        return c < 0;
+
+    return mFileName < o.mFileName;
+}
+
 // DkImageContainer --------------------------------------------------------------------
 /**
  * Creates a DkImageContainer.
@@ -70,6 +116,23 @@ DkImageContainer::DkImageContainer(const QString &filePath)
     init();
 }
 
+/**
+ * Creates a DkImageContainer from a directory listing.
+ * The file info is shared with the listing, so the file is not queried again (e.g. for sorting).
+ * @param fileInfo the file's info
+ **/
+DkImageContainer::DkImageContainer(const QFileInfo &fileInfo)
+{
+    mFilePath = fileInfo.absoluteFilePath();
+    mFileInfo = fileInfo;
+
+#ifdef Q_OS_WIN
+    mFileNameStr = DkUtils::qStringToStdWString(fileName());
+#endif
+
+    init();
+}
+
 DkImageContainer::~DkImageContainer()
 {
 }
@@ -93,8 +156,7 @@ void DkImageContainer::clear()
 {
     if (mLoader)
         mLoader->release();
-    if (mFileBuffer)
-        mFileBuffer->clear();
+    mFileBuffer.reset(); // unmaps the file (if nobody else uses it)
     init();
 }
 
@@ -247,12 +309,33 @@ float DkImageContainer::getMemoryUsage() const
     if (!mLoader)
         return 0;
 
-    float memSize = mFileBuffer ? mFileBuffer->size() / (1024.0f * 1024.0f) : 0;
+    // mapped file buffers are not counted - the OS can drop their pages at any time
+    float memSize = DkFileBuffer::heapSize(mFileBuffer);
     memSize += DkImage::getBufferSizeFloat(mLoader->image().size(), mLoader->image().depth());
+    memSize += (float)mLoader->historyMemoryUsage();
 
     return memSize;
 }
 
+/**
+ * Returns the size (in MB) of the edit history (without the current image).
+ **/
+float DkImageContainer::getHistoryMemoryUsage() const
+{
+    if (!mLoader)
+        return 0;
+
+    return (float)mLoader->historyMemoryUsage();
+}
+
+/**
+ * Returns the size (in MB) of the memory mapped file buffer.
+ **/
+float DkImageContainer::getMappedMemoryUsage() const
+{
+    return DkFileBuffer::mappedSize(mFileBuffer);
+}
+
 float DkImageContainer::getFileSize() const
 {
     return QFileInfo(mFilePath).size() / (1024.0f * 1024.0f);
@@ -272,35 +355,17 @@ DkRotatingRect DkImageContainer::cropRect()
 
 std::function<bool(const QSharedPointer<DkImageContainer> &, const QSharedPointer<DkImageContainer> &)> DkImageContainer::compareFunc()
 {
-    // select from the assortment of QFileInfo functions; if there isn't one use this one
-    // future: exif, custom sorting, etc can all be tied in here, need not be QFileInfo
-    std::function<bool(const QFileInfo &, const QFileInfo &FileInfo)> cmp;
-
+    // future: exif, custom sorting, etc can all be tied in here (see DkSortKey)
     int mode = DkSettingsManager::param().global().sortMode;
+    quint32 seed = DkSettingsManager::param().global().sortSeed;
 
-    switch ((DkSettings::sortMode)mode) {
-    case DkSettings::sort_filename:
-        cmp = &DkUtils::compFilename;
-        break;
-    case DkSettings::sort_date_created:
-        cmp = &DkUtils::compDateCreated;
-        break;
-    case DkSettings::sort_file_size:
-        cmp = &DkUtils::compFileSize;
-        break;
-    case DkSettings::sort_date_modified:
-        cmp = &DkUtils::compDateModified;
-        break;
-    case DkSettings::sort_random:
-        cmp = &DkUtils::compRandom;
-        break;
-    default:
+    if (mode < 0 || mode >= DkSettings::sort_end) {
         qWarning() << "[compareFunc] bogus sort mode ignored" << mode;
-        cmp = &DkUtils::compFilename;
+        mode = DkSettings::sort_filename;
     }
 
-    return [cmp](const QSharedPointer<DkImageContainer> &lhs, const QSharedPointer<DkImageContainer> &rhs) {
-        return cmp(lhs->fileInfo(), rhs->fileInfo());
+    return [mode, seed](const QSharedPointer<DkImageContainer> &lhs, const QSharedPointer<DkImageContainer> &rhs) {
+        return DkSortKey(lhs->fileInfo(), mode, seed) < DkSortKey(rhs->fileInfo(), mode, seed);
     };
 }
 
@@ -457,13 +522,7 @@ QSharedPointer<QByteArray> DkImageContainer::loadFileToBuffer(const QString &fil
         return QSharedPointer<QByteArray>(new QByteArray());
     }
 
-    QFile file(fInfo.absoluteFilePath());
-    file.open(QIODevice::ReadOnly);
-
-    QSharedPointer<QByteArray> ba(new QByteArray(file.readAll()));
-    file.close();
-
-    return ba;
+    return DkFileBuffer::load(fInfo.absoluteFilePath());
 }
 
 QSharedPointer<DkBasicLoader>
@@ -543,19 +602,30 @@ std::wstring DkImageContainer::getFileNameWStr() const
 DkImageContainerT::DkImageContainerT(const QString &filePath)
     : DkImageContainer(filePath)
 {
-    // our file watcher
-    mFileUpdateTimer.setSingleShot(false);
-    mFileUpdateTimer.setInterval(500);
+}
 
-    connect(&mFileUpdateTimer, &QTimer::timeout, this, &DkImageContainerT::checkForFileUpdates, Qt::UniqueConnection);
+DkImageContainerT::DkImageContainerT(const QFileInfo &fileInfo)
+    : DkImageContainer(fileInfo)
+{
 }
 
 DkImageContainerT::~DkImageContainerT()
 {
-    mBufferWatcher.blockSignals(true);
-    mBufferWatcher.cancel();
-    mImageWatcher.blockSignals(true);
-    mImageWatcher.cancel();
+    DkImageCache::instance().release(mCacheKey, this);
+
+    if (mMemoryId != -1) {
+        DkMemoryGovernor::instance().unregisterAllocation(mMemoryId);
+        DkMemoryGovernor::instance().unregisterAllocation(mHistoryMemoryId);
+    }
+
+    if (!mTasks)
+        return;
+
+    mTasks->bufferWatcher.blockSignals(true);
+    mTasks->bufferWatcher.cancel();
+    mTasks->imageWatcher.blockSignals(true);
+    mTasks->imageWatcher.cancel();
+    mTasks->previewWatcher.blockSignals(true);
 
     // This dtor is where saveMetaData() used to be called, which called the "dangerous" overload of saveMetaData(),
     // which is dangerous because it updates the file. We consider this to be a bug.
@@ -564,8 +634,23 @@ DkImageContainerT::~DkImageContainerT()
     // See issue #799. [2022, PSE]
 
     // we have to wait here
-    mSaveMetaDataWatcher.blockSignals(true);
-    mSaveImageWatcher.blockSignals(true);
+    mTasks->saveMetaDataWatcher.blockSignals(true);
+    mTasks->saveImageWatcher.blockSignals(true);
+}
+
+DkImageContainerT::Tasks &DkImageContainerT::tasks()
+{
+    if (!mTasks) {
+        mTasks.reset(new Tasks());
+
+        // our file watcher
+        mTasks->fileUpdateTimer.setSingleShot(false);
+        mTasks->fileUpdateTimer.setInterval(500);
+
+        connect(&mTasks->fileUpdateTimer, &QTimer::timeout, this, &DkImageContainerT::checkForFileUpdates, Qt::UniqueConnection);
+    }
+
+    return *mTasks;
 }
 
 void DkImageContainerT::clear()
@@ -576,6 +661,10 @@ void DkImageContainerT::clear()
         return;
 
     DkImageContainer::clear();
+
+    // another tab counts the shared image now
+    DkImageCache::instance().release(mCacheKey, this);
+    mCacheKey.clear();
 }
 
 void DkImageContainerT::checkForFileUpdates()
@@ -604,7 +693,7 @@ void DkImageContainerT::checkForFileUpdates()
 #endif
 
     if (changed) {
-        mFileUpdateTimer.stop();
+        tasks().fileUpdateTimer.stop();
         if (DkSettingsManager::param().global().askToSaveDeletedFiles) {
             mEdited = changed;
             emit fileLoadedSignal(true);
@@ -628,7 +717,15 @@ void DkImageContainerT::checkForFileUpdates()
     }
 }
 
-bool DkImageContainerT::loadImageThreaded(bool force)
+/**
+ * Loads the image in a background thread.
+ * fileLoadedSignal is emitted when the image is loaded.
+ * @param force if true, the image is reloaded
+ * @param loadPreview if true, previewLoadedSignal is emitted as soon as a preview
+ *   of large images is available (see DkBasicLoader::loadPreview)
+ * @return bool false if the file does not exist
+ **/
+bool DkImageContainerT::loadImageThreaded(bool force, bool loadPreview)
 {
 #ifdef WITH_QUAZIP
     // zip archives: get zip file fileInfo for checks
@@ -641,10 +738,15 @@ bool DkImageContainerT::loadImageThreaded(bool force)
     QDateTime modifiedBefore = fileInfo.lastModified();
     fileInfo.refresh();
 
-    if (force || fileInfo.lastModified() != modifiedBefore || getLoader()->isDirty()) {
+    if (force || fileInfo.lastModified() != modifiedBefore) {
         qDebug() << "updating image...";
         getThumb()->setImage(QImage());
         clear();
+    } else if (getLoader()->isDirty() && !mFetchingImage && !mFetchingBuffer) {
+        // another page: keep the file buffer and the open TIFF
+        getThumb()->setImage(QImage());
+        getLoader()->release(true);
+        init();
     }
 
     // null file?
@@ -667,6 +769,7 @@ bool DkImageContainerT::loadImageThreaded(bool force)
 #endif
 
     mLoadState = loading;
+    mLoadPreview = loadPreview;
     fetchFile();
     return true;
 }
@@ -678,7 +781,7 @@ void DkImageContainerT::fetchFile()
         return;
     }
     if (mFetchingImage)
-        mImageWatcher.waitForFinished();
+        tasks().imageWatcher.waitForFinished();
     // I think we missed to return here
     if (mFetchingBuffer)
         return;
@@ -690,8 +793,8 @@ void DkImageContainerT::fetchFile()
     }
 
     mFetchingBuffer = true; // saves the threaded call
-    connect(&mBufferWatcher, &QFutureWatcher<QSharedPointer<QByteArray>>::finished, this, &DkImageContainerT::bufferLoaded, Qt::UniqueConnection);
-    mBufferWatcher.setFuture(QtConcurrent::run([&] {
+    connect(&tasks().bufferWatcher, &QFutureWatcher<QSharedPointer<QByteArray>>::finished, this, &DkImageContainerT::bufferLoaded, Qt::UniqueConnection);
+    tasks().bufferWatcher.setFuture(QtConcurrent::run([&] {
         return loadFileToBuffer(filePath());
     }));
 }
@@ -700,8 +803,10 @@ void DkImageContainerT::bufferLoaded()
 {
     mFetchingBuffer = false;
 
-    if (!mBufferWatcher.isCanceled())
-        mFileBuffer = mBufferWatcher.result();
+    if (!tasks().bufferWatcher.isCanceled()) {
+        mFileBuffer = tasks().bufferWatcher.result();
+        registerMemory();
+    }
 
     if (getLoadState() == loading)
         fetchImage();
@@ -715,7 +820,7 @@ void DkImageContainerT::bufferLoaded()
 void DkImageContainerT::fetchImage()
 {
     if (mFetchingBuffer)
-        mBufferWatcher.waitForFinished();
+        tasks().bufferWatcher.waitForFinished();
 
     if (mFetchingImage) {
         mLoadState = loading;
@@ -730,16 +835,178 @@ void DkImageContainerT::fetchImage()
     qInfoClean() << "loading " << filePath();
     mFetchingImage = true;
 
-    connect(&mImageWatcher, &QFutureWatcher<QSharedPointer<DkBasicLoader>>::finished, this, &DkImageContainerT::imageLoaded, Qt::UniqueConnection);
+    if (mLoadPreview)
+        fetchPreview();
+
+    connect(&tasks().imageWatcher, &QFutureWatcher<QSharedPointer<DkBasicLoader>>::finished, this, &DkImageContainerT::imageLoaded, Qt::UniqueConnection);
 
-    mImageWatcher.setFuture(QtConcurrent::run([&] {
+    tasks().decodeTimer.start();
+    tasks().imageWatcher.setFuture(QtConcurrent::run([&] {
         return loadImageIntern(filePath(), mLoader, mFileBuffer);
     }));
 }
 
+void DkImageContainerT::fetchPreview()
+{
+    mLoadPreview = false;
+
+    if (tasks().previewWatcher.isRunning())
+        return;
+
+    connect(&tasks().previewWatcher, &QFutureWatcher<QPair<QImage, QSize>>::finished, this, &DkImageContainerT::previewLoaded, Qt::UniqueConnection);
+
+    QString fp = filePath();
+    QSharedPointer<QByteArray> ba = mFileBuffer;
+
+    tasks().previewWatcher.setFuture(QtConcurrent::run([fp, ba] {
+        QSize imgSize;
+        QImage preview = DkBasicLoader::loadPreview(fp, ba, imgSize);
+        return qMakePair(preview, imgSize);
+    }));
+}
+
+void DkImageContainerT::previewLoaded()
+{
+    // the image was decoded faster
+    if (getLoadState() != loading || !mFetchingImage)
+        return;
+
+    QPair<QImage, QSize> preview = tasks().previewWatcher.result();
+
+    if (preview.first.isNull())
+        return;
+
+    mPreview = preview.first;
+    mPreviewImgSize = preview.second;
+
+    emit previewLoadedSignal();
+}
+
+QImage DkImageContainerT::previewImage() const
+{
+    return mPreview;
+}
+
+QSize DkImageContainerT::previewImageSize() const
+{
+    return mPreviewImgSize;
+}
+
+/**
+ * Returns how long (ms) it took to decode the image.
+ * -1 is returned if the image was not decoded since the last call.
+ **/
+int DkImageContainerT::takeDecodeTime()
+{
+    int ms = mDecodeTime;
+    mDecodeTime = -1;
+    return ms;
+}
+
+/**
+ * Sets the priority of the image's memory.
+ * Images that are shown should have DkMemoryGovernor::priority_current
+ * so that they are never released.
+ **/
+void DkImageContainerT::setMemoryPriority(DkMemoryGovernor::Priority priority)
+{
+    mMemoryPriority = priority;
+
+    if (mMemoryId != -1)
+        DkMemoryGovernor::instance().setPriority(mMemoryId, priority);
+}
+
+/**
+ * Returns true if the container holds nothing that would be lost if it is deleted.
+ * Idle containers of a folder are released (see DkImageList::release).
+ **/
+bool DkImageContainerT::isIdle() const
+{
+    if (mLoadState != not_loaded || mFetchingImage || mFetchingBuffer || mEdited || mSelected || mFileDownloader)
+        return false;
+
+    if (hasImage() || (mFileBuffer && !mFileBuffer->isEmpty()))
+        return false;
+
+    if (mTasks && (mTasks->previewWatcher.isRunning() || mTasks->saveImageWatcher.isRunning() || mTasks->saveMetaDataWatcher.isRunning()))
+        return false;
+
+    // keep loaded thumbnails (and the ones that do not exist, so that they are not loaded again)
+    return !mThumb || mThumb->hasImage() == DkThumbNail::not_loaded;
+}
+
+/**
+ * Returns the memory (MB) of the image, its file buffer and its edit history.
+ * While the image is decoded, only the file buffer is counted
+ * since the decoding thread writes the image and the history.
+ * Images that are shared with other tabs are counted by one of them (see DkImageCache::countImage).
+ **/
+float DkImageContainerT::getMemoryUsage() const
+{
+    if (mFetchingImage)
+        return DkFileBuffer::heapSize(mFileBuffer);
+
+    float mem = DkImageContainer::getMemoryUsage();
+
+    if (mLoader && !mCacheKey.isEmpty()) {
+        QImage img = mLoader->image();
+
+        if (!DkImageCache::instance().countImage(mCacheKey, img, this))
+            mem -= DkImage::getBufferSizeFloat(img.size(), img.depth());
+    }
+
+    return mem;
+}
+
+float DkImageContainerT::getHistoryMemoryUsage() const
+{
+    if (mFetchingImage)
+        return 0;
+
+    return DkImageContainer::getHistoryMemoryUsage();
+}
+
+/**
+ * Registers the decoded image, the file buffer and the edit history with the DkMemoryGovernor.
+ * The edit history is counted but never released.
+ **/
+void DkImageContainerT::registerMemory()
+{
+    DkMemoryGovernor &mg = DkMemoryGovernor::instance();
+
+    if (mMemoryId != -1) {
+        mg.touch(mMemoryId);
+        mg.requestUpdate();
+        return;
+    }
+
+    mMemoryId = mg.registerAllocation(
+        mMemoryPriority,
+        [this]() {
+            return (double)(getMemoryUsage() - getHistoryMemoryUsage());
+        },
+        [this](double) {
+            // never drop edits
+            if (isEdited() || mFetchingImage || mFetchingBuffer || getLoadState() == loading)
+                return;
+
+            qDebug() << "[DkMemoryGovernor]" << fileName() << "released";
+            clear();
+        });
+
+    // dropping undo steps is the user's decision - not ours
+    mHistoryMemoryId = mg.registerAllocation(
+        DkMemoryGovernor::priority_history,
+        [this]() {
+            return (double)getHistoryMemoryUsage();
+        },
+        DkMemoryGovernor::ReleaseFunction());
+}
+
 void DkImageContainerT::imageLoaded()
 {
     mFetchingImage = false;
+    mPreview = QImage();
 
     if (getLoadState() == loading_canceled) {
         mLoadState = not_loaded;
@@ -748,7 +1015,11 @@ void DkImageContainerT::imageLoaded()
     }
 
     // deliver image
-    mLoader = mImageWatcher.result();
+    mLoader = tasks().imageWatcher.result();
+
+    // shared images say nothing about the decoding time
+    if (mLoader && mLoader->hasImage() && !mCachedDecode)
+        mDecodeTime = (int)tasks().decodeTimer.elapsed();
 
     loadingFinished();
 }
@@ -777,7 +1048,7 @@ void DkImageContainerT::loadingFinished()
     }
 
     if (!getLoader()->hasImage()) {
-        mFileUpdateTimer.stop();
+        tasks().fileUpdateTimer.stop();
         mEdited = false;
         QString msg = tr("Sorry, I could not load: %1").arg(fileName());
         emit showInfoSignal(msg);
@@ -790,7 +1061,7 @@ void DkImageContainerT::loadingFinished()
 
     // clear file buffer if it exceeds a certain size?! e.g. psd files
     if (mFileBuffer) {
-        double bs = mFileBuffer->size() / (1024.0f * 1024.0f);
+        double bs = DkFileBuffer::heapSize(mFileBuffer);
 
         // if the file buffer is more than 5MB - we check if we need to delete it
         if (bs > 5 && bs > DkSettingsManager::param().resources().cacheMemory * 0.5f)
@@ -798,6 +1069,7 @@ void DkImageContainerT::loadingFinished()
     }
 
     mLoadState = loaded;
+    registerMemory();
     emit fileLoadedSignal(true);
 }
 
@@ -859,9 +1131,9 @@ void DkImageContainerT::receiveUpdates(bool connectSignals)
 {
     // !selected - do not connect twice
     if (connectSignals && !mSelected) {
-        mFileUpdateTimer.start();
+        tasks().fileUpdateTimer.start();
     } else if (!connectSignals) {
-        mFileUpdateTimer.stop();
+        tasks().fileUpdateTimer.stop();
     }
 
     mSelected = connectSignals;
@@ -872,7 +1144,7 @@ void DkImageContainerT::saveMetaDataThreaded(const QString &filePath)
     if (!exists() || (getLoader()->getMetaData() && !getLoader()->getMetaData()->isDirty()))
         return;
 
-    mFileUpdateTimer.stop();
+    tasks().fileUpdateTimer.stop();
     QFuture<void> future = QtConcurrent::run([&, filePath] {
         return saveMetaDataIntern(filePath, getLoader(), getFileBuffer());
     });
@@ -890,7 +1162,7 @@ bool DkImageContainerT::saveImageThreaded(const QString &filePath, int compressi
 
 bool DkImageContainerT::saveImageThreaded(const QString &filePath, const QImage saveImg, int compression /* = -1 */)
 {
-    mSaveImageWatcher.waitForFinished();
+    tasks().saveImageWatcher.waitForFinished();
 
     QFileInfo fInfo = QFileInfo(filePath);
 
@@ -912,10 +1184,10 @@ bool DkImageContainerT::saveImageThreaded(const QString &filePath, const QImage
 
     qDebug() << "attempting to save: " << filePath;
 
-    mFileUpdateTimer.stop();
-    connect(&mSaveImageWatcher, &QFutureWatcher<QString>::finished, this, &DkImageContainerT::savingFinished, Qt::UniqueConnection);
+    tasks().fileUpdateTimer.stop();
+    connect(&tasks().saveImageWatcher, &QFutureWatcher<QString>::finished, this, &DkImageContainerT::savingFinished, Qt::UniqueConnection);
 
-    mSaveImageWatcher.setFuture(QtConcurrent::run([&, filePath, saveImg, compression] {
+    tasks().saveImageWatcher.setFuture(QtConcurrent::run([&, filePath, saveImg, compression] {
         return saveImageIntern(filePath, mLoader, saveImg, compression);
     }));
 
@@ -924,7 +1196,7 @@ bool DkImageContainerT::saveImageThreaded(const QString &filePath, const QImage
 
 void DkImageContainerT::savingFinished()
 {
-    QString savePath = mSaveImageWatcher.result();
+    QString savePath = tasks().saveImageWatcher.result();
 
     QFileInfo sInfo = QFileInfo(savePath);
     sInfo.refresh();
@@ -936,8 +1208,7 @@ void DkImageContainerT::savingFinished()
         //// reset thumb - loadImageThreaded should do it anyway
         // thumb = QSharedPointer<DkThumbNailT>(new DkThumbNailT(saveFile, loader->image()));
 
-        if (mFileBuffer)
-            mFileBuffer->clear(); // do a complete clear?
+        mFileBuffer.reset(); // the old file might still be mapped
 
         if (DkSettingsManager::param().resources().loadSavedImage == DkSettings::ls_load || filePath().isEmpty() || dirPath() == sInfo.absolutePath()) {
             setFilePath(savePath);
@@ -951,7 +1222,7 @@ void DkImageContainerT::savingFinished()
         mDownloaded = false;
         if (mSelected) {
             loadImageThreaded(true); // force a reload
-            mFileUpdateTimer.start();
+            tasks().fileUpdateTimer.start();
         }
     }
 }
@@ -961,19 +1232,56 @@ QSharedPointer<QByteArray> DkImageContainerT::loadFileToBuffer(const QString &fi
     return DkImageContainer::loadFileToBuffer(filePath);
 }
 
+/**
+ * Loads the image - images that were decoded by another tab are shared (see DkImageCache).
+ * This function is called from a worker thread.
+ **/
 QSharedPointer<DkBasicLoader>
 DkImageContainerT::loadImageIntern(const QString &filePath, QSharedPointer<DkBasicLoader> loader, const QSharedPointer<QByteArray> fileBuffer)
 {
-    return DkImageContainer::loadImageIntern(filePath, loader, fileBuffer);
+    DkImageCache &cache = DkImageCache::instance();
+    QString key = DkImageCache::key(filePath, loader->isDirty() ? loader->getPageIdx() : 1);
+
+    // the image of the old key is dropped
+    if (mCacheKey != key) {
+        cache.release(mCacheKey, this);
+        mCacheKey = key;
+    }
+
+    DkImageCache::Entry entry;
+    DkImageCache::AcquireState state = cache.acquire(key, entry);
+    mCachedDecode = state == DkImageCache::acquire_cached;
+
+    if (mCachedDecode) {
+        loader->loadCached(filePath, fileBuffer, entry.img, entry.numPages, entry.pageIdx, entry.loaderId);
+        return loader;
+    }
+
+    // wakes up tabs that wait for this image - unless another thread still decodes it
+    DkImageCache::FinishGuard guard(state == DkImageCache::acquire_decode ? key : QString());
+
+    DkImageContainer::loadImageIntern(filePath, loader, fileBuffer);
+
+    if (loader->hasImage()) {
+        entry.img = loader->image();
+        entry.numPages = loader->getNumPages();
+        entry.pageIdx = loader->getPageIdx();
+        entry.loaderId = loader->getLoader();
+        guard.setEntry(entry);
+    }
+
+    return loader;
 }
 
 QString DkImageContainerT::saveImageIntern(const QString &filePath, QSharedPointer<DkBasicLoader> loader, QImage saveImg, int compression)
 {
+    DkImageCache::instance().invalidate(filePath);
     return DkImageContainer::saveImageIntern(filePath, loader, saveImg, compression);
 }
 
 void DkImageContainerT::saveMetaDataIntern(const QString &filePath, QSharedPointer<DkBasicLoader> loader, QSharedPointer<QByteArray> fileBuffer)
 {
+    DkImageCache::instance().invalidate(filePath);
     return DkImageContainer::saveMetaDataIntern(filePath, loader, fileBuffer);
 }
 
@@ -1020,4 +1328,168 @@ void DkImageContainerT::setHistoryIndex(int idx)
     emit imageUpdatedSignal();
 }
 
+// DkImageList --------------------------------------------------------------------
+DkImageList::DkImageList()
+    : d(new Data())
+{
+}
+
+DkImageList::DkImageList(const QVector<QSharedPointer<DkImageContainerT>> &images)
+    : d(new Data())
+{
+    reserve(images.size());
+
+    for (const auto &img : images)
+        append(img);
+}
+
+int DkImageList::size() const
+{
+    return d->entries.size();
+}
+
+bool DkImageList::isEmpty() const
+{
+    return d->entries.isEmpty();
+}
+
+bool DkImageList::empty() const
+{
+    return isEmpty();
+}
+
+/**
+ * Returns the container of the file at idx - it is created if needed.
+ **/
+QSharedPointer<DkImageContainerT> DkImageList::at(int idx) const
+{
+    const Entry &e = d->entries.at(idx);
+
+    if (!e.image)
+        e.image = QSharedPointer<DkImageContainerT>(new DkImageContainerT(e.filePath));
+
+    return e.image;
+}
+
+QSharedPointer<DkImageContainerT> DkImageList::operator[](int idx) const
+{
+    return at(idx);
+}
+
+/**
+ * Returns the container of the file at idx or a null pointer if it was not created yet.
+ **/
+QSharedPointer<DkImageContainerT> DkImageList::created(int idx) const
+{
+    return d->entries.at(idx).image;
+}
+
+/**
+ * Returns the file path at idx.
+ * The path of a container might change (e.g. if it is saved) - so its path is returned if it was created.
+ **/
+QString DkImageList::filePath(int idx) const
+{
+    const Entry &e = d->entries.at(idx);
+    return e.image ? e.image->filePath() : e.filePath;
+}
+
+/**
+ * Returns the number of containers that were created.
+ **/
+int DkImageList::numCreated() const
+{
+    int num = 0;
+
+    for (const Entry &e : qAsConst(d->entries)) {
+        if (e.image)
+            num++;
+    }
+
+    return num;
+}
+
+void DkImageList::append(const QString &filePath)
+{
+    d.detach();
+
+    Entry e;
+    e.filePath = filePath;
+    d->entries << e;
+}
+
+void DkImageList::append(const QSharedPointer<DkImageContainerT> &image)
+{
+    if (!image)
+        return;
+
+    d.detach();
+
+    Entry e;
+    e.filePath = image->filePath();
+    e.image = image;
+    d->entries << e;
+}
+
+DkImageList &DkImageList::operator<<(const QSharedPointer<DkImageContainerT> &image)
+{
+    append(image);
+    return *this;
+}
+
+void DkImageList::removeAt(int idx)
+{
+    d.detach();
+    d->entries.removeAt(idx);
+}
+
+void DkImageList::reserve(int size)
+{
+    d.detach();
+    d->entries.reserve(size);
+}
+
+void DkImageList::clear()
+{
+    d = new Data();
+}
+
+void DkImageList::reverse()
+{
+    d.detach();
+    std::reverse(d->entries.begin(), d->entries.end());
+}
+
+/**
+ * Returns a list with the entries order[0], order[1], ...
+ **/
+DkImageList DkImageList::reordered(const QVector<int> &order) const
+{
+    DkImageList list;
+    list.d->entries.reserve(order.size());
+
+    for (int idx : order)
+        list.d->entries << d->entries.at(idx);
+
+    return list;
+}
+
+/**
+ * Deletes the container of the file at idx if it is idle.
+ * The file stays in the list - its container is created again when it is accessed.
+ * @return true if the container was released
+ **/
+bool DkImageList::release(int idx)
+{
+    const Entry &e = d->entries.at(idx);
+
+    if (!e.image || !e.image->isIdle())
+        return false;
+
+    // other copies drop it too, so that there is only one container per file
+    e.image.reset();
+
+    return true;
+}
+
 }
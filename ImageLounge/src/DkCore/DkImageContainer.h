@@ -28,7 +28,11 @@
 #pragma once
 
 #pragma warning(push, 0) // no warnings from includes - begin
+#include <QElapsedTimer>
 #include <QFutureWatcher>
+#include <QPair>
+#include <QScopedPointer>
+#include <QSharedData>
 #include <QSharedPointer>
 #include <QTimer>
 #pragma warning(pop) // no warnings from includes - end
@@ -45,7 +49,9 @@
 #endif
 #endif
 
+#include "DkMemoryGovernor.h"
 #include "DkThumbs.h"
+#include "DkUtils.h"
 
 namespace nmc
 {
@@ -56,6 +62,30 @@ class DkZipContainer;
 class FileDownloader;
 class DkRotatingRect;
 
+/**
+ * DkSortKey holds everything needed to compare two files in a given sort mode.
+ * It is computed once per file, so that sorting neither calls stat()
+ * nor hashes or parses file names for every comparison.
+ **/
+class DllCoreExport DkSortKey
+{
+public:
+    DkSortKey(const QFileInfo &fileInfo = QFileInfo(), int sortMode = 0, quint32 seed = 0);
+
+    bool operator<(const DkSortKey &o) const;
+
+protected:
+    qint64 mValue = 0; // date, size or random hash (depending on the sort mode)
+    DkNaturalSortKey mName; // natural collation key of the file name
+    QString mFileName;
+};
+
+/**
+ * DkImageContainer manages a file and its decoded image.
+ * Its loader, thumbnail and file buffer (and the tasks of DkImageContainerT)
+ * are created on demand. The files of a folder are not containers
+ * until they are needed (see DkImageList).
+ **/
 class DllCoreExport DkImageContainer
 {
 public:
@@ -68,6 +98,7 @@ public:
     };
 
     DkImageContainer(const QString &filePath);
+    DkImageContainer(const QFileInfo &fileInfo);
     virtual ~DkImageContainer();
     bool operator==(const DkImageContainer &ric) const;
 
@@ -89,7 +120,9 @@ public:
     bool isSelected() const;
     void setEdited(bool edited = true);
     QString getTitleAttribute() const;
-    float getMemoryUsage() const;
+    virtual float getMemoryUsage() const;
+    virtual float getHistoryMemoryUsage() const;
+    float getMappedMemoryUsage() const;
     float getFileSize() const;
 
     virtual QSharedPointer<DkBasicLoader> getLoader();
@@ -125,6 +158,7 @@ public:
 
     /**
      * Get a less-than function based on the global sort mode, suitable for std::sort et al
+     * @note it computes DkSortKeys for every comparison - use DkSortKey directly to sort many images
      * @note does not incorporate the ascending/descending mode (always ascending),
      *       to sort descending, reverse the array after sorting.
      */
@@ -166,6 +200,7 @@ class DllCoreExport DkImageContainerT : public QObject, public DkImageContainer
 
 public:
     DkImageContainerT(const QString &filePath);
+    DkImageContainerT(const QFileInfo &fileInfo);
     virtual ~DkImageContainerT();
 
     void fetchFile();
@@ -174,15 +209,23 @@ public:
     void receiveUpdates(bool connectSignals);
     void downloadFile(const QUrl &url);
 
-    bool loadImageThreaded(bool force = false);
+    bool loadImageThreaded(bool force = false, bool loadPreview = false);
     bool saveImageThreaded(const QString &filePath, const QImage saveImg, int compression = -1);
     bool saveImageThreaded(const QString &filePath, int compression = -1);
     void saveMetaDataThreaded(const QString &filePath);
     void saveMetaDataThreaded();
     bool isFileDownloaded() const;
 
+    QImage previewImage() const;
+    QSize previewImageSize() const;
+    int takeDecodeTime();
+    void setMemoryPriority(DkMemoryGovernor::Priority priority);
+    bool isIdle() const;
+
     virtual QSharedPointer<DkBasicLoader> getLoader() override;
     virtual QSharedPointer<DkThumbNailT> getThumb() override;
+    virtual float getMemoryUsage() const override;
+    virtual float getHistoryMemoryUsage() const override;
     static QSharedPointer<DkImageContainerT> fromImageContainer(QSharedPointer<DkImageContainer> imgC);
 
     virtual void undo() override;
@@ -196,6 +239,7 @@ signals:
     void errorDialogSignal(const QString &msg) const;
     void thumbLoadedSignal(bool loaded = true) const;
     void imageUpdatedSignal() const;
+    void previewLoadedSignal() const;
 
 public slots:
     void checkForFileUpdates();
@@ -203,22 +247,37 @@ public slots:
 protected slots:
     void bufferLoaded();
     void imageLoaded();
+    void previewLoaded();
     void savingFinished();
     void loadingFinished();
     void fileDownloaded(const QString &filePath);
 
 protected:
     void fetchImage();
+    void fetchPreview();
+    void registerMemory();
 
     QSharedPointer<QByteArray> loadFileToBuffer(const QString &filePath);
     QSharedPointer<DkBasicLoader> loadImageIntern(const QString &filePath, QSharedPointer<DkBasicLoader> loader, const QSharedPointer<QByteArray> fileBuffer);
     QString saveImageIntern(const QString &filePath, QSharedPointer<DkBasicLoader> loader, QImage saveImg, int compression);
     void saveMetaDataIntern(const QString &filePath, QSharedPointer<DkBasicLoader> loader, QSharedPointer<QByteArray> fileBuffer);
 
-    QFutureWatcher<QSharedPointer<QByteArray>> mBufferWatcher;
-    QFutureWatcher<QSharedPointer<DkBasicLoader>> mImageWatcher;
-    QFutureWatcher<QString> mSaveImageWatcher;
-    QFutureWatcher<bool> mSaveMetaDataWatcher;
+    /**
+     * The watchers and the file update timer are created when the container is loaded or saved.
+     * Most containers of a folder never are, so they stay small.
+     **/
+    struct Tasks {
+        QFutureWatcher<QSharedPointer<QByteArray>> bufferWatcher;
+        QFutureWatcher<QSharedPointer<DkBasicLoader>> imageWatcher;
+        QFutureWatcher<QPair<QImage, QSize>> previewWatcher;
+        QFutureWatcher<QString> saveImageWatcher;
+        QFutureWatcher<bool> saveMetaDataWatcher;
+        QTimer fileUpdateTimer;
+        QElapsedTimer decodeTimer;
+    };
+
+    QScopedPointer<Tasks> mTasks;
+    Tasks &tasks();
 
     QSharedPointer<FileDownloader> mFileDownloader;
 
@@ -235,8 +294,65 @@ protected:
     bool mFetchingImage = false;
     bool mFetchingBuffer = false;
     bool mDownloaded = false;
+    bool mLoadPreview = false;
+
+    QImage mPreview; // shown until the image is decoded
+    QSize mPreviewImgSize; // size of the full image
+    int mDecodeTime = -1; // ms of the last decoding (-1 if it was taken already)
+    bool mCachedDecode = false; // true if the image was shared by another tab (see DkImageCache)
+    QString mCacheKey; // DkImageCache key of the decoded image
+
+    // see DkMemoryGovernor
+    int mMemoryId = -1; // decoded image & file buffer
+    int mHistoryMemoryId = -1;
+    DkMemoryGovernor::Priority mMemoryPriority = DkMemoryGovernor::priority_cached;
+};
+
+/**
+ * DkImageList holds the files of a folder.
+ * A file is a small entry (its path) - its DkImageContainerT is created
+ * when it is accessed for the first time and it is shared by all copies of the list.
+ * Views should use filePath() if they do not need the container.
+ * Modifying a list does not change its copies (but the containers are shared).
+ * Containers are created in the GUI thread only.
+ **/
+class DllCoreExport DkImageList
+{
+public:
+    DkImageList();
+    DkImageList(const QVector<QSharedPointer<DkImageContainerT>> &images);
+
+    int size() const;
+    bool isEmpty() const;
+    bool empty() const;
+
+    QSharedPointer<DkImageContainerT> at(int idx) const;
+    QSharedPointer<DkImageContainerT> operator[](int idx) const;
+    QSharedPointer<DkImageContainerT> created(int idx) const;
+    QString filePath(int idx) const;
+    int numCreated() const;
+
+    void append(const QString &filePath);
+    void append(const QSharedPointer<DkImageContainerT> &image);
+    DkImageList &operator<<(const QSharedPointer<DkImageContainerT> &image);
+    void removeAt(int idx);
+    void reserve(int size);
+    void clear();
+    void reverse();
+    DkImageList reordered(const QVector<int> &order) const;
+    bool release(int idx);
+
+protected:
+    struct Entry {
+        QString filePath;
+        mutable QSharedPointer<DkImageContainerT> image; // null until it is accessed
+    };
+
+    struct Data : public QSharedData {
+        QVector<Entry> entries;
+    };
 
-    QTimer mFileUpdateTimer;
+    QExplicitlySharedDataPointer<Data> d;
 };
 
 }
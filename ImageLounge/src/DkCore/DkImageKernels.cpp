@@ -0,0 +1,564 @@
+/*******************************************************************************************************
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2026 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2026 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2026 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ related links:
+ [1] https://nomacs.org/
+ [2] https://github.com/nomacs/
+ [3] http://download.nomacs.org
+ *******************************************************************************************************/
+
+#include "DkImageKernels.h"
+
+#include <cmath>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define DK_KERNELS_SSE2
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#if defined(_MSC_VER) || defined(__GNUC__) || defined(__clang__)
+#define DK_KERNELS_AVX2
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define DK_KERNELS_NEON
+#include <arm_neon.h>
+#endif
+
+#if defined(DK_KERNELS_AVX2) && (defined(__GNUC__) || defined(__clang__))
+#define DK_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define DK_TARGET_AVX2
+#endif
+
+namespace nmc
+{
+
+// scalar reference --------------------------------------------------------------------
+static void minMaxScalar(const uchar *ptr, int numBytes, bool skipAlpha, uchar &minVal, uchar &maxVal)
+{
+    uchar cMin = minVal;
+    uchar cMax = maxVal;
+
+    if (skipAlpha) {
+        for (int idx = 0; idx + 3 <= numBytes; idx += 4) {
+            for (int cIdx = idx; cIdx < idx + 3; cIdx++) {
+                cMin = qMin(cMin, ptr[cIdx]);
+                cMax = qMax(cMax, ptr[cIdx]);
+            }
+        }
+    } else {
+        for (int idx = 0; idx < numBytes; idx++) {
+            cMin = qMin(cMin, ptr[idx]);
+            cMax = qMax(cMax, ptr[idx]);
+        }
+    }
+
+    minVal = cMin;
+    maxVal = cMax;
+}
+
+// bytes >= thr -> 255
+static void thresholdScalar(uchar *ptr, int numBytes, uchar thr)
+{
+    for (int idx = 0; idx < numBytes; idx++)
+        ptr[idx] = ptr[idx] >= thr ? 255 : 0;
+}
+
+static bool alphaUsedScalar(const uchar *ptr, int numPixels)
+{
+    uchar a = 255;
+
+    for (int idx = 0; idx < numPixels; idx++)
+        a &= ptr[idx * 4 + 3];
+
+    return a != 255;
+}
+
+// counts pixels where the first three channels are 0 (black) or 255 (white)
+static void countBlackWhiteScalar(const uchar *ptr, int numPixels, int channels, int &numBlack, int &numWhite)
+{
+    for (int idx = 0; idx < numPixels; idx++, ptr += channels) {
+        if (ptr[0] == 0 && ptr[1] == 0 && ptr[2] == 0)
+            numBlack++;
+        else if (ptr[0] == 255 && ptr[1] == 255 && ptr[2] == 255)
+            numWhite++;
+    }
+}
+
+// SSE2 --------------------------------------------------------------------
+#ifdef DK_KERNELS_SSE2
+static void minMaxSse2(const uchar *ptr, int numBytes, bool skipAlpha, uchar &minVal, uchar &maxVal)
+{
+    // alpha values are set to 255 for min and to 0 for max
+    const __m128i alphaMask = skipAlpha ? _mm_set1_epi32((int)0xFF000000) : _mm_setzero_si128();
+    __m128i vMin = _mm_set1_epi8((char)minVal);
+    __m128i vMax = _mm_set1_epi8((char)maxVal);
+
+    int idx = 0;
+    for (; idx + 16 <= numBytes; idx += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(ptr + idx));
+        vMin = _mm_min_epu8(vMin, _mm_or_si128(v, alphaMask));
+        vMax = _mm_max_epu8(vMax, _mm_andnot_si128(alphaMask, v));
+    }
+
+    alignas(16) uchar mins[16];
+    alignas(16) uchar maxs[16];
+    _mm_store_si128(reinterpret_cast<__m128i *>(mins), vMin);
+    _mm_store_si128(reinterpret_cast<__m128i *>(maxs), vMax);
+
+    for (int vIdx = 0; vIdx < 16; vIdx++) {
+        minVal = qMin(minVal, mins[vIdx]);
+        maxVal = qMax(maxVal, maxs[vIdx]);
+    }
+
+    // idx is a multiple of 4 -> alpha positions are preserved
+    minMaxScalar(ptr + idx, numBytes - idx, skipAlpha, minVal, maxVal);
+}
+
+static void thresholdSse2(uchar *ptr, int numBytes, uchar thr)
+{
+    const __m128i vThr = _mm_set1_epi8((char)thr);
+
+    int idx = 0;
+    for (; idx + 16 <= numBytes; idx += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(ptr + idx));
+        // max(v, thr) == v <=> v >= thr
+        __m128i m = _mm_cmpeq_epi8(_mm_max_epu8(v, vThr), v);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(ptr + idx), m);
+    }
+
+    thresholdScalar(ptr + idx, numBytes - idx, thr);
+}
+
+static bool alphaUsedSse2(const uchar *ptr, int numPixels)
+{
+    const __m128i colorMask = _mm_set1_epi32(0x00FFFFFF);
+    __m128i acc = _mm_set1_epi8((char)0xFF);
+
+    int idx = 0;
+    for (; idx + 4 <= numPixels; idx += 4)
+        acc = _mm_and_si128(acc, _mm_loadu_si128(reinterpret_cast<const __m128i *>(ptr + idx * 4)));
+
+    acc = _mm_or_si128(acc, colorMask);
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(acc, _mm_set1_epi8((char)0xFF))) != 0xFFFF)
+        return true;
+
+    return alphaUsedScalar(ptr + idx * 4, numPixels - idx);
+}
+
+static void countBlackWhiteSse2(const uchar *ptr, int numPixels, int channels, int &numBlack, int &numWhite)
+{
+    if (channels != 4) {
+        countBlackWhiteScalar(ptr, numPixels, channels, numBlack, numWhite);
+        return;
+    }
+
+    const __m128i colorMask = _mm_set1_epi32(0x00FFFFFF);
+    __m128i black = _mm_setzero_si128();
+    __m128i white = _mm_setzero_si128();
+
+    // the comparisons are -1 for matching pixels
+    int idx = 0;
+    for (; idx + 4 <= numPixels; idx += 4) {
+        __m128i v = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(ptr + idx * 4)), colorMask);
+        black = _mm_sub_epi32(black, _mm_cmpeq_epi32(v, _mm_setzero_si128()));
+        white = _mm_sub_epi32(white, _mm_cmpeq_epi32(v, colorMask));
+    }
+
+    alignas(16) int blacks[4];
+    alignas(16) int whites[4];
+    _mm_store_si128(reinterpret_cast<__m128i *>(blacks), black);
+    _mm_store_si128(reinterpret_cast<__m128i *>(whites), white);
+
+    numBlack += blacks[0] + blacks[1] + blacks[2] + blacks[3];
+    numWhite += whites[0] + whites[1] + whites[2] + whites[3];
+
+    countBlackWhiteScalar(ptr + idx * 4, numPixels - idx, channels, numBlack, numWhite);
+}
+#endif // DK_KERNELS_SSE2
+
+// AVX2 --------------------------------------------------------------------
+#ifdef DK_KERNELS_AVX2
+DK_TARGET_AVX2 static void minMaxAvx2(const uchar *ptr, int numBytes, bool skipAlpha, uchar &minVal, uchar &maxVal)
+{
+    const __m256i alphaMask = skipAlpha ? _mm256_set1_epi32((int)0xFF000000) : _mm256_setzero_si256();
+    __m256i vMin = _mm256_set1_epi8((char)minVal);
+    __m256i vMax = _mm256_set1_epi8((char)maxVal);
+
+    int idx = 0;
+    for (; idx + 32 <= numBytes; idx += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(ptr + idx));
+        vMin = _mm256_min_epu8(vMin, _mm256_or_si256(v, alphaMask));
+        vMax = _mm256_max_epu8(vMax, _mm256_andnot_si256(alphaMask, v));
+    }
+
+    alignas(32) uchar mins[32];
+    alignas(32) uchar maxs[32];
+    _mm256_store_si256(reinterpret_cast<__m256i *>(mins), vMin);
+    _mm256_store_si256(reinterpret_cast<__m256i *>(maxs), vMax);
+
+    for (int vIdx = 0; vIdx < 32; vIdx++) {
+        minVal = qMin(minVal, mins[vIdx]);
+        maxVal = qMax(maxVal, maxs[vIdx]);
+    }
+
+    minMaxScalar(ptr + idx, numBytes - idx, skipAlpha, minVal, maxVal);
+}
+
+DK_TARGET_AVX2 static void thresholdAvx2(uchar *ptr, int numBytes, uchar thr)
+{
+    const __m256i vThr = _mm256_set1_epi8((char)thr);
+
+    int idx = 0;
+    for (; idx + 32 <= numBytes; idx += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(ptr + idx));
+        __m256i m = _mm256_cmpeq_epi8(_mm256_max_epu8(v, vThr), v);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(ptr + idx), m);
+    }
+
+    thresholdScalar(ptr + idx, numBytes - idx, thr);
+}
+
+DK_TARGET_AVX2 static bool alphaUsedAvx2(const uchar *ptr, int numPixels)
+{
+    const __m256i colorMask = _mm256_set1_epi32(0x00FFFFFF);
+    __m256i acc = _mm256_set1_epi8((char)0xFF);
+
+    int idx = 0;
+    for (; idx + 8 <= numPixels; idx += 8)
+        acc = _mm256_and_si256(acc, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(ptr + idx * 4)));
+
+    acc = _mm256_or_si256(acc, colorMask);
+    if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(acc, _mm256_set1_epi8((char)0xFF))) != -1)
+        return true;
+
+    return alphaUsedScalar(ptr + idx * 4, numPixels - idx);
+}
+
+DK_TARGET_AVX2 static void countBlackWhiteAvx2(const uchar *ptr, int numPixels, int channels, int &numBlack, int &numWhite)
+{
+    if (channels != 4) {
+        countBlackWhiteScalar(ptr, numPixels, channels, numBlack, numWhite);
+        return;
+    }
+
+    const __m256i colorMask = _mm256_set1_epi32(0x00FFFFFF);
+    __m256i black = _mm256_setzero_si256();
+    __m256i white = _mm256_setzero_si256();
+
+    int idx = 0;
+    for (; idx + 8 <= numPixels; idx += 8) {
+        __m256i v = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(ptr + idx * 4)), colorMask);
+        black = _mm256_sub_epi32(black, _mm256_cmpeq_epi32(v, _mm256_setzero_si256()));
+        white = _mm256_sub_epi32(white, _mm256_cmpeq_epi32(v, colorMask));
+    }
+
+    alignas(32) int blacks[8];
+    alignas(32) int whites[8];
+    _mm256_store_si256(reinterpret_cast<__m256i *>(blacks), black);
+    _mm256_store_si256(reinterpret_cast<__m256i *>(whites), white);
+
+    for (int vIdx = 0; vIdx < 8; vIdx++) {
+        numBlack += blacks[vIdx];
+        numWhite += whites[vIdx];
+    }
+
+    countBlackWhiteScalar(ptr + idx * 4, numPixels - idx, channels, numBlack, numWhite);
+}
+
+static bool cpuHasAvx2()
+{
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return false;
+
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+
+    // the OS must save the ymm registers
+    if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6)
+        return false;
+
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif // DK_KERNELS_AVX2
+
+// NEON --------------------------------------------------------------------
+#ifdef DK_KERNELS_NEON
+static void minMaxNeon(const uchar *ptr, int numBytes, bool skipAlpha, uchar &minVal, uchar &maxVal)
+{
+    const uint8x16_t alphaMask = skipAlpha ? vreinterpretq_u8_u32(vdupq_n_u32(0xFF000000)) : vdupq_n_u8(0);
+    uint8x16_t vMin = vdupq_n_u8(minVal);
+    uint8x16_t vMax = vdupq_n_u8(maxVal);
+
+    int idx = 0;
+    for (; idx + 16 <= numBytes; idx += 16) {
+        uint8x16_t v = vld1q_u8(ptr + idx);
+        vMin = vminq_u8(vMin, vorrq_u8(v, alphaMask));
+        vMax = vmaxq_u8(vMax, vbicq_u8(v, alphaMask));
+    }
+
+    minVal = qMin(minVal, vminvq_u8(vMin));
+    maxVal = qMax(maxVal, vmaxvq_u8(vMax));
+
+    minMaxScalar(ptr + idx, numBytes - idx, skipAlpha, minVal, maxVal);
+}
+
+static void thresholdNeon(uchar *ptr, int numBytes, uchar thr)
+{
+    const uint8x16_t vThr = vdupq_n_u8(thr);
+
+    int idx = 0;
+    for (; idx + 16 <= numBytes; idx += 16)
+        vst1q_u8(ptr + idx, vcgeq_u8(vld1q_u8(ptr + idx), vThr));
+
+    thresholdScalar(ptr + idx, numBytes - idx, thr);
+}
+
+static bool alphaUsedNeon(const uchar *ptr, int numPixels)
+{
+    const uint8x16_t colorMask = vreinterpretq_u8_u32(vdupq_n_u32(0x00FFFFFF));
+    uint8x16_t acc = vdupq_n_u8(0xFF);
+
+    int idx = 0;
+    for (; idx + 4 <= numPixels; idx += 4)
+        acc = vandq_u8(acc, vld1q_u8(ptr + idx * 4));
+
+    if (vminvq_u8(vorrq_u8(acc, colorMask)) != 255)
+        return true;
+
+    return alphaUsedScalar(ptr + idx * 4, numPixels - idx);
+}
+
+static void countBlackWhiteNeon(const uchar *ptr, int numPixels, int channels, int &numBlack, int &numWhite)
+{
+    if (channels != 4) {
+        countBlackWhiteScalar(ptr, numPixels, channels, numBlack, numWhite);
+        return;
+    }
+
+    const uint32x4_t colorMask = vdupq_n_u32(0x00FFFFFF);
+    uint32x4_t black = vdupq_n_u32(0);
+    uint32x4_t white = vdupq_n_u32(0);
+
+    int idx = 0;
+    for (; idx + 4 <= numPixels; idx += 4) {
+        uint32x4_t v = vandq_u32(vreinterpretq_u32_u8(vld1q_u8(ptr + idx * 4)), colorMask);
+        black = vsubq_u32(black, vceqq_u32(v, vdupq_n_u32(0)));
+        white = vsubq_u32(white, vceqq_u32(v, colorMask));
+    }
+
+    numBlack += (int)vaddvq_u32(black);
+    numWhite += (int)vaddvq_u32(white);
+
+    countBlackWhiteScalar(ptr + idx * 4, numPixels - idx, channels, numBlack, numWhite);
+}
+#endif // DK_KERNELS_NEON
+
+// dispatching --------------------------------------------------------------------
+struct DkKernelTable {
+    DkImageKernels::InstructionSet is = DkImageKernels::is_scalar;
+    void (*minMax)(const uchar *, int, bool, uchar &, uchar &) = &minMaxScalar;
+    void (*threshold)(uchar *, int, uchar) = &thresholdScalar;
+    bool (*alphaUsed)(const uchar *, int) = &alphaUsedScalar;
+    void (*countBlackWhite)(const uchar *, int, int, int &, int &) = &countBlackWhiteScalar;
+};
+
+static DkKernelTable createKernelTable(DkImageKernels::InstructionSet is)
+{
+    DkKernelTable kt;
+
+    switch (is) {
+#ifdef DK_KERNELS_AVX2
+    case DkImageKernels::is_avx2:
+        kt.is = is;
+        kt.minMax = &minMaxAvx2;
+        kt.threshold = &thresholdAvx2;
+        kt.alphaUsed = &alphaUsedAvx2;
+        kt.countBlackWhite = &countBlackWhiteAvx2;
+        break;
+#endif
+#ifdef DK_KERNELS_SSE2
+    case DkImageKernels::is_sse2:
+        kt.is = is;
+        kt.minMax = &minMaxSse2;
+        kt.threshold = &thresholdSse2;
+        kt.alphaUsed = &alphaUsedSse2;
+        kt.countBlackWhite = &countBlackWhiteSse2;
+        break;
+#endif
+#ifdef DK_KERNELS_NEON
+    case DkImageKernels::is_neon:
+        kt.is = is;
+        kt.minMax = &minMaxNeon;
+        kt.threshold = &thresholdNeon;
+        kt.alphaUsed = &alphaUsedNeon;
+        kt.countBlackWhite = &countBlackWhiteNeon;
+        break;
+#endif
+    default:
+        break;
+    }
+
+    return kt;
+}
+
+static DkKernelTable &kernels()
+{
+    static DkKernelTable kt = createKernelTable(DkImageKernels::bestInstructionSet());
+    return kt;
+}
+
+// DkImageKernels --------------------------------------------------------------------
+/**
+ * Returns the instruction set that is currently used.
+ **/
+DkImageKernels::InstructionSet DkImageKernels::instructionSet()
+{
+    return kernels().is;
+}
+
+/**
+ * Returns the fastest instruction set supported by this CPU.
+ **/
+DkImageKernels::InstructionSet DkImageKernels::bestInstructionSet()
+{
+#if defined(DK_KERNELS_AVX2)
+    static bool avx2 = cpuHasAvx2();
+    return avx2 ? is_avx2 : is_sse2;
+#elif defined(DK_KERNELS_SSE2)
+    return is_sse2;
+#elif defined(DK_KERNELS_NEON)
+    return is_neon;
+#else
+    return is_scalar;
+#endif
+}
+
+/**
+ * Switches the kernel implementation (e.g. to compare it with the scalar reference).
+ * Instruction sets that are not supported by this CPU fall back to the scalar kernels.
+ * This function is not thread-safe.
+ **/
+void DkImageKernels::setInstructionSet(InstructionSet is)
+{
+    InstructionSet best = bestInstructionSet();
+
+    if (is == is_avx2 && best != is_avx2)
+        is = is_scalar;
+    else if (is == is_sse2 && best != is_sse2 && best != is_avx2)
+        is = is_scalar;
+    else if (is == is_neon && best != is_neon)
+        is = is_scalar;
+
+    kernels() = createKernelTable(is);
+}
+
+void DkImageKernels::minMax(const uchar *ptr, int numBytes, bool skipAlpha, uchar &minVal, uchar &maxVal)
+{
+    kernels().minMax(ptr, numBytes, skipAlpha, minVal, maxVal);
+}
+
+void DkImageKernels::histogram(const uchar *ptr, int numPixels, int channels, int *hist0, int *hist1, int *hist2)
+{
+    // NOTE: byte histograms need scatter stores - the scalar loop is as fast as it gets
+    if (channels < 3)
+        return;
+
+    for (int idx = 0; idx < numPixels; idx++, ptr += channels) {
+        hist0[ptr[0]]++;
+        hist1[ptr[1]]++;
+        hist2[ptr[2]]++;
+    }
+}
+
+void DkImageKernels::applyLut(uchar *ptr, int numPixels, int channels, const uchar *lut)
+{
+    // NOTE: 256 entry lookups cannot be vectorized without gather instructions
+    switch (channels) {
+    case 1:
+        for (int idx = 0; idx < numPixels; idx++)
+            ptr[idx] = lut[ptr[idx]];
+        break;
+    case 3:
+        for (int idx = 0; idx < numPixels; idx++, ptr += 3) {
+            ptr[0] = lut[ptr[0]];
+            ptr[1] = lut[256 + ptr[1]];
+            ptr[2] = lut[512 + ptr[2]];
+        }
+        break;
+    case 4:
+        for (int idx = 0; idx < numPixels; idx++, ptr += 4) {
+            ptr[0] = lut[ptr[0]];
+            ptr[1] = lut[256 + ptr[1]];
+            ptr[2] = lut[512 + ptr[2]];
+            ptr[3] = lut[768 + ptr[3]];
+        }
+        break;
+    default:
+        for (int idx = 0; idx < numPixels; idx++, ptr += channels) {
+            for (int cIdx = 0; cIdx < channels; cIdx++)
+                ptr[cIdx] = lut[cIdx * 256 + ptr[cIdx]];
+        }
+    }
+}
+
+void DkImageKernels::threshold(uchar *ptr, int numBytes, double thr)
+{
+    // for integer values: v > thr <=> v >= floor(thr) + 1
+    double t = std::floor(thr) + 1.0;
+
+    if (t <= 0.0) {
+        memset(ptr, 255, numBytes);
+        return;
+    } else if (t > 255.0) {
+        memset(ptr, 0, numBytes);
+        return;
+    }
+
+    kernels().threshold(ptr, numBytes, (uchar)t);
+}
+
+bool DkImageKernels::alphaUsed(const uchar *ptr, int numPixels)
+{
+    return kernels().alphaUsed(ptr, numPixels);
+}
+
+void DkImageKernels::countBlackWhite(const uchar *ptr, int numPixels, int channels, int &numBlack, int &numWhite)
+{
+    if (channels < 3)
+        return;
+
+    kernels().countBlackWhite(ptr, numPixels, channels, numBlack, numWhite);
+}
+
+}
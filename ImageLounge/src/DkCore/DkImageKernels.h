@@ -0,0 +1,89 @@
+/*******************************************************************************************************
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2026 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2026 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2026 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ related links:
+ [1] https://nomacs.org/
+ [2] https://github.com/nomacs/
+ [3] http://download.nomacs.org
+ *******************************************************************************************************/
+
+#pragma once
+
+#pragma warning(push, 0) // no warnings from includes - begin
+#include <QtGlobal>
+#pragma warning(pop) // no warnings from includes - end
+
+#ifndef DllCoreExport
+#ifdef DK_CORE_DLL_EXPORT
+#define DllCoreExport Q_DECL_EXPORT
+#elif DK_DLL_IMPORT
+#define DllCoreExport Q_DECL_IMPORT
+#else
+#define DllCoreExport Q_DECL_IMPORT
+#endif
+#endif
+
+namespace nmc
+{
+
+/**
+ * DkImageKernels are the per-pixel inner loops of DkImage.
+ * All kernels work on a single scan line. The vectorized
+ * implementations (SSE2, AVX2, NEON) are selected at runtime
+ * depending on the CPU. The scalar implementations are the reference.
+ **/
+class DllCoreExport DkImageKernels
+{
+public:
+    enum InstructionSet {
+        is_scalar = 0,
+        is_sse2,
+        is_avx2,
+        is_neon,
+
+        is_end
+    };
+
+    static InstructionSet instructionSet();
+    static InstructionSet bestInstructionSet();
+    static void setInstructionSet(InstructionSet is);
+
+    // minimum and maximum of numBytes values - every 4th byte is ignored if skipAlpha is true
+    static void minMax(const uchar *ptr, int numBytes, bool skipAlpha, uchar &minVal, uchar &maxVal);
+
+    // histograms of the first three channels
+    static void histogram(const uchar *ptr, int numPixels, int channels, int *hist0, int *hist1, int *hist2);
+
+    // maps each channel c with lut[c * 256 + value]
+    static void applyLut(uchar *ptr, int numPixels, int channels, const uchar *lut);
+
+    // values > thr become 255 - all others 0
+    static void threshold(uchar *ptr, int numBytes, double thr);
+
+    // true if any alpha value of numPixels (A)RGB32 pixels is not 255
+    static bool alphaUsed(const uchar *ptr, int numPixels);
+
+    // adds the number of pixels whose first three channels are all 0 (numBlack) or all 255 (numWhite)
+    static void countBlackWhite(const uchar *ptr, int numPixels, int channels, int &numBlack, int &numWhite);
+};
+
+}
@@ -32,6 +32,7 @@
 #include "DkDialog.h"
 #include "DkImageContainer.h"
 #include "DkImageStorage.h"
+#include "DkMemoryGovernor.h"
 #include "DkMessageBox.h"
 #include "DkMetaData.h"
 #include "DkSaveDialog.h"
@@ -66,6 +67,7 @@
 #include <QReadLocker>
 #include <QReadWriteLock>
 #include <QRegularExpression>
+#include <QSet>
 #include <QSettings>
 #include <QStandardPaths>
 #include <QStringBuilder>
@@ -100,11 +102,315 @@
 #include <winsock2.h> // needed since libraw 0.16
 #endif
 
+#ifndef Q_OS_WIN
+#include <dirent.h>
+#endif
+
 #pragma warning(pop) // no warnings from includes - end
 
 namespace nmc
 {
 
+// DkImageIndex --------------------------------------------------------------------
+DkImageIndex::DkImageIndex(const DkImageList &images)
+{
+    rebuild(images);
+}
+
+void DkImageIndex::rebuild(const DkImageList &images)
+{
+    mIndex.clear();
+    mIndex.reserve(images.size());
+
+    for (int idx = 0; idx < images.size(); idx++)
+        mIndex.insert(key(images.filePath(idx)), idx);
+}
+
+void DkImageIndex::clear()
+{
+    mIndex.clear();
+}
+
+/**
+ * Returns the index of the file or -1 if it is not indexed.
+ **/
+int DkImageIndex::indexOf(const QString &filePath) const
+{
+    return mIndex.value(key(filePath), -1);
+}
+
+/**
+ * Returns the normalized file path that is used as key.
+ * Separators are unified, so paths from a QFileInfo and native paths result in the same key.
+ **/
+QString DkImageIndex::key(const QString &filePath)
+{
+    QString k = filePath;
+    k.replace("\\", "/");
+
+    return k;
+}
+
+// DkSiblingIndex --------------------------------------------------------------------
+DkSiblingIndex::DkSiblingIndex(const QStringList &fileNames)
+{
+    mGroups.reserve(fileNames.size());
+
+    for (const QString &fn : fileNames)
+        mGroups[baseName(fn)] << fn;
+
+    // we only need to know about siblings
+    for (auto it = mGroups.begin(); it != mGroups.end();) {
+        if (it.value().size() < 2)
+            it = mGroups.erase(it);
+        else
+            ++it;
+    }
+}
+
+/**
+ * Removes files that have a sibling with a higher priority.
+ * Files with extensions that are not part of the extensionPriority list are
+ * removed if any sibling is in the list, otherwise they are kept.
+ * @param fileNames the files to be filtered (in the order they should be returned).
+ * @param extensionPriority lower case suffixes, the first one has the highest priority.
+ **/
+QStringList DkSiblingIndex::filter(const QStringList &fileNames, const QStringList &extensionPriority) const
+{
+    if (mGroups.isEmpty() || extensionPriority.isEmpty())
+        return fileNames;
+
+    auto priority = [&extensionPriority](const QString &fileName) {
+        int idx = extensionPriority.indexOf(QFileInfo(fileName).suffix().toLower());
+        return idx != -1 ? idx : extensionPriority.size();
+    };
+
+    QStringList filtered;
+    filtered.reserve(fileNames.size());
+
+    for (const QString &fn : fileNames) {
+        auto git = mGroups.constFind(baseName(fn));
+
+        if (git == mGroups.constEnd()) {
+            filtered << fn;
+            continue;
+        }
+
+        int bestPriority = extensionPriority.size();
+        for (const QString &sibling : git.value())
+            bestPriority = qMin(bestPriority, priority(sibling));
+
+        if (priority(fn) <= bestPriority)
+            filtered << fn;
+    }
+
+    return filtered;
+}
+
+/**
+ * Returns all files with the same base name (including fileName).
+ * An empty list is returned if fileName has no siblings.
+ **/
+QStringList DkSiblingIndex::siblings(const QString &fileName) const
+{
+    return mGroups.value(baseName(fileName));
+}
+
+bool DkSiblingIndex::isEmpty() const
+{
+    return mGroups.isEmpty();
+}
+
+/**
+ * Returns the file name up to the first dot (like QFileInfo::baseName).
+ **/
+QString DkSiblingIndex::baseName(const QString &fileName)
+{
+    int dotIdx = fileName.indexOf(".");
+    return dotIdx != -1 ? fileName.left(dotIdx) : fileName;
+}
+
+/**
+ * Converts extension settings (e.g. "*.jpg; *.png") to a list of lower case suffixes.
+ **/
+QStringList DkSiblingIndex::extensionPriority(const QString &extensions)
+{
+    static QRegularExpression sep("[;,\\s]+");
+
+    QStringList priority;
+
+    for (QString ext : extensions.split(sep, Qt::SkipEmptyParts)) {
+        ext.replace("*", "");
+        ext.replace(".", "");
+
+        if (!ext.isEmpty())
+            priority << ext.toLower();
+    }
+
+    return priority;
+}
+
+// DkPrefetchPlanner --------------------------------------------------------------------
+/**
+ * Records that the image idx is shown.
+ * Steps that are repeated (e.g. holding an arrow key) increase the confidence
+ * in the navigation direction. Jumps (e.g. the folder scrollbar) are ignored.
+ **/
+void DkPrefetchPlanner::navigated(int idx, int numFiles)
+{
+    if (idx == mLastIdx || idx < 0)
+        return;
+
+    const int maxStep = qMax(DkSettingsManager::param().global().skipImgs, 1) * 2;
+
+    if (mLastIdx >= 0 && mLastIdx < numFiles) {
+        int delta = idx - mLastIdx;
+
+        // we looped
+        if (qAbs(delta) > numFiles / 2)
+            delta -= delta > 0 ? numFiles : -numFiles;
+
+        if (delta != 0 && qAbs(delta) <= maxStep) {
+            if (delta == mStep) {
+                mConfidence = qMin(mConfidence + 1, 3);
+            } else {
+                mStep = delta;
+                mConfidence = 1;
+            }
+
+            qint64 ms = mTimer.isValid() ? mTimer.elapsed() : -1;
+
+            // the user looks at the images - no need to hurry
+            if (ms < 0 || ms > 5000)
+                mInterval = -1;
+            else
+                mInterval = mInterval < 0 ? ms : mInterval * 0.7 + ms * 0.3;
+        }
+    }
+
+    mLastIdx = idx;
+    mTimer.start();
+}
+
+void DkPrefetchPlanner::reset()
+{
+    mLastIdx = -1;
+    mStep = 1;
+    mConfidence = 0;
+    mInterval = -1;
+    mTimer.invalidate();
+}
+
+void DkPrefetchPlanner::addDecodeTime(const QString &suffix, int ms)
+{
+    QString key = suffix.toLower();
+    auto it = mDecodeTimes.find(key);
+
+    if (it == mDecodeTimes.end())
+        mDecodeTimes.insert(key, ms);
+    else
+        *it = *it * 0.7 + ms * 0.3;
+}
+
+/**
+ * Returns the mean decode time of files with the given suffix.
+ * If no such file was decoded, the mean of all formats is returned.
+ **/
+int DkPrefetchPlanner::decodeTime(const QString &suffix) const
+{
+    auto it = mDecodeTimes.find(suffix.toLower());
+
+    if (it != mDecodeTimes.end())
+        return qRound(*it);
+
+    if (mDecodeTimes.isEmpty())
+        return 100;
+
+    double sum = 0;
+    for (double t : mDecodeTimes)
+        sum += t;
+
+    return qRound(sum / mDecodeTimes.size());
+}
+
+/**
+ * Returns the images that should be cached if the image idx is shown.
+ * @param idx the index of the current image
+ * @param numFiles the number of images in the folder
+ * @param suffix the current image's suffix - we assume that the next files are similar
+ * @param imageMemory the current image's memory in MB
+ **/
+DkPrefetchPlanner::Plan DkPrefetchPlanner::plan(int idx, int numFiles, const QString &suffix, double imageMemory) const
+{
+    Plan p;
+
+    if (numFiles <= 1 || idx < 0)
+        return p;
+
+    const auto &rp = DkSettingsManager::param().resources();
+    int maxCached = qMax(rp.maxImagesCached, 1);
+
+    // decode as many images as are shown while one image is decoded
+    int ahead = 1;
+    if (mInterval > 0)
+        ahead = qCeil(decodeTime(suffix) / mInterval) + 1;
+    ahead = qBound(1, ahead, qMax(maxCached - 1, 1));
+
+    // keep more images behind if we are not sure about the direction
+    int behind = mConfidence >= 2 ? 1 : qMax(ahead / 2, 1);
+
+    // the decoded images must fit into the image cache
+    behind = qMin(behind, maxCached - ahead);
+
+    // the decoded images must fit into the cache
+    if (imageMemory > 0) {
+        int maxImages = qFloor(cacheMemory() / imageMemory);
+
+        while (ahead + behind > maxImages && behind > 0)
+            behind--;
+        while (ahead + behind > maxImages && ahead > 1)
+            ahead--;
+    }
+
+    auto add = [&](QVector<int> &list, int i) {
+        i = wrap(i, numFiles);
+
+        if (i != -1 && i != idx && !p.decode.contains(i) && !p.fetch.contains(i))
+            list << i;
+    };
+
+    for (int k = 1; k <= ahead; k++)
+        add(p.decode, idx + mStep * k);
+    for (int k = 1; k <= behind; k++)
+        add(p.decode, idx - mStep * k);
+
+    // reading files is cheap compared to decoding
+    for (int k = ahead + 1; k <= maxCached; k++)
+        add(p.fetch, idx + mStep * k);
+
+    return p;
+}
+
+/**
+ * Returns the memory (MB) that prefetched images may use.
+ * It is limited by the cache settings and by the memory that the
+ * DkMemoryGovernor does not reserve for shown images and edits.
+ **/
+double DkPrefetchPlanner::cacheMemory()
+{
+    double cacheMem = DkSettingsManager::param().resources().cacheMemory;
+
+    return qMin(cacheMem, DkMemoryGovernor::instance().headroom(DkMemoryGovernor::priority_cached));
+}
+
+int DkPrefetchPlanner::wrap(int idx, int numFiles) const
+{
+    if (DkSettingsManager::param().global().loop)
+        return ((idx % numFiles) + numFiles) % numFiles;
+
+    return (idx < 0 || idx >= numFiles) ? -1 : idx;
+}
+
 // DkImageLoader -> is nomacs file handling routine --------------------------------------------------------------------
 /**
  * Default constructor.
@@ -121,7 +427,8 @@ DkImageLoader::DkImageLoader(const QString &filePath)
     mSortingIsDirty = false;
     mSortingImages = false;
 
-    connect(&mCreateImageWatcher, &QFutureWatcher<QVector<QSharedPointer<DkImageContainerT>>>::finished, this, &DkImageLoader::imagesSorted);
+    connect(&mCreateImageWatcher, &QFutureWatcher<DkImageList>::finished, this, &DkImageLoader::imagesSorted);
+    connect(&mIndexDirWatcher, &QFutureWatcher<QPair<QFileInfoList, DkSiblingIndex>>::finished, this, &DkImageLoader::dirIndexed);
 
     mDelayedUpdateTimer.setSingleShot(true);
     connect(&mDelayedUpdateTimer, &QTimer::timeout, this, [this]() {
@@ -133,6 +440,7 @@ DkImageLoader::DkImageLoader(const QString &filePath)
     connect(DkActionManager::instance().action(DkActionManager::menu_edit_redo), &QAction::triggered, this, &DkImageLoader::redo);
     connect(DkActionManager::instance().action(DkActionManager::menu_view_gps_map), &QAction::triggered, this, &DkImageLoader::showOnMap);
     connect(DkActionManager::instance().action(DkActionManager::sc_delete_silent), &QAction::triggered, this, &DkImageLoader::deleteFile, Qt::UniqueConnection);
+    connect(DkActionManager::instance().action(DkActionManager::sc_switch_sibling), &QAction::triggered, this, &DkImageLoader::loadSibling, Qt::UniqueConnection);
 
     // saveDir = DkSettingsManager::param().global().lastSaveDir;	// loading save dir is obsolete ?!
 
@@ -151,6 +459,9 @@ DkImageLoader::~DkImageLoader()
 {
     if (mCreateImageWatcher.isRunning())
         mCreateImageWatcher.blockSignals(true);
+
+    if (mIndexDirWatcher.isRunning())
+        mIndexDirWatcher.blockSignals(true);
 }
 
 /**
@@ -164,8 +475,10 @@ void DkImageLoader::clearPath()
     // lastFileLoaded must exist
     if (mCurrentImage && mCurrentImage->exists()) {
         this->receiveUpdates(false);
+        mCurrentImage->setMemoryPriority(DkMemoryGovernor::priority_cached);
         mLastImageLoaded = mCurrentImage;
         mImages.clear();
+        mImageIndex.clear();
 
         // only clear the current image if it exists
         mCurrentImage.clear();
@@ -233,16 +546,22 @@ bool DkImageLoader::loadDir(const QString &newDirPath, bool scanRecursive)
 
     DkTimer dt;
 
+    // the folder is currently indexed in the background - don't block, the images are created in dirIndexed()
+    if (isIndexing(newDirPath))
+        return false;
+
     // folder changed signal was emitted
     if (mFolderUpdated && newDirPath == mCurrentDir) {
         mFolderUpdated = false;
         QFileInfoList files = getFilteredFileInfoList(newDirPath,
-                                                      mFolderFilterString); // this line takes seconds if you have lots of files and slow loading (e.g. network)
+                                                      mFolderFilterString,
+                                                      &mSiblings); // this line takes seconds if you have lots of files and slow loading (e.g. network)
 
         // might get empty too (e.g. someone deletes all images)
         if (files.empty()) {
             emit showInfoSignal(tr("%1 \n does not contain any image").arg(newDirPath), 4000); // stop showing
             mImages.clear();
+            mImageIndex.clear();
             emit updateDirSignal(mImages);
             return false;
         }
@@ -267,6 +586,9 @@ bool DkImageLoader::loadDir(const QString &newDirPath, bool scanRecursive)
         // update save directory
         mCurrentDir = newDirPath;
         mFolderUpdated = false;
+        mIndexingDir.clear(); // drop pending background results
+        clearPendingNavigation();
+        mPrefetchPlanner.reset();
 
         mFolderFilterString.clear(); // delete key words -> otherwise user may be confused
 
@@ -274,7 +596,8 @@ bool DkImageLoader::loadDir(const QString &newDirPath, bool scanRecursive)
             files = updateSubFolders(mCurrentDir);
         else
             files = getFilteredFileInfoList(mCurrentDir,
-                                            mFolderFilterString); // this line takes seconds if you have lots of files and slow loading (e.g. network)
+                                            mFolderFilterString,
+                                            &mSiblings); // this line takes seconds if you have lots of files and slow loading (e.g. network)
 
         if (files.empty()) {
             emit showInfoSignal(tr("%1 \n does not contain any image").arg(mCurrentDir), 4000); // stop showing
@@ -283,6 +606,7 @@ bool DkImageLoader::loadDir(const QString &newDirPath, bool scanRecursive)
 
         // ok new folder, this should speed-up loading
         mImages.clear();
+        mImageIndex.clear();
 
         //// TODO: creating ~120 000 images takes about 2 secs
         //// but sorting (just filenames) takes ages (on windows)
@@ -309,7 +633,113 @@ void DkImageLoader::loadDirRecursive(const QString &newDirPath)
     this->loadDir(newDirPath, true);
 }
 
-void DkImageLoader::sortImagesThreaded(QVector<QSharedPointer<DkImageContainerT>> images)
+/**
+ * Indexes a new directory in the background.
+ * This allows for showing the current image while
+ * large (or network) folders are indexed.
+ * The images are updated as soon as the file list is ready (see dirIndexed()).
+ * @param dirPath the directory to be indexed.
+ **/
+void DkImageLoader::loadDirThreaded(const QString &dirPath)
+{
+    mCurrentDir = dirPath;
+    mFolderUpdated = false;
+    mFolderFilterString.clear(); // delete key words -> otherwise user may be confused
+
+    mImages.clear();
+    mImageIndex.clear();
+    mSiblings = DkSiblingIndex();
+    emit updateDirSignal(mImages);
+
+    mIndexingDir = dirPath;
+    clearPendingNavigation();
+    mIndexDirWatcher.setFuture(QtConcurrent::run([dirPath] {
+        DkSiblingIndex siblings;
+        QFileInfoList files = getFilteredFileInfoList(dirPath, QString(), &siblings);
+        return qMakePair(files, siblings);
+    }));
+}
+
+bool DkImageLoader::isIndexing(const QString &dirPath) const
+{
+    return !mIndexingDir.isEmpty() && mIndexingDir == dirPath;
+}
+
+void DkImageLoader::clearPendingNavigation()
+{
+    mPendingSkip = 0;
+    mPendingFileAt = false;
+    mPendingFileIdx = 0;
+}
+
+/**
+ * Applies the navigation that was requested while the folder was indexed.
+ **/
+void DkImageLoader::applyPendingNavigation()
+{
+    bool fileAt = mPendingFileAt;
+    int fileIdx = mPendingFileIdx;
+    int skipIdx = mPendingSkip;
+
+    clearPendingNavigation();
+
+    if (fileAt)
+        loadFileAt(fileIdx);
+    else if (skipIdx != 0)
+        changeFile(skipIdx);
+}
+
+void DkImageLoader::dirIndexed()
+{
+    // results were already applied by loadDir()
+    if (mIndexingDir.isEmpty())
+        return;
+
+    QString dirPath = mIndexingDir;
+    mIndexingDir.clear();
+
+    // the user moved on to another folder
+    if (dirPath != mCurrentDir) {
+        clearPendingNavigation();
+        return;
+    }
+
+    DkTimer dt;
+    QFileInfoList files = mIndexDirWatcher.result().first;
+    mSiblings = mIndexDirWatcher.result().second;
+
+    if (files.empty()) {
+        clearPendingNavigation();
+        emit showInfoSignal(tr("%1 \n does not contain any image").arg(dirPath), 4000); // stop showing
+        return;
+    }
+
+    // keep the container of the image that is (being) loaded
+    if (mCurrentImage && mCurrentImage->dirPath() == dirPath && mImages.empty())
+        mImages << mCurrentImage;
+
+    createImages(files, true);
+
+    qInfoClean() << dirPath << " [" << mImages.size() << "] indexed in background, images created in " << dt;
+
+    int idx = mCurrentImage ? findFileIdx(mCurrentImage->filePath(), mImages) : -1;
+
+    if (idx < 0) {
+        applyPendingNavigation();
+        return;
+    }
+
+    // the folder scrollbar & status bar need that
+    emit imageUpdatedSignal(idx);
+    DkStatusBarManager::instance().setMessage(tr("%1 of %2").arg(idx + 1).arg(mImages.size()), DkStatusBar::status_filenumber_info);
+
+    if (mCurrentImage->hasImage())
+        updateCacher(mCurrentImage);
+
+    applyPendingNavigation();
+}
+
+void DkImageLoader::sortImagesThreaded(DkImageList images)
 {
     if (mSortingImages) {
         mSortingIsDirty = true;
@@ -329,6 +759,7 @@ void DkImageLoader::imagesSorted()
 {
     mSortingImages = false;
     mImages = mCreateImageWatcher.result();
+    mImageIndex.rebuild(mImages);
 
     if (mSortingIsDirty) {
         qDebug() << "re-sorting because it's dirty...";
@@ -351,20 +782,27 @@ void DkImageLoader::createImages(const QFileInfoList &files, bool sort)
 {
     // TODO: change files to QStringList
     DkTimer dt;
-    QVector<QSharedPointer<DkImageContainerT>> oldImages = mImages;
+    DkImageList oldImages = mImages;
+    DkImageIndex oldIndex(oldImages);
     mImages.clear();
-
-    QDate today = QDate::currentDate();
+    mImages.reserve(files.size());
 
     for (const QFileInfo &f : files) {
         const QString &fp = f.absoluteFilePath();
-        int oIdx = findFileIdx(fp, oldImages);
+        int oIdx = oldIndex.indexOf(fp);
 
+        // keep the containers that were created already - the others are created when they are needed
         // NOTE: we had this here: oIdx != -1 && QFileInfo(oldImages.at(oIdx)->filePath()).lastModified() == f.lastModified())
         // however, that did not detect file changes & slowed down the process - so I removed it...
-        mImages << ((oIdx != -1) ? oldImages.at(oIdx) : QSharedPointer<DkImageContainerT>(new DkImageContainerT(fp)));
+        QSharedPointer<DkImageContainerT> oldImage = (oIdx != -1) ? oldImages.created(oIdx) : QSharedPointer<DkImageContainerT>();
+
+        if (oldImage)
+            mImages << oldImage;
+        else
+            mImages.append(fp);
     }
-    qInfo() << "[DkImageLoader]" << mImages.size() << "containers created in" << dt;
+    mImageIndex.rebuild(mImages);
+    qInfo() << "[DkImageLoader]" << mImages.size() << "files listed in" << dt;
 
     if (sort) {
         DkImageLoader::sort();
@@ -378,7 +816,7 @@ void DkImageLoader::createImages(const QFileInfoList &files, bool sort)
     }
 }
 
-QVector<QSharedPointer<DkImageContainerT>> DkImageLoader::sortImages(QVector<QSharedPointer<DkImageContainerT>> images) const
+DkImageList DkImageLoader::sortImages(DkImageList images) const
 {
     // this is dead code and could crash, see sort() for a correct way to do it
     // std::sort(images.begin(), images.end(), imageContainerLessThanPtr);
@@ -404,6 +842,19 @@ void DkImageLoader::changeFile(int skipIdx)
         return;
     }
 
+    // the folder is indexed in the background - navigate as soon as it is done
+    if (isIndexing(mCurrentDir)) {
+        // pages of the current file don't need the folder
+        if (mCurrentImage && mCurrentImage->setPageIdx(skipIdx)) {
+            load(mCurrentImage);
+            return;
+        }
+
+        mPendingSkip += skipIdx;
+        mPendingFileAt = false;
+        return;
+    }
+
     // update dir
     loadDir(mCurrentDir);
 
@@ -457,11 +908,14 @@ QSharedPointer<DkImageContainerT> DkImageLoader::getSkippedImage(int skipIdx, bo
             qDebug() << "missing file" << mCurrentImage->filePath();
 
             bool sortAscending = DkSettingsManager::param().global().sortDir == DkSettings::sort_ascending;
-            const auto isLessThan = DkImageContainer::compareFunc();
+            int mode = DkSettingsManager::param().global().sortMode;
+            quint32 seed = DkSettingsManager::param().global().sortSeed;
+            DkSortKey currentKey(mCurrentImage->fileInfo(), mode, seed);
 
+            // compare file paths - this does not create the containers
             currFileIdx = 0;
             for (; currFileIdx < mImages.size(); currFileIdx++) {
-                if (!sortAscending ^ isLessThan(mCurrentImage, mImages[currFileIdx]))
+                if (!sortAscending ^ (currentKey < DkSortKey(QFileInfo(mImages.filePath(currFileIdx)), mode, seed)))
                     break;
             }
 
@@ -581,6 +1035,14 @@ void DkImageLoader::loadFileAt(int idx)
     // if (basicLoader.hasImage() && !file.exists())
     //	return;
 
+    // the folder is indexed in the background - load the file as soon as it is done
+    if (isIndexing(mCurrentDir)) {
+        mPendingFileAt = true;
+        mPendingFileIdx = idx;
+        mPendingSkip = 0;
+        return;
+    }
+
     if (mCurrentImage)
         qDebug() << "current image: " << mCurrentImage->filePath();
     else
@@ -622,6 +1084,42 @@ void DkImageLoader::loadFileAt(int idx)
     load(mCurrentImage);
 }
 
+/**
+ * Returns the file paths of all files with the same base name
+ * (e.g. IMG_0001.CR2 and IMG_0001.JPG) - including filePath itself.
+ * The folder is not scanned again, siblings are collected when it is indexed.
+ * @param filePath a file of the current folder.
+ **/
+QStringList DkImageLoader::siblings(const QString &filePath) const
+{
+    QFileInfo fInfo(filePath);
+    QStringList paths;
+
+    for (const QString &fn : mSiblings.siblings(fInfo.fileName()))
+        paths << QFileInfo(fInfo.absolutePath(), fn).absoluteFilePath();
+
+    return paths;
+}
+
+/**
+ * Switches to the next sibling of the current image (e.g. from RAW to JPG).
+ **/
+void DkImageLoader::loadSibling()
+{
+    if (!mCurrentImage)
+        return;
+
+    QStringList paths = siblings(mCurrentImage->filePath());
+
+    if (paths.size() < 2) {
+        emit showInfoSignal(tr("%1 has no siblings").arg(mCurrentImage->fileName()), 1000);
+        return;
+    }
+
+    int idx = paths.indexOf(mCurrentImage->filePath());
+    load(paths.at((idx + 1) % paths.size()));
+}
+
 QSharedPointer<DkImageContainerT> DkImageLoader::findOrCreateFile(const QString &filePath) const
 {
     QSharedPointer<DkImageContainerT> imgC = findFile(filePath);
@@ -634,36 +1132,40 @@ QSharedPointer<DkImageContainerT> DkImageLoader::findOrCreateFile(const QString
 
 QSharedPointer<DkImageContainerT> DkImageLoader::findFile(const QString &filePath) const
 {
-    // if one image is from zip than all should be
-    // for images in zip the "images[idx]->file() == file" comparison somahow does not work
-    if (mImages.size() > 0) {
-        if (mImages[0]->isFromZip()) {
-            int idx = findFileIdx(filePath, mImages);
-            if (idx < 0)
-                return QSharedPointer<DkImageContainerT>();
-            else
-                return mImages[idx];
-        }
-    }
+    int idx = findFileIdx(filePath, mImages);
 
-    for (int idx = 0; idx < mImages.size(); idx++) {
-        if (mImages[idx]->filePath() == filePath)
-            return mImages[idx];
-    }
+    if (idx < 0)
+        return QSharedPointer<DkImageContainerT>();
 
-    return QSharedPointer<DkImageContainerT>();
+    return mImages[idx];
 }
 
-int DkImageLoader::findFileIdx(const QString &filePath, const QVector<QSharedPointer<DkImageContainerT>> &images) const
+int DkImageLoader::findFileIdx(const QString &filePath, const DkImageList &images) const
 {
-    // this seems a bit bizare...
-    // however, in converting the string from a fileInfo - we quarantee that the separators are the same (/ vs \)
-    QString lFilePath = filePath;
-    lFilePath.replace("\\", QDir::separator());
+    bool indexed = &images == &mImages;
+
+    // the images of this folder are indexed
+    if (indexed) {
+        int idx = mImageIndex.indexOf(filePath);
+
+        if (idx >= 0 && idx < mImages.size() && DkImageIndex::key(mImages.filePath(idx)) == DkImageIndex::key(filePath))
+            return idx;
+
+        // the index misses files whose path changed (e.g. saved images or zip files) - so we search them
+    }
+
+    // the separators of paths from a fileInfo and native paths might differ (/ vs \)
+    QString lFilePath = DkImageIndex::key(filePath);
 
     for (int idx = 0; idx < images.size(); idx++) {
-        if (images[idx]->filePath() == lFilePath)
+        if (DkImageIndex::key(images.filePath(idx)) == lFilePath) {
+            if (indexed) {
+                qWarning() << "[DkImageLoader] image index is outdated";
+                mImageIndex.rebuild(mImages);
+            }
+
             return idx;
+        }
     }
 
     return -1;
@@ -674,12 +1176,12 @@ QStringList DkImageLoader::getFileNames() const
     QStringList fileNames;
 
     for (int idx = 0; idx < mImages.size(); idx++)
-        fileNames.append(QFileInfo(mImages[idx]->filePath()).fileName());
+        fileNames.append(QFileInfo(mImages.filePath(idx)).fileName());
 
     return fileNames;
 }
 
-QVector<QSharedPointer<DkImageContainerT>> DkImageLoader::getImages()
+DkImageList DkImageLoader::getImages()
 {
     loadDir(mCurrentDir);
     return mImages;
@@ -770,10 +1272,14 @@ void DkImageLoader::setCurrentImage(QSharedPointer<DkImageContainerT> newImg)
 
     if (signalsBlocked()) {
         mCurrentImage = newImg;
+
+        // inactive tabs do not show their images
+        if (mCurrentImage)
+            mCurrentImage->setMemoryPriority(DkMemoryGovernor::priority_cached);
         return;
     }
 
-    if (newImg)
+    if (newImg && !isIndexing(newImg->dirPath()))
         loadDir(newImg->dirPath());
     // else
     //	qDebug() << "empty image assigned"; // TODO
@@ -805,6 +1311,7 @@ void DkImageLoader::setCurrentImage(QSharedPointer<DkImageContainerT> newImg)
                 mCurrentImage->clear();
 
             mCurrentImage->getLoader()->resetPageIdx();
+            mCurrentImage->setMemoryPriority(DkMemoryGovernor::priority_cached);
         }
         this->receiveUpdates(false); // reset updates
     }
@@ -812,6 +1319,7 @@ void DkImageLoader::setCurrentImage(QSharedPointer<DkImageContainerT> newImg)
     mCurrentImage = newImg;
 
     if (mCurrentImage) {
+        mCurrentImage->setMemoryPriority(DkMemoryGovernor::priority_current);
         this->receiveUpdates(true);
     }
 }
@@ -830,6 +1338,7 @@ void DkImageLoader::reloadImage()
 
     mCurrentDir = "";
     mImages.clear();
+    mImageIndex.clear();
     mCurrentImage->clear();
     setCurrentImage(mCurrentImage);
     loadDir(mCurrentImage->dirPath());
@@ -856,7 +1365,14 @@ void DkImageLoader::load(const QString &filePath)
     hasZipMarker = filePath.contains(DkZipContainer::zipMarker()) != 0;
 #endif
 
+    QString dirPath = QFileInfo(filePath).absolutePath();
+
     if (QFileInfo(filePath).isFile() || hasZipMarker) {
+        // index new folders in the background so that the image is shown right away
+        if (!hasZipMarker && !signalsBlocked() && !DkSettingsManager::param().global().scanSubFolders && (dirPath != mCurrentDir || mImages.empty())
+            && !isIndexing(dirPath))
+            loadDirThreaded(dirPath);
+
         QSharedPointer<DkImageContainerT> newImg = findOrCreateFile(filePath);
         setCurrentImage(newImg);
         load(mCurrentImage);
@@ -864,7 +1380,8 @@ void DkImageLoader::load(const QString &filePath)
         firstFile();
 
     // if here is a folder upate bug - this was before -- if (QFileInfo(filePath).isFile() || hasZipMarker) {
-    loadDir(QFileInfo(filePath).absolutePath());
+    if (!isIndexing(dirPath))
+        loadDir(dirPath);
 }
 
 void DkImageLoader::load(QSharedPointer<DkImageContainerT> image /* = QSharedPointer<DkImageContainerT> */)
@@ -888,7 +1405,7 @@ void DkImageLoader::load(QSharedPointer<DkImageContainerT> image /* = QSharedPoi
         return;
 
     emit updateSpinnerSignalDelayed(true);
-    bool loaded = mCurrentImage->loadImageThreaded(); // loads file threaded
+    bool loaded = mCurrentImage->loadImageThreaded(false, true); // loads file threaded - large images send a preview first
 
     if (!loaded)
         emit updateSpinnerSignalDelayed(false);
@@ -919,6 +1436,10 @@ void DkImageLoader::imageLoaded(bool loaded /* = false */)
 
     QApplication::sendPostedEvents(); // force an event post here
 
+    int decodeTime = mCurrentImage ? mCurrentImage->takeDecodeTime() : -1;
+    if (decodeTime >= 0)
+        mPrefetchPlanner.addDecodeTime(mCurrentImage->fileInfo().suffix(), decodeTime);
+
     updateCacher(mCurrentImage);
     updateHistory();
 
@@ -926,9 +1447,10 @@ void DkImageLoader::imageLoaded(bool loaded /* = false */)
         emit imageHasGPSSignal(DkMetaDataHelper::getInstance().hasGPS(mCurrentImage->getMetaData()));
 
     // update status bar info
-    if (mCurrentImage && !mImages.empty() && mImages.indexOf(mCurrentImage) >= 0)
-        DkStatusBarManager::instance().setMessage(tr("%1 of %2").arg(mImages.indexOf(mCurrentImage) + 1).arg(mImages.size()),
-                                                  DkStatusBar::status_filenumber_info);
+    int currentIdx = mCurrentImage ? findFileIdx(mCurrentImage->filePath(), mImages) : -1;
+
+    if (currentIdx >= 0)
+        DkStatusBarManager::instance().setMessage(tr("%1 of %2").arg(currentIdx + 1).arg(mImages.size()), DkStatusBar::status_filenumber_info);
     else
         DkStatusBarManager::instance().setMessage("", DkStatusBar::status_filenumber_info);
 }
@@ -1441,6 +1963,7 @@ bool DkImageLoader::deleteFile()
         int currFileIdx = findFileIdx(mCurrentImage->filePath(), mImages);
         if (DkUtils::moveToTrash(mCurrentImage->filePath())) {
             mImages.removeAt(currFileIdx);
+            mImageIndex.rebuild(mImages);
             QSharedPointer<DkImageContainerT> imgC = getSkippedImage(1);
             if (!imgC)
                 imgC = getSkippedImage(0); // deleted from the end
@@ -1635,7 +2158,7 @@ QFileInfoList DkImageLoader::updateSubFolders(const QString &rootDirPath)
     // find the first subfolder that has images
     for (int idx = 0; idx < mSubFolders.size(); idx++) {
         mCurrentDir = mSubFolders[idx];
-        files = getFilteredFileInfoList(mCurrentDir); // this line takes seconds if you have lots of files and slow loading (e.g. network)
+        files = getFilteredFileInfoList(mCurrentDir, QString(), &mSiblings); // this line takes seconds if you have lots of files and slow loading (e.g. network)
         if (!files.empty())
             break;
     }
@@ -1702,62 +2225,96 @@ void DkImageLoader::updateCacher(QSharedPointer<DkImageContainerT> imgC)
 
     DkTimer dt;
 
-    //// no caching? delete all
-    // if (!DkSettingsManager::param().resources().cacheMemory) {
-    //	for (int idx = 0; idx < images.size(); idx++) {
-    //		images.at(idx)->clear();
-    //	}
-    //	return;
-    // }
-
     int cIdx = findFileIdx(imgC->filePath(), mImages);
     double mem = 0;
     double totalMem = 0;
+    double mappedMem = 0; // mapped file buffers are accounted separately
 
     if (cIdx == -1) {
         qWarning() << "WARNING: image not found for caching!";
         return;
     }
 
+    mPrefetchPlanner.navigated(cIdx, mImages.size());
+    DkPrefetchPlanner::Plan plan = mPrefetchPlanner.plan(cIdx, mImages.size(), imgC->fileInfo().suffix(), imgC->getMemoryUsage());
+
     for (int idx = 0; idx < mImages.size(); idx++) {
-        auto cImg = mImages.at(idx);
+        auto cImg = mImages.created(idx);
+
+        if (!cImg)
+            continue;
+
+        if (idx == cIdx) {
+            mappedMem += cImg->getMappedMemoryUsage();
+            totalMem += cImg->getMemoryUsage();
+            continue;
+        }
 
         // clear images if they are edited
-        if (idx != cIdx && cImg->isEdited()) {
+        if (cImg->isEdited()) {
             cImg->clear();
             continue;
         }
 
-        // do not count the last & the current image
-        if (idx > cIdx && idx <= cIdx + DkSettingsManager::param().resources().maxImagesCached)
-            mem += cImg->getMemoryUsage();
-        else if (abs(cIdx - idx) > 1) {
+        mappedMem += cImg->getMappedMemoryUsage();
+
+        // this cancels prefetching images that are not needed anymore
+        if (!plan.decode.contains(idx) && !plan.fetch.contains(idx)) {
             cImg->clear();
             if (cImg->hasImage())
                 qDebug() << "[Cacher]" << cImg->filePath() << "freed";
 
-            continue;
-        } else
-            totalMem += cImg->getMemoryUsage();
+            // the thumbnail views create containers too - keep only the ones that hold something
+            if (cImg != mLastImageLoaded)
+                mImages.release(idx);
 
-        // ignore the last and current one
-        if (idx == cIdx - 1 || idx == cIdx) {
             continue;
         }
-        // fully load the next image
-        else if (idx == cIdx + 1 && mem < DkSettingsManager::param().resources().cacheMemory
-                 && mImages.at(idx)->getLoadState() == DkImageContainerT::not_loaded) {
+
+        mem += cImg->getMemoryUsage();
+    }
+
+    // fully load the images we will most likely show next
+    for (int idx : plan.decode) {
+        auto cImg = mImages.at(idx);
+
+        if (cImg->getLoadState() == DkImageContainerT::not_loaded) {
+            connect(cImg.data(), &DkImageContainerT::fileLoadedSignal, this, &DkImageLoader::imagePrefetched, Qt::UniqueConnection);
             cImg->loadImageThreaded();
             qDebug() << "[Cacher] " << cImg->filePath() << " fully cached...";
-        } else if (idx > cIdx && idx < cIdx + DkSettingsManager::param().resources().maxImagesCached - 2
-                   && mem < DkSettingsManager::param().resources().cacheMemory && mImages.at(idx)->getLoadState() == DkImageContainerT::not_loaded) {
-            // dt.getIvl();
-            mImages.at(idx)->fetchFile(); // TODO: crash detected here
+        }
+    }
+
+    double cacheMem = DkPrefetchPlanner::cacheMemory();
+
+    for (int idx : plan.fetch) {
+        auto cImg = mImages.at(idx);
+
+        if (mem < cacheMem && cImg->getLoadState() == DkImageContainerT::not_loaded) {
+            cImg->fetchFile();
             qDebug() << "[Cacher] " << cImg->filePath() << " file fetched...";
         }
     }
 
-    qDebug() << "[Cacher] created in" << dt << "(" << mem + totalMem << "MB)";
+    qDebug() << "[Cacher] created in" << dt << "(" << mem + totalMem << "MB heap," << mappedMem << "MB mapped)"
+             << "decoding" << plan.decode.size() << "images";
+}
+
+/**
+ * Learns the decode time of images that were loaded in advance.
+ **/
+void DkImageLoader::imagePrefetched()
+{
+    DkImageContainerT *imgC = qobject_cast<DkImageContainerT *>(sender());
+
+    if (!imgC)
+        return;
+
+    disconnect(imgC, &DkImageContainerT::fileLoadedSignal, this, &DkImageLoader::imagePrefetched);
+
+    int ms = imgC->takeDecodeTime();
+    if (ms >= 0)
+        mPrefetchPlanner.addDecodeTime(imgC->fileInfo().suffix(), ms);
 }
 
 /**
@@ -1766,9 +2323,10 @@ void DkImageLoader::updateCacher(QSharedPointer<DkImageContainerT> imgC)
  * directory or if the directory is in the net.
  * Currently the file list is sorted according to the system specification.
  * @param dir the directory to load the file list from.
+ * @param siblings if set, it is assigned the RAW + JPG (and other) siblings of the directory.
  * @return QStringList all filtered files of the current directory.
  **/
-QFileInfoList DkImageLoader::getFilteredFileInfoList(const QString &dirPath, QString folderKeywords) const
+QFileInfoList DkImageLoader::getFilteredFileInfoList(const QString &dirPath, QString folderKeywords, DkSiblingIndex *siblings)
 {
     DkTimer dt;
 
@@ -1784,18 +2342,6 @@ QFileInfoList DkImageLoader::getFilteredFileInfoList(const QString &dirPath, QSt
     WIN32_FIND_DATAW findFileData;
     HANDLE MyHandle = FindFirstFileW(fname, &findFileData);
 
-    std::vector<std::wstring> fileNameList;
-    std::wstring fileName;
-
-    if (MyHandle != INVALID_HANDLE_VALUE) {
-        do {
-            fileName = findFileData.cFileName;
-            fileNameList.push_back(fileName); // TODO: sort correct according to numbers
-        } while (FindNextFileW(MyHandle, &findFileData) != 0);
-    }
-
-    FindClose(MyHandle);
-
     // remove the * in fileFilters
     QStringList fileFiltersClean = DkSettingsManager::param().app().browseFilters;
     for (QString &filter : fileFiltersClean)
@@ -1804,39 +2350,77 @@ QFileInfoList DkImageLoader::getFilteredFileInfoList(const QString &dirPath, QSt
     // qDebug() << "browse filters: " << DkSettingsManager::param().app().browseFilters;
 
     QStringList fileList;
-    std::vector<std::wstring>::iterator lIter = fileNameList.begin();
+    QStringList noSuffixFiles;
 
-    // convert to QStringList
-    for (unsigned int idx = 0; idx < fileNameList.size(); idx++, lIter++) {
-        QString qFilename = DkUtils::stdWStringToQString(*lIter);
+    if (MyHandle != INVALID_HANDLE_VALUE) {
+        do {
+            if (findFileData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+                continue;
 
-        // believe it or not, but this is 10 times faster than QRegExp
-        // drawback: we also get files that contain *.jpg*
-        for (int i = 0; i < fileFiltersClean.size(); i++) {
-            if (qFilename.contains(fileFiltersClean[i], Qt::CaseInsensitive)) {
-                fileList.append(qFilename);
-                break;
+            QString qFilename = DkUtils::stdWStringToQString(findFileData.cFileName);
+
+            if (!qFilename.contains(".")) {
+                noSuffixFiles << qFilename;
+                continue;
             }
-        }
+
+            // believe it or not, but this is 10 times faster than QRegExp
+            // drawback: we also get files that contain *.jpg*
+            for (int i = 0; i < fileFiltersClean.size(); i++) {
+                if (qFilename.contains(fileFiltersClean[i], Qt::CaseInsensitive)) {
+                    fileList.append(qFilename);
+                    break;
+                }
+            }
+        } while (FindNextFileW(MyHandle, &findFileData) != 0);
     }
 
+    FindClose(MyHandle);
+
     qInfoClean() << "WinAPI, indexed (" << fileList.size() << ") files in: " << dt;
 #else
 
-    // true file list
-    QDir tmpDir(dirPath);
-    tmpDir.setSorting(QDir::LocaleAware);
-    QStringList fileList = tmpDir.entryList(DkSettingsManager::param().app().browseFilters);
+    // lower case suffixes of the browse filters (e.g. *.jpg -> jpg)
+    QSet<QString> suffixes;
+    for (const QString &filter : DkSettingsManager::param().app().browseFilters)
+        suffixes.insert(filter.mid(filter.lastIndexOf(".") + 1).toLower());
+
+    QStringList fileList;
+    QStringList noSuffixFiles;
+
+    // a single readdir pass - d_type lets us skip folders without calling stat() (if the file system reports it)
+    DIR *dir = opendir(QFile::encodeName(dirPath).constData());
+
+    if (dir) {
+        while (dirent *entry = readdir(dir)) {
+            if (entry->d_name[0] == '.' || entry->d_type == DT_DIR)
+                continue;
 
+            QString name = QFile::decodeName(entry->d_name);
+            int dotIdx = name.lastIndexOf(".");
+
+            if (dotIdx != -1 && !suffixes.contains(name.mid(dotIdx + 1).toLower()))
+                continue;
+
+            // some file systems do not fill d_type and links might point to folders - stat() the candidates
+            if ((entry->d_type == DT_UNKNOWN || entry->d_type == DT_LNK) && QFileInfo(dirPath, name).isDir())
+                continue;
+
+            if (dotIdx == -1)
+                noSuffixFiles << name;
+            else
+                fileList << name;
+        }
+
+        closedir(dir);
+    }
+
+    qInfoClean() << "readdir, indexed (" << fileList.size() << ") files in: " << dt;
 #endif
 
     // append files with no suffix
-    QDir cDir(dirPath);
-    QStringList allFiles = cDir.entryList();
-    QStringList noSuffixFiles;
-
-    for (const QString &name : allFiles) {
-        if (!name.contains(".") && DkUtils::isValid(QFileInfo(dirPath, name))) {
+    for (const QString &name : noSuffixFiles) {
+        if (DkUtils::isValid(QFileInfo(dirPath, name))) {
             fileList << name;
         }
     }
@@ -1846,64 +2430,57 @@ QFileInfoList DkImageLoader::getFilteredFileInfoList(const QString &dirPath, QSt
         fileList = DkUtils::filterStringList(folderKeywords, filterList);
     }
 
-    if (DkSettingsManager::param().resources().filterDuplicats) {
-        QString preferredExtension = DkSettingsManager::param().resources().preferredExtension;
-        preferredExtension = preferredExtension.replace("*.", "");
-        qDebug() << "preferred extension: " << preferredExtension;
+    // group RAW + JPG (and other) siblings by their base name
+    DkSiblingIndex siblingIndex(fileList);
 
-        QStringList resultList = fileList;
-        fileList.clear();
-
-        for (int idx = 0; idx < resultList.size(); idx++) {
-            QFileInfo cFName = QFileInfo(resultList.at(idx));
-
-            if (preferredExtension.compare(cFName.suffix(), Qt::CaseInsensitive) == 0) {
-                fileList.append(resultList.at(idx));
-                continue;
-            }
-
-            QString cFBase = cFName.baseName();
-            bool remove = false;
-
-            for (int cIdx = 0; cIdx < resultList.size(); cIdx++) {
-                QString ccBase = QFileInfo(resultList.at(cIdx)).baseName();
-
-                if (cIdx != idx && ccBase == cFBase && resultList.at(cIdx).contains(preferredExtension, Qt::CaseInsensitive)) {
-                    remove = true;
-                    break;
-                }
-            }
+    if (DkSettingsManager::param().resources().filterDuplicats) {
+        QStringList priority = DkSiblingIndex::extensionPriority(DkSettingsManager::param().resources().preferredExtension);
+        qDebug() << "extension priority: " << priority;
 
-            if (!remove)
-                fileList.append(resultList.at(idx));
-        }
+        fileList = siblingIndex.filter(fileList, priority);
     }
 
+    if (siblings)
+        *siblings = siblingIndex;
+
     // fileList = sort(fileList, dir);
 
     QFileInfoList fileInfoList;
 
     for (int idx = 0; idx < fileList.size(); idx++)
-        fileInfoList.append(QFileInfo(mCurrentDir, fileList.at(idx)));
+        fileInfoList.append(QFileInfo(dirPath, fileList.at(idx)));
 
     return fileInfoList;
 }
 
 void DkImageLoader::sort()
 {
-    for (auto &img : qAsConst(mImages))
-        if (!img) {
-            qWarning() << "attempt to sort null image(s) averted";
-            return;
-        }
-
     bool ascending = DkSettingsManager::param().global().sortDir == DkSettings::sort_ascending;
+    int mode = DkSettingsManager::param().global().sortMode;
+    quint32 seed = DkSettingsManager::param().global().sortSeed;
+
+    // compute the sort keys once and sort key/index pairs - this is much faster than comparing containers
+    std::vector<std::pair<DkSortKey, int>> keys;
+    keys.reserve(mImages.size());
+
+    for (int idx = 0; idx < mImages.size(); idx++)
+        keys.emplace_back(DkSortKey(QFileInfo(mImages.filePath(idx)), mode, seed), idx);
+
+    std::sort(keys.begin(), keys.end(), [](const std::pair<DkSortKey, int> &lhs, const std::pair<DkSortKey, int> &rhs) {
+        return lhs.first < rhs.first;
+    });
 
-    auto cmp = DkImageContainer::compareFunc();
+    QVector<int> order;
+    order.reserve(mImages.size());
+
+    for (const auto &k : keys)
+        order << k.second;
+
+    mImages = mImages.reordered(order);
 
-    std::sort(mImages.begin(), mImages.end(), cmp);
     if (!ascending)
-        std::reverse(mImages.begin(), mImages.end());
+        mImages.reverse();
+    mImageIndex.rebuild(mImages);
 
     emit updateDirSignal(mImages);
 }
@@ -1916,6 +2493,14 @@ void DkImageLoader::currentImageUpdated() const
     emit imageUpdatedSignal(mCurrentImage);
 }
 
+void DkImageLoader::previewLoaded() const
+{
+    if (mCurrentImage.isNull() || mCurrentImage->getLoadState() != DkImageContainerT::loading)
+        return;
+
+    emit imagePreviewSignal(mCurrentImage);
+}
+
 /**
  * Returns the directory where files are copied to.
  * @return QDir the directory where the user copied the last file to.
@@ -1995,6 +2580,12 @@ void DkImageLoader::setDir(const QString &dir)
 {
     // QDir oldDir = file.absoluteDir();
 
+    // the folder is indexed in the background - its first file is loaded as soon as it is done
+    if (isIndexing(dir)) {
+        loadFileAt(0);
+        return;
+    }
+
     bool valid = loadDir(dir);
 
     if (valid)
@@ -2068,12 +2659,14 @@ void DkImageLoader::receiveUpdates(bool connectSignals)
         connect(currImage, &DkImageContainerT::showInfoSignal, this, &DkImageLoader::showInfoSignal, Qt::UniqueConnection);
         connect(currImage, &DkImageContainerT::fileSavedSignal, this, &DkImageLoader::imageSaved, Qt::UniqueConnection);
         connect(currImage, &DkImageContainerT::imageUpdatedSignal, this, &DkImageLoader::currentImageUpdated, Qt::UniqueConnection);
+        connect(currImage, &DkImageContainerT::previewLoadedSignal, this, &DkImageLoader::previewLoaded, Qt::UniqueConnection);
     } else if (!connectSignals) {
         disconnect(currImage, &DkImageContainerT::errorDialogSignal, this, &DkImageLoader::errorDialog);
         disconnect(currImage, &DkImageContainerT::fileLoadedSignal, this, &DkImageLoader::imageLoaded);
         disconnect(currImage, &DkImageContainerT::showInfoSignal, this, &DkImageLoader::showInfoSignal);
         disconnect(currImage, &DkImageContainerT::fileSavedSignal, this, &DkImageLoader::imageSaved);
         disconnect(currImage, &DkImageContainerT::imageUpdatedSignal, this, &DkImageLoader::currentImageUpdated);
+        disconnect(currImage, &DkImageContainerT::previewLoadedSignal, this, &DkImageLoader::previewLoaded);
     }
 
     currImage->receiveUpdates(connectSignals);
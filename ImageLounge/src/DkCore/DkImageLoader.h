@@ -28,7 +28,11 @@
 #pragma once
 
 #pragma warning(push, 0) // no warnings from includes - begin
+#include <QElapsedTimer>
+#include <QHash>
 #include <QImage>
+#include <QPair>
+#include <QStringList>
 #include <QTimer>
 #pragma warning(pop) // no warnings from includes - end
 
@@ -56,6 +60,80 @@ class QUrl;
 namespace nmc
 {
 
+/**
+ * DkImageIndex maps (normalized) file paths to their positions in a DkImageList.
+ * Lookups are O(1), the index must be rebuilt whenever the images are changed.
+ **/
+class DllCoreExport DkImageIndex
+{
+public:
+    DkImageIndex(const DkImageList &images = DkImageList());
+
+    void rebuild(const DkImageList &images);
+    void clear();
+    int indexOf(const QString &filePath) const;
+
+    static QString key(const QString &filePath);
+
+protected:
+    QHash<QString, int> mIndex;
+};
+
+/**
+ * DkSiblingIndex groups the files of a folder by their base name.
+ * Files with the same base name (e.g. IMG_0001.CR2 and IMG_0001.JPG) are siblings.
+ * Only groups with more than one file are stored.
+ **/
+class DllCoreExport DkSiblingIndex
+{
+public:
+    DkSiblingIndex(const QStringList &fileNames = QStringList());
+
+    QStringList filter(const QStringList &fileNames, const QStringList &extensionPriority) const;
+    QStringList siblings(const QString &fileName) const;
+    bool isEmpty() const;
+
+    static QString baseName(const QString &fileName);
+    static QStringList extensionPriority(const QString &extensions);
+
+protected:
+    QHash<QString, QStringList> mGroups; // base name -> file names
+};
+
+/**
+ * DkPrefetchPlanner decides which images are decoded before they are shown.
+ * It learns the navigation direction and step size (e.g. skipping files)
+ * and how fast the user navigates (e.g. holding an arrow key, slideshows).
+ * The number of images decoded in advance depends on the measured decode
+ * time per file format and on the cache memory.
+ **/
+class DllCoreExport DkPrefetchPlanner
+{
+public:
+    struct Plan {
+        QVector<int> decode; // images to decode - the most important first
+        QVector<int> fetch; // images whose file is read
+    };
+
+    void navigated(int idx, int numFiles);
+    void reset();
+    void addDecodeTime(const QString &suffix, int ms);
+    int decodeTime(const QString &suffix) const;
+
+    Plan plan(int idx, int numFiles, const QString &suffix, double imageMemory) const;
+    static double cacheMemory();
+
+protected:
+    int wrap(int idx, int numFiles) const;
+
+    QHash<QString, double> mDecodeTimes; // suffix -> mean decode time in ms
+    QElapsedTimer mTimer;
+    double mInterval = -1; // mean time between two images in ms
+    int mLastIdx = -1;
+    int mStep = 1;
+    int mConfidence = 0; // how often the last step was repeated
+};
+
 /**
  * This class is a basic image loader class.
  * It takes care of the file watches for the current folder,
@@ -79,7 +157,8 @@ public:
     QString filePath() const;
     QStringList getFileNames() const;
 
-    QVector<QSharedPointer<DkImageContainerT>> getImages();
+    DkImageList getImages();
+    QStringList siblings(const QString &filePath) const;
     QSharedPointer<DkImageContainerT> setImage(const QImage &img, const QString &editName, const QString &editFilePath = QString());
     QSharedPointer<DkImageContainerT> setImage(QSharedPointer<DkImageContainerT> img);
     void setImageUpdated();
@@ -115,8 +194,9 @@ signals:
     void imageUpdatedSignal(QSharedPointer<DkImageContainerT> image) const;
     void imageUpdatedSignal(int idx) const; // folder scrollbar needs that
     void imageLoadedSignal(QSharedPointer<DkImageContainerT> image, bool loaded = true) const;
+    void imagePreviewSignal(QSharedPointer<DkImageContainerT> image) const;
     void showInfoSignal(const QString &msg, int time = 3000, int position = 0) const;
-    void updateDirSignal(QVector<QSharedPointer<DkImageContainerT>> images) const;
+    void updateDirSignal(DkImageList images) const;
     void imageHasGPSSignal(bool hasGPS) const;
     void loadImageToTab(const QString &filePath) const;
 
@@ -139,12 +219,16 @@ public slots:
     void loadDirRecursive(const QString &newDirPath);
     void errorDialog(const QString &msg) const;
     void loadFileAt(int idx);
+    void loadSibling();
 
     // new slots
     void currentImageUpdated() const;
     void imageLoaded(bool loaded = false);
+    void previewLoaded() const;
     void imageSaved(const QString &file, bool saved = true, bool loadToTab = true);
     void imagesSorted();
+    void dirIndexed();
+    void imagePrefetched();
     bool unloadFile();
     void reloadImage();
     void showOnMap();
@@ -154,13 +238,17 @@ protected:
     void updateCacher(QSharedPointer<DkImageContainerT> imgC);
     int getSubFolderIdx(int fromIdx, bool forward) const;
     void updateHistory();
-    void sortImagesThreaded(QVector<QSharedPointer<DkImageContainerT>> images);
+    void sortImagesThreaded(DkImageList images);
     void createImages(const QFileInfoList &files, bool sort = true);
-    QVector<QSharedPointer<DkImageContainerT>> sortImages(QVector<QSharedPointer<DkImageContainerT>> images) const;
+    void loadDirThreaded(const QString &dirPath);
+    bool isIndexing(const QString &dirPath) const;
+    void clearPendingNavigation();
+    void applyPendingNavigation();
+    DkImageList sortImages(DkImageList images) const;
     void receiveUpdates(bool connectSignals);
 
     static QStringList getFoldersRecursive(const QString &dirPath);
-    QFileInfoList getFilteredFileInfoList(const QString &dirPath, QString folderKeywords = QString()) const;
+    static QFileInfoList getFilteredFileInfoList(const QString &dirPath, QString folderKeywords = QString(), DkSiblingIndex *siblings = 0);
 
     void clearPath();
 
@@ -168,7 +256,7 @@ protected:
 
     QSharedPointer<DkImageContainerT> findOrCreateFile(const QString &filePath) const;
     QSharedPointer<DkImageContainerT> findFile(const QString &filePath) const;
-    int findFileIdx(const QString &filePath, const QVector<QSharedPointer<DkImageContainerT>> &images) const;
+    int findFileIdx(const QString &filePath, const DkImageList &images) const;
 
     bool hasFile() const;
     QString fileName() const;
@@ -181,13 +269,23 @@ protected:
     QString mCopyDir;
     QFileSystemWatcher *mDirWatcher = 0;
     QStringList mSubFolders;
-    QVector<QSharedPointer<DkImageContainerT>> mImages;
+    DkImageList mImages;
+    mutable DkImageIndex mImageIndex; // file path -> index of mImages (rebuilt if a path changed)
+    DkSiblingIndex mSiblings; // RAW + JPG siblings of the current folder
     QSharedPointer<DkImageContainerT> mCurrentImage;
     QSharedPointer<DkImageContainerT> mLastImageLoaded;
     bool mFolderUpdated = false;
     bool mSortingImages = false;
     bool mSortingIsDirty = false;
-    QFutureWatcher<QVector<QSharedPointer<DkImageContainerT>>> mCreateImageWatcher;
+    QFutureWatcher<DkImageList> mCreateImageWatcher;
+    QFutureWatcher<QPair<QFileInfoList, DkSiblingIndex>> mIndexDirWatcher;
+    QString mIndexingDir; // folder that is indexed in the background
+
+    // navigation requested while the folder is indexed - it is applied in dirIndexed()
+    int mPendingSkip = 0;
+    bool mPendingFileAt = false;
+    int mPendingFileIdx = 0;
+    DkPrefetchPlanner mPrefetchPlanner;
 };
 
 }
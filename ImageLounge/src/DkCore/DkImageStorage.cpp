@@ -27,7 +27,9 @@
 
 #include "DkImageStorage.h"
 #include "DkActionManager.h"
+#include "DkImageKernels.h"
 #include "DkMath.h"
+#include "DkMemoryGovernor.h"
 #include "DkSettings.h"
 #include "DkThumbs.h"
 #include "DkTimer.h"
@@ -47,6 +49,8 @@
 #include <QPainter>
 #include <QPixmap>
 #include <QSvgRenderer>
+#include <QThread>
+#include <QThreadPool>
 #include <QTimer>
 #include <QtConcurrentRun>
 #include <qmath.h>
@@ -96,6 +100,306 @@ float DkImage::getBufferSizeFloat(const QSize &imgSize, const int depth)
     return (float)size / (1024.0f * 1024.0f);
 }
 
+// gamma correct resampling --------------------------------------------------------------------
+struct DkResampleWeights {
+    QVector<int> start; // first source index per target index
+    QVector<int> count; // number of source indices per target index
+    QVector<float> weights; // maxCount weights per target index
+    int maxCount = 0;
+};
+
+static double resampleKernel(double t, int interpolation)
+{
+    t = std::abs(t);
+
+    switch (interpolation) {
+    case DkImage::ipl_linear:
+        return t < 1.0 ? 1.0 - t : 0.0;
+    case DkImage::ipl_cubic: {
+        // same coefficient as OpenCV's bicubic interpolation
+        const double a = -0.75;
+        if (t < 1.0)
+            return ((a + 2.0) * t - (a + 3.0)) * t * t + 1.0;
+        if (t < 2.0)
+            return ((a * t - 5.0 * a) * t + 8.0 * a) * t - 4.0 * a;
+        return 0.0;
+    }
+    case DkImage::ipl_lanczos: {
+        if (t < DBL_EPSILON)
+            return 1.0;
+        if (t >= 4.0)
+            return 0.0;
+        double pt = CV_PI * t;
+        return 4.0 * std::sin(pt) * std::sin(pt / 4.0) / (pt * pt);
+    }
+    }
+
+    return 0.0;
+}
+
+static int resampleKernelRadius(int interpolation)
+{
+    switch (interpolation) {
+    case DkImage::ipl_cubic:
+        return 2;
+    case DkImage::ipl_lanczos:
+        return 4;
+    }
+
+    return 1;
+}
+
+/**
+ * Computes the (normalized) filter weights for downsampling srcSize values to dstSize values.
+ * The kernels are stretched by the scale factor to prevent aliasing.
+ **/
+static DkResampleWeights resampleWeights(int srcSize, int dstSize, int interpolation)
+{
+    DkResampleWeights rw;
+    rw.start.resize(dstSize);
+    rw.count.resize(dstSize);
+
+    double scale = (double)srcSize / dstSize;
+    double fScale = qMax(1.0, scale);
+    double support = interpolation == DkImage::ipl_area ? scale : resampleKernelRadius(interpolation) * fScale;
+    rw.maxCount = qMin(srcSize, (int)std::ceil(2.0 * support) + 2);
+    rw.weights.fill(0.0f, dstSize * rw.maxCount);
+
+    QVector<double> cw(rw.maxCount);
+
+    for (int dIdx = 0; dIdx < dstSize; dIdx++) {
+        int lo, hi;
+        double center = 0.0;
+
+        if (interpolation == DkImage::ipl_area) {
+            lo = (int)std::floor(dIdx * scale);
+            hi = (int)std::ceil((dIdx + 1) * scale) - 1;
+        } else {
+            center = (dIdx + 0.5) * scale - 0.5;
+            lo = (int)std::ceil(center - support);
+            hi = (int)std::floor(center + support);
+        }
+
+        // taps outside the image are folded onto the border pixels
+        int start = qBound(0, lo, srcSize - 1);
+        int end = qBound(0, hi, srcSize - 1);
+        end = qMin(end, start + rw.maxCount - 1);
+        cw.fill(0.0);
+
+        double sum = 0.0;
+        for (int sIdx = lo; sIdx <= hi; sIdx++) {
+            double w;
+
+            if (interpolation == DkImage::ipl_area)
+                w = qMin((dIdx + 1) * scale, sIdx + 1.0) - qMax(dIdx * scale, (double)sIdx);
+            else
+                w = resampleKernel((sIdx - center) / fScale, interpolation);
+
+            int cIdx = qBound(start, sIdx, end) - start;
+            cw[cIdx] += w;
+            sum += w;
+        }
+
+        rw.start[dIdx] = start;
+        rw.count[dIdx] = end - start + 1;
+
+        float *wPtr = rw.weights.data() + dIdx * rw.maxCount;
+        for (int cIdx = 0; cIdx < rw.count[dIdx]; cIdx++)
+            wPtr[cIdx] = sum != 0.0 ? (float)(cw[cIdx] / sum) : 0.0f;
+    }
+
+    return rw;
+}
+
+// sRGB (8 bit) -> linear [0 1]
+static const QVector<float> &srgbToLinearTable()
+{
+    static const QVector<float> lut = [] {
+        QVector<float> t(256);
+        for (int idx = 0; idx < 256; idx++) {
+            double v = idx / 255.0;
+            t[idx] = (float)(v <= 0.04045 ? v / 12.92 : std::pow((v + 0.055) / 1.055, 2.4));
+        }
+        return t;
+    }();
+
+    return lut;
+}
+
+// linear [0 USHRT_MAX] -> sRGB (8 bit)
+static const QVector<uchar> &linearToSrgbTable()
+{
+    static const QVector<uchar> lut = [] {
+        QVector<uchar> t(USHRT_MAX + 1);
+        for (int idx = 0; idx <= USHRT_MAX; idx++) {
+            double v = idx / (double)USHRT_MAX;
+            v = v <= 0.0031308 ? v * 12.92 : 1.055 * std::pow(v, 1 / 2.4) - 0.055;
+            t[idx] = (uchar)qRound(v * 255.0);
+        }
+        return t;
+    }();
+
+    return lut;
+}
+
+/**
+ * Returns the number of 8 bit channels if the format can be resampled.
+ **/
+static int resampleChannels(QImage::Format format)
+{
+    switch (format) {
+    case QImage::Format_RGB32:
+    case QImage::Format_ARGB32:
+    case QImage::Format_ARGB32_Premultiplied:
+    case QImage::Format_RGBX8888:
+    case QImage::Format_RGBA8888:
+    case QImage::Format_RGBA8888_Premultiplied:
+        return 4;
+    case QImage::Format_RGB888:
+        return 3;
+    case QImage::Format_Grayscale8:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+/**
+ * Resamples the target rows [yStart yEnd).
+ * Source rows are converted to floats with the channel luts and filtered
+ * horizontally one at a time - so no full size float/16 bit copy of the image is needed.
+ **/
+static void resampleStripe(const QImage &src,
+                           uchar *dstBits,
+                           int dstBpl,
+                           int dstWidth,
+                           int channels,
+                           const DkResampleWeights &rx,
+                           const DkResampleWeights &ry,
+                           const float *const *luts,
+                           const uchar *toGamma,
+                           int yStart,
+                           int yEnd)
+{
+    const int dw = dstWidth * channels;
+
+    // ring buffer with horizontally filtered source rows
+    const int ringSize = ry.maxCount;
+    QVector<float> ring(ringSize * dw);
+    QVector<int> ringRow(ringSize, -1);
+    QVector<float> acc(dw);
+
+    for (int y = yStart; y < yEnd; y++) {
+        acc.fill(0.0f);
+
+        for (int k = 0; k < ry.count[y]; k++) {
+            int sy = ry.start[y] + k;
+            float *hRow = ring.data() + (sy % ringSize) * dw;
+
+            if (ringRow[sy % ringSize] != sy) {
+                const uchar *sPtr = src.constScanLine(sy);
+
+                for (int x = 0; x < dstWidth; x++) {
+                    const float *w = rx.weights.constData() + x * rx.maxCount;
+                    const uchar *px = sPtr + rx.start[x] * channels;
+                    float *hPx = hRow + x * channels;
+
+                    for (int c = 0; c < channels; c++)
+                        hPx[c] = 0.0f;
+
+                    for (int wIdx = 0; wIdx < rx.count[x]; wIdx++, px += channels) {
+                        for (int c = 0; c < channels; c++)
+                            hPx[c] += w[wIdx] * luts[c][px[c]];
+                    }
+                }
+
+                ringRow[sy % ringSize] = sy;
+            }
+
+            float w = ry.weights[y * ry.maxCount + k];
+            for (int idx = 0; idx < dw; idx++)
+                acc[idx] += w * hRow[idx];
+        }
+
+        uchar *dPtr = dstBits + (qint64)y * dstBpl;
+        for (int idx = 0; idx < dw; idx++) {
+            float v = qBound(0.0f, acc[idx], 1.0f);
+
+            // the 4th channel is never gamma corrected
+            if (toGamma && (channels != 4 || idx % 4 != 3))
+                dPtr[idx] = toGamma[qRound(v * USHRT_MAX)];
+            else
+                dPtr[idx] = (uchar)qRound(v * 255.0f);
+        }
+    }
+}
+
+/**
+ * Downsamples 8 bit images in parallel stripes.
+ * @param src an image with a format supported by resampleChannels()
+ * @param size the new size (must not be larger than the image)
+ * @param interpolation one of ipl_area, ipl_linear, ipl_cubic, ipl_lanczos
+ * @param linearize if true, the image is resampled in linear color space
+ * @param cancel if set to 1, the computation is stopped at the next stripe and a null image is returned
+ * @return QImage the resized image
+ **/
+static QImage resampleImage(const QImage &src, const QSize &size, int interpolation, bool linearize, const QSharedPointer<QAtomicInt> &cancel = QSharedPointer<QAtomicInt>())
+{
+    DkTimer dt;
+
+    int channels = resampleChannels(src.format());
+    if (channels == 0 || size.isEmpty())
+        return QImage();
+
+    // lookup tables for each channel (the 4th channel is alpha which is not gamma corrected)
+    QVector<float> identityLut(256);
+    for (int idx = 0; idx < 256; idx++)
+        identityLut[idx] = idx / 255.0f;
+
+    const float *toLinear = linearize ? srgbToLinearTable().constData() : identityLut.constData();
+    const float *luts[4] = {toLinear, toLinear, toLinear, identityLut.constData()};
+    const uchar *toGamma = linearize ? linearToSrgbTable().constData() : nullptr;
+
+    DkResampleWeights rx = resampleWeights(src.width(), size.width(), interpolation);
+    DkResampleWeights ry = resampleWeights(src.height(), size.height(), interpolation);
+
+    QImage dst(size, src.format());
+    if (dst.isNull())
+        return dst;
+
+    dst.setColorSpace(src.colorSpace());
+
+    // get the pointer here - scanLine() is not thread-safe
+    uchar *dstBits = dst.bits();
+    const int dstBpl = dst.bytesPerLine();
+
+    // stripes are computed in parallel - each stripe has its own ring buffer
+    const int numStripes = qMax(1, QThread::idealThreadCount() * 2);
+    const int stripeHeight = qMax(16, (size.height() + numStripes - 1) / numStripes);
+
+    QVector<QFuture<void>> stripes;
+    for (int y = 0; y < size.height(); y += stripeHeight) {
+        int yEnd = qMin(y + stripeHeight, size.height());
+
+        stripes << QtConcurrent::run(DkImage::stripePool(), [&, y, yEnd] {
+            if (cancel && cancel->loadRelaxed())
+                return;
+
+            resampleStripe(src, dstBits, dstBpl, size.width(), channels, rx, ry, luts, toGamma, y, yEnd);
+        });
+    }
+
+    for (QFuture<void> &f : stripes)
+        f.waitForFinished();
+
+    if (cancel && cancel->loadRelaxed())
+        return QImage();
+
+    qDebug() << "[DkImage] resampled to" << size << "in" << dt;
+
+    return dst;
+}
+
 /**
  * This function resizes an image according to the interpolation method specified.
  * @param img the image to resize
@@ -120,6 +424,17 @@ DkImage::resizeImage(const QImage &img, const QSize &newSize, double factor /* =
         return QImage();
     }
 
+    // nearest neighbor only copies pixels - converting them to linear is pointless
+    if (interpolation == ipl_nearest)
+        correctGamma = false;
+
+    // downsample 8 bit images in linear space without converting the whole image to 16 bit
+    if (correctGamma && nSize.width() <= img.width() && nSize.height() <= img.height()
+        && (img.format() == QImage::Format_RGB32 || img.format() == QImage::Format_ARGB32 || img.format() == QImage::Format_RGB888
+            || img.format() == QImage::Format_Grayscale8)) {
+        return resampleImage(img, nSize, interpolation, true);
+    }
+
     Qt::TransformationMode iplQt = Qt::FastTransformation;
     switch (interpolation) {
     case ipl_nearest:
@@ -155,7 +470,8 @@ DkImage::resizeImage(const QImage &img, const QSize &newSize, double factor /* =
 
     try {
         QImage qImg;
-        cv::Mat resizeImage = DkImage::qImage2Mat(img);
+        DkMatView imgView(img);
+        cv::Mat resizeImage = imgView.mat(); // shares the pixels - don't modify
 
         if (correctGamma) {
             resizeImage.convertTo(resizeImage, CV_16U, USHRT_MAX / 255.0f);
@@ -175,7 +491,7 @@ DkImage::resizeImage(const QImage &img, const QSize &newSize, double factor /* =
                 resizeImage.convertTo(resizeImage, CV_8U, 255.0f / USHRT_MAX);
             }
 
-            qImg = DkImage::mat2QImage(resizeImage);
+            qImg = DkMatView::toImage(resizeImage);
         }
 
         if (!img.colorTable().isEmpty())
@@ -193,7 +509,7 @@ DkImage::resizeImage(const QImage &img, const QSize &newSize, double factor /* =
 
     if (correctGamma)
         DkImage::gammaToLinear(qImg);
-    qImg.scaled(nSize, Qt::IgnoreAspectRatio, iplQt);
+    qImg = qImg.scaled(nSize, Qt::IgnoreAspectRatio, iplQt);
 
     if (correctGamma)
         DkImage::linearToGamma(qImg);
@@ -206,18 +522,9 @@ bool DkImage::alphaChannelUsed(const QImage &img)
     if (img.format() != QImage::Format_ARGB32)
         return false;
 
-    // number of used bytes per line
-    int bpl = (img.width() * img.depth() + 7) / 8;
-    int pad = img.bytesPerLine() - bpl;
-    const uchar *ptr = img.bits();
-
     for (int rIdx = 0; rIdx < img.height(); rIdx++) {
-        for (int cIdx = 0; cIdx < bpl; cIdx++, ptr++) {
-            if (cIdx % 4 == 3 && *ptr != 255)
-                return true;
-        }
-
-        ptr += pad;
+        if (DkImageKernels::alphaUsed(img.constScanLine(rIdx), img.width()))
+            return true;
     }
 
     return false;
@@ -234,16 +541,9 @@ QImage DkImage::thresholdImage(const QImage &img, double thr, bool color)
 
     // number of bytes per line used
     int bpl = (tImg.width() * tImg.depth() + 7) / 8;
-    int pad = tImg.bytesPerLine() - bpl;
-
-    uchar *mPtr = tImg.bits();
 
-    for (int rIdx = 0; rIdx < tImg.height(); rIdx++) {
-        for (int cIdx = 0; cIdx < bpl; cIdx++, mPtr++) {
-            *mPtr = *mPtr > thr ? 255 : 0;
-        }
-        mPtr += pad;
-    }
+    for (int rIdx = 0; rIdx < tImg.height(); rIdx++)
+        DkImageKernels::threshold(tImg.scanLine(rIdx), bpl, thr);
 
     qDebug() << "thresholding takes: " << dt;
 
@@ -461,8 +761,8 @@ QImage DkImage::grayscaleImage(const QImage &img)
 
 #ifdef WITH_OPENCV
 
-    cv::Mat cvImg = DkImage::qImage2Mat(img);
-    cv::cvtColor(cvImg, cvImg, CV_RGB2Lab);
+    cv::Mat cvImg;
+    cv::cvtColor(DkMatView(img).mat(), cvImg, CV_RGB2Lab);
 
     std::vector<cv::Mat> imgs;
     cv::split(cvImg, imgs);
@@ -474,7 +774,7 @@ QImage DkImage::grayscaleImage(const QImage &img)
     // convert it back for the painter
     cv::cvtColor(cvImg, cvImg, CV_GRAY2RGB);
 
-    imgR = DkImage::mat2QImage(cvImg);
+    imgR = DkMatView::toImage(cvImg);
 #else
 
     QVector<QRgb> table(256);
@@ -529,13 +829,14 @@ QVector<numFmt> DkImage::getGamma2LinearTable(int maxVal)
 
 void DkImage::gammaToLinear(QImage &img)
 {
-    QVector<uchar> gt = getGamma2LinearTable<uchar>(255);
+    // the tables are computed once
+    static const QVector<uchar> gt = getGamma2LinearTable<uchar>(255);
     mapGammaTable(img, gt);
 }
 
 void DkImage::linearToGamma(QImage &img)
 {
-    QVector<uchar> gt = getLinear2GammaTable<uchar>(255);
+    static const QVector<uchar> gt = getLinear2GammaTable<uchar>(255);
     mapGammaTable(img, gt);
 }
 
@@ -545,27 +846,14 @@ void DkImage::mapGammaTable(QImage &img, const QVector<uchar> &gammaTable)
 
     // number of bytes per line used
     int bpl = (img.width() * img.depth() + 7) / 8;
-    int pad = img.bytesPerLine() - bpl;
 
-    // int channels = (img.hasAlphaChannel() || img.format() == QImage::Format_RGB32) ? 4 : 3;
-
-    uchar *mPtr = img.bits();
-
-    for (int rIdx = 0; rIdx < img.height(); rIdx++) {
-        for (int cIdx = 0; cIdx < bpl; cIdx++, mPtr++) {
-            if (*mPtr < 0 || *mPtr > gammaTable.size()) {
-                qDebug() << "WRONG VALUE: " << *mPtr;
-                continue;
-            }
-            if ((int)gammaTable[*mPtr] < 0 || (int)gammaTable[*mPtr] > USHRT_MAX) {
-                qDebug() << "WRONG VALUE: " << *mPtr;
-                continue;
-            }
+    // values that are not covered by the table are not changed
+    uchar lut[256];
+    for (int idx = 0; idx < 256; idx++)
+        lut[idx] = idx < gammaTable.size() ? gammaTable[idx] : (uchar)idx;
 
-            *mPtr = gammaTable[*mPtr];
-        }
-        mPtr += pad;
-    }
+    for (int rIdx = 0; rIdx < img.height(); rIdx++)
+        DkImageKernels::applyLut(img.scanLine(rIdx), bpl, 1, lut);
 
     qDebug() << "gamma computation takes: " << dt;
 }
@@ -577,38 +865,29 @@ bool DkImage::normImage(QImage &img)
 
     // number of used bytes per line
     int bpl = (img.width() * img.depth() + 7) / 8;
-    int pad = img.bytesPerLine() - bpl;
-    uchar *mPtr = img.bits();
     bool hasAlpha = img.hasAlphaChannel() || img.format() == QImage::Format_RGB32;
 
-    for (int rIdx = 0; rIdx < img.height(); rIdx++) {
-        for (int cIdx = 0; cIdx < bpl; cIdx++, mPtr++) {
-            if (hasAlpha && cIdx % 4 == 3)
-                continue;
-
-            if (*mPtr > maxVal)
-                maxVal = *mPtr;
-            if (*mPtr < minVal)
-                minVal = *mPtr;
-        }
-
-        mPtr += pad;
-    }
+    for (int rIdx = 0; rIdx < img.height(); rIdx++)
+        DkImageKernels::minMax(img.constScanLine(rIdx), bpl, hasAlpha, minVal, maxVal);
 
     if ((minVal == 0 && maxVal == 255) || maxVal - minVal == 0)
         return false;
 
-    uchar *ptr = img.bits();
+    // the alpha channel (4th lut) is not changed
+    uchar lut[4 * 256];
+    for (int idx = 0; idx < 256; idx++) {
+        uchar v = (uchar)qRound(255.0f * (idx - minVal) / (maxVal - minVal));
+        lut[idx] = v;
+        lut[256 + idx] = v;
+        lut[512 + idx] = v;
+        lut[768 + idx] = hasAlpha ? (uchar)idx : v;
+    }
 
     for (int rIdx = 0; rIdx < img.height(); rIdx++) {
-        for (int cIdx = 0; cIdx < bpl; cIdx++, ptr++) {
-            if (hasAlpha && cIdx % 4 == 3)
-                continue;
-
-            *ptr = (uchar)qRound(255.0f * (*ptr - minVal) / (maxVal - minVal));
-        }
-
-        ptr += pad;
+        if (hasAlpha)
+            DkImageKernels::applyLut(img.scanLine(rIdx), bpl / 4, 4, lut);
+        else
+            DkImageKernels::applyLut(img.scanLine(rIdx), bpl, 1, lut);
     }
 
     return true;
@@ -632,65 +911,36 @@ bool DkImage::autoAdjustImage(QImage &img)
 
     int channels = (img.hasAlphaChannel() || img.format() == QImage::Format_RGB32) ? 4 : 3;
 
-    uchar maxR = 0, maxG = 0, maxB = 0;
-    uchar minR = 255, minG = 255, minB = 255;
-
-    // number of bytes per line used
-    int bpl = (img.width() * img.depth() + 7) / 8;
-    int pad = img.bytesPerLine() - bpl;
-
-    uchar *mPtr = img.bits();
-    uchar r, g, b;
-
     int histR[256] = {0};
     int histG[256] = {0};
     int histB[256] = {0};
 
-    for (int rIdx = 0; rIdx < img.height(); rIdx++) {
-        for (int cIdx = 0; cIdx < bpl;) {
-            r = *mPtr;
-            mPtr++;
-            g = *mPtr;
-            mPtr++;
-            b = *mPtr;
-            mPtr++;
-            cIdx += 3;
-
-            if (r > maxR)
-                maxR = r;
-            if (r < minR)
-                minR = r;
-
-            if (g > maxG)
-                maxG = g;
-            if (g < minG)
-                minG = g;
-
-            if (b > maxB)
-                maxB = b;
-            if (b < minB)
-                minB = b;
-
-            histR[r]++;
-            histG[g]++;
-            histB[b]++;
-
-            // ?? strange but I would expect the alpha channel to be the first (big endian?)
-            if (channels == 4) {
-                mPtr++;
-                cIdx++;
+    for (int rIdx = 0; rIdx < img.height(); rIdx++)
+        DkImageKernels::histogram(img.constScanLine(rIdx), img.width(), channels, histR, histG, histB);
+
+    // min/max are the first/last non-empty bins
+    auto histRange = [](const int *hist, uchar &minVal, uchar &maxVal) {
+        minVal = 255;
+        maxVal = 0;
+
+        for (int idx = 0; idx < 256; idx++) {
+            if (hist[idx]) {
+                minVal = qMin(minVal, (uchar)idx);
+                maxVal = (uchar)idx;
             }
         }
-        mPtr += pad;
-    }
+    };
+
+    uchar maxR, maxG, maxB;
+    uchar minR, minG, minB;
+    histRange(histR, minR, maxR);
+    histRange(histG, minG, maxG);
+    histRange(histB, minB, maxB);
 
-    QColor ignoreChannel;
     bool ignoreR = maxR - minR == 0 || maxR - minR == 255;
     bool ignoreG = maxR - minR == 0 || maxG - minG == 255;
     bool ignoreB = maxR - minR == 0 || maxB - minB == 255;
 
-    uchar *ptr = img.bits();
-
     if (ignoreR) {
         maxR = findHistPeak(histR);
         ignoreR = maxR - minR == 0 || maxR - minR == 255;
@@ -714,39 +964,26 @@ bool DkImage::autoAdjustImage(QImage &img)
         return false;
     }
 
-    for (int rIdx = 0; rIdx < img.height(); rIdx++) {
-        for (int cIdx = 0; cIdx < bpl;) {
-            // don't check values - speed (but you see under-/overflows anyway)
-            if (!ignoreR && *ptr < maxR)
-                *ptr = (uchar)qRound(255.0f * ((float)*ptr - minR) / (maxR - minR));
-            else if (!ignoreR)
-                *ptr = 255;
-
-            ptr++;
-            cIdx++;
-
-            if (!ignoreG && *ptr < maxG)
-                *ptr = (uchar)qRound(255.0f * ((float)*ptr - minG) / (maxG - minG));
-            else if (!ignoreG)
-                *ptr = 255;
-
-            ptr++;
-            cIdx++;
-
-            if (!ignoreB && *ptr < maxB)
-                *ptr = (uchar)qRound(255.0f * ((float)*ptr - minB) / (maxB - minB));
-            else if (!ignoreB)
-                *ptr = 255;
-            ptr++;
-            cIdx++;
-
-            if (channels == 4) {
-                ptr++;
-                cIdx++;
-            }
+    // don't check values - speed (but you see under-/overflows anyway)
+    auto channelLut = [](uchar *lut, bool ignore, uchar minVal, uchar maxVal) {
+        for (int idx = 0; idx < 256; idx++) {
+            if (ignore)
+                lut[idx] = (uchar)idx;
+            else if (idx < maxVal)
+                lut[idx] = (uchar)qRound(255.0f * ((float)idx - minVal) / (maxVal - minVal));
+            else
+                lut[idx] = 255;
         }
-        ptr += pad;
-    }
+    };
+
+    uchar lut[4 * 256];
+    channelLut(lut, ignoreR, minR, maxR);
+    channelLut(lut + 256, ignoreG, minG, maxG);
+    channelLut(lut + 512, ignoreB, minB, maxB);
+    channelLut(lut + 768, true, 0, 255); // alpha
+
+    for (int rIdx = 0; rIdx < img.height(); rIdx++)
+        DkImageKernels::applyLut(img.scanLine(rIdx), img.width(), channels, lut);
 
     qDebug() << "[Auto Adjust] image adjusted in: " << dt;
 
@@ -864,12 +1101,16 @@ QImage DkImage::hueSaturation(const QImage &src, int hue, int sat, int brightnes
     int brightnessN = qRound(brightness / 100.0 * 255.0);
     double satN = sat / 100.0 + 1.0;
 
-    cv::Mat hsvImg = DkImage::qImage2Mat(src);
-
-    if (hsvImg.channels() > 3)
-        cv::cvtColor(hsvImg, hsvImg, CV_RGBA2BGR);
+    DkMatView srcView(src);
+    cv::Mat hsvImg;
 
-    cv::cvtColor(hsvImg, hsvImg, CV_BGR2HSV);
+    // don't convert in-place: the view shares its pixels with src
+    if (srcView.mat().channels() > 3) {
+        cv::cvtColor(srcView.mat(), hsvImg, CV_RGBA2BGR);
+        cv::cvtColor(hsvImg, hsvImg, CV_BGR2HSV);
+    } else {
+        cv::cvtColor(srcView.mat(), hsvImg, CV_BGR2HSV);
+    }
 
     // apply hue/saturation changes
     for (int rIdx = 0; rIdx < hsvImg.rows; rIdx++) {
@@ -904,7 +1145,7 @@ QImage DkImage::hueSaturation(const QImage &src, int hue, int sat, int brightnes
     }
 
     cv::cvtColor(hsvImg, hsvImg, CV_HSV2BGR);
-    imgR = DkImage::mat2QImage(hsvImg);
+    imgR = DkMatView::toImage(hsvImg);
 
 #endif // WITH_OPENCV
 
@@ -919,8 +1160,8 @@ QImage DkImage::exposure(const QImage &src, double exposure, double offset, doub
     QImage imgR;
 #ifdef WITH_OPENCV
 
-    cv::Mat rgbImg = DkImage::qImage2Mat(src);
-    rgbImg.convertTo(rgbImg, CV_16U, 256, offset * std::numeric_limits<unsigned short>::max());
+    cv::Mat rgbImg;
+    DkMatView(src).mat().convertTo(rgbImg, CV_16U, 256, offset * std::numeric_limits<unsigned short>::max());
 
     if (rgbImg.channels() > 3)
         cv::cvtColor(rgbImg, rgbImg, CV_RGBA2BGR);
@@ -932,7 +1173,7 @@ QImage DkImage::exposure(const QImage &src, double exposure, double offset, doub
         rgbImg = gammaMat(rgbImg, gamma);
 
     rgbImg.convertTo(rgbImg, CV_8U, 1.0 / 256.0);
-    imgR = DkImage::mat2QImage(rgbImg);
+    imgR = DkMatView::toImage(rgbImg);
 
 #endif // WITH_OPENCV
 
@@ -1044,6 +1285,17 @@ QByteArray DkImage::fixSamsungPanorama(QByteArray &ba)
     return nb;
 }
 
+/**
+ * Returns the thread pool that runs the stripes of parallel pixel loops.
+ * These loops are called from tasks of the global pool that wait for their stripes.
+ * Stripes on the global pool would compete with (and might wait for) their callers.
+ **/
+QThreadPool *DkImage::stripePool()
+{
+    static QThreadPool pool;
+    return &pool;
+}
+
 int DkImage::intFromByteArray(const QByteArray &ba, int pos)
 {
     // TODO saveify:
@@ -1282,15 +1534,127 @@ QImage DkImage::mat2QImage(cv::Mat img)
     return qImg;
 }
 
+// DkMatView --------------------------------------------------------------------
+DkMatView::DkMatView(const QImage &img)
+{
+    if (img.isNull())
+        return;
+
+    mImg = img;
+
+    if (img.format() != QImage::Format_ARGB32 && img.format() != QImage::Format_RGB32 && img.format() != QImage::Format_RGB888)
+        mImg = img.convertToFormat(QImage::Format_ARGB32);
+
+    mMat = view(mImg);
+}
+
+bool DkMatView::isEmpty() const
+{
+    return mMat.empty();
+}
+
+/**
+ * Returns the Mat which shares its pixels with the image.
+ * Don't write to it (e.g. by calling OpenCV functions in-place).
+ **/
+const cv::Mat &DkMatView::mat() const
+{
+    return mMat;
+}
+
+/**
+ * Returns a writable Mat.
+ * The pixels are copied if the image is shared (copy-on-write).
+ **/
+cv::Mat &DkMatView::detach()
+{
+    if (mImg.isNull())
+        return mMat;
+
+    // QImage::bits() detaches if needed
+    uchar *bits = mImg.bits();
+
+    if (bits != mMat.data)
+        mMat = view(mImg);
+
+    return mMat;
+}
+
+QImage DkMatView::image() const
+{
+    return mImg;
+}
+
+/**
+ * Returns a non-owning Mat that points to the image's pixels.
+ * The image must outlive the Mat.
+ * @param img formats supported: ARGB32 | RGB32 | RGB888
+ * @return cv::Mat the Mat or an empty Mat if the format is not supported
+ **/
+cv::Mat DkMatView::view(const QImage &img)
+{
+    if (img.format() == QImage::Format_ARGB32 || img.format() == QImage::Format_RGB32)
+        return cv::Mat(img.height(), img.width(), CV_8UC4, (uchar *)img.constBits(), img.bytesPerLine());
+    else if (img.format() == QImage::Format_RGB888)
+        return cv::Mat(img.height(), img.width(), CV_8UC3, (uchar *)img.constBits(), img.bytesPerLine());
+
+    return cv::Mat();
+}
+
+static void releaseMat(void *mat)
+{
+    delete static_cast<cv::Mat *>(mat);
+}
+
+/**
+ * Converts a cv::Mat to a QImage without copying the pixels.
+ * The QImage keeps a reference to the Mat's buffer which is released with the last QImage copy.
+ * Mats that do not own their data (e.g. views) are copied.
+ * @param mat supported formats CV_8UC1 | CV_8UC3 | CV_8UC4 | CV_32F
+ * @return QImage the image
+ **/
+QImage DkMatView::toImage(const cv::Mat &mat)
+{
+    cv::Mat img = mat;
+
+    if (img.depth() == CV_32F)
+        img.convertTo(img, CV_8U, 255);
+
+    QImage::Format format;
+
+    switch (img.type()) {
+    case CV_8UC1:
+        format = QImage::Format_Indexed8;
+        break;
+    case CV_8UC3:
+        format = QImage::Format_RGB888;
+        break;
+    case CV_8UC4:
+        format = QImage::Format_ARGB32;
+        break;
+    default:
+        return QImage();
+    }
+
+    // we can only take ownership of buffers that are ref-counted by OpenCV
+    if (!img.u)
+        img = img.clone();
+
+    cv::Mat *owner = new cv::Mat(img);
+
+    return QImage(owner->data, owner->cols, owner->rows, (int)owner->step, format, &releaseMat, owner);
+}
+
 void DkImage::linearToGamma(cv::Mat &img)
 {
-    QVector<unsigned short> gt = getLinear2GammaTable<unsigned short>();
+    // the tables are computed once
+    static const QVector<unsigned short> gt = getLinear2GammaTable<unsigned short>();
     mapGammaTable(img, gt);
 }
 
 void DkImage::gammaToLinear(cv::Mat &img)
 {
-    QVector<unsigned short> gt = getGamma2LinearTable<unsigned short>();
+    static const QVector<unsigned short> gt = getGamma2LinearTable<unsigned short>();
     mapGammaTable(img, gt);
 }
 
@@ -1298,6 +1662,22 @@ void DkImage::mapGammaTable(cv::Mat &img, const QVector<unsigned short> &gammaTa
 {
     DkTimer dt;
 
+    // the table covers all 16 bit values: no need to check them
+    if (img.depth() == CV_16U && gammaTable.size() > USHRT_MAX) {
+        const unsigned short *lut = gammaTable.constData();
+
+        for (int rIdx = 0; rIdx < img.rows; rIdx++) {
+            unsigned short *mPtr = img.ptr<unsigned short>(rIdx);
+            const int numValues = img.cols * img.channels();
+
+            for (int cIdx = 0; cIdx < numValues; cIdx++)
+                mPtr[cIdx] = lut[mPtr[cIdx]];
+        }
+
+        qDebug() << "gamma computation takes: " << dt;
+        return;
+    }
+
     for (int rIdx = 0; rIdx < img.rows; rIdx++) {
         unsigned short *mPtr = img.ptr<unsigned short>(rIdx);
 
@@ -1412,13 +1792,13 @@ bool DkImage::gaussianBlur(QImage &img, float sigma)
 {
 #ifdef WITH_OPENCV
     DkTimer dt;
-    cv::Mat imgCv = DkImage::qImage2Mat(img);
+    DkMatView imgCv(img);
 
     cv::Mat imgG;
     cv::Mat gx = cv::getGaussianKernel(qRound(4 * sigma + 1), sigma);
     cv::Mat gy = gx.t();
-    cv::sepFilter2D(imgCv, imgG, CV_8U, gx, gy);
-    img = DkImage::mat2QImage(imgG);
+    cv::sepFilter2D(imgCv.mat(), imgG, CV_8U, gx, gy);
+    img = DkMatView::toImage(imgG);
 
     qDebug() << "gaussian blur takes: " << dt;
 #else
@@ -1434,15 +1814,15 @@ bool DkImage::unsharpMask(QImage &img, float sigma, float weight)
 #ifdef WITH_OPENCV
     DkTimer dt;
     // DkImage::gammaToLinear(img);
-    cv::Mat imgCv = DkImage::qImage2Mat(img);
+    DkMatView imgCv(img);
 
     cv::Mat imgG;
     cv::Mat gx = cv::getGaussianKernel(qRound(4 * sigma + 1), sigma);
     cv::Mat gy = gx.t();
-    cv::sepFilter2D(imgCv, imgG, CV_8U, gx, gy);
+    cv::sepFilter2D(imgCv.mat(), imgG, CV_8U, gx, gy);
     // cv::GaussianBlur(imgCv, imgG, cv::Size(4*sigma+1, 4*sigma+1), sigma);		// this is awesomely slow
-    cv::addWeighted(imgCv, weight, imgG, 1 - weight, 0, imgCv);
-    img = DkImage::mat2QImage(imgCv);
+    cv::addWeighted(imgCv.mat(), weight, imgG, 1 - weight, 0, imgG);
+    img = DkMatView::toImage(imgG);
 
     qDebug() << "unsharp mask takes: " << dt;
     // DkImage::linearToGamma(img);
@@ -1486,31 +1866,290 @@ QImage DkImage::createThumb(const QImage &image, int maxSize)
     return thumb;
 }
 
+// DkImagePyramid --------------------------------------------------------------------
+DkImagePyramid::DkImagePyramid(const QImage &img)
+{
+    setImage(img);
+}
+
+void DkImagePyramid::setImage(const QImage &img)
+{
+    mLevels.clear();
+    mNumLevels = 0;
+
+    if (img.isNull())
+        return;
+
+    mLevels << img;
+
+    // add levels until the whole image fits into a single tile
+    QSize s = img.size();
+    mNumLevels = 1;
+
+    while (s.width() > tile_size || s.height() > tile_size) {
+        s = QSize((s.width() + 1) / 2, (s.height() + 1) / 2);
+        mNumLevels++;
+    }
+}
+
+bool DkImagePyramid::isEmpty() const
+{
+    return mLevels.isEmpty();
+}
+
+int DkImagePyramid::numLevels() const
+{
+    return mNumLevels;
+}
+
+int DkImagePyramid::numComputedLevels() const
+{
+    return mLevels.size();
+}
+
+bool DkImagePyramid::isComputed(int level) const
+{
+    return level >= 0 && level < mLevels.size();
+}
+
+QImage DkImagePyramid::level(int level) const
+{
+    if (!isComputed(level))
+        return QImage();
+
+    return mLevels[level];
+}
+
+/**
+ * Returns the size of a level - even if it is not computed yet.
+ * @param level the pyramid level
+ * @return QSize the level's size
+ **/
+QSize DkImagePyramid::levelSize(int level) const
+{
+    if (mLevels.isEmpty() || level < 0 || level >= mNumLevels)
+        return QSize();
+
+    QSize s = mLevels[0].size();
+
+    for (int idx = 0; idx < level; idx++)
+        s = QSize((s.width() + 1) / 2, (s.height() + 1) / 2);
+
+    return s;
+}
+
+/**
+ * Returns the coarsest level that has at least the resolution needed for scale.
+ * @param scale the scale factor w.r.t. the original image (e.g. 0.25)
+ * @return int the level index
+ **/
+int DkImagePyramid::levelForScale(double scale) const
+{
+    if (scale >= 1.0 || scale <= 0.0 || mNumLevels == 0)
+        return 0;
+
+    int level = qFloor(std::log2(1.0 / scale));
+
+    return qBound(0, level, mNumLevels - 1);
+}
+
+/**
+ * Returns all tiles of a level that intersect imgRect.
+ * @param level the pyramid level
+ * @param imgRect a rectangle in coordinates of the original image (level 0)
+ * @return QVector<QRect> tile rectangles in level coordinates
+ **/
+QVector<QRect> DkImagePyramid::tiles(int level, const QRectF &imgRect) const
+{
+    QVector<QRect> tileRects;
+
+    QSize ls = levelSize(level);
+    if (ls.isEmpty() || imgRect.isEmpty())
+        return tileRects;
+
+    double sx = (double)ls.width() / mLevels[0].width();
+    double sy = (double)ls.height() / mLevels[0].height();
+    QRectF lr(imgRect.x() * sx, imgRect.y() * sy, imgRect.width() * sx, imgRect.height() * sy);
+    lr = lr.intersected(QRectF(QPointF(), ls));
+
+    if (lr.isEmpty())
+        return tileRects;
+
+    int x0 = qFloor(lr.left() / tile_size);
+    int y0 = qFloor(lr.top() / tile_size);
+    int x1 = qCeil(lr.right() / tile_size);
+    int y1 = qCeil(lr.bottom() / tile_size);
+
+    for (int yIdx = y0; yIdx < y1; yIdx++) {
+        for (int xIdx = x0; xIdx < x1; xIdx++) {
+            QRect r(xIdx * tile_size, yIdx * tile_size, tile_size, tile_size);
+            tileRects << r.intersected(QRect(QPoint(), ls));
+        }
+    }
+
+    return tileRects;
+}
+
+/**
+ * Returns a tile of a computed level.
+ * The tile shares its memory with the level - so it is only
+ * valid as long as the level is alive.
+ * @param level the pyramid level
+ * @param tileRect the tile's rectangle in level coordinates
+ * @return QImage the tile (or a null image if the level is not computed)
+ **/
+QImage DkImagePyramid::tile(int level, const QRect &tileRect) const
+{
+    const QImage &lImg = mLevels.value(level);
+
+    if (lImg.isNull())
+        return QImage();
+
+    QRect r = tileRect.intersected(lImg.rect());
+
+    // we cannot point into bit-packed formats
+    if (lImg.depth() < 8)
+        return lImg.copy(r);
+
+    const uchar *ptr = lImg.constScanLine(r.y()) + r.x() * (lImg.depth() / 8);
+    QImage tImg(ptr, r.width(), r.height(), lImg.bytesPerLine(), lImg.format());
+    tImg.setColorTable(lImg.colorTable());
+
+    return tImg;
+}
+
+void DkImagePyramid::addLevels(const QVector<QImage> &levels)
+{
+    for (const QImage &img : levels) {
+        if (mLevels.size() >= mNumLevels || img.size() != levelSize(mLevels.size()))
+            break;
+
+        mLevels << img;
+    }
+}
+
+/**
+ * Removes all levels but the original image.
+ **/
+void DkImagePyramid::releaseLevels()
+{
+    if (mLevels.size() > 1)
+        mLevels.resize(1);
+}
+
+/**
+ * Returns the memory (MB) of the computed levels (without the original image).
+ **/
+double DkImagePyramid::memoryUsage() const
+{
+    double mem = 0;
+
+    for (int idx = 1; idx < mLevels.size(); idx++)
+        mem += DkImage::getBufferSizeFloat(mLevels[idx].size(), mLevels[idx].depth());
+
+    return mem;
+}
+
+/**
+ * Computes numLevels levels starting from src.
+ * Each level is half the size of its predecessor.
+ * This function is called from a worker thread.
+ * @param src the finest level
+ * @param numLevels number of levels to compute
+ * @return QVector<QImage> the new levels (without src)
+ **/
+QVector<QImage> DkImagePyramid::computeLevels(const QImage &src, int numLevels)
+{
+    DkTimer dt;
+    QVector<QImage> levels;
+    QImage cImg = src;
+
+    for (int idx = 0; idx < numLevels; idx++) {
+        QSize s((cImg.width() + 1) / 2, (cImg.height() + 1) / 2);
+        cImg = DkImage::resizeImage(cImg, s, 1.0, DkImage::ipl_area, false);
+
+        if (cImg.isNull())
+            break;
+
+        levels << cImg;
+    }
+
+    qDebug() << "[DkImagePyramid]" << levels.size() << "levels computed in" << dt;
+
+    return levels;
+}
+
+/**
+ * Returns true if an image is large enough to be rendered using tiles.
+ **/
+bool DkImagePyramid::isRequired(const QSize &imgSize)
+{
+    // 64 MP - smaller images are faster with a single scaled image
+    const qint64 minPixels = 64ll * 1024 * 1024;
+
+    return (qint64)imgSize.width() * imgSize.height() > minPixels;
+}
+
 // DkImageStorage --------------------------------------------------------------------
 DkImageStorage::DkImageStorage(const QImage &img)
 {
     mImg = img;
+    mPyramid.setImage(img);
+    mTileCancelToken = QSharedPointer<QAtomicInt>(new QAtomicInt(0));
+
+    // tiles of the viewport
+    mTiles.setMaxCost(256 * 1024);
 
     init();
 
     connect(&mFutureWatcher, &QFutureWatcher<QImage>::finished, this, &DkImageStorage::imageComputed, Qt::UniqueConnection);
+    connect(&mPyramidWatcher, &QFutureWatcher<QVector<QImage>>::finished, this, &DkImageStorage::pyramidComputed, Qt::UniqueConnection);
     connect(DkActionManager::instance().action(DkActionManager::menu_view_anti_aliasing),
             &QAction::toggled,
             this,
             &DkImageStorage::antiAliasingChanged,
             Qt::UniqueConnection);
+
+    // scaled images are recomputed when they are painted again
+    mMemoryId = DkMemoryGovernor::instance().registerAllocation(
+        DkMemoryGovernor::priority_scaled,
+        [this]() {
+            return DkImage::getBufferSizeFloat(mScaledImg.size(), mScaledImg.depth()) + mPyramid.memoryUsage() + mTiles.totalCost() / 1024.0;
+        },
+        [this](double) {
+            if (mCancelToken)
+                mCancelToken->storeRelaxed(1);
+
+            init();
+            mPyramid.releaseLevels();
+            releaseTiles();
+        });
+}
+
+DkImageStorage::~DkImageStorage()
+{
+    DkMemoryGovernor::instance().unregisterAllocation(mMemoryId);
+    mTileCancelToken->storeRelaxed(1);
 }
 
 void DkImageStorage::init()
 {
     mComputeState = l_not_computed;
     mScaledImg = QImage();
+    mScaledSize = QSize();
 }
 
 void DkImageStorage::setImage(const QImage &img)
 {
+    if (mCancelToken)
+        mCancelToken->storeRelaxed(1);
+
     mScaledImg = QImage();
     mImg = img;
+    mPyramid.setImage(img);
+    mRegionReader = RegionReader();
+    mReaderMinLevel = 1;
+    releaseTiles();
     mComputeState = l_cancelled;
 }
 
@@ -1538,34 +2177,66 @@ QImage DkImageStorage::image(const QSize &size)
         return mImg;
     }
 
-    if (mScaledImg.size() == size) {
+    // huge images: return the pyramid level that is closest to size
+    if (useTiles()) {
+        qreal devicePixelRatio = QGuiApplication::primaryScreen()->devicePixelRatio();
+        return mPyramid.level(tileLevel(size.width() * devicePixelRatio / mImg.width()));
+    }
+
+    DkMemoryGovernor::instance().touch(mMemoryId);
+
+    if (mScaledSize == size && !mScaledImg.isNull() && mComputeState == l_computed) {
         return mScaledImg;
     }
 
     // trigger a new computation
     compute(size);
 
-    // currently no alternative is available
+    // the last result is a good preview as long as it's not upscaled
+    if (!mScaledImg.isNull() && mScaledSize.width() >= size.width())
+        return mScaledImg;
+
     return mImg;
 }
 
-QImage imageStorageScaleToSize(const QImage &src, const QSize &size);
+QImage imageStorageScaleToSize(const QImage &src, const QSize &size, qreal devicePixelRatio, QSharedPointer<QAtomicInt> cancel);
 
 void DkImageStorage::compute(const QSize &size)
 {
     // don't compute twice
-    if (mComputeState == l_computing) {
+    if (mComputeState == l_computing && mComputeSize == size) {
         return;
     }
 
-    // Reset state
-    mScaledImg = QImage();
+    // we are only interested in the newest size: stop the running computation
+    if (mCancelToken)
+        mCancelToken->storeRelaxed(1);
+
+    mCancelToken = QSharedPointer<QAtomicInt>(new QAtomicInt(0));
+
+    qreal devicePixelRatio = QGuiApplication::primaryScreen()->devicePixelRatio();
+
+    // the last result is a cheaper source if we scale down further
+    QImage src = mImg;
+    if (!mScaledImg.isNull() && mScaledImg.width() >= qRound(size.width() * devicePixelRatio) && mScaledImg.width() < mImg.width())
+        src = mScaledImg;
+
+    mComputeSize = size;
     mComputeState = l_computing;
 
-    mFutureWatcher.setFuture(QtConcurrent::run(imageStorageScaleToSize, mImg, size));
+    mFutureWatcher.setFuture(QtConcurrent::run(imageStorageScaleToSize, src, size, devicePixelRatio, mCancelToken));
 }
 
-QImage imageStorageScaleToSize(const QImage &src, const QSize &size)
+/**
+ * Resizes src to size (in device independent pixels).
+ * This function is called from a worker thread.
+ * @param src the image
+ * @param size the target size
+ * @param devicePixelRatio the screen's pixel ratio
+ * @param cancel if set to 1 by the caller, the computation is stopped and a null image is returned
+ * @return QImage the resized image
+ **/
+QImage imageStorageScaleToSize(const QImage &src, const QSize &size, qreal devicePixelRatio, QSharedPointer<QAtomicInt> cancel)
 {
     // should not happen
     if (size.width() >= src.width()) {
@@ -1597,22 +2268,28 @@ QImage imageStorageScaleToSize(const QImage &src, const QSize &size)
         s.setWidth(1);
 
     // Adjust size according to device pixel ratio
-    qreal devicePixelRatio = QGuiApplication::primaryScreen()->devicePixelRatio();
     s.setWidth(s.width() * devicePixelRatio);
     s.setHeight(s.height() * devicePixelRatio);
 
+    if (cancel->loadRelaxed())
+        return QImage();
+
+    if (resampleChannels(resizedImg.format()) > 0 && s.width() <= resizedImg.width() && s.height() <= resizedImg.height()) {
+        // area interpolation in parallel stripes (cancellable)
+        resizedImg = resampleImage(resizedImg, s, DkImage::ipl_area, false, cancel);
+    } else {
 #ifdef WITH_OPENCV
-    try {
-        cv::Mat rImgCv = DkImage::qImage2Mat(resizedImg);
-        cv::Mat tmp;
-        cv::resize(rImgCv, tmp, cv::Size(s.width(), s.height()), 0, 0, CV_INTER_AREA);
-        resizedImg = DkImage::mat2QImage(tmp);
-    } catch (...) {
-        qWarning() << "imageStorageScaleToSize: OpenCV exception caught while resizing...";
-    }
+        try {
+            cv::Mat tmp;
+            cv::resize(DkMatView(resizedImg).mat(), tmp, cv::Size(s.width(), s.height()), 0, 0, CV_INTER_AREA);
+            resizedImg = DkMatView::toImage(tmp);
+        } catch (...) {
+            qWarning() << "imageStorageScaleToSize: OpenCV exception caught while resizing...";
+        }
 #else
-    resizedImg = resizedImg.scaled(s, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+        resizedImg = resizedImg.scaled(s, Qt::KeepAspectRatio, Qt::SmoothTransformation);
 #endif
+    }
 
     // Set the device pixel ratio for the resized image
     resizedImg.setDevicePixelRatio(devicePixelRatio);
@@ -1627,16 +2304,201 @@ void DkImageStorage::imageComputed()
         return;
     }
 
-    mScaledImg = mFutureWatcher.result();
+    QImage img = mFutureWatcher.result();
+
+    // a newer computation is running
+    if (img.isNull() && mCancelToken && mCancelToken->loadRelaxed())
+        return;
+
+    mScaledImg = img;
+    mScaledSize = mComputeSize;
 
     mComputeState = (mScaledImg.isNull()) ? l_empty : l_computed;
 
-    if (mComputeState == l_computed)
+    if (mComputeState == l_computed) {
+        DkMemoryGovernor::instance().requestUpdate();
         emit imageUpdated();
+    }
     else
         qWarning() << "could not compute interpolated image...";
 }
 
+/**
+ * Returns true if the image should be rendered tile by tile.
+ **/
+bool DkImageStorage::useTiles() const
+{
+    return DkImagePyramid::isRequired(mImg.size());
+}
+
+/**
+ * Returns the pyramid level that should be rendered for a given scale.
+ * If the optimal level is not computed yet, its computation is triggered
+ * and the best level that is currently available is returned.
+ * @param scale the scale w.r.t. the original image (in device pixels)
+ * @return int a computed pyramid level
+ **/
+int DkImageStorage::tileLevel(double scale)
+{
+    if (!DkSettingsManager::param().display().antiAliasing)
+        return 0;
+
+    DkMemoryGovernor::instance().touch(mMemoryId);
+
+    int level = mPyramid.levelForScale(scale);
+
+    // the visible tiles are read from the file (see tile())
+    if (!mPyramid.isComputed(level) && mRegionReader && level >= mReaderMinLevel)
+        return level;
+
+    if (!mPyramid.isComputed(level)) {
+        computePyramid(level);
+        level = mPyramid.numComputedLevels() - 1;
+    }
+
+    return level;
+}
+
+const DkImagePyramid &DkImageStorage::pyramid() const
+{
+    return mPyramid;
+}
+
+// identifies a tile of a pyramid level
+static quint64 tileKey(int level, const QRect &tileRect)
+{
+    return (quint64(level) << 48) | (quint64(tileRect.y() / DkImagePyramid::tile_size) << 24) | quint64(tileRect.x() / DkImagePyramid::tile_size);
+}
+
+/**
+ * Returns a tile of a pyramid level.
+ * Tiles of levels that are not computed are read from the file in the background
+ * (see setRegionReader()) - a null image is returned until they are read.
+ * Computed tiles share their memory with the level (see DkImagePyramid::tile()).
+ * @param level the pyramid level
+ * @param tileRect the tile's rectangle in level coordinates
+ * @return QImage the tile or a null image
+ **/
+QImage DkImageStorage::tile(int level, const QRect &tileRect)
+{
+    if (mPyramid.isComputed(level))
+        return mPyramid.tile(level, tileRect);
+
+    if (!mRegionReader || level < mReaderMinLevel)
+        return QImage();
+
+    quint64 key = tileKey(level, tileRect);
+
+    QImage *t = mTiles.object(key);
+
+    if (t)
+        return *t;
+
+    readTile(level, tileRect);
+
+    return QImage();
+}
+
+/**
+ * Sets a function that reads tiles of the current image from its file.
+ * Huge files (e.g. pyramidal TIFFs) are then tiled from the file's reduced-resolution
+ * images instead of downsampling the whole image for each pyramid level.
+ * It is reset by setImage().
+ **/
+void DkImageStorage::setRegionReader(const RegionReader &reader)
+{
+    releaseTiles();
+    mRegionReader = reader;
+    mReaderMinLevel = 1;
+}
+
+void DkImageStorage::readTile(int level, const QRect &tileRect)
+{
+    quint64 key = tileKey(level, tileRect);
+
+    if (mPendingTiles.contains(key))
+        return;
+
+    mPendingTiles.insert(key);
+
+    RegionReader reader = mRegionReader;
+    QSharedPointer<QAtomicInt> cancelToken = mTileCancelToken;
+
+    // the watcher is deleted with us - so finished is never delivered to a dead object
+    QFutureWatcher<QImage> *watcher = new QFutureWatcher<QImage>(this);
+
+    connect(watcher, &QFutureWatcher<QImage>::finished, this, [this, watcher, cancelToken, level, key]() {
+        if (!cancelToken->loadRelaxed())
+            tileRead(level, key, watcher->result());
+
+        watcher->deleteLater();
+    });
+
+    watcher->setFuture(QtConcurrent::run([reader, cancelToken, tileRect, level]() {
+        // the image changed in the meantime
+        if (cancelToken->loadRelaxed())
+            return QImage();
+
+        return reader(tileRect, level);
+    }));
+}
+
+void DkImageStorage::tileRead(int level, quint64 key, const QImage &tile)
+{
+    mPendingTiles.remove(key);
+
+    if (tile.isNull()) {
+        // the file has no directory for this level - compute it from the image
+        qInfo() << "[DkImageStorage] level" << level << "cannot be read from the file";
+        mReaderMinLevel = qMax(mReaderMinLevel, level + 1);
+    } else {
+        mTiles.insert(key, new QImage(tile), qMax(qRound(DkImage::getBufferSizeFloat(tile.size(), tile.depth()) * 1024), 1));
+        DkMemoryGovernor::instance().requestUpdate();
+    }
+
+    emit imageUpdated();
+}
+
+/**
+ * Cancels all tile requests and removes the tiles that were read from the file.
+ **/
+void DkImageStorage::releaseTiles()
+{
+    if (mTileCancelToken)
+        mTileCancelToken->storeRelaxed(1);
+
+    mTileCancelToken = QSharedPointer<QAtomicInt>(new QAtomicInt(0));
+    mTiles.clear();
+    mPendingTiles.clear();
+}
+
+void DkImageStorage::computePyramid(int level)
+{
+    // we are called again with the next repaint
+    if (mPyramidWatcher.isRunning() || mPyramid.isEmpty())
+        return;
+
+    int numComputed = mPyramid.numComputedLevels();
+    QImage src = mPyramid.level(numComputed - 1);
+    mPyramidSrcKey = src.cacheKey();
+
+    mPyramidWatcher.setFuture(QtConcurrent::run(&DkImagePyramid::computeLevels, src, level - numComputed + 1));
+}
+
+void DkImageStorage::pyramidComputed()
+{
+    QImage src = mPyramid.level(mPyramid.numComputedLevels() - 1);
+
+    // drop the levels if the image changed in the meantime
+    if (!src.isNull() && src.cacheKey() == mPyramidSrcKey) {
+        mPyramid.addLevels(mPyramidWatcher.result());
+        DkMemoryGovernor::instance().requestUpdate();
+    }
+
+    if (useTiles())
+        emit imageUpdated();
+}
+
 QImage DkImageStorage::loadImage(const QString &filePath) {
     QImageReader reader(filePath);
     reader.setAutoTransform(true);
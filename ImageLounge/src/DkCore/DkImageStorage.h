@@ -28,11 +28,16 @@
 #pragma once
 
 #pragma warning(push, 0) // no warnings from includes - begin
+#include <QAtomicInt>
+#include <QCache>
 #include <QColor>
 #include <QFutureWatcher>
 #include <QImage>
 #include <QObject>
+#include <QSet>
+#include <QSharedPointer>
 #include <QVector>
+#include <functional>
 
 // opencv
 #ifdef WITH_OPENCV
@@ -67,6 +72,7 @@ class QString;
 class QSize;
 class QColor;
 class QTimer;
+class QThreadPool;
 
 namespace nmc
 {
@@ -133,6 +139,7 @@ public:
                                                  bool debugOutput = false);
     static QByteArray fixSamsungPanorama(QByteArray &ba);
     static int intFromByteArray(const QByteArray &ba, int pos);
+    static QThreadPool *stripePool();
 
 #ifdef WITH_OPENCV
     static cv::Mat exposureMat(const cv::Mat &src, double exposure);
@@ -141,12 +148,78 @@ public:
 #endif // WITH_OPENCV
 };
 
+#ifdef WITH_OPENCV
+/**
+ * DkMatView maps the pixels of a QImage to a cv::Mat without copying them.
+ * The view keeps a (shallow) copy of the QImage so that the pixels stay alive.
+ * Formats other than ARGB32, RGB32 and RGB888 are converted to ARGB32 first.
+ * mat() must not be modified since its pixels are shared with the image -
+ * use detach() to get a writable Mat (it copies only if the pixels are shared).
+ **/
+class DllCoreExport DkMatView
+{
+public:
+    DkMatView(const QImage &img = QImage());
+
+    bool isEmpty() const;
+    const cv::Mat &mat() const;
+    cv::Mat &detach();
+    QImage image() const;
+
+    static cv::Mat view(const QImage &img);
+    static QImage toImage(const cv::Mat &mat);
+
+protected:
+    QImage mImg;
+    cv::Mat mMat;
+};
+#endif
+
+/**
+ * DkImagePyramid holds power-of-two downscaled versions (levels) of an image.
+ * Level 0 is the original image, level n is scaled by 1/2^n.
+ * Each level is partitioned into tiles so that only the visible
+ * part of huge images needs to be rendered.
+ **/
+class DllCoreExport DkImagePyramid
+{
+public:
+    enum { tile_size = 256 };
+
+    DkImagePyramid(const QImage &img = QImage());
+
+    void setImage(const QImage &img);
+    bool isEmpty() const;
+
+    int numLevels() const;
+    int numComputedLevels() const;
+    bool isComputed(int level) const;
+
+    QImage level(int level) const;
+    QSize levelSize(int level) const;
+    int levelForScale(double scale) const;
+
+    QVector<QRect> tiles(int level, const QRectF &imgRect) const;
+    QImage tile(int level, const QRect &tileRect) const;
+
+    void addLevels(const QVector<QImage> &levels);
+    void releaseLevels();
+    double memoryUsage() const;
+    static QVector<QImage> computeLevels(const QImage &src, int numLevels);
+    static bool isRequired(const QSize &imgSize);
+
+protected:
+    QVector<QImage> mLevels;
+    int mNumLevels = 0;
+};
+
 class DllCoreExport DkImageStorage : public QObject
 {
     Q_OBJECT
 
 public:
     DkImageStorage(const QImage &img = QImage());
+    ~DkImageStorage();
 
     enum ComputeState {
         l_not_computed,
@@ -173,9 +246,19 @@ public:
     QImage image(const QSize &size = QSize());
     static QImage loadImage(const QString &filePath); // Add this declaration
 
+    // decodes a region of the image at a pyramid level (see DkBasicLoader::regionReader())
+    using RegionReader = std::function<QImage(const QRect &region, int level)>;
+
+    bool useTiles() const;
+    int tileLevel(double scale);
+    QImage tile(int level, const QRect &tileRect);
+    const DkImagePyramid &pyramid() const;
+    void setRegionReader(const RegionReader &reader);
+
 public slots:
     void antiAliasingChanged(bool antiAliasing);
     void imageComputed();
+    void pyramidComputed();
 
 signals:
     void imageUpdated() const;
@@ -184,13 +267,31 @@ signals:
 protected:
     QImage mImg;
     QImage mScaledImg;
+    QSize mScaledSize; // device independent size of mScaledImg
 
     QFutureWatcher<QImage> mFutureWatcher;
+    QSize mComputeSize;
+    QSharedPointer<QAtomicInt> mCancelToken;
 
     ComputeState mComputeState = l_not_computed;
 
+    DkImagePyramid mPyramid;
+    QFutureWatcher<QVector<QImage>> mPyramidWatcher;
+    qint64 mPyramidSrcKey = 0; // cache key of the level the pyramid computation started from
+    RegionReader mRegionReader; // reads the tiles of pyramid levels from the file
+    int mReaderMinLevel = 1; // finer levels are computed from the image
+    QCache<quint64, QImage> mTiles; // tiles read from the file - the cost is in KB
+    QSet<quint64> mPendingTiles;
+    QSharedPointer<QAtomicInt> mTileCancelToken;
+
+    int mMemoryId = -1; // see DkMemoryGovernor
+
     void init();
     void compute(const QSize &size);
+    void computePyramid(int level);
+    void readTile(int level, const QRect &tileRect);
+    void tileRead(int level, quint64 key, const QImage &tile);
+    void releaseTiles();
 };
 
 /**
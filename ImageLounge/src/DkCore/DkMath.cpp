@@ -35,6 +35,85 @@
 namespace nmc
 {
 
+// DkPrefixSum --------------------------------------------------------------------
+/**
+ * Creates the prefix sums of values in O(n).
+ **/
+DkPrefixSum::DkPrefixSum(const QVector<qint64> &values)
+    : mValues(values)
+{
+    mTree.resize(values.size() + 1);
+
+    for (int idx = 1; idx < mTree.size(); idx++) {
+        mTree[idx] += values[idx - 1];
+
+        int parent = idx + (idx & -idx);
+        if (parent < mTree.size())
+            mTree[parent] += mTree[idx];
+    }
+}
+
+int DkPrefixSum::size() const
+{
+    return mValues.size();
+}
+
+qint64 DkPrefixSum::value(int idx) const
+{
+    return mValues.at(idx);
+}
+
+void DkPrefixSum::setValue(int idx, qint64 value)
+{
+    qint64 delta = value - mValues.at(idx);
+    mValues[idx] = value;
+
+    if (delta == 0)
+        return;
+
+    for (int i = idx + 1; i < mTree.size(); i += i & -i)
+        mTree[i] += delta;
+}
+
+/**
+ * Returns the sum of the first idx values.
+ **/
+qint64 DkPrefixSum::sum(int idx) const
+{
+    qint64 s = 0;
+
+    for (int i = qMin(idx, size()); i > 0; i -= i & -i)
+        s += mTree.at(i);
+
+    return s;
+}
+
+qint64 DkPrefixSum::total() const
+{
+    return sum(size());
+}
+
+/**
+ * Returns the largest idx with sum(idx) <= pos (0 if pos is negative).
+ **/
+int DkPrefixSum::find(qint64 pos) const
+{
+    int idx = 0;
+    int step = 1;
+
+    while (step * 2 <= size())
+        step *= 2;
+
+    for (; step > 0; step /= 2) {
+        if (idx + step <= size() && mTree.at(idx + step) <= pos) {
+            idx += step;
+            pos -= mTree.at(idx);
+        }
+    }
+
+    return idx;
+}
+
 // DkRotatingRect --------------------------------------------------------------------
 DkRotatingRect::DkRotatingRect(QRectF rect)
 {
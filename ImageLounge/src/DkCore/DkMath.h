@@ -31,6 +31,7 @@
 #include <QDebug>
 #include <QPointF>
 #include <QPolygonF>
+#include <QVector>
 #include <cmath>
 #include <float.h>
 #include <iostream>
@@ -283,6 +284,27 @@ public:
     }
 };
 
+/**
+ * DkPrefixSum holds the prefix sums of a sequence of non-negative values (a Fenwick tree).
+ * Changing a value, computing a prefix sum and finding the position of a sum are O(log n).
+ **/
+class DllCoreExport DkPrefixSum
+{
+public:
+    DkPrefixSum(const QVector<qint64> &values = QVector<qint64>());
+
+    int size() const;
+    qint64 value(int idx) const;
+    void setValue(int idx, qint64 value);
+    qint64 sum(int idx) const;
+    qint64 total() const;
+    int find(qint64 pos) const;
+
+protected:
+    QVector<qint64> mValues;
+    QVector<qint64> mTree; // 1-based
+};
+
 /**
  * A simple 2D vector class.
  */
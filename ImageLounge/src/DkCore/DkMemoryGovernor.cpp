@@ -0,0 +1,330 @@
+/*******************************************************************************************************
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2026 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2026 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2026 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ related links:
+ [1] https://nomacs.org/
+ [2] https://github.com/nomacs/
+ [3] http://download.nomacs.org
+ *******************************************************************************************************/
+
+
+#include "DkMemoryGovernor.h"
+#include "DkSettings.h"
+#include "DkTimer.h"
+#include "DkUtils.h"
+
+#pragma warning(push, 0) // no warnings from includes - begin
+#include <QCoreApplication>
+#include <QDebug>
+#include <QThread>
+#include <QVector>
+#include <algorithm>
+#pragma warning(pop) // no warnings from includes - end
+
+namespace nmc
+{
+
+// fraction of the free memory that may be used if no budget is set
+static const double freeMemoryFraction = 0.5;
+// MB - we never squeeze images below this
+static const double minBudget = 512;
+
+DkMemoryGovernor::DkMemoryGovernor()
+{
+    // the usage and release functions must be called from the main thread
+    if (QCoreApplication::instance() && thread() != QCoreApplication::instance()->thread()) {
+        moveToThread(QCoreApplication::instance()->thread());
+        mUpdateTimer.moveToThread(QCoreApplication::instance()->thread());
+    }
+
+    // polls while the usage is close to the budget (see update)
+    mUpdateTimer.setInterval(2000);
+    connect(&mUpdateTimer, &QTimer::timeout, this, &DkMemoryGovernor::update);
+}
+
+DkMemoryGovernor &DkMemoryGovernor::instance()
+{
+    static DkMemoryGovernor inst;
+    return inst;
+}
+
+/**
+ * Registers a large allocation.
+ * @param priority allocations with a low priority are released first
+ * @param usage returns the current memory of the allocation in MB
+ * @param release releases the allocation - the argument is the memory (MB) that should be freed.
+ * Allocations without a release function are counted but never released.
+ * @return int the id needed to update or unregister the allocation
+ **/
+int DkMemoryGovernor::registerAllocation(Priority priority, const UsageFunction &usage, const ReleaseFunction &release)
+{
+    int id = 0;
+
+    {
+        QMutexLocker locker(&mMutex);
+
+        Allocation a;
+        a.priority = priority;
+        a.usage = usage;
+        a.release = release;
+        a.lastAccess = ++mAccessCounter;
+
+        id = ++mLastId;
+        mAllocations.insert(id, a);
+    }
+
+    requestUpdate();
+
+    return id;
+}
+
+/**
+ * Unregisters an allocation.
+ * If its functions are called right now (from the main thread), we wait for them
+ * so that the owner can be destroyed safely after this call.
+ **/
+void DkMemoryGovernor::unregisterAllocation(int id)
+{
+    QMutexLocker locker(&mMutex);
+
+    // release functions may unregister allocations (even their own) on the main thread
+    while (mCallingId == id && QThread::currentThread() != thread())
+        mCallFinished.wait(&mMutex);
+
+    mAllocations.remove(id);
+}
+
+void DkMemoryGovernor::setPriority(int id, Priority priority)
+{
+    QMutexLocker locker(&mMutex);
+
+    auto it = mAllocations.find(id);
+
+    if (it != mAllocations.end()) {
+        it->priority = priority;
+        it->lastAccess = ++mAccessCounter;
+    }
+}
+
+/**
+ * Marks the allocation as recently used.
+ **/
+void DkMemoryGovernor::touch(int id)
+{
+    QMutexLocker locker(&mMutex);
+
+    auto it = mAllocations.find(id);
+
+    if (it != mAllocations.end())
+        it->lastAccess = ++mAccessCounter;
+}
+
+/**
+ * Returns the budget in MB.
+ * If no budget is set, a fraction of the free memory is used.
+ **/
+double DkMemoryGovernor::budget() const
+{
+    return budget(memoryUsage());
+}
+
+double DkMemoryGovernor::budget(double usage) const
+{
+    double maxMemory = DkSettingsManager::param().resources().memoryBudget;
+
+    if (maxMemory > 0)
+        return maxMemory;
+
+    // our own allocations are not free anymore - but we may reuse them
+    double freeMemory = DkMemory::getFreeMemory();
+
+    if (freeMemory > 0)
+        return qMax((freeMemory + usage) * freeMemoryFraction, minBudget);
+
+    double totalMemory = DkMemory::getTotalMemory();
+
+    if (totalMemory > 0)
+        return qMax(totalMemory * freeMemoryFraction, minBudget);
+
+    return 4 * minBudget;
+}
+
+/**
+ * Returns the memory (MB) of all allocations at the last update.
+ **/
+double DkMemoryGovernor::memoryUsage() const
+{
+    QMutexLocker locker(&mMutex);
+
+    double usage = 0;
+    for (const Allocation &a : mAllocations)
+        usage += a.memory;
+
+    return usage;
+}
+
+/**
+ * Returns the memory (MB) that allocations of a given priority may use.
+ * Allocations with a higher priority are not released for them.
+ **/
+double DkMemoryGovernor::headroom(Priority priority) const
+{
+    double usage = 0;
+    double reserved = 0;
+
+    {
+        QMutexLocker locker(&mMutex);
+
+        for (const Allocation &a : mAllocations) {
+            usage += a.memory;
+
+            if (a.priority > priority)
+                reserved += a.memory;
+        }
+    }
+
+    return qMax(budget(usage) - reserved, 0.0);
+}
+
+/**
+ * Marks the allocation as being called - it cannot be unregistered until endCall().
+ * @return bool false if the allocation was unregistered
+ **/
+bool DkMemoryGovernor::beginCall(int id)
+{
+    QMutexLocker locker(&mMutex);
+
+    if (!mAllocations.contains(id))
+        return false;
+
+    mCallingId = id;
+    return true;
+}
+
+void DkMemoryGovernor::endCall()
+{
+    QMutexLocker locker(&mMutex);
+
+    mCallingId = -1;
+    mCallFinished.wakeAll();
+}
+
+/**
+ * Schedules an update - call it after allocating large chunks of memory.
+ **/
+void DkMemoryGovernor::requestUpdate()
+{
+    QMutexLocker locker(&mMutex);
+
+    if (mUpdateRequested)
+        return;
+
+    mUpdateRequested = true;
+    QMetaObject::invokeMethod(this, &DkMemoryGovernor::update, Qt::QueuedConnection);
+}
+
+/**
+ * Queries the memory of all allocations and releases
+ * them if the budget is exceeded.
+ **/
+void DkMemoryGovernor::update()
+{
+    QHash<int, Allocation> allocations;
+
+    {
+        QMutexLocker locker(&mMutex);
+        mUpdateRequested = false;
+        allocations = mAllocations;
+    }
+
+    double usage = 0;
+
+    for (auto it = allocations.begin(); it != allocations.end(); it++) {
+        // it was unregistered in the meantime - its owner might be gone
+        if (!beginCall(it.key())) {
+            it->memory = 0;
+            continue;
+        }
+
+        it->memory = it->usage();
+        endCall();
+
+        usage += it->memory;
+    }
+
+    double maxMemory = budget(usage);
+
+    if (usage > maxMemory) {
+        DkTimer dt;
+
+        // release a bit more so that we are not called with every new image
+        double target = maxMemory * 7 / 8;
+        double oldUsage = usage;
+
+        QVector<QPair<QPair<int, quint64>, int>> order;
+        for (auto it = allocations.constBegin(); it != allocations.constEnd(); it++) {
+            if (it->priority < priority_current && it->release && it->memory > 0)
+                order << qMakePair(qMakePair((int)it->priority, it->lastAccess), it.key());
+        }
+
+        std::sort(order.begin(), order.end());
+
+        for (const auto &o : order) {
+            if (usage <= target)
+                break;
+
+            // a release function might have unregistered others
+            if (!beginCall(o.second))
+                continue;
+
+            Allocation &a = allocations[o.second];
+            a.release(usage - target);
+
+            double mem = a.usage();
+            endCall();
+
+            usage -= a.memory - mem;
+            a.memory = mem;
+        }
+
+        qInfo() << "[DkMemoryGovernor]" << qRound(oldUsage - usage) << "MB released in" << dt << "-" << qRound(usage) << "of" << qRound(maxMemory)
+                << "MB used";
+    }
+
+    // allocations that change without requesting an update (e.g. scaled images)
+    // are only polled while we are close to the budget
+    if (usage > maxMemory * 3 / 4)
+        mUpdateTimer.start();
+    else
+        mUpdateTimer.stop();
+
+    QMutexLocker locker(&mMutex);
+
+    for (auto it = allocations.constBegin(); it != allocations.constEnd(); it++) {
+        auto a = mAllocations.find(it.key());
+
+        if (a != mAllocations.end())
+            a->memory = it->memory;
+    }
+}
+
+}
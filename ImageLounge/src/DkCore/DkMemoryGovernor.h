@@ -0,0 +1,130 @@
+/*******************************************************************************************************
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2026 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2026 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2026 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ related links:
+ [1] https://nomacs.org/
+ [2] https://github.com/nomacs/
+ [3] http://download.nomacs.org
+ *******************************************************************************************************/
+
+
+#pragma once
+
+#pragma warning(push, 0) // no warnings from includes - begin
+#include <QHash>
+#include <QMutex>
+#include <QObject>
+#include <QTimer>
+#include <QWaitCondition>
+#include <functional>
+#pragma warning(pop) // no warnings from includes - end
+
+#ifndef DllCoreExport
+#ifdef DK_CORE_DLL_EXPORT
+#define DllCoreExport Q_DECL_EXPORT
+#elif DK_DLL_IMPORT
+#define DllCoreExport Q_DECL_IMPORT
+#else
+#define DllCoreExport Q_DECL_IMPORT
+#endif
+#endif
+
+namespace nmc
+{
+
+/**
+ * DkMemoryGovernor enforces one memory budget for the whole process.
+ * Large allocations (decoded images, file buffers, edit histories,
+ * scaled images, pyramids and thumbnails) register a function that returns
+ * their memory and a function that releases it. If the budget
+ * (see DkSettings::Resources::memoryBudget) is exceeded, allocations are
+ * released by priority - and least recently used first within a priority.
+ * Allocations with priority_current or without a release function
+ * (e.g. edit histories) are never released.
+ * The usage and release functions are called from the main thread.
+ * Allocations may be unregistered from any thread: unregisterAllocation()
+ * waits until the allocation's functions returned.
+ * @threadsafe
+ **/
+class DllCoreExport DkMemoryGovernor : public QObject
+{
+    Q_OBJECT
+
+public:
+    // lower priorities are released first
+    enum Priority {
+        priority_unused = 0, // decoded images that no tab uses (see DkImageCache)
+        priority_thumbnail,
+        priority_cached, // prefetched images and file buffers
+        priority_scaled, // scaled images and pyramids - they are recomputed when painted
+        priority_history, // undo history of edited images
+        priority_current, // images that are shown
+
+        priority_end
+    };
+
+    using UsageFunction = std::function<double()>;
+    using ReleaseFunction = std::function<void(double)>;
+
+    static DkMemoryGovernor &instance();
+
+    int registerAllocation(Priority priority, const UsageFunction &usage, const ReleaseFunction &release);
+    void unregisterAllocation(int id);
+    void setPriority(int id, Priority priority);
+    void touch(int id);
+
+    double budget() const;
+    double memoryUsage() const;
+    double headroom(Priority priority) const;
+
+public slots:
+    void requestUpdate();
+    void update();
+
+private:
+    DkMemoryGovernor();
+    DkMemoryGovernor(const DkMemoryGovernor &);
+
+    struct Allocation {
+        Priority priority = priority_cached;
+        UsageFunction usage;
+        ReleaseFunction release;
+        double memory = 0; // MB at the last update
+        quint64 lastAccess = 0;
+    };
+
+    double budget(double usage) const;
+    bool beginCall(int id);
+    void endCall();
+
+    mutable QMutex mMutex;
+    QHash<int, Allocation> mAllocations;
+    int mLastId = 0;
+    quint64 mAccessCounter = 0;
+    bool mUpdateRequested = false;
+    int mCallingId = -1; // the allocation whose functions are called right now
+    QWaitCondition mCallFinished;
+
+    QTimer mUpdateTimer;
+};
+
+}
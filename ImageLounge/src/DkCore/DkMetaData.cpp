@@ -39,6 +39,7 @@
 #include <QImage>
 #include <QObject>
 #include <QRegularExpression>
+#include <QSaveFile>
 #include <QTranslator>
 #include <QVector2D>
 #pragma warning(pop) // no warnings from includes - end
@@ -182,10 +183,12 @@ bool DkMetaDataT::saveMetaData(const QString &filePath, bool force)
         return false;
     }
 
-    // Open image file for WRITING, save it with modified metadata
-    file.open(QFile::WriteOnly);
-    file.write(ba->data(), ba->size());
-    file.close();
+    // write a new file and replace the old one - truncating it would break readers that mapped it
+    QSaveFile saveFile(filePath);
+    if (!saveFile.open(QFile::WriteOnly) || saveFile.write(ba->constData(), ba->size()) != ba->size() || !saveFile.commit()) {
+        qWarning() << "[DkMetaDataT] could not write" << QFileInfo(filePath).fileName() << saveFile.errorString();
+        return false;
+    }
 
     qInfo() << "[DkMetaDataT] I saved: " << ba->size() << " bytes";
 
@@ -798,38 +801,50 @@ bool DkMetaDataT::isLoaded() const
 
 bool DkMetaDataT::isTiff() const
 {
+    static const QRegularExpression tiffSuffix("(tif|tiff)", QRegularExpression::CaseInsensitiveOption);
+
     QString newSuffix = QFileInfo(mFilePath).suffix();
-    return newSuffix.contains(QRegularExpression("(tif|tiff)", QRegularExpression::CaseInsensitiveOption)) != 0;
+    return newSuffix.contains(tiffSuffix);
 }
 
 bool DkMetaDataT::isJpg() const
 {
+    static const QRegularExpression jpgSuffix("(jpg|jpeg)", QRegularExpression::CaseInsensitiveOption);
+
     QString newSuffix = QFileInfo(mFilePath).suffix();
-    return newSuffix.contains(QRegularExpression("(jpg|jpeg)", QRegularExpression::CaseInsensitiveOption)) != 0;
+    return newSuffix.contains(jpgSuffix);
 }
 
 bool DkMetaDataT::isRaw() const
 {
+    static const QRegularExpression rawSuffix("(nef|crw|cr2|arw)", QRegularExpression::CaseInsensitiveOption);
+
     QString newSuffix = QFileInfo(mFilePath).suffix();
-    return newSuffix.contains(QRegularExpression("(nef|crw|cr2|arw)", QRegularExpression::CaseInsensitiveOption)) != 0;
+    return newSuffix.contains(rawSuffix);
 }
 
 bool DkMetaDataT::isAVIF() const
 {
+    static const QRegularExpression avifSuffix("(avif)", QRegularExpression::CaseInsensitiveOption);
+
     QString newSuffix = QFileInfo(mFilePath).suffix();
-    return newSuffix.contains(QRegularExpression("(avif)", QRegularExpression::CaseInsensitiveOption)) != 0;
+    return newSuffix.contains(avifSuffix);
 }
 
 bool DkMetaDataT::isHEIF() const
 {
+    static const QRegularExpression heifSuffix("(heic|heif)", QRegularExpression::CaseInsensitiveOption);
+
     QString newSuffix = QFileInfo(mFilePath).suffix();
-    return newSuffix.contains(QRegularExpression("(heic|heif)", QRegularExpression::CaseInsensitiveOption)) != 0;
+    return newSuffix.contains(heifSuffix);
 }
 
 bool DkMetaDataT::isJXL() const
 {
+    static const QRegularExpression jxlSuffix("(jxl)", QRegularExpression::CaseInsensitiveOption);
+
     QString newSuffix = QFileInfo(mFilePath).suffix();
-    return newSuffix.contains(QRegularExpression("(jxl)", QRegularExpression::CaseInsensitiveOption)) != 0;
+    return newSuffix.contains(jxlSuffix);
 }
 
 bool DkMetaDataT::isDirty() const
@@ -507,6 +507,10 @@ void DkSettings::load(QSettings &settings, bool defaults)
     resources_p.preferredExtension = settings.value("preferredExtension", resources_p.preferredExtension).toString();
     resources_p.gammaCorrection = settings.value("gammaCorrection", resources_p.gammaCorrection).toBool();
     resources_p.loadSavedImage = settings.value("loadSavedImage", resources_p.loadSavedImage).toInt();
+    resources_p.thumbCacheSize = settings.value("thumbCacheSize", resources_p.thumbCacheSize).toInt();
+    resources_p.thumbMemorySize = settings.value("thumbMemorySize", resources_p.thumbMemorySize).toInt();
+    resources_p.memoryBudget = settings.value("memoryBudget", resources_p.memoryBudget).toInt();
+    resources_p.keep16BitTiff = settings.value("keep16BitTiff", resources_p.keep16BitTiff).toBool();
 
     if (sync_p.switchModifier) {
         global_p.altMod = Qt::ControlModifier;
@@ -802,6 +806,14 @@ void DkSettings::save(QSettings &settings, bool force)
         settings.setValue("gammaCorrection", resources_p.gammaCorrection);
     if (force || resources_p.loadSavedImage != resources_d.loadSavedImage)
         settings.setValue("loadSavedImage", resources_p.loadSavedImage);
+    if (force || resources_p.thumbCacheSize != resources_d.thumbCacheSize)
+        settings.setValue("thumbCacheSize", resources_p.thumbCacheSize);
+    if (force || resources_p.thumbMemorySize != resources_d.thumbMemorySize)
+        settings.setValue("thumbMemorySize", resources_p.thumbMemorySize);
+    if (force || resources_p.memoryBudget != resources_d.memoryBudget)
+        settings.setValue("memoryBudget", resources_p.memoryBudget);
+    if (force || resources_p.keep16BitTiff != resources_d.keep16BitTiff)
+        settings.setValue("keep16BitTiff", resources_p.keep16BitTiff);
 
     settings.endGroup();
 
@@ -948,6 +960,10 @@ void DkSettings::setToDefaultSettings()
     resources_p.preferredExtension = "*.jpg";
     resources_p.gammaCorrection = true;
     resources_p.loadSavedImage = ls_load_to_tab;
+    resources_p.thumbCacheSize = 256;
+    resources_p.thumbMemorySize = 256;
+    resources_p.memoryBudget = 0;
+    resources_p.keep16BitTiff = false;
     resources_p.waitForLastImg = true;
 
     qDebug() << "ok... default settings are set";
@@ -324,6 +324,10 @@ public:
         QString preferredExtension;
         bool gammaCorrection;
         int loadSavedImage;
+        int thumbCacheSize; // MB on disk - 0 disables the thumbnail cache
+        int thumbMemorySize; // MB of decoded thumbnails in memory - 0 is unlimited
+        int memoryBudget; // MB of all images, buffers and thumbnails - 0 uses a fraction of the free memory
+        bool keep16BitTiff; // 16 bit TIFF samples are reduced to 8 bit (half the memory) unless this is set
     };
 
     enum DisplayItems {
@@ -28,6 +28,7 @@
 #include "DkThumbs.h"
 #include "DkBasicLoader.h"
 #include "DkImageStorage.h"
+#include "DkMemoryGovernor.h"
 #include "DkMetaData.h"
 #include "DkSettings.h"
 #include "DkTimer.h"
@@ -35,18 +36,34 @@
 
 #pragma warning(push, 0) // no warnings from includes - begin
 #include <QBuffer>
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
 #include <QFileInfo>
+#include <QFutureInterface>
 #include <QImageReader>
 #include <QMutex>
+#include <QSaveFile>
+#include <QStandardPaths>
 #include <QStringList>
 #include <QThreadPool>
 #include <QTimer>
+#include <QUrl>
 #include <QtConcurrentRun>
 #pragma warning(pop) // no warnings from includes - end
 
 namespace nmc
 {
 
+// touches every page of a memory-mapped buffer so that it is read from the disk
+static void prefetchBuffer(const QByteArray &ba)
+{
+    volatile char v = 0;
+
+    for (int idx = 0; idx < ba.size(); idx += 4096)
+        v = v ^ ba.constData()[idx];
+}
+
 /**
  * Default constructor.
  * @param file the corresponding file
@@ -95,6 +112,20 @@ QImage DkThumbNail::computeIntern(const QString &filePath, QSharedPointer<QByteA
     DkTimer dt;
     // qDebug() << "[thumb] file: " << filePath;
 
+    // diem: do_not_force is the generic load - so also rescale these
+    bool rescale = forceLoad == do_not_force;
+
+    // file access is limited separately - decoding (below) is CPU bound
+    DkThumbsThreadPool::IoLocker ioLocker;
+
+    // thumbnails that were computed before are read from the disk cache
+    if (rescale || forceLoad == force_exif_thumb) {
+        QImage cachedThumb = DkThumbCache::instance().find(filePath, maxThumbSize);
+
+        if (!cachedThumb.isNull())
+            return cachedThumb;
+    }
+
     // see if we can read the thumbnail from the exif data
     QImage thumb;
     DkMetaDataT metaData;
@@ -104,6 +135,14 @@ QImage DkThumbNail::computeIntern(const QString &filePath, QSharedPointer<QByteA
     if (QFileInfo(filePath).dir().path().contains(DkZipContainer::zipMarker()))
         baZip = DkZipContainer::extractImage(DkZipContainer::decodeZipFile(filePath), DkZipContainer::decodeImageFile(filePath));
 #endif
+
+    // map large files once - exiv2 and the decoders read the same buffer
+    bool mapped = false;
+    if (!baZip && (!ba || ba->isEmpty())) {
+        ba = DkFileBuffer::map(filePath);
+        mapped = ba && !ba->isEmpty();
+    }
+
     try {
         // [DIEM] READ  build crashed here 09.06.2016
         if (baZip && !baZip->isEmpty())
@@ -135,19 +174,27 @@ QImage DkThumbNail::computeIntern(const QString &filePath, QSharedPointer<QByteA
     QString lFilePath = fInfo.isSymLink() ? fInfo.symLinkTarget() : filePath;
     fInfo = QFileInfo(lFilePath);
 
-    // diem: do_not_force is the generic load - so also rescale these
-    bool rescale = forceLoad == do_not_force;
+    bool loadFull = (forceLoad != force_exif_thumb || fInfo.size() < 1e5) && (thumb.isNull() || forceLoad == force_full_thumb || forceLoad == force_save_thumb);
+
+    // read the pages the decoder needs while we hold the I/O slot
+    if (loadFull && DkFileBuffer::isMapped(ba))
+        prefetchBuffer(*ba);
+
+    ioLocker.release();
 
-    if ((forceLoad != force_exif_thumb || fInfo.size() < 1e5) && (thumb.isNull() || forceLoad == force_full_thumb || forceLoad == force_save_thumb)) { // braces
+    if (loadFull) {
 
         // try to read the image
         DkBasicLoader loader;
 
+        // thumbnails that are rescaled anyway can be decoded with a reduced scale
+        QSize targetSize = rescale ? QSize(maxThumbSize, maxThumbSize) : QSize();
+
         if (baZip && !baZip->isEmpty()) {
-            if (loader.loadGeneral(lFilePath, baZip, true, true))
+            if (loader.loadGeneral(lFilePath, baZip, true, true, targetSize))
                 thumb = loader.image();
         } else {
-            if (loader.loadGeneral(lFilePath, ba, true, true))
+            if (loader.loadGeneral(lFilePath, ba, true, true, targetSize))
                 thumb = loader.image();
         }
     }
@@ -184,6 +231,9 @@ QImage DkThumbNail::computeIntern(const QString &filePath, QSharedPointer<QByteA
         thumb = thumb.transformed(rotationMatrix);
     }
 
+    if (rescale)
+        DkThumbCache::instance().insert(filePath, thumb, maxThumbSize);
+
     // save the thumbnail if the caller either forces it, or the save thumb is requested and the image did not have any before
     if (forceLoad == force_save_thumb || (forceLoad == save_thumb && !exifThumb)) {
         try {
@@ -196,7 +246,8 @@ QImage DkThumbNail::computeIntern(const QString &filePath, QSharedPointer<QByteA
 
             metaData.updateImageMetaData(sThumb);
 
-            if (!ba || ba->isEmpty())
+            // a mapped buffer is a read-only copy of the file
+            if (!ba || ba->isEmpty() || mapped)
                 metaData.saveMetaData(lFilePath);
             else
                 metaData.saveMetaData(ba);
@@ -285,18 +336,65 @@ DkThumbNailT::DkThumbNailT(const QString &filePath, const QImage &img)
 {
     mFetching = false;
     mForceLoad = do_not_force;
+
+    if (!mImg.isNull())
+        DkThumbMemoryCache::instance().insert(this);
 }
 
 DkThumbNailT::~DkThumbNailT()
 {
     mThumbWatcher.blockSignals(true);
     mThumbWatcher.cancel();
+
+    DkThumbMemoryCache::instance().remove(this);
+}
+
+void DkThumbNailT::setImage(const QImage img)
+{
+    DkThumbNail::setImage(img);
+    DkThumbMemoryCache::instance().insert(this);
+    emit thumbLoadedSignal(true);
+}
+
+/**
+ * Returns the thumbnail and marks it as recently used.
+ **/
+QImage DkThumbNailT::getImage() const
+{
+    if (!mImg.isNull())
+        DkThumbMemoryCache::instance().touch(this);
+
+    return mImg;
+}
+
+/**
+ * Returns the thumbnail size without marking it as used.
+ * The size of released thumbnails is returned too.
+ **/
+QSize DkThumbNailT::imageSize() const
+{
+    return mImg.isNull() ? mReleasedSize : mImg.size();
 }
 
-bool DkThumbNailT::fetchThumb(int forceLoad /* = false */, QSharedPointer<QByteArray> ba)
+/**
+ * Drops the thumbnail - it is fetched again if needed.
+ **/
+void DkThumbNailT::release()
+{
+    mReleasedSize = mImg.size();
+    mImg = QImage();
+}
+
+bool DkThumbNailT::fetchThumb(int forceLoad /* = false */, QSharedPointer<QByteArray> ba, int priority)
 {
-    if (forceLoad == force_full_thumb || forceLoad == force_save_thumb || forceLoad == save_thumb)
+    if (forceLoad == force_full_thumb || forceLoad == force_save_thumb || forceLoad == save_thumb) {
         mImg = QImage();
+        DkThumbMemoryCache::instance().remove(this);
+    }
+
+    // the thumbnail is already queued - it might be more important now
+    if (mFetching)
+        DkThumbsThreadPool::setPriority(mRequest, priority);
 
     if (!mImg.isNull() || !mImgExists || mFetching)
         return false;
@@ -317,33 +415,81 @@ bool DkThumbNailT::fetchThumb(int forceLoad /* = false */, QSharedPointer<QByteA
     // note: arguments to lambda must be thread-safe or copies (no "&", "this") to prevent race conditions
     QString filePath = getFilePath(); // not a copy, but will detach (COW) if string is modified
     int maxThumbSize = mMaxThumbSize;
-    mThumbWatcher.setFuture(QtConcurrent::run(DkThumbsThreadPool::pool(), // load thumbnails on their dedicated pool
-                                              [filePath, ba, forceLoad, maxThumbSize] {
-                                                  QImage thumb = DkThumbNail::computeIntern(filePath, ba, forceLoad, maxThumbSize);
-                                                  return DkImage::createThumb(thumb);
-                                              }));
+
+    // the thumbnail was released before - decompressing is faster than reading the file
+    QByteArray compressed;
+    if (forceLoad == do_not_force)
+        compressed = DkThumbMemoryCache::instance().takeCompressed(filePath, maxThumbSize);
+
+    mRequest = DkThumbsThreadPool::schedule(
+        [filePath, ba, forceLoad, maxThumbSize, compressed] {
+            if (!compressed.isEmpty()) {
+                QImage thumb = QImage::fromData(compressed);
+
+                if (!thumb.isNull())
+                    return thumb;
+            }
+
+            QImage thumb = DkThumbNail::computeIntern(filePath, ba, forceLoad, maxThumbSize);
+            return DkImage::createThumb(thumb);
+        },
+        priority);
+    mThumbWatcher.setFuture(DkThumbsThreadPool::future(mRequest));
 
     return true;
 }
 
+/**
+ * Cancels the request if it did not start yet.
+ **/
+void DkThumbNailT::cancel()
+{
+    mThumbWatcher.cancel();
+}
+
 void DkThumbNailT::thumbLoaded()
 {
     QFuture<QImage> future = mThumbWatcher.future();
+    mRequest.clear();
+
+    // the request was cancelled - we can fetch it again later
+    if (future.isCanceled() || future.resultCount() == 0) {
+        mFetching = false;
+        return;
+    }
 
     mImg = future.result();
 
     if (mImg.isNull() && mForceLoad != force_exif_thumb)
         mImgExists = false;
+    else if (!mImg.isNull())
+        DkThumbMemoryCache::instance().insert(this);
 
     mFetching = false;
     emit thumbLoadedSignal(!mImg.isNull());
 }
 
+// DkThumbRequest --------------------------------------------------------------------
+/**
+ * A thumbnail request of the DkThumbsThreadPool.
+ **/
+class DkThumbRequest
+{
+public:
+    std::function<QImage()> job;
+    QFutureInterface<QImage> fi;
+    int priority = DkThumbsThreadPool::priority_visible;
+    bool queued = false;
+};
+
 // DkThumbsThreadPool --------------------------------------------------------------------
 DkThumbsThreadPool::DkThumbsThreadPool()
+    : mIoSemaphore(max_io_requests)
 {
     mPool = new QThreadPool();
     mPool->setMaxThreadCount(qMax(mPool->maxThreadCount() - 2, 1));
+
+    mQueues.resize(priority_end);
 }
 
 DkThumbsThreadPool &DkThumbsThreadPool::instance()
@@ -357,9 +503,728 @@ QThreadPool *DkThumbsThreadPool::pool()
     return instance().mPool;
 }
 
+/**
+ * Queues a thumbnail job.
+ * The request's future (see future()) is cancelled if the job should not be run anymore.
+ * @param job the job which returns the thumbnail - it must not access any class members.
+ * @param priority the request's Priority.
+ **/
+QSharedPointer<DkThumbRequest> DkThumbsThreadPool::schedule(const std::function<QImage()> &job, int priority)
+{
+    QSharedPointer<DkThumbRequest> request(new DkThumbRequest());
+    request->job = job;
+    request->priority = qBound(0, priority, priority_end - 1);
+    request->fi.reportStarted();
+
+    DkThumbsThreadPool &inst = instance();
+
+    {
+        QMutexLocker locker(&inst.mMutex);
+        request->queued = true;
+        inst.mQueues[request->priority].append(request);
+        inst.mNumQueued++;
+    }
+
+    // every runnable processes the most important request that is queued when it starts
+    inst.mPool->start([] {
+        instance().runNext();
+    });
+
+    return request;
+}
+
+/**
+ * Changes the priority of a request that is still queued.
+ **/
+void DkThumbsThreadPool::setPriority(QSharedPointer<DkThumbRequest> request, int priority)
+{
+    if (!request)
+        return;
+
+    priority = qBound(0, priority, priority_end - 1);
+
+    DkThumbsThreadPool &inst = instance();
+    QMutexLocker locker(&inst.mMutex);
+
+    if (!request->queued || request->priority == priority)
+        return;
+
+    // the old queue entry is outdated now and skipped in takeNext()
+    request->priority = priority;
+    inst.mQueues[priority].append(request);
+}
+
+/**
+ * Moves all queued requests to the background.
+ * Views call this if they are scrolled and then re-prioritize the thumbnails that are visible.
+ **/
+void DkThumbsThreadPool::deprioritize()
+{
+    DkThumbsThreadPool &inst = instance();
+    QMutexLocker locker(&inst.mMutex);
+
+    for (int p = priority_background + 1; p < priority_end; p++) {
+        for (const QSharedPointer<DkThumbRequest> &r : qAsConst(inst.mQueues[p])) {
+            if (r->queued && r->priority == p) {
+                r->priority = priority_background;
+                inst.mQueues[priority_background].append(r);
+            }
+        }
+
+        inst.mQueues[p].clear();
+    }
+}
+
+/**
+ * Cancels all requests that did not start yet.
+ **/
 void DkThumbsThreadPool::clear()
 {
-    pool()->clear();
+    DkThumbsThreadPool &inst = instance();
+    inst.mPool->clear();
+
+    QMutexLocker locker(&inst.mMutex);
+
+    for (QList<QSharedPointer<DkThumbRequest>> &queue : inst.mQueues) {
+        for (const QSharedPointer<DkThumbRequest> &r : qAsConst(queue)) {
+            if (r->queued) {
+                r->queued = false;
+                r->fi.reportCanceled();
+                r->fi.reportFinished();
+            }
+        }
+
+        queue.clear();
+    }
+
+    inst.mNumQueued = 0;
+}
+
+QFuture<QImage> DkThumbsThreadPool::future(QSharedPointer<DkThumbRequest> request)
+{
+    return request ? request->fi.future() : QFuture<QImage>();
+}
+
+QSharedPointer<DkThumbRequest> DkThumbsThreadPool::takeNext()
+{
+    QMutexLocker locker(&mMutex);
+
+    for (int p = priority_end - 1; p >= 0 && mNumQueued > 0; p--) {
+        QList<QSharedPointer<DkThumbRequest>> &queue = mQueues[p];
+
+        while (!queue.isEmpty()) {
+            QSharedPointer<DkThumbRequest> r = queue.takeFirst();
+
+            // skip outdated entries (the request was re-prioritized or is already processed)
+            if (!r->queued || r->priority != p)
+                continue;
+
+            r->queued = false;
+            mNumQueued--;
+            return r;
+        }
+    }
+
+    return QSharedPointer<DkThumbRequest>();
+}
+
+void DkThumbsThreadPool::runNext()
+{
+    QSharedPointer<DkThumbRequest> r = takeNext();
+
+    if (!r)
+        return;
+
+    // the thumbnail is not needed anymore
+    if (!r->fi.isCanceled())
+        r->fi.reportResult(r->job());
+
+    r->fi.reportFinished();
+}
+
+DkThumbsThreadPool::IoLocker::IoLocker()
+{
+    DkThumbsThreadPool::instance().mIoSemaphore.acquire();
+    mLocked = true;
+}
+
+DkThumbsThreadPool::IoLocker::~IoLocker()
+{
+    release();
+}
+
+void DkThumbsThreadPool::IoLocker::release()
+{
+    if (mLocked)
+        DkThumbsThreadPool::instance().mIoSemaphore.release();
+
+    mLocked = false;
+}
+
+// DkThumbCache --------------------------------------------------------------------
+static const quint32 thumb_cache_magic = 0x6e6d7463; // nmtc
+static const quint32 thumb_cache_version = 1;
+
+/**
+ * Creates the cache.
+ * @param dirPath the cache's directory - if it is empty, the user's cache location is used
+ **/
+DkThumbCache::DkThumbCache(const QString &dirPath)
+{
+    mDirPath = dirPath.isEmpty() ? QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + QDir::separator() + "thumbnails" : dirPath;
+}
+
+DkThumbCache::~DkThumbCache()
+{
+    save();
+}
+
+DkThumbCache &DkThumbCache::instance()
+{
+    static DkThumbCache inst;
+    return inst;
+}
+
+/**
+ * Returns the cached thumbnail of filePath.
+ * A null image is returned if the file is not cached, if it was changed
+ * since caching or if the cached thumbnail is smaller than maxThumbSize.
+ **/
+QImage DkThumbCache::find(const QString &filePath, int maxThumbSize)
+{
+    if (maxCacheSize() <= 0)
+        return QImage();
+
+    QFileInfo fInfo(filePath);
+
+    if (!fInfo.isFile())
+        return QImage();
+
+    QString key = fInfo.absoluteFilePath();
+    QByteArray data;
+
+    {
+        QMutexLocker locker(&mMutex);
+
+        if (!open())
+            return QImage();
+
+        auto it = mIndex.find(key);
+
+        if (it != mIndex.end()) {
+            if (it->fileSize != fInfo.size() || it->modified != fInfo.lastModified().toMSecsSinceEpoch() || it->maxThumbSize < maxThumbSize) {
+                mIndex.erase(it); // outdated - the pack space is freed with the next compaction
+                mNumUnsaved++;
+            } else if (it->offset + it->length <= mMappedSize || mapPack()) {
+                it->lastAccess = ++mAccessCounter;
+                data = QByteArray((const char *)mPackData + it->offset, it->length);
+            }
+        }
+    }
+
+    QImage thumb;
+
+    if (!data.isEmpty())
+        return QImage::fromData(data);
+
+    thumb = findSystemThumb(fInfo, maxThumbSize);
+
+    // keep it in our cache - it is faster to read than the png
+    if (!thumb.isNull()) {
+        thumb = DkImage::createThumb(thumb, maxThumbSize);
+        insert(filePath, thumb, maxThumbSize);
+    }
+
+    return thumb;
+}
+
+/**
+ * Adds a thumbnail to the cache.
+ * @param filePath the file the thumbnail belongs to.
+ * @param thumb the thumbnail (it must be scaled to maxThumbSize already).
+ * @param maxThumbSize the thumbnail size requested.
+ **/
+void DkThumbCache::insert(const QString &filePath, const QImage &thumb, int maxThumbSize)
+{
+    qint64 maxSize = maxCacheSize();
+
+    if (thumb.isNull() || maxSize <= 0)
+        return;
+
+    QFileInfo fInfo(filePath);
+
+    if (!fInfo.isFile())
+        return;
+
+    // encode outside the lock
+    QByteArray data;
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::WriteOnly);
+
+    if (!thumb.save(&buffer, thumb.hasAlphaChannel() ? "PNG" : "JPG", 90))
+        return;
+
+    QMutexLocker locker(&mMutex);
+
+    if (!open())
+        return;
+
+    Entry e;
+    e.fileSize = fInfo.size();
+    e.modified = fInfo.lastModified().toMSecsSinceEpoch();
+    e.offset = mPack.size();
+    e.length = data.size();
+    e.maxThumbSize = maxThumbSize;
+    e.lastAccess = ++mAccessCounter;
+
+    if (!mPack.seek(e.offset) || mPack.write(data) != data.size()) {
+        qWarning() << "[DkThumbCache] could not write to" << mPack.fileName();
+        return;
+    }
+
+    mIndex.insert(fInfo.absoluteFilePath(), e);
+
+    if (mPack.size() > maxSize)
+        compact(maxSize * 3 / 4);
+    else if (++mNumUnsaved >= 100)
+        saveIndex();
+}
+
+/**
+ * Writes the index to disk.
+ **/
+void DkThumbCache::save()
+{
+    QMutexLocker locker(&mMutex);
+
+    if (mOpened && mNumUnsaved > 0)
+        saveIndex();
+}
+
+bool DkThumbCache::open()
+{
+    if (mOpened)
+        return mPack.isOpen();
+
+    mOpened = true;
+
+    if (!QDir().mkpath(mDirPath))
+        return false;
+
+    // other instances may use the cache too - the first one owns it
+    mLock.reset(new QLockFile(mDirPath + QDir::separator() + "thumbs.lock"));
+
+    if (!mLock->tryLock(0)) {
+        qInfo() << "[DkThumbCache] disabled because another instance uses it";
+        return false;
+    }
+
+    DkTimer dt;
+    QFile indexFile(mDirPath + QDir::separator() + "thumbs.idx");
+    mPack.setFileName(mDirPath + QDir::separator() + "thumbs.pack");
+
+    if (indexFile.open(QIODevice::ReadOnly)) {
+        QDataStream ds(&indexFile);
+        quint32 magic, version, numEntries;
+        ds >> magic >> version >> numEntries;
+
+        if (magic == thumb_cache_magic && version == thumb_cache_version) {
+            mIndex.reserve(numEntries);
+
+            for (quint32 idx = 0; idx < numEntries && ds.status() == QDataStream::Ok; idx++) {
+                QString key;
+                Entry e;
+                ds >> key >> e.fileSize >> e.modified >> e.offset >> e.length >> e.maxThumbSize >> e.lastAccess;
+                mIndex.insert(key, e);
+                mAccessCounter = qMax(mAccessCounter, e.lastAccess);
+            }
+        }
+
+        if (ds.status() != QDataStream::Ok)
+            mIndex.clear();
+    }
+
+    // without index, the pack is garbage
+    QIODevice::OpenMode mode = QIODevice::ReadWrite;
+    if (mIndex.isEmpty())
+        mode |= QIODevice::Truncate;
+
+    if (!mPack.open(mode)) {
+        qWarning() << "[DkThumbCache] could not open" << mPack.fileName();
+        mIndex.clear();
+        return false;
+    }
+
+    // drop entries that point beyond the pack (e.g. if it was not written completely)
+    for (auto it = mIndex.begin(); it != mIndex.end();) {
+        if (it->offset + it->length > mPack.size())
+            it = mIndex.erase(it);
+        else
+            ++it;
+    }
+
+    mapPack();
+
+    qInfo() << "[DkThumbCache]" << mIndex.size() << "thumbnails indexed in" << dt;
+
+    return true;
+}
+
+bool DkThumbCache::mapPack()
+{
+    if (mPackData)
+        mPack.unmap(mPackData);
+
+    mPackData = 0;
+    mMappedSize = 0;
+
+    if (mPack.size() == 0)
+        return false;
+
+    mPackData = mPack.map(0, mPack.size());
+
+    if (mPackData)
+        mMappedSize = mPack.size();
+
+    return mPackData != 0;
+}
+
+/**
+ * Evicts the least recently used thumbnails until the pack is smaller than maxSize.
+ * The remaining thumbnails are copied to a new pack.
+ **/
+void DkThumbCache::compact(qint64 maxSize)
+{
+    DkTimer dt;
+
+    if (mMappedSize < mPack.size())
+        mapPack();
+
+    if (!mPackData)
+        return;
+
+    QVector<QPair<quint32, QString>> lru;
+    lru.reserve(mIndex.size());
+
+    for (auto it = mIndex.constBegin(); it != mIndex.constEnd(); ++it)
+        lru << qMakePair(it->lastAccess, it.key());
+
+    // most recently used first
+    std::sort(lru.begin(), lru.end(), [](const QPair<quint32, QString> &l, const QPair<quint32, QString> &r) {
+        return l.first > r.first;
+    });
+
+    QFile newPack(mPack.fileName() + ".tmp");
+
+    if (!newPack.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "[DkThumbCache] could not compact" << mPack.fileName();
+        return;
+    }
+
+    QHash<QString, Entry> newIndex;
+    qint64 size = 0;
+
+    for (const auto &l : lru) {
+        Entry e = mIndex.value(l.second);
+
+        if (size + e.length > maxSize)
+            break;
+
+        newPack.write((const char *)mPackData + e.offset, e.length);
+        e.offset = size;
+        size += e.length;
+        newIndex.insert(l.second, e);
+    }
+
+    newPack.close();
+
+    mPack.unmap(mPackData);
+    mPackData = 0;
+    mMappedSize = 0;
+    mPack.close();
+
+    if (!QFile::remove(mPack.fileName()) || !newPack.rename(mPack.fileName())) {
+        qWarning() << "[DkThumbCache] could not replace" << mPack.fileName();
+        newPack.remove();
+        mIndex.clear();
+        mPack.open(QIODevice::ReadWrite | QIODevice::Truncate);
+    } else {
+        mIndex = newIndex;
+        mPack.open(QIODevice::ReadWrite);
+    }
+
+    mapPack();
+    saveIndex();
+
+    qInfo() << "[DkThumbCache] compacted to" << mIndex.size() << "thumbnails in" << dt;
+}
+
+void DkThumbCache::saveIndex()
+{
+    // the index reveals the files that were browsed
+    if (DkSettingsManager::param().app().privateMode)
+        return;
+
+    QSaveFile indexFile(mDirPath + QDir::separator() + "thumbs.idx");
+
+    if (!indexFile.open(QIODevice::WriteOnly))
+        return;
+
+    QDataStream ds(&indexFile);
+    ds << thumb_cache_magic << thumb_cache_version << (quint32)mIndex.size();
+
+    for (auto it = mIndex.constBegin(); it != mIndex.constEnd(); ++it)
+        ds << it.key() << it->fileSize << it->modified << it->offset << it->length << it->maxThumbSize << it->lastAccess;
+
+    if (indexFile.commit())
+        mNumUnsaved = 0;
+}
+
+/**
+ * Returns the cache size in bytes - the cache is disabled (0) in private mode.
+ **/
+qint64 DkThumbCache::maxCacheSize()
+{
+    if (DkSettingsManager::param().app().privateMode)
+        return 0;
+
+    return (qint64)DkSettingsManager::param().resources().thumbCacheSize * 1024 * 1024;
+}
+
+/**
+ * Loads the thumbnail from the freedesktop thumbnail cache.
+ * See: https://specifications.freedesktop.org/thumbnail-spec/latest/
+ **/
+QImage DkThumbCache::findSystemThumb(const QFileInfo &fileInfo, int maxThumbSize)
+{
+#ifdef Q_OS_LINUX
+    static const QVector<QPair<int, QString>> folders = {{256, "large"}, {512, "x-large"}, {1024, "xx-large"}};
+
+    QString cacheDir = qEnvironmentVariable("XDG_CACHE_HOME", QDir::homePath() + "/.cache") + "/thumbnails/";
+    QString uri = QUrl::fromLocalFile(fileInfo.absoluteFilePath()).toString(QUrl::FullyEncoded);
+    QString thumbName = QCryptographicHash::hash(uri.toUtf8(), QCryptographicHash::Md5).toHex() + ".png";
+
+    for (const auto &f : folders) {
+        if (f.first < maxThumbSize)
+            continue;
+
+        QString thumbPath = cacheDir + f.second + "/" + thumbName;
+
+        if (!QFileInfo::exists(thumbPath))
+            continue;
+
+        QImage thumb(thumbPath);
+
+        if (!thumb.isNull() && thumb.text("Thumb::MTime").toLongLong() == fileInfo.lastModified().toSecsSinceEpoch())
+            return thumb;
+    }
+#else
+    Q_UNUSED(fileInfo);
+    Q_UNUSED(maxThumbSize);
+#endif
+
+    return QImage();
+}
+
+
+// DkThumbMemoryCache --------------------------------------------------------------------
+DkThumbMemoryCache::DkThumbMemoryCache()
+{
+    // the thumbnails are the first to go if the process runs out of memory
+    DkMemoryGovernor::instance().registerAllocation(
+        DkMemoryGovernor::priority_thumbnail,
+        [this]() {
+            // compressed thumbnails are limited separately (see insertCompressed) - we cannot release them
+            QMutexLocker locker(&mMutex);
+            return mMemory / (1024.0 * 1024.0);
+        },
+        [this](double memory) {
+            QMutexLocker locker(&mMutex);
+            evict(mMemory - (qint64)(memory * 1024 * 1024));
+        });
+}
+
+DkThumbMemoryCache &DkThumbMemoryCache::instance()
+{
+    static DkThumbMemoryCache inst;
+    return inst;
+}
+
+/**
+ * Adds (or updates) the thumbnail's image.
+ * The least recently used thumbnails are released if the budget is exceeded.
+ **/
+void DkThumbMemoryCache::insert(DkThumbNailT *thumb)
+{
+    QMutexLocker locker(&mMutex);
+
+    Entry &e = mEntries[thumb];
+    mMemory -= e.bytes;
+
+    QImage img = thumb->mImg;
+    e.bytes = (qint64)img.bytesPerLine() * img.height();
+    e.lastAccess = ++mAccessCounter;
+    mMemory += e.bytes;
+
+    qint64 maxMem = maxMemory();
+
+    if (maxMem > 0 && mMemory > maxMem)
+        evict(maxMem * 3 / 4);
+
+    DkMemoryGovernor::instance().requestUpdate();
+}
+
+void DkThumbMemoryCache::touch(const DkThumbNailT *thumb)
+{
+    QMutexLocker locker(&mMutex);
+
+    auto it = mEntries.find(thumb);
+
+    if (it != mEntries.end())
+        it->lastAccess = ++mAccessCounter;
+}
+
+void DkThumbMemoryCache::remove(const DkThumbNailT *thumb)
+{
+    QMutexLocker locker(&mMutex);
+
+    auto it = mEntries.find(thumb);
+
+    if (it != mEntries.end()) {
+        mMemory -= it->bytes;
+        mEntries.erase(it);
+    }
+}
+
+/**
+ * Returns the compressed thumbnail of a released thumbnail.
+ * It is removed from the cache since it will be decoded.
+ **/
+QByteArray DkThumbMemoryCache::takeCompressed(const QString &filePath, int maxThumbSize)
+{
+    QMutexLocker locker(&mMutex);
+
+    auto it = mCompressed.find(filePath);
+
+    if (it == mCompressed.end() || it->maxThumbSize < maxThumbSize) {
+        mMisses++;
+        return QByteArray();
+    }
+
+    QByteArray data = it->data;
+    mCompressedMemory -= data.size();
+    mCompressed.erase(it);
+    mCompressedOrder.removeOne(filePath);
+    mHits++;
+
+    return data;
+}
+
+/**
+ * Returns the number of released thumbnails that were restored from their compressed version.
+ **/
+qint64 DkThumbMemoryCache::hits() const
+{
+    return mHits;
+}
+
+/**
+ * Returns the number of thumbnails that had to be loaded from the file.
+ **/
+qint64 DkThumbMemoryCache::misses() const
+{
+    return mMisses;
+}
+
+qint64 DkThumbMemoryCache::evictions() const
+{
+    return mEvictions;
+}
+
+qint64 DkThumbMemoryCache::memoryUsage() const
+{
+    return mMemory;
+}
+
+void DkThumbMemoryCache::evict(qint64 maxMemory)
+{
+    DkTimer dt;
+
+    QVector<QPair<quint64, const DkThumbNailT *>> entries;
+    entries.reserve(mEntries.size());
+
+    for (auto it = mEntries.constBegin(); it != mEntries.constEnd(); it++)
+        entries << qMakePair(it->lastAccess, it.key());
+
+    std::sort(entries.begin(), entries.end());
+
+    QVector<QPair<QString, QImage>> released;
+    int maxThumbSize = 0;
+
+    // the most recent thumbnail is never released
+    for (int idx = 0; idx < entries.size() - 1 && mMemory > maxMemory; idx++) {
+        DkThumbNailT *thumb = const_cast<DkThumbNailT *>(entries[idx].second);
+
+        if (!thumb->mImg.hasAlphaChannel())
+            released << qMakePair(thumb->getFilePath(), thumb->mImg);
+
+        maxThumbSize = thumb->getMaxThumbSize();
+        mMemory -= mEntries.value(thumb).bytes;
+        mEntries.remove(thumb);
+        thumb->release();
+        mEvictions++;
+    }
+
+    qInfo() << "[DkThumbMemoryCache]" << released.size() << "thumbnails released in" << dt << "- hits:" << mHits << "misses:" << mMisses
+            << "evictions:" << mEvictions;
+
+    if (released.isEmpty())
+        return;
+
+    // compress in the background - the thumbnails are likely to be shown again
+    QFuture<void> future = QtConcurrent::run([released, maxThumbSize] {
+        for (const auto &r : released) {
+            QByteArray data;
+            QBuffer buffer(&data);
+            buffer.open(QIODevice::WriteOnly);
+
+            if (r.second.save(&buffer, "JPG", 90))
+                DkThumbMemoryCache::instance().insertCompressed(r.first, data, maxThumbSize);
+        }
+    });
+}
+
+void DkThumbMemoryCache::insertCompressed(const QString &filePath, const QByteArray &data, int maxThumbSize)
+{
+    QMutexLocker locker(&mMutex);
+
+    auto it = mCompressed.find(filePath);
+
+    if (it != mCompressed.end()) {
+        mCompressedMemory -= it->data.size();
+        mCompressedOrder.removeOne(filePath);
+    }
+
+    Compressed c;
+    c.data = data;
+    c.maxThumbSize = maxThumbSize;
+    mCompressed.insert(filePath, c);
+    mCompressedOrder << filePath;
+    mCompressedMemory += data.size();
+
+    // the compressed thumbnails may use a quarter of the budget
+    qint64 maxMem = maxMemory() / 4;
+
+    while (maxMem > 0 && mCompressedMemory > maxMem && !mCompressedOrder.isEmpty()) {
+        QString oldest = mCompressedOrder.takeFirst();
+        mCompressedMemory -= mCompressed.value(oldest).data.size();
+        mCompressed.remove(oldest);
+    }
+}
+
+qint64 DkThumbMemoryCache::maxMemory()
+{
+    return (qint64)DkSettingsManager::param().resources().thumbMemorySize * 1024 * 1024;
 }
 
 }
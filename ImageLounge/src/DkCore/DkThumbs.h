@@ -30,10 +30,20 @@
 #pragma warning(push, 0) // no warnings from includes - begin
 #include <QColor>
 #include <QDir>
+#include <QFile>
 #include <QFutureWatcher>
+#include <QHash>
 #include <QImage>
+#include <QLockFile>
+#include <QMutex>
+#include <QScopedPointer>
+#include <QSemaphore>
 #include <QSharedPointer>
+#include <QStringList>
 #include <QThread>
+#include <QVector>
+
+#include <functional>
 #pragma warning(pop) // no warnings from includes - end
 
 #pragma warning(disable : 4251) // TODO: remove
@@ -48,6 +58,7 @@
 #endif
 #endif
 
+class QFileInfo;
 class QThreadPool;
 
 namespace nmc
@@ -55,6 +66,70 @@ namespace nmc
 
 #define max_thumb_size 400
 
+class DkThumbRequest;
+
+/**
+ * DkThumbsThreadPool schedules the thumbnail requests.
+ * Requests are processed by priority (visible thumbnails first).
+ * They can be re-prioritized, and cancelled via their QFuture, as long as they did not start.
+ * File access is limited separately from the decoding threads (see IoLocker),
+ * so that slow disks are not flooded with concurrent reads.
+ **/
+class DllCoreExport DkThumbsThreadPool
+{
+public:
+    enum Priority {
+        priority_background = 0,
+        priority_near_visible,
+        priority_visible,
+
+        priority_end
+    };
+
+    enum {
+        max_io_requests = 4,
+    };
+
+    /**
+     * Holds one of the I/O slots until it is released or destroyed.
+     **/
+    class DllCoreExport IoLocker
+    {
+    public:
+        IoLocker();
+        ~IoLocker();
+
+        void release();
+
+    private:
+        bool mLocked = false;
+    };
+
+    static DkThumbsThreadPool &instance();
+
+    static QThreadPool *pool();
+    static QSharedPointer<DkThumbRequest> schedule(const std::function<QImage()> &job, int priority = priority_visible);
+    static void setPriority(QSharedPointer<DkThumbRequest> request, int priority);
+    static void deprioritize();
+    static void clear();
+
+    static QFuture<QImage> future(QSharedPointer<DkThumbRequest> request);
+
+private:
+    DkThumbsThreadPool();
+    DkThumbsThreadPool(const DkThumbsThreadPool &);
+
+    QSharedPointer<DkThumbRequest> takeNext();
+    void runNext();
+
+    QThreadPool *mPool;
+    QSemaphore mIoSemaphore;
+
+    QMutex mMutex;
+    QVector<QList<QSharedPointer<DkThumbRequest>>> mQueues; // one queue per priority
+    int mNumQueued = 0;
+};
+
 /**
  * This class holds thumbnails.
  **/
@@ -173,7 +248,8 @@ public:
     DkThumbNailT(const QString &mFile = QString(), const QImage &mImg = QImage());
     ~DkThumbNailT();
 
-    bool fetchThumb(int forceLoad = do_not_force, QSharedPointer<QByteArray> ba = QSharedPointer<QByteArray>());
+    bool fetchThumb(int forceLoad = do_not_force, QSharedPointer<QByteArray> ba = QSharedPointer<QByteArray>(), int priority = DkThumbsThreadPool::priority_visible);
+    void cancel();
 
     /**
      * Returns whether the thumbnail was loaded, or does not exist.
@@ -187,11 +263,9 @@ public:
             return DkThumbNail::hasImage();
     };
 
-    void setImage(const QImage img)
-    {
-        DkThumbNail::setImage(img);
-        emit thumbLoadedSignal(true);
-    };
+    void setImage(const QImage img);
+    QImage getImage() const;
+    QSize imageSize() const;
 
 signals:
     void thumbLoadedSignal(bool loaded = true);
@@ -200,24 +274,127 @@ protected slots:
     void thumbLoaded();
 
 protected:
+    friend class DkThumbMemoryCache;
+    void release();
+
     QFutureWatcher<QImage> mThumbWatcher;
+    QSharedPointer<DkThumbRequest> mRequest;
     bool mFetching;
     int mForceLoad;
+    QSize mReleasedSize; // size of the thumbnail if it was released by the DkThumbMemoryCache
 };
 
-class DkThumbsThreadPool
+/**
+ * DkThumbMemoryCache limits the memory of decoded thumbnails.
+ * Thumbnails register their image when it is loaded and are touched when
+ * they are shown (see DkThumbNailT::getImage()). If the budget
+ * (see DkSettings::Resources::thumbMemorySize) is exceeded, the least
+ * recently shown thumbnails are released. DkThumbNailT::hasImage() then
+ * returns not_loaded so that they are fetched again if needed.
+ * Thumbnails are released first if the DkMemoryGovernor's budget is exceeded.
+ * Released thumbnails are kept compressed (a quarter of the budget) so that
+ * fetching them again does not need to read the file.
+ * @threadsafe
+ **/
+class DllCoreExport DkThumbMemoryCache
 {
 public:
-    static DkThumbsThreadPool &instance();
+    static DkThumbMemoryCache &instance();
 
-    static QThreadPool *pool();
-    static void clear();
+    void insert(DkThumbNailT *thumb);
+    void touch(const DkThumbNailT *thumb);
+    void remove(const DkThumbNailT *thumb);
+
+    QByteArray takeCompressed(const QString &filePath, int maxThumbSize);
+
+    qint64 hits() const;
+    qint64 misses() const;
+    qint64 evictions() const;
+    qint64 memoryUsage() const;
 
 private:
-    DkThumbsThreadPool();
-    DkThumbsThreadPool(const DkThumbsThreadPool &);
+    DkThumbMemoryCache();
+    DkThumbMemoryCache(const DkThumbMemoryCache &);
 
-    QThreadPool *mPool;
+    struct Entry {
+        qint64 bytes = 0;
+        quint64 lastAccess = 0;
+    };
+
+    struct Compressed {
+        QByteArray data;
+        int maxThumbSize = 0;
+    };
+
+    void evict(qint64 maxMemory);
+    void insertCompressed(const QString &filePath, const QByteArray &data, int maxThumbSize);
+    static qint64 maxMemory();
+
+    QMutex mMutex;
+    QHash<const DkThumbNailT *, Entry> mEntries;
+    qint64 mMemory = 0;
+    quint64 mAccessCounter = 0;
+
+    qint64 mHits = 0;
+    qint64 mMisses = 0;
+    qint64 mEvictions = 0;
+
+    QHash<QString, Compressed> mCompressed; // released thumbs are compressed in the background
+    QStringList mCompressedOrder; // oldest first
+    qint64 mCompressedMemory = 0;
+};
+
+/**
+ * DkThumbCache stores computed thumbnails on disk.
+ * Thumbnails are appended to a pack file which is memory-mapped for reading.
+ * The index maps file paths to their thumbnails - an entry is only valid
+ * if the file's size and modification date did not change.
+ * If the pack exceeds the cache size (see DkSettings::Resources::thumbCacheSize)
+ * the least recently used thumbnails are evicted.
+ * On Linux, thumbnails of the freedesktop cache (~/.cache/thumbnails) are used as well.
+ * Nothing is read or written in private mode.
+ * @threadsafe
+ **/
+class DllCoreExport DkThumbCache
+{
+public:
+    static DkThumbCache &instance();
+    virtual ~DkThumbCache();
+
+    QImage find(const QString &filePath, int maxThumbSize);
+    void insert(const QString &filePath, const QImage &thumb, int maxThumbSize);
+    void save();
+
+protected:
+    DkThumbCache(const QString &dirPath = QString());
+    DkThumbCache(const DkThumbCache &);
+
+    struct Entry {
+        qint64 fileSize = 0;
+        qint64 modified = 0; // msecs since epoch
+        qint64 offset = 0;
+        int length = 0;
+        int maxThumbSize = 0;
+        quint32 lastAccess = 0;
+    };
+
+    bool open();
+    bool mapPack();
+    void compact(qint64 maxSize);
+    void saveIndex();
+    static qint64 maxCacheSize();
+    static QImage findSystemThumb(const QFileInfo &fileInfo, int maxThumbSize);
+
+    QMutex mMutex;
+    bool mOpened = false;
+    QString mDirPath;
+    QScopedPointer<QLockFile> mLock;
+    QFile mPack;
+    uchar *mPackData = 0;
+    qint64 mMappedSize = 0;
+    QHash<QString, Entry> mIndex;
+    quint32 mAccessCounter = 0;
+    int mNumUnsaved = 0;
 };
 
 }
@@ -355,10 +355,27 @@ bool DkUtils::compFileSize(const QFileInfo &lhf, const QFileInfo &rhf)
 
 bool DkUtils::compRandom(const QFileInfo &lhf, const QFileInfo &rhf)
 {
-    return QCryptographicHash::hash(lhf.absoluteFilePath().toUtf8() + QByteArray::number(DkSettingsManager::param().global().sortSeed),
-                                    QCryptographicHash::Algorithm::Md5)
-        > QCryptographicHash::hash(rhf.absoluteFilePath().toUtf8() + QByteArray::number(DkSettingsManager::param().global().sortSeed),
-                                   QCryptographicHash::Algorithm::Md5);
+    quint32 seed = DkSettingsManager::param().global().sortSeed;
+    return randomSortKey(lhf.absoluteFilePath(), seed) < randomSortKey(rhf.absoluteFilePath(), seed);
+}
+
+quint64 DkUtils::randomSortKey(const QString &str, quint32 seed)
+{
+    // FNV-1a followed by the splitmix64 finalizer
+    quint64 h = 14695981039346656037ULL ^ seed;
+
+    for (const QChar &c : str) {
+        h ^= c.unicode();
+        h *= 1099511628211ULL;
+    }
+
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ULL;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebULL;
+    h ^= h >> 31;
+
+    return h;
 }
 
 void DkUtils::addLanguages(QComboBox *langCombo, QStringList &languages)
@@ -1077,6 +1094,61 @@ QString DkUtils::stdWStringToQString(const std::wstring &str)
 #endif
 }
 
+// DkNaturalSortKey --------------------------------------------------------------------
+#ifdef Q_OS_WIN
+
+DkNaturalSortKey::DkNaturalSortKey(const QString &str)
+    : mKey(DkUtils::qStringToStdWString(str))
+{
+}
+
+int DkNaturalSortKey::compare(const DkNaturalSortKey &o) const
+{
+    return StrCmpLogicalW(mKey.c_str(), o.mKey.c_str());
+}
+
+#else
+
+/**
+ * Creates the key of str.
+ * QCollator's numeric mode does not work in the C/POSIX locale, so we build the key ourselves:
+ * the string is case folded and every number is prefixed by its number of digits
+ * (without leading zeros). Hence, a plain string compare sorts numbers naturally.
+ **/
+DkNaturalSortKey::DkNaturalSortKey(const QString &str)
+{
+    QString folded = str.toCaseFolded();
+    mKey.reserve(folded.size() + 8);
+
+    for (int idx = 0; idx < folded.size();) {
+        if (!folded[idx].isDigit()) {
+            mKey += folded[idx++];
+            continue;
+        }
+
+        int end = idx;
+        while (end < folded.size() && folded[end].isDigit())
+            end++;
+
+        // skip leading zeros but keep the last digit (0 == 000)
+        int first = idx;
+        while (first < end - 1 && folded[first].digitValue() == 0)
+            first++;
+
+        // '0' + #digits is smaller than letters for numbers with up to 48 digits
+        mKey += QChar('0' + (end - first));
+        mKey += folded.mid(first, end - first);
+        idx = end;
+    }
+}
+
+int DkNaturalSortKey::compare(const DkNaturalSortKey &o) const
+{
+    return mKey.compare(o.mKey);
+}
+
+#endif
+
 // DkConvertFileName --------------------------------------------------------------------
 DkFileNameConverter::DkFileNameConverter(const QString &p)
     : mFrags{}
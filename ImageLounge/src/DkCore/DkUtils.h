@@ -142,6 +142,9 @@ public:
 
     static bool naturalCompare(const QString &s1, const QString &s2, Qt::CaseSensitivity cs = Qt::CaseSensitive);
 
+    // seeded 64 bit hash of str - used for sorting in random order
+    static quint64 randomSortKey(const QString &str, quint32 seed);
+
     static QString resolveSymLink(const QString &filePath);
 
     static QString getLongestNumber(const QString &str, int startIdx = 0);
@@ -440,6 +443,32 @@ public:
     };
 };
 
+/**
+ * DkNaturalSortKey is the precomputed collation key of a file name.
+ * Numbers are sorted naturally (img4 < img10) and the case is ignored.
+ * The key does not depend on the locale (letters are compared by their code points).
+ * On Windows the names are compared with StrCmpLogicalW to match the Explorer.
+ **/
+class DllCoreExport DkNaturalSortKey
+{
+public:
+    DkNaturalSortKey(const QString &str = QString());
+
+    int compare(const DkNaturalSortKey &o) const;
+
+    bool operator<(const DkNaturalSortKey &o) const
+    {
+        return compare(o) < 0;
+    };
+
+protected:
+#ifdef Q_OS_WIN
+    std::wstring mKey;
+#else
+    QString mKey;
+#endif
+};
+
 class DllCoreExport DkMemory
 {
 public:
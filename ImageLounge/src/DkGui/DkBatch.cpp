@@ -405,7 +405,7 @@ void DkBatchInput::changeTab(int tabIdx) const
     mInputTabs->setCurrentIndex(tabIdx);
 }
 
-void DkBatchInput::updateDir(QVector<QSharedPointer<DkImageContainerT>> thumbs)
+void DkBatchInput::updateDir(DkImageList thumbs)
 {
     emit updateDirSignal(thumbs);
 }
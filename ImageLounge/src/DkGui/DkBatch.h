@@ -227,14 +227,14 @@ public:
 public slots:
     void setDir(const QString &dirPath);
     void browse();
-    void updateDir(QVector<QSharedPointer<DkImageContainerT>>);
+    void updateDir(DkImageList);
     void setVisible(bool visible) override;
     void parameterChanged();
     void selectionChanged();
     void setFileInfo(QFileInfo file);
 
 signals:
-    void updateDirSignal(QVector<QSharedPointer<DkImageContainerT>>) const;
+    void updateDirSignal(DkImageList) const;
     void updateInputDir(const QString &) const;
     void changed() const;
 
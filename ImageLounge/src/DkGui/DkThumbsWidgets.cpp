@@ -61,6 +61,7 @@
 #include <QToolBar>
 #include <QToolButton>
 #include <QUrl>
+#include <QtConcurrentRun>
 #include <QtGlobal>
 #include <qmath.h>
 #pragma warning(pop) // no warnings from includes - end
@@ -109,6 +110,7 @@ void DkFilePreview::init()
     moveImageTimer = new QTimer(this);
     moveImageTimer->setInterval(5); // reduce cpu utilization
     connect(moveImageTimer, &QTimer::timeout, this, &DkFilePreview::moveImages);
+    connect(&mScaleWatcher, &QFutureWatcher<QImage>::finished, this, &DkFilePreview::imageScaled);
 
     int borderTriggerI = qRound(borderTrigger);
     leftGradient =
@@ -176,6 +178,7 @@ void DkFilePreview::initOrientations()
     worldMatrix.reset();
     currentDx = 0;
     scrollToCurrentImage = true;
+    mLayoutDirty = true;
     update();
 }
 
@@ -256,7 +259,8 @@ void DkFilePreview::paintEvent(QPaintEvent *)
     painter.setWorldMatrixEnabled(true);
 
     if (mThumbs.empty()) {
-        thumbRects.clear();
+        mThumbSizes.clear();
+        mThumbExtents = DkPrefixSum();
         return;
     }
 
@@ -275,83 +279,64 @@ void DkFilePreview::drawThumbs(QPainter *painter)
 {
     // qDebug() << "drawing thumbs: " << worldMatrix.dx();
 
-    bufferDim = (orientation == Qt::Horizontal) ? QRectF(QPointF(0, yOffset / 2), QSize(xOffset, 0)) : QRectF(QPointF(yOffset / 2, 0), QSize(0, xOffset));
-    thumbRects.clear();
+    int ts = DkSettingsManager::param().effectiveThumbSize(this);
 
-    DkTimer dt;
+    if (mLayoutDirty || mLayoutSize != size() || mLayoutThumbSize != ts)
+        updateThumbRects();
 
-    // mouse over effect
-    QPoint p = worldMatrix.inverted().map(mapFromGlobal(QCursor::pos()));
+    // find the visible thumbs
+    QRectF visibleRect = worldMatrix.inverted().mapRect(QRectF(rect()));
+    int firstIdx = thumbIndexAt(orientation == Qt::Horizontal ? visibleRect.left() : visibleRect.top());
+    int lastIdx = thumbIndexAt(orientation == Qt::Horizontal ? visibleRect.right() : visibleRect.bottom());
 
-    for (int idx = 0; idx < mThumbs.size(); idx++) {
-        QSharedPointer<DkThumbNailT> thumb = mThumbs.at(idx)->getThumb();
-        QImage img;
+    // the layout changes if visible thumbs were loaded in the meantime
+    bool changed = false;
 
-        // if the image is loaded draw that (it might be edited)
-        if (mThumbs.at(idx)->hasImage()) {
-            img = mThumbs.at(idx)->imageScaledToHeight(DkSettingsManager::param().effectiveThumbSize(this));
-        } else {
-            if (thumb->hasImage() == DkThumbNail::exists_not) {
-                thumbRects.push_back(QRectF());
-                continue;
-            }
+    for (int idx = firstIdx; idx <= lastIdx; idx++) {
+        QSize s = thumbSize(idx);
 
-            if (thumb->hasImage() == DkThumbNail::loaded)
-                img = thumb->getImage();
+        if (s != mThumbSizes.at(idx)) {
+            updateThumbRect(idx, s);
+            changed = true;
         }
+    }
 
-        // if (img.width() > max_thumb_size * DkSettingsManager::param().dpiScaleFactor())
-        //	qDebug() << thumb->getFilePath() << "size:" << img.size();
+    if (changed) {
+        firstIdx = thumbIndexAt(orientation == Qt::Horizontal ? visibleRect.left() : visibleRect.top());
+        lastIdx = thumbIndexAt(orientation == Qt::Horizontal ? visibleRect.right() : visibleRect.bottom());
+    }
+
+    // update file rect for move to current file timer
+    if (scrollToCurrentImage && currentFileIdx >= 0 && currentFileIdx < mThumbSizes.size())
+        newFileRect = worldMatrix.mapRect(thumbRect(currentFileIdx));
+
+    // mouse over effect
+    QPoint p = worldMatrix.inverted().map(mapFromGlobal(QCursor::pos()));
 
-        QPointF anchor = orientation == Qt::Horizontal ? bufferDim.topRight() : bufferDim.bottomLeft();
-        QRectF r = !img.isNull()
-            ? QRectF(anchor, img.size())
-            : QRectF(anchor, QSize(DkSettingsManager::param().effectiveThumbSize(this), DkSettingsManager::param().effectiveThumbSize(this)));
-        if (orientation == Qt::Horizontal && height() - yOffset < r.height() * 2)
-            r.setSize(QSizeF(qFloor(r.width() * (float)(height() - yOffset) / r.height()), height() - yOffset));
-        else if (orientation == Qt::Vertical && width() - yOffset < r.width() * 2)
-            r.setSize(QSizeF(width() - yOffset, qFloor(r.height() * (float)(width() - yOffset) / r.width())));
+    for (int idx = firstIdx; idx <= lastIdx; idx++) {
+        QRectF r = thumbRect(idx);
 
         // check if the size is still valid
         if (r.width() < 1 || r.height() < 1)
-            continue; // this brings us in serious problems with the selection
+            continue;
 
-        // center vertically
-        if (orientation == Qt::Horizontal)
-            r.moveCenter(QPoint(qFloor(r.center().x()), height() / 2));
-        else
-            r.moveCenter(QPoint(width() / 2, qFloor(r.center().y())));
+        QSharedPointer<DkThumbNailT> thumb = mThumbs.at(idx)->getThumb();
+        QImage img;
 
-        // update the buffer dim
-        if (orientation == Qt::Horizontal)
-            bufferDim.setRight(qFloor(bufferDim.right() + r.width()) + qCeil(xOffset / 2.0f));
-        else
-            bufferDim.setBottom(qFloor(bufferDim.bottom() + r.height()) + qCeil(xOffset / 2.0f));
-        thumbRects.push_back(r);
+        // if the image is loaded draw that (it might be edited)
+        if (mThumbs.at(idx)->hasImage())
+            img = scaledImage(mThumbs.at(idx), ts);
+        else if (thumb->hasImage() == DkThumbNail::loaded)
+            img = thumb->getImage();
 
         QRectF imgWorldRect = worldMatrix.mapRect(r);
 
-        // update file rect for move to current file timer
-        if (scrollToCurrentImage && idx == currentFileIdx)
-            newFileRect = imgWorldRect;
-
-        // is the current image within the canvas?
-        if ((orientation == Qt::Horizontal && imgWorldRect.right() < 0) || (orientation == Qt::Vertical && imgWorldRect.bottom() < 0)) {
-            continue;
-        }
-
-        if (((orientation == Qt::Horizontal && imgWorldRect.left() > width()) || (orientation == Qt::Vertical && imgWorldRect.top() > height()))
-            && scrollToCurrentImage) {
-            continue;
-        } else if ((orientation == Qt::Horizontal && imgWorldRect.left() > width()) || (orientation == Qt::Vertical && imgWorldRect.top() > height())) {
-            break;
-        }
-
         // only fetch thumbs if we are not moving too fast...
         if (thumb->hasImage() == DkThumbNail::not_loaded && fabs(currentDx) < 40) {
             thumb->fetchThumb();
-            connect(thumb.data(), &DkThumbNailT::thumbLoadedSignal, this, QOverload<>::of(&DkFilePreview::update));
-        }
+            connect(thumb.data(), &DkThumbNailT::thumbLoadedSignal, this, QOverload<>::of(&DkFilePreview::update), Qt::UniqueConnection);
+        } else if (thumb->hasImage() == DkThumbNailT::loading)
+            thumb->fetchThumb(); // it's visible now -> load it first
 
         bool isLeftGradient = (orientation == Qt::Horizontal && worldMatrix.dx() < 0 && imgWorldRect.left() < leftGradient.finalStop().x())
             || (orientation == Qt::Vertical && worldMatrix.dy() < 0 && imgWorldRect.top() < leftGradient.finalStop().y());
@@ -377,6 +362,209 @@ void DkFilePreview::drawThumbs(QPainter *painter)
     }
 }
 
+/**
+ * Returns the size of a thumbnail before it is fit into the filmstrip.
+ * The size is empty if the image does not exist.
+ **/
+QSize DkFilePreview::thumbSize(int idx)
+{
+    int ts = DkSettingsManager::param().effectiveThumbSize(this);
+    QSharedPointer<DkImageContainerT> cImg = mThumbs.created(idx);
+
+    // files that were never shown have no container (and no thumbnail) yet
+    if (!cImg)
+        return QSize(ts, ts);
+
+    // loaded images are drawn instead of the thumbnail
+    if (cImg->hasImage()) {
+        QSize s = cImg->pixmap().size();
+
+        if (!s.isEmpty())
+            return QSize(qMax(qRound(s.width() * (double)ts / s.height()), 1), ts);
+    }
+
+    QSharedPointer<DkThumbNailT> thumb = cImg->getThumb();
+
+    if (thumb->hasImage() == DkThumbNail::exists_not)
+        return QSize();
+    else if (!thumb->imageSize().isEmpty())
+        return thumb->imageSize(); // released thumbnails keep their size
+
+    return QSize(ts, ts);
+}
+
+/**
+ * Returns the size a thumbnail of size s is drawn with.
+ **/
+QSizeF DkFilePreview::drawnSize(const QSize &s) const
+{
+    QSizeF ds(s);
+
+    if (!s.isEmpty() && orientation == Qt::Horizontal && height() - yOffset < ds.height() * 2)
+        ds = QSizeF(qFloor(ds.width() * (float)(height() - yOffset) / ds.height()), height() - yOffset);
+    else if (!s.isEmpty() && orientation == Qt::Vertical && width() - yOffset < ds.width() * 2)
+        ds = QSizeF(width() - yOffset, qFloor(ds.height() * (float)(width() - yOffset) / ds.width()));
+
+    return ds;
+}
+
+/**
+ * Returns the space a thumbnail of size s takes along the filmstrip (including the gap).
+ * Empty thumbs keep their index but do not take any space.
+ **/
+qint64 DkFilePreview::thumbExtent(const QSize &s) const
+{
+    QSizeF ds = drawnSize(s);
+
+    if (ds.width() < 1 || ds.height() < 1)
+        return 0;
+
+    return qFloor(orientation == Qt::Horizontal ? ds.width() : ds.height()) + qCeil(xOffset / 2.0f);
+}
+
+/**
+ * Returns the filmstrip rect of the thumbnail idx.
+ **/
+QRectF DkFilePreview::thumbRect(int idx) const
+{
+    qreal pos = xOffset + mThumbExtents.sum(idx);
+    QPointF anchor = orientation == Qt::Horizontal ? QPointF(pos, yOffset / 2) : QPointF(yOffset / 2, pos);
+
+    if (mThumbExtents.value(idx) == 0)
+        return QRectF(anchor, QSizeF());
+
+    QRectF r(anchor, drawnSize(mThumbSizes.at(idx)));
+
+    // center vertically
+    if (orientation == Qt::Horizontal)
+        r.moveCenter(QPoint(qFloor(r.center().x()), height() / 2));
+    else
+        r.moveCenter(QPoint(width() / 2, qFloor(r.center().y())));
+
+    return r;
+}
+
+/**
+ * Lays out all thumbnails.
+ * mThumbExtents holds the thumbnail extents along the filmstrip in a prefix sum
+ * so that single thumbs can be updated and the visible thumbs can be found in O(log n).
+ * Containers that were not created yet get the default thumbnail extent.
+ **/
+void DkFilePreview::updateThumbRects()
+{
+    DkTimer dt;
+
+    QVector<qint64> extents(mThumbs.size());
+    mThumbSizes.resize(mThumbs.size());
+
+    for (int idx = 0; idx < mThumbs.size(); idx++) {
+        mThumbSizes[idx] = thumbSize(idx);
+        extents[idx] = thumbExtent(mThumbSizes[idx]);
+    }
+
+    mThumbExtents = DkPrefixSum(extents);
+    updateBufferDim();
+
+    mLayoutSize = size();
+    mLayoutThumbSize = DkSettingsManager::param().effectiveThumbSize(this);
+    mLayoutDirty = false;
+
+    if (dt.elapsed() > 50)
+        qInfo() << "[DkFilePreview]" << mThumbs.size() << "thumbs laid out in" << dt;
+}
+
+/**
+ * Updates the layout if the thumbnail idx changed its size to s.
+ * Only the extent of idx is updated which is O(log n).
+ **/
+void DkFilePreview::updateThumbRect(int idx, const QSize &s)
+{
+    if (idx < 0 || idx >= mThumbSizes.size())
+        return;
+
+    mThumbSizes[idx] = s;
+    mThumbExtents.setValue(idx, thumbExtent(s));
+    updateBufferDim();
+}
+
+void DkFilePreview::updateBufferDim()
+{
+    qreal end = xOffset + mThumbExtents.total();
+
+    bufferDim = (orientation == Qt::Horizontal) ? QRectF(QPointF(0, yOffset / 2), QSizeF(end, 0)) : QRectF(QPointF(yOffset / 2, 0), QSizeF(0, end));
+}
+
+/**
+ * Returns the index of the thumbnail at the filmstrip position pos.
+ * Positions before (after) the first (last) thumbnail are clamped.
+ **/
+int DkFilePreview::thumbIndexAt(qreal pos) const
+{
+    if (mThumbSizes.isEmpty())
+        return -1;
+
+    int idx = mThumbExtents.find(qFloor(pos - xOffset));
+
+    return qBound(0, idx, (int)mThumbSizes.size() - 1);
+}
+
+/**
+ * Returns the index of the thumbnail that is drawn at the widget position pos.
+ **/
+int DkFilePreview::thumbAt(const QPoint &pos) const
+{
+    QPointF wp = worldMatrix.inverted().map(QPointF(pos));
+    int idx = thumbIndexAt(orientation == Qt::Horizontal ? wp.x() : wp.y());
+
+    if (idx >= 0 && idx < mThumbSizes.size() && thumbRect(idx).contains(wp))
+        return idx;
+
+    return -1;
+}
+
+/**
+ * Returns the image scaled to the filmstrip height.
+ * Scaled images are computed in the background - the thumbnail
+ * is returned until the scaled image is ready.
+ **/
+QImage DkFilePreview::scaledImage(QSharedPointer<DkImageContainerT> cImg, int height)
+{
+    QImage src = cImg->pixmap();
+
+    for (const ScaledImage &si : mScaledImgs) {
+        if (si.srcKey == src.cacheKey() && si.img.height() == height && si.filePath == cImg->filePath())
+            return si.img;
+    }
+
+    if (!mScaleWatcher.isRunning() && !src.isNull()) {
+        mScalingImg.filePath = cImg->filePath();
+        mScalingImg.srcKey = src.cacheKey();
+
+        mScaleWatcher.setFuture(QtConcurrent::run([src, height]() {
+            return src.scaledToHeight(height, Qt::SmoothTransformation);
+        }));
+    }
+
+    QSharedPointer<DkThumbNailT> thumb = cImg->getThumb();
+    return thumb->hasImage() == DkThumbNail::loaded ? thumb->getImage() : QImage();
+}
+
+void DkFilePreview::imageScaled()
+{
+    mScalingImg.img = mScaleWatcher.result();
+
+    if (mScalingImg.img.isNull())
+        return;
+
+    mScaledImgs << mScalingImg;
+
+    // clean up
+    if (mScaledImgs.size() > 10)
+        mScaledImgs.pop_front();
+
+    update();
+}
+
 void DkFilePreview::drawNoImgEffect(QPainter *painter, const QRectF &r)
 {
     QBrush oldBrush = painter->brush();
@@ -553,28 +741,23 @@ void DkFilePreview::mouseMoveEvent(QMouseEvent *event)
     // select the current thumbnail
     if (dx > borderTrigger * 0.5) {
         int oldSelection = selected;
-        selected = -1;
 
         // find out where the mouse is
-        for (int idx = 0; idx < thumbRects.size(); idx++) {
-            if (worldMatrix.mapRect(thumbRects.at(idx)).contains(event->pos())) {
-                selected = idx;
-
-                if (selected <= mThumbs.size() && selected >= 0) {
-                    QSharedPointer<DkThumbNailT> thumb = mThumbs.at(selected)->getThumb();
-                    // selectedImg = DkImage::colorizePixmap(QPixmap::fromImage(thumb->getImage()), DkSettingsManager::param().display().highlightColor, 0.3f);
-
-                    // important: setText shows the label - if you then hide it here again you'll get a stack overflow
-                    // if (fileLabel->height() < height())
-                    //	fileLabel->setText(thumbs.at(selected).getFile().fileName(), -1);
-                    QFileInfo fileInfo(thumb->getFilePath());
-                    QString toolTipInfo = tr("Name: ") + fileInfo.fileName() + "\n" + tr("Size: ") + DkUtils::readableByte((float)fileInfo.size()) + "\n"
-                        + tr("Created: ") + fileInfo.birthTime().toString();
-                    setToolTip(toolTipInfo);
-                    setStatusTip(fileInfo.fileName());
-                }
-                break;
-            }
+        selected = thumbAt(event->pos());
+
+        // the tool tip only needs an update if we hover a new thumb
+        if (selected != oldSelection && selected < mThumbs.size() && selected >= 0) {
+            QSharedPointer<DkThumbNailT> thumb = mThumbs.at(selected)->getThumb();
+            // selectedImg = DkImage::colorizePixmap(QPixmap::fromImage(thumb->getImage()), DkSettingsManager::param().display().highlightColor, 0.3f);
+
+            // important: setText shows the label - if you then hide it here again you'll get a stack overflow
+            // if (fileLabel->height() < height())
+            //	fileLabel->setText(thumbs.at(selected).getFile().fileName(), -1);
+            QFileInfo fileInfo(thumb->getFilePath());
+            QString toolTipInfo = tr("Name: ") + fileInfo.fileName() + "\n" + tr("Size: ") + DkUtils::readableByte((float)fileInfo.size()) + "\n"
+                + tr("Created: ") + fileInfo.birthTime().toString();
+            setToolTip(toolTipInfo);
+            setStatusTip(fileInfo.fileName());
         }
 
         if (selected != -1 || selected != oldSelection)
@@ -616,13 +799,12 @@ void DkFilePreview::mouseReleaseEvent(QMouseEvent *event)
 
     if (mouseTrace < 20) {
         // find out where the mouse did click
-        for (int idx = 0; idx < thumbRects.size(); idx++) {
-            if (idx < mThumbs.size() && worldMatrix.mapRect(thumbRects.at(idx)).contains(event->pos())) {
-                if (mThumbs.at(idx)->isFromZip())
-                    emit changeFileSignal(idx - currentFileIdx);
-                else
-                    emit loadFileSignal(mThumbs.at(idx)->filePath() /*, event->modifiers() == Qt::ControlModifier*/);
-            }
+        int idx = thumbAt(event->pos());
+        if (idx >= 0 && idx < mThumbs.size()) {
+            if (mThumbs.at(idx)->isFromZip())
+                emit changeFileSignal(idx - currentFileIdx);
+            else
+                emit loadFileSignal(mThumbs.filePath(idx) /*, event->modifiers() == Qt::ControlModifier*/);
         }
     } else
         unsetCursor();
@@ -799,7 +981,7 @@ void DkFilePreview::setFileInfo(QSharedPointer<DkImageContainerT> cImage)
     int tIdx = -1;
 
     for (int idx = 0; idx < mThumbs.size(); idx++) {
-        if (mThumbs.at(idx)->filePath() == cImage->filePath()) {
+        if (mThumbs.filePath(idx) == cImage->filePath()) {
             tIdx = idx;
             break;
         }
@@ -808,15 +990,22 @@ void DkFilePreview::setFileInfo(QSharedPointer<DkImageContainerT> cImage)
     currentFileIdx = tIdx;
     if (currentFileIdx >= 0)
         scrollToCurrentImage = true;
+    // the loaded image might have a different size than its thumbnail
+    if (!mLayoutDirty && currentFileIdx >= 0 && currentFileIdx < mThumbSizes.size())
+        updateThumbRect(currentFileIdx, thumbSize(currentFileIdx));
     update();
 }
 
-void DkFilePreview::updateThumbs(QVector<QSharedPointer<DkImageContainerT>> thumbs)
+void DkFilePreview::updateThumbs(DkImageList thumbs)
 {
     mThumbs = thumbs;
+    mLayoutDirty = true;
 
+    // the current image is always created
     for (int idx = 0; idx < thumbs.size(); idx++) {
-        if (thumbs.at(idx)->isSelected()) {
+        auto cImg = thumbs.created(idx);
+
+        if (cImg && cImg->isSelected()) {
             currentFileIdx = idx;
             break;
         }
@@ -853,7 +1042,18 @@ DkThumbLabel::~DkThumbLabel()
 
 void DkThumbLabel::setThumb(QSharedPointer<DkThumbNailT> thumb)
 {
+    // the label is recycled -> reset the previous thumb
+    if (mThumb)
+        disconnect(mThumb.data(), &DkThumbNailT::thumbLoadedSignal, this, &DkThumbLabel::updateLabel);
+
     this->mThumb = thumb;
+    mThumbInitialized = false;
+    mFetchingThumb = false;
+    mIsHovered = false;
+    mIcon.setPixmap(QPixmap());
+    mIcon.setScale(1.0f);
+    mIcon.setPos(0, 0);
+    setFlag(ItemIsSelectable, true);
 
     if (thumb.isNull())
         return;
@@ -875,6 +1075,16 @@ void DkThumbLabel::setThumb(QSharedPointer<DkThumbNailT> thumb)
     mSelectPen.setColor(DkSettingsManager::param().display().highlightColor);
 }
 
+void DkThumbLabel::setIndex(int idx)
+{
+    mIndex = idx;
+}
+
+int DkThumbLabel::index() const
+{
+    return mIndex;
+}
+
 QPixmap DkThumbLabel::pixmap() const
 {
     return mIcon.pixmap();
@@ -960,6 +1170,14 @@ void DkThumbLabel::updateSize()
     // update();
 }
 
+QVariant DkThumbLabel::itemChange(GraphicsItemChange change, const QVariant &value)
+{
+    if (change == ItemSelectedHasChanged)
+        emit selectedSignal(mIndex, value.toBool());
+
+    return QGraphicsObject::itemChange(change, value);
+}
+
 void DkThumbLabel::mouseDoubleClickEvent(QGraphicsSceneMouseEvent *event)
 {
     if (mThumb.isNull())
@@ -997,6 +1215,8 @@ void DkThumbLabel::paint(QPainter *painter, const QStyleOptionGraphicsItem *opti
         updateLabel();
         mThumbInitialized = true;
         return; // exit - otherwise we get paint errors
+    } else if (mThumb->hasImage() == DkThumbNail::loading) {
+        mThumb->fetchThumb(); // we are visible -> raise the priority
     }
 
     if (mIcon.pixmap().isNull() && mThumb->hasImage() == DkThumbNail::exists_not) {
@@ -1073,7 +1293,7 @@ DkThumbScene::DkThumbScene(QWidget *parent /* = 0 */)
 
 void DkThumbScene::updateLayout()
 {
-    if (mThumbLabels.empty())
+    if (mThumbs.empty())
         return;
 
     QSize pSize;
@@ -1084,85 +1304,213 @@ void DkThumbScene::updateLayout()
     int psz = DkSettingsManager::param().effectiveThumbPreviewSize();
     mXOffset = 2; // qCeil(psz*0.1f);
     mNumCols = qMax(qFloor(((float)pSize.width() - mXOffset) / (psz + mXOffset)), 1);
-    mNumCols = qMin(mThumbLabels.size(), mNumCols);
-    mNumRows = qCeil((float)mThumbLabels.size() / mNumCols);
+    mNumCols = qMin(mThumbs.size(), mNumCols);
+    mNumRows = qCeil((float)mThumbs.size() / mNumCols);
 
     int tso = psz + mXOffset;
     setSceneRect(0, 0, mNumCols * tso + mXOffset, mNumRows * tso + mXOffset);
 
-    DkTimer dt;
-    int cYOffset = mXOffset;
+    // the labels are positioned in updateVisibleThumbs()
+    for (DkThumbLabel *label : mThumbLabels)
+        label->updateSize();
 
-    for (int rIdx = 0; rIdx < mNumRows; rIdx++) {
-        int cXOffset = mXOffset;
+    int selIdx = selectedThumbIndex();
+    if (selIdx != -1)
+        ensureVisible(selIdx);
 
-        for (int cIdx = 0; cIdx < mNumCols; cIdx++) {
-            int tIdx = rIdx * mNumCols + cIdx;
+    updateVisibleThumbs();
 
-            if (tIdx < 0 || tIdx >= mThumbLabels.size())
-                break;
+    mFirstLayout = false;
+}
 
-            DkThumbLabel *cLabel = mThumbLabels.at(tIdx);
-            cLabel->setPos(cXOffset, cYOffset);
-            cLabel->updateSize();
+/**
+ * Shows labels for all thumbs that are within the viewport
+ * (plus one viewport height above and below).
+ * Labels of thumbs that left this area are recycled.
+ **/
+void DkThumbScene::updateVisibleThumbs()
+{
+    if (mThumbs.empty() || mNumCols <= 0 || views().empty())
+        return;
 
-            cXOffset += psz + mXOffset;
-        }
+    QGraphicsView *view = views().first();
+    QRectF visibleRect = view->mapToScene(view->viewport()->rect()).boundingRect();
+    double margin = visibleRect.height();
+
+    int tso = DkSettingsManager::param().effectiveThumbPreviewSize() + mXOffset;
+    int firstRow = qMax(qFloor((visibleRect.top() - margin - mXOffset) / tso), 0);
+    int lastRow = qMin(qFloor((visibleRect.bottom() + margin) / tso), mNumRows - 1);
 
-        // update ypos
-        cYOffset += psz + mXOffset; // 20 for label
+    int firstIdx = firstRow * mNumCols;
+    int lastIdx = qMin((lastRow + 1) * mNumCols, mThumbs.size()) - 1;
+
+    // recycle labels that are out of range
+    for (int idx : mThumbLabels.keys()) {
+        if (idx < firstIdx || idx > lastIdx)
+            releaseLabel(idx);
     }
 
-    for (int idx = 0; idx < mThumbLabels.size(); idx++) {
-        if (mThumbLabels.at(idx)->isSelected())
-            mThumbLabels.at(idx)->ensureVisible();
+    for (int idx = firstIdx; idx <= lastIdx; idx++) {
+        DkThumbLabel *label = mThumbLabels.value(idx);
+
+        if (!label)
+            label = createLabel(idx);
+
+        label->setPos(thumbRect(idx).topLeft());
     }
+}
 
-    mFirstLayout = false;
+QRectF DkThumbScene::thumbRect(int idx) const
+{
+    int psz = DkSettingsManager::param().effectiveThumbPreviewSize();
+    int tso = psz + mXOffset;
+    int cols = qMax(mNumCols, 1);
+
+    return QRectF(mXOffset + (idx % cols) * tso, mXOffset + (idx / cols) * tso, psz, psz);
+}
+
+DkThumbLabel *DkThumbScene::createLabel(int idx)
+{
+    DkThumbLabel *label = 0;
+
+    if (!mFreeLabels.empty()) {
+        label = mFreeLabels.takeLast();
+        label->setThumb(mThumbs.at(idx)->getThumb());
+    } else {
+        label = new DkThumbLabel(mThumbs.at(idx)->getThumb());
+        connect(label, &DkThumbLabel::loadFileSignal, this, &DkThumbScene::loadFileSignal);
+        connect(label, &DkThumbLabel::showFileSignal, this, &DkThumbScene::showFile);
+        connect(label, &DkThumbLabel::selectedSignal, this, &DkThumbScene::thumbSelected);
+        addItem(label);
+    }
+
+    connect(mThumbs.at(idx).data(), &DkImageContainerT::thumbLoadedSignal, this, &DkThumbScene::thumbLoadedSignal, Qt::UniqueConnection);
+
+    // thumbs that cannot be loaded lose their selection
+    if (mSelected.testBit(idx) && !isSelectable(idx))
+        mSelected.clearBit(idx);
+
+    bool selected = mSelected.testBit(idx);
+    blockSignals(true);
+    label->setIndex(idx);
+    label->show(); // hidden (recycled) items ignore setSelected()
+    label->setSelected(selected);
+    blockSignals(false);
+
+    mThumbLabels.insert(idx, label);
+
+    return label;
 }
 
-void DkThumbScene::updateThumbs(QVector<QSharedPointer<DkImageContainerT>> thumbs)
+void DkThumbScene::releaseLabel(int idx)
+{
+    DkThumbLabel *label = mThumbLabels.take(idx);
+
+    if (!label)
+        return;
+
+    // the container might have been released already
+    QSharedPointer<DkImageContainerT> cImg = idx < mThumbs.size() ? mThumbs.created(idx) : QSharedPointer<DkImageContainerT>();
+
+    if (cImg)
+        disconnect(cImg.data(), &DkImageContainerT::thumbLoadedSignal, this, &DkThumbScene::thumbLoadedSignal);
+
+    // detach the index first - hiding deselects the label
+    blockSignals(true);
+    label->setIndex(-1);
+    label->setSelected(false);
+    label->hide();
+    blockSignals(false);
+
+    mFreeLabels.append(label);
+}
+
+void DkThumbScene::releaseLabels()
+{
+    blockSignals(true); // do not emit selection changed while clearing!
+    for (int idx : mThumbLabels.keys())
+        releaseLabel(idx);
+    blockSignals(false);
+}
+
+void DkThumbScene::thumbSelected(int idx, bool selected)
+{
+    if (idx >= 0 && idx < mSelected.size())
+        mSelected.setBit(idx, selected);
+}
+
+bool DkThumbScene::isSelectable(int idx) const
+{
+    // thumbs that cannot be loaded cannot be selected - we do not know that before they are shown
+    QSharedPointer<DkImageContainerT> cImg = mThumbs.created(idx);
+    return !cImg || cImg->getThumb()->hasImage() != DkThumbNail::exists_not;
+}
+
+/**
+ * Deselects all thumbs that have no label.
+ * Qt only deselects the items that are in the scene if the user clicks.
+ **/
+void DkThumbScene::clearHiddenSelection()
+{
+    QBitArray selected(mSelected.size());
+
+    for (auto it = mThumbLabels.constBegin(); it != mThumbLabels.constEnd(); it++) {
+        if (it.value()->isSelected())
+            selected.setBit(it.key());
+    }
+
+    mSelected = selected;
+}
+
+void DkThumbScene::mousePressEvent(QGraphicsSceneMouseEvent *event)
+{
+    // mimic QGraphicsItem: a click without ctrl clears the selection
+    if (event->button() == Qt::LeftButton && !(event->modifiers() & Qt::ControlModifier)) {
+        DkThumbLabel *label = dynamic_cast<DkThumbLabel *>(itemAt(event->scenePos(), QTransform()));
+
+        if (!label || !label->isSelected())
+            clearHiddenSelection();
+    }
+
+    QGraphicsScene::mousePressEvent(event);
+}
+
+void DkThumbScene::mouseReleaseEvent(QGraphicsSceneMouseEvent *event)
+{
+    // clicking an already selected thumb selects only this thumb
+    if (event->button() == Qt::LeftButton && !(event->modifiers() & Qt::ControlModifier)
+        && event->scenePos() == event->buttonDownScenePos(Qt::LeftButton)
+        && dynamic_cast<DkThumbLabel *>(itemAt(event->scenePos(), QTransform())))
+        clearHiddenSelection();
+
+    QGraphicsScene::mouseReleaseEvent(event);
+}
+
+void DkThumbScene::updateThumbs(DkImageList thumbs)
 {
     int selectedIdx = mLastSelectedIdx;
     mLastSelectedIdx = -1;
 
-    if (selectedIdx < 0) {
-        for (int idx = 0; idx < mThumbLabels.size(); idx++) {
-            if (mThumbLabels.at(idx)->isSelected()) {
-                selectedIdx = idx;
-                break;
-            }
-        }
-    }
+    if (selectedIdx < 0)
+        selectedIdx = selectedThumbIndex();
+
+    // labels must be released while mThumbs still holds the containers they are connected to
+    releaseLabels();
 
     this->mThumbs = thumbs;
     updateThumbLabels();
 
-    if (selectedIdx >= 0) {
-        selectedIdx = qMax(0, qMin(selectedIdx, mThumbLabels.size() - 1));
+    if (selectedIdx >= 0 && !mThumbs.empty()) {
+        selectedIdx = qMax(0, qMin(selectedIdx, mThumbs.size() - 1));
         selectThumb(selectedIdx);
     }
 }
 
 void DkThumbScene::updateThumbLabels()
 {
-    blockSignals(true); // do not emit selection changed while clearing!
-    clear(); // deletes the thumbLabels
-    blockSignals(false);
-
-    mThumbLabels.clear();
-
-    for (int idx = 0; idx < mThumbs.size(); idx++) {
-        DkThumbLabel *thumb = new DkThumbLabel(mThumbs.at(idx)->getThumb());
-        connect(thumb, &DkThumbLabel::loadFileSignal, this, &DkThumbScene::loadFileSignal);
-        connect(thumb, &DkThumbLabel::showFileSignal, this, &DkThumbScene::showFile);
-        connect(mThumbs.at(idx).data(), &DkImageContainerT::thumbLoadedSignal, this, &DkThumbScene::thumbLoadedSignal);
+    releaseLabels();
 
-        // thumb->show();
-        addItem(thumb);
-        mThumbLabels.append(thumb);
-        // thumbsNotLoaded.append(thumb);
-    }
+    mSelected = QBitArray(mThumbs.size());
 
     showFile();
 
@@ -1208,7 +1556,7 @@ void DkThumbScene::keyPressEvent(QKeyEvent *event)
         break;
     }
     case Qt::Key_Right: {
-        selectThumb(qMin(idx + 1, mThumbLabels.size() - 1));
+        selectThumb(qMin(idx + 1, mThumbs.size() - 1));
         break;
     }
     case Qt::Key_Up: {
@@ -1216,7 +1564,7 @@ void DkThumbScene::keyPressEvent(QKeyEvent *event)
         break;
     }
     case Qt::Key_Down: {
-        selectThumb(qMin(idx + mNumCols, mThumbLabels.size() - 1));
+        selectThumb(qMin(idx + mNumCols, mThumbs.size() - 1));
         break;
     }
     }
@@ -1232,7 +1580,7 @@ void DkThumbScene::showFile(const QString &filePath)
         if (sf > 1)
             info = QString::number(sf) + tr(" selected");
         else
-            info = QString::number(mThumbLabels.size()) + tr(" images");
+            info = QString::number(mThumbs.size()) + tr(" images");
 
         DkStatusBarManager::instance().setMessage(tr("%1 | %2").arg(info, currentDir()));
     } else
@@ -1244,29 +1592,38 @@ void DkThumbScene::ensureVisible(QSharedPointer<DkImageContainerT> img) const
     if (!img)
         return;
 
-    for (DkThumbLabel *label : mThumbLabels) {
-        if (label->getThumb()->getFilePath() == img->filePath()) {
-            label->ensureVisible();
+    for (int idx = 0; idx < mThumbs.size(); idx++) {
+        if (mThumbs.filePath(idx) == img->filePath()) {
+            ensureVisible(idx);
             break;
         }
     }
 }
 
+void DkThumbScene::ensureVisible(int idx) const
+{
+    if (idx < 0 || idx >= mThumbs.size() || views().empty())
+        return;
+
+    // scrolling updates the visible labels
+    views().first()->ensureVisible(thumbRect(idx));
+}
+
 QString DkThumbScene::currentDir() const
 {
-    if (mThumbs.empty() || !mThumbs[0])
+    if (mThumbs.empty())
         return "";
 
-    return mThumbs[0]->fileInfo().absolutePath();
+    return QFileInfo(mThumbs.filePath(0)).absolutePath();
 }
 
 int DkThumbScene::selectedThumbIndex(bool first)
 {
     int selIdx = -1;
-    for (int idx = 0; idx < mThumbLabels.size(); idx++) {
-        if (first && mThumbLabels[idx]->isSelected())
+    for (int idx = 0; idx < mSelected.size(); idx++) {
+        if (first && mSelected.testBit(idx))
             return idx;
-        else if (mThumbLabels[idx]->isSelected())
+        else if (mSelected.testBit(idx))
             selIdx = idx;
     }
 
@@ -1331,11 +1688,11 @@ void DkThumbScene::selectAllThumbs(bool selected)
 
 void DkThumbScene::selectThumbs(bool selected /* = true */, int from /* = 0 */, int to /* = -1 */)
 {
-    if (mThumbLabels.empty())
+    if (mThumbs.empty())
         return;
 
     if (to == -1)
-        to = mThumbLabels.size() - 1;
+        to = mThumbs.size() - 1;
 
     if (from > to) {
         int tmp = to;
@@ -1344,8 +1701,11 @@ void DkThumbScene::selectThumbs(bool selected /* = true */, int from /* = 0 */,
     }
 
     blockSignals(true);
-    for (int idx = from; idx <= to && idx < mThumbLabels.size(); idx++) {
-        mThumbLabels.at(idx)->setSelected(selected);
+    for (int idx = qMax(from, 0); idx <= to && idx < mThumbs.size(); idx++) {
+        if (DkThumbLabel *label = mThumbLabels.value(idx))
+            label->setSelected(selected);
+
+        mSelected.setBit(idx, selected && isSelectable(idx));
     }
     blockSignals(false);
     emit selectionChanged();
@@ -1354,21 +1714,23 @@ void DkThumbScene::selectThumbs(bool selected /* = true */, int from /* = 0 */,
 
 void DkThumbScene::selectThumb(int idx, bool select)
 {
-    if (mThumbLabels.empty())
+    if (mThumbs.empty())
         return;
 
-    if (idx < 0 || idx >= mThumbLabels.size()) {
+    if (idx < 0 || idx >= mThumbs.size()) {
         qWarning() << "index out of bounds in selectThumbs()" << idx;
         return;
     }
 
     blockSignals(true);
-    mThumbLabels[idx]->setSelected(select);
+    if (DkThumbLabel *label = mThumbLabels.value(idx))
+        label->setSelected(select);
+    mSelected.setBit(idx, select && isSelectable(idx));
     blockSignals(false);
 
     emit selectionChanged();
     showFile(); // update selection label
-    ensureVisible(mThumbs[idx]);
+    ensureVisible(idx);
 }
 
 void DkThumbScene::copySelected() const
@@ -1479,15 +1841,14 @@ void DkThumbScene::deleteSelected()
 
         mLastSelectedIdx = -1;
 
-        for (int i = 0; i < mThumbLabels.size(); i++) {
-            DkThumbLabel *thumb = mThumbLabels.at(i);
-            if (!thumb->isSelected())
+        for (int i = 0; i < mSelected.size(); i++) {
+            if (!mSelected.testBit(i))
                 continue;
 
             if (mLastSelectedIdx < 0)
                 mLastSelectedIdx = i;
 
-            const QString filePath = thumb->getThumb()->getFilePath();
+            const QString filePath = mThumbs.filePath(i);
             const QString fileName = QFileInfo(filePath).fileName();
 
             if (!DkUtils::moveToTrash(filePath)) {
@@ -1502,7 +1863,9 @@ void DkThumbScene::deleteSelected()
             }
 
             // we might try to delete it twice because directoryChanged() can defer the update
-            thumb->setSelected(false);
+            if (DkThumbLabel *label = mThumbLabels.value(i))
+                label->setSelected(false);
+            mSelected.clearBit(i);
         }
 
         mLoader->blockSignals(false);
@@ -1551,22 +1914,21 @@ QStringList DkThumbScene::getSelectedFiles() const
 {
     QStringList fileList;
 
-    for (int idx = 0; idx < mThumbLabels.size(); idx++) {
-        if (mThumbLabels.at(idx) && mThumbLabels.at(idx)->isSelected()) {
-            fileList.append(mThumbLabels.at(idx)->getThumb()->getFilePath());
-        }
+    for (int idx = 0; idx < mSelected.size(); idx++) {
+        if (mSelected.testBit(idx))
+            fileList.append(mThumbs.filePath(idx));
     }
 
     return fileList;
 }
 
-QVector<DkThumbLabel *> DkThumbScene::getSelectedThumbs() const
+QVector<QSharedPointer<DkThumbNailT>> DkThumbScene::getSelectedThumbs() const
 {
-    QVector<DkThumbLabel *> selected;
+    QVector<QSharedPointer<DkThumbNailT>> selected;
 
-    for (DkThumbLabel *label : mThumbLabels) {
-        if (label->isSelected())
-            selected << label;
+    for (int idx = 0; idx < mSelected.size(); idx++) {
+        if (mSelected.testBit(idx))
+            selected << mThumbs.at(idx)->getThumb();
     }
 
     return selected;
@@ -1574,22 +1936,16 @@ QVector<DkThumbLabel *> DkThumbScene::getSelectedThumbs() const
 
 int DkThumbScene::findThumb(DkThumbLabel *thumb) const
 {
-    int thumbIdx = -1;
+    if (!thumb || mThumbLabels.value(thumb->index()) != thumb)
+        return -1;
 
-    for (int idx = 0; idx < mThumbLabels.size(); idx++) {
-        if (thumb == mThumbLabels.at(idx)) {
-            thumbIdx = idx;
-            break;
-        }
-    }
-
-    return thumbIdx;
+    return thumb->index();
 }
 
 bool DkThumbScene::allThumbsSelected() const
 {
-    for (DkThumbLabel *label : mThumbLabels)
-        if (label->flags() & QGraphicsItem::ItemIsSelectable && !label->isSelected())
+    for (int idx = 0; idx < mSelected.size(); idx++)
+        if (!mSelected.testBit(idx) && isSelectable(idx))
             return false;
 
     return true;
@@ -1602,6 +1958,8 @@ DkThumbsView::DkThumbsView(DkThumbScene *scene, QWidget *parent /* = 0 */)
     setObjectName("DkThumbsView");
     this->scene = scene;
     connect(scene, &DkThumbScene::thumbLoadedSignal, this, &DkThumbsView::fetchThumbs);
+    connect(verticalScrollBar(), &QScrollBar::valueChanged, scene, &DkThumbScene::updateVisibleThumbs);
+    connect(verticalScrollBar(), &QScrollBar::valueChanged, this, &DkThumbsView::prioritizeThumbs);
 
     setResizeAnchor(QGraphicsView::AnchorUnderMouse);
     setAcceptDrops(true);
@@ -1658,11 +2016,11 @@ void DkThumbsView::mouseMoveEvent(QMouseEvent *event)
                 mimeData->setUrls(urls);
 
                 // create thumb image
-                QVector<DkThumbLabel *> tl = scene->getSelectedThumbs();
+                QVector<QSharedPointer<DkThumbNailT>> tl = scene->getSelectedThumbs();
                 QVector<QImage> imgs;
 
                 for (int idx = 0; idx < tl.size() && idx < 3; idx++) {
-                    imgs << tl[idx]->getThumb()->getImage();
+                    imgs << tl[idx]->getImage();
                 }
 
                 QPixmap pm = DkImage::merge(imgs).scaledToHeight(73); // 73: see https://www.youtube.com/watch?v=TIYMmbHik08
@@ -1771,12 +2129,37 @@ void DkThumbsView::fetchThumbs()
             continue;
         }
 
-        if (th->pixmap().isNull()) {
+        if (th->isVisible() && th->pixmap().isNull()) {
             th->update();
         }
     }
 }
 
+/**
+ * Loads the thumbnails that are visible first.
+ * Thumbnails that are queued but left the viewport are moved to the background
+ * and thumbnails close to the viewport are fetched before all others.
+ **/
+void DkThumbsView::prioritizeThumbs()
+{
+    DkThumbsThreadPool::deprioritize();
+
+    QRectF visibleRect = mapToScene(viewport()->rect()).boundingRect();
+    QRectF nearRect = visibleRect.adjusted(0, -visibleRect.height(), 0, visibleRect.height());
+
+    for (QGraphicsItem *item : scene->items(nearRect, Qt::IntersectsItemShape)) {
+        DkThumbLabel *th = dynamic_cast<DkThumbLabel *>(item);
+
+        if (!th || !th->isVisible() || !th->getThumb())
+            continue;
+
+        bool visible = visibleRect.intersects(th->sceneBoundingRect());
+        th->getThumb()->fetchThumb(DkThumbNail::do_not_force,
+                                   QSharedPointer<QByteArray>(),
+                                   visible ? DkThumbsThreadPool::priority_visible : DkThumbsThreadPool::priority_near_visible);
+    }
+}
+
 // DkThumbScrollWidget --------------------------------------------------------------------
 DkThumbScrollWidget::DkThumbScrollWidget(QWidget *parent /* = 0 */, Qt::WindowFlags flags /* = 0 */)
     : DkFadeWidget(parent, flags)
@@ -1904,25 +2287,22 @@ void DkThumbScrollWidget::batchPrint() const
 
 void DkThumbScrollWidget::onLoadFileTriggered()
 {
-    auto selected = mThumbsScene->selectedItems();
+    QStringList selected = mThumbsScene->getSelectedFiles();
 
     if (selected.isEmpty())
         return;
 
-    auto thumb = dynamic_cast<DkThumbLabel *>(selected.first());
-
-    if (thumb && thumb->getThumb())
-        mThumbsScene->loadFileSignal(thumb->getThumb()->getFilePath(), false);
+    mThumbsScene->loadFileSignal(selected.first(), false);
 }
 
-void DkThumbScrollWidget::updateThumbs(QVector<QSharedPointer<DkImageContainerT>> thumbs)
+void DkThumbScrollWidget::updateThumbs(DkImageList thumbs)
 {
     mThumbsScene->updateThumbs(thumbs);
 }
 
 void DkThumbScrollWidget::clear()
 {
-    mThumbsScene->updateThumbs(QVector<QSharedPointer<DkImageContainerT>>());
+    mThumbsScene->updateThumbs(DkImageList());
 }
 
 void DkThumbScrollWidget::setDir(const QString &dirPath)
@@ -1996,6 +2376,8 @@ void DkThumbScrollWidget::resizeEvent(QResizeEvent *event)
 {
     if (event->oldSize().width() != event->size().width() && isVisible())
         mThumbsScene->updateLayout();
+    else if (isVisible())
+        mThumbsScene->updateVisibleThumbs();
 
     DkFadeWidget::resizeEvent(event);
 }
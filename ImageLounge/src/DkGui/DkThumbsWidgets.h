@@ -30,11 +30,14 @@
 #include "DkQt5Compat.h"
 
 #pragma warning(push, 0) // no warnings from includes - begin
+#include <QBitArray>
 #include <QDrag>
 #include <QFileInfo>
+#include <QFutureWatcher>
 #include <QGraphicsObject>
 #include <QGraphicsScene>
 #include <QGraphicsView>
+#include <QHash>
 #include <QPen>
 #include <QProcess>
 #include <QSharedPointer>
@@ -42,6 +45,7 @@
 
 #include "DkBaseWidgets.h"
 #include "DkImageContainer.h"
+#include "DkMath.h"
 
 #ifndef DllCoreExport
 #ifdef DK_CORE_DLL_EXPORT
@@ -114,9 +118,10 @@ public:
 public slots:
     void moveImages();
     void updateFileIdx(int fileIdx);
-    void updateThumbs(QVector<QSharedPointer<DkImageContainerT>> thumbs);
+    void updateThumbs(DkImageList thumbs);
     void setFileInfo(QSharedPointer<DkImageContainerT> cImage);
     void newPosition();
+    void imageScaled();
 
 signals:
     void loadFileSignal(const QString &filePath) const;
@@ -137,7 +142,13 @@ protected:
     void saveSettings();
 
 private:
-    QVector<QSharedPointer<DkImageContainerT>> mThumbs;
+    struct ScaledImage {
+        QString filePath;
+        qint64 srcKey = 0; // cache key of the image that was scaled
+        QImage img;
+    };
+
+    DkImageList mThumbs;
     QTransform worldMatrix;
 
     QPoint lastMousePos;
@@ -146,7 +157,15 @@ private:
     QTimer *moveImageTimer;
 
     QRectF bufferDim;
-    QVector<QRectF> thumbRects;
+    QVector<QSize> mThumbSizes; // thumb sizes the layout is based on
+    DkPrefixSum mThumbExtents; // extents of the thumbs along the filmstrip (including the gap)
+    bool mLayoutDirty = true;
+    QSize mLayoutSize;
+    int mLayoutThumbSize = 0;
+
+    QVector<ScaledImage> mScaledImgs; // loaded images scaled to the thumb size
+    ScaledImage mScalingImg;
+    QFutureWatcher<QImage> mScaleWatcher;
 
     QLinearGradient leftGradient;
     QLinearGradient rightGradient;
@@ -180,6 +199,16 @@ private:
     void init();
     void initOrientations();
     void drawThumbs(QPainter *painter);
+    void updateThumbRects();
+    void updateThumbRect(int idx, const QSize &s);
+    void updateBufferDim();
+    QSize thumbSize(int idx);
+    QSizeF drawnSize(const QSize &s) const;
+    qint64 thumbExtent(const QSize &s) const;
+    QRectF thumbRect(int idx) const;
+    int thumbIndexAt(qreal pos) const;
+    int thumbAt(const QPoint &pos) const;
+    QImage scaledImage(QSharedPointer<DkImageContainerT> cImg, int height);
     void drawFadeOut(QLinearGradient gradient, QRectF imgRect, QImage *img);
     void drawSelectedEffect(QPainter *painter, const QRectF &r);
     void drawCurrentImgEffect(QPainter *painter, const QRectF &r);
@@ -200,6 +229,8 @@ public:
     {
         return mThumb;
     };
+    void setIndex(int idx);
+    int index() const;
     QRectF boundingRect() const override;
     QPainterPath shape() const override;
     void updateSize();
@@ -213,8 +244,10 @@ public slots:
 signals:
     void loadFileSignal(const QString &filePath, bool newTab) const;
     void showFileSignal(const QString &filePath = QString()) const;
+    void selectedSignal(int idx, bool selected) const;
 
 protected:
+    QVariant itemChange(GraphicsItemChange change, const QVariant &value) override;
     void mouseDoubleClickEvent(QGraphicsSceneMouseEvent *event) override;
     void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget = 0) override;
     void hoverEnterEvent(QGraphicsSceneHoverEvent *event) override;
@@ -231,8 +264,16 @@ protected:
     QBrush mSelectBrush;
     bool mIsHovered = false;
     QPointF mLastMove;
+    int mIndex = -1;
 };
 
+/**
+ * DkThumbScene shows the thumbnails of a folder in a grid.
+ * The grid is virtualized: positions are computed from the thumb index
+ * and labels are only created for the rows that are (nearly) visible.
+ * Labels that scroll out of view are recycled. The selection is kept
+ * per index so that it does not depend on the labels.
+ **/
 class DllCoreExport DkThumbScene : public QGraphicsScene
 {
     Q_OBJECT
@@ -242,7 +283,7 @@ public:
 
     void updateLayout();
     QStringList getSelectedFiles() const;
-    QVector<DkThumbLabel *> getSelectedThumbs() const;
+    QVector<QSharedPointer<DkThumbNailT>> getSelectedThumbs() const;
     int selectedThumbIndex(bool first = true);
 
     void setImageLoader(QSharedPointer<DkImageLoader> loader);
@@ -250,10 +291,12 @@ public:
     int findThumb(DkThumbLabel *thumb) const;
     bool allThumbsSelected() const;
     void ensureVisible(QSharedPointer<DkImageContainerT> img) const;
+    void ensureVisible(int idx) const;
     QString currentDir() const;
 
 public slots:
     void updateThumbLabels();
+    void updateVisibleThumbs();
     void cancelLoading();
     void increaseThumbs();
     void decreaseThumbs();
@@ -264,7 +307,7 @@ public slots:
     void selectThumbs(bool select = true, int from = 0, int to = -1);
     void selectThumb(int idx, bool select = true);
     void selectAllThumbs(bool select = true);
-    void updateThumbs(QVector<QSharedPointer<DkImageContainerT>> thumbs);
+    void updateThumbs(DkImageList thumbs);
     void deleteSelected();
     void copySelected() const;
     void pasteImages() const;
@@ -275,9 +318,21 @@ signals:
     void statusInfoSignal(const QString &msg, int pos = 0) const;
     void thumbLoadedSignal() const;
 
+protected slots:
+    void thumbSelected(int idx, bool selected);
+
 protected:
     void connectLoader(QSharedPointer<DkImageLoader> loader, bool connectSignals = true);
     void keyPressEvent(QKeyEvent *event) override;
+    void mousePressEvent(QGraphicsSceneMouseEvent *event) override;
+    void mouseReleaseEvent(QGraphicsSceneMouseEvent *event) override;
+
+    QRectF thumbRect(int idx) const;
+    DkThumbLabel *createLabel(int idx);
+    void releaseLabel(int idx);
+    void releaseLabels();
+    void clearHiddenSelection();
+    bool isSelectable(int idx) const;
 
     int mXOffset = 0;
     int mNumRows = 0;
@@ -285,9 +340,11 @@ protected:
     bool mFirstLayout = true;
     int mLastSelectedIdx = -1; // last selected item to restore on updateThumbs()
 
-    QVector<DkThumbLabel *> mThumbLabels;
+    QHash<int, DkThumbLabel *> mThumbLabels; // visible labels by thumb index
+    QVector<DkThumbLabel *> mFreeLabels; // hidden labels that can be recycled
+    QBitArray mSelected; // selection by thumb index
     QSharedPointer<DkImageLoader> mLoader;
-    QVector<QSharedPointer<DkImageContainerT>> mThumbs;
+    DkImageList mThumbs;
 };
 
 class DkThumbsView : public QGraphicsView
@@ -302,6 +359,7 @@ signals:
 
 public slots:
     void fetchThumbs();
+    void prioritizeThumbs();
 
 protected:
     void wheelEvent(QWheelEvent *event) override;
@@ -333,7 +391,7 @@ public:
 
 public slots:
     virtual void setVisible(bool visible) override;
-    void updateThumbs(QVector<QSharedPointer<DkImageContainerT>> thumbs);
+    void updateThumbs(DkImageList thumbs);
     void setDir(const QString &dirPath);
     void enableSelectionActions();
     void setFilterFocus() const;
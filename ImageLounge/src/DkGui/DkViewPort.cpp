@@ -269,6 +269,15 @@ void DkViewPort::onImageLoaded(QSharedPointer<DkImageContainerT> image, bool loa
 {
     // things todo if a file was not loaded...
     if (!loaded) {
+        // don't keep showing the preview of an image that could not be decoded
+        if (!mPreviewSize.isEmpty()) {
+            mImgStorage.setImage(QImage());
+            mController->getOverview()->setImage(QImage());
+            update();
+        }
+
+        mPreviewSize = QSize();
+        mPreviewFilePath.clear();
         mController->getPlayer()->startTimer();
         return;
     }
@@ -278,6 +287,55 @@ void DkViewPort::onImageLoaded(QSharedPointer<DkImageContainerT> image, bool loa
     mController->updateImage(image);
 }
 
+/**
+ * Shows the preview of an image that is currently decoded.
+ * The preview is scaled to the size of the full image so that
+ * the full image can replace it without changing zoom or pan.
+ * @param image the image container that is loading
+ **/
+void DkViewPort::onImagePreview(QSharedPointer<DkImageContainerT> image)
+{
+    if (!image || image != imageContainer() || image->getLoadState() != DkImageContainerT::loading)
+        return;
+
+    QImage preview = image->previewImage();
+
+    if (preview.isNull())
+        return;
+
+    mDisabledBackground = false;
+
+    emit movieLoadedSignal(false);
+    stopMovie();
+
+    if (mManipulatorWatcher.isRunning())
+        mManipulatorWatcher.cancel();
+
+    mImgStorage.setImage(preview);
+    mPreviewSize = image->previewImageSize();
+    mPreviewFilePath = image->filePath();
+
+    mImgRect = QRectF(QPoint(), getImageSize());
+
+    if (!(DkSettingsManager::param().display().keepZoom == DkSettings::zoom_keep_same_size && mOldImgRect == mImgRect))
+        mWorldMatrix.reset();
+
+    updateImageMatrix();
+
+    // if image is not inside, we'll align it at the top left border
+    if (!mViewportRect.intersects(mWorldMatrix.mapRect(mImgViewRect))) {
+        mWorldMatrix.translate(-mWorldMatrix.dx(), -mWorldMatrix.dy());
+        centerImage();
+    }
+
+    mController->getOverview()->setImage(preview);
+    mOldImgRect = mImgRect;
+    mAnimationValue = 0.0f;
+
+    update();
+    emit zoomSignal(mWorldMatrix.m11() * mImgMatrix.m11() * 100);
+}
+
 void DkViewPort::setImageUpdated()
 {
     if (!mLoader)
@@ -332,8 +390,18 @@ void DkViewPort::setImage(QImage newImg)
 
     mController->getOverview()->setImage(QImage()); // clear overview
 
+    // the preview of this image is shown: the image replaces it at the same position
+    bool replacePreview = !mPreviewSize.isEmpty() && imageContainer() && imageContainer()->filePath() == mPreviewFilePath;
+    QRectF previewRect = mWorldMatrix.mapRect(mImgViewRect);
+    mPreviewSize = QSize();
+    mPreviewFilePath.clear();
+
     mImgStorage.setImage(newImg);
 
+    // huge (pyramidal) TIFFs are tiled from the file's reduced-resolution images
+    if (mImgStorage.useTiles() && imageContainer())
+        mImgStorage.setRegionReader(imageContainer()->getLoader()->regionReader(newImg));
+
     if (mLoader->hasMovie() && !mLoader->isEdited())
         loadMovie();
     if (mLoader->hasSvg() && !mLoader->isEdited())
@@ -346,19 +414,27 @@ void DkViewPort::setImage(QImage newImg)
 
     double oldZoom = mWorldMatrix.m11(); // *mImgMatrix.m11();
 
-    if (!(DkSettingsManager::param().display().keepZoom == DkSettings::zoom_keep_same_size && mOldImgRect == mImgRect))
+    if (!replacePreview && !(DkSettingsManager::param().display().keepZoom == DkSettings::zoom_keep_same_size && mOldImgRect == mImgRect))
         mWorldMatrix.reset();
 
     updateImageMatrix();
 
-    // if image is not inside, we'll align it at the top left border
-    if (!mViewportRect.intersects(mWorldMatrix.mapRect(mImgViewRect))) {
-        mWorldMatrix.translate(-mWorldMatrix.dx(), -mWorldMatrix.dy());
-        centerImage();
-    }
+    if (replacePreview) {
+        // keep zoom & pan of the preview (its size might differ slightly)
+        if (!mImgViewRect.isEmpty()) {
+            double s = previewRect.width() / mImgViewRect.width();
+            mWorldMatrix = QTransform(s, 0, 0, s, previewRect.left() - s * mImgViewRect.left(), previewRect.top() - s * mImgViewRect.top());
+        }
+    } else {
+        // if image is not inside, we'll align it at the top left border
+        if (!mViewportRect.intersects(mWorldMatrix.mapRect(mImgViewRect))) {
+            mWorldMatrix.translate(-mWorldMatrix.dx(), -mWorldMatrix.dy());
+            centerImage();
+        }
 
-    if (DkSettingsManager::param().display().keepZoom == DkSettings::zoom_always_keep) {
-        zoomToPoint(oldZoom, mImgViewRect.center().toPoint(), mWorldMatrix);
+        if (DkSettingsManager::param().display().keepZoom == DkSettings::zoom_always_keep) {
+            zoomToPoint(oldZoom, mImgViewRect.center().toPoint(), mWorldMatrix);
+        }
     }
 
     mController->getPlayer()->startTimer();
@@ -366,8 +442,9 @@ void DkViewPort::setImage(QImage newImg)
 
     mOldImgRect = mImgRect;
 
-    // init fading
-    if (DkSettingsManager::param().display().animationDuration && DkSettingsManager::param().display().transition != DkSettingsManager::param().trans_appear
+    // init fading (not if the preview is replaced)
+    if (!replacePreview && DkSettingsManager::param().display().animationDuration
+        && DkSettingsManager::param().display().transition != DkSettingsManager::param().trans_appear
         && (mController->getPlayer()->isPlaying() || DkUtils::getMainWindow()->isFullScreen() || DkSettingsManager::param().display().alwaysAnimate)) {
         mAnimationTimer->start();
         mAnimationTime.start();
@@ -676,6 +753,15 @@ void DkViewPort::applyPlugin(DkPluginContainer *plugin, const QString &key)
 #endif
 }
 
+QSize DkViewPort::getImageSize() const
+{
+    // the preview is scaled to the size of the image that is loading
+    if (!mPreviewSize.isEmpty())
+        return mPreviewSize;
+
+    return DkBaseViewPort::getImageSize();
+}
+
 QImage DkViewPort::getImage() const
 {
     if (imageContainer() && (!mSvg || !mSvg->isValid()) && (!mMovie || !mMovie->isValid()))
@@ -1882,6 +1968,7 @@ void DkViewPort::connectLoader(QSharedPointer<DkImageLoader> loader, bool connec
 
     if (connectSignals) {
         connect(loader.data(), &DkImageLoader::imageLoadedSignal, this, &DkViewPort::onImageLoaded, Qt::UniqueConnection);
+        connect(loader.data(), &DkImageLoader::imagePreviewSignal, this, &DkViewPort::onImagePreview, Qt::UniqueConnection);
 
         connect(loader.data(),
                 QOverload<QSharedPointer<DkImageContainerT>>::of(&DkImageLoader::imageUpdatedSignal),
@@ -1911,6 +1998,7 @@ void DkViewPort::connectLoader(QSharedPointer<DkImageLoader> loader, bool connec
         connect(mController->getScroller(), &DkFolderScrollBar::valueChanged, loader.data(), &DkImageLoader::loadFileAt);
     } else {
         disconnect(loader.data(), &DkImageLoader::imageLoadedSignal, this, &DkViewPort::onImageLoaded);
+        disconnect(loader.data(), &DkImageLoader::imagePreviewSignal, this, &DkViewPort::onImagePreview);
 
         disconnect(loader.data(), QOverload<QSharedPointer<DkImageContainerT>>::of(&DkImageLoader::imageUpdatedSignal), this, &DkViewPort::updateLoadedImage);
 
@@ -2408,7 +2496,8 @@ void DkViewPortContrast::setImage(QImage newImg)
         mImgs = QVector<QImage>(4);
         std::vector<cv::Mat> planes;
 
-        cv::Mat imgUC3 = DkImage::qImage2Mat(mImgStorage.image());
+        DkMatView imgView(mImgStorage.image());
+        const cv::Mat &imgUC3 = imgView.mat();
         // int format = imgQt.format();
         // if (format == QImage::Format_RGB888)
         //	imgUC3 = Mat(imgQt.height(), imgQt.width(), CV_8UC3, (uchar*)imgQt.bits(), imgQt.bytesPerLine());
@@ -2422,15 +2511,13 @@ void DkViewPortContrast::setImage(QImage newImg)
             // dirty hack
             if (i >= (int)planes.size())
                 i = 0;
-            mImgs[idx] = QImage((const unsigned char *)planes[i].data, (int)planes[i].cols, (int)planes[i].rows, (int)planes[i].step, QImage::Format_Indexed8);
-            mImgs[idx] = mImgs[idx].copy();
+            mImgs[idx] = DkMatView::toImage(planes[i]);
             idx++;
         }
         // The first element in the vector contains the gray scale 'average' of the 3 channels:
         cv::Mat grayMat;
         cv::cvtColor(imgUC3, grayMat, CV_BGR2GRAY);
-        mImgs[0] = QImage((const unsigned char *)grayMat.data, (int)grayMat.cols, (int)grayMat.rows, (int)grayMat.step, QImage::Format_Indexed8);
-        mImgs[0] = mImgs[0].copy();
+        mImgs[0] = DkMatView::toImage(grayMat);
         planes.clear();
     }
 #else
@@ -167,6 +167,7 @@ public slots:
 
     // image saving
     QImage getImage() const override;
+    QSize getImageSize() const override;
     void saveFile();
     void saveFileAs(bool silent = false);
     void saveFileWeb();
@@ -184,6 +185,7 @@ public slots:
 
     void updateLoadedImage();
     void onImageLoaded(QSharedPointer<DkImageContainerT> image, bool loaded = true);
+    void onImagePreview(QSharedPointer<DkImageContainerT> image);
     virtual void setImageUpdated();
     virtual void loadImage(const QImage &newImg);
     virtual void loadImage(QSharedPointer<DkImageContainerT> img);
@@ -218,6 +220,10 @@ protected:
 
     QRectF mOldImgRect;
 
+    // progressive loading: the preview is shown with the full image's size
+    QSize mPreviewSize;
+    QString mPreviewFilePath;
+
     QTimer *mRepeatZoomTimer;
 
     // fading stuff
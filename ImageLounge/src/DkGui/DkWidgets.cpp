@@ -30,6 +30,7 @@
 #include "DkActionManager.h"
 #include "DkDialog.h"
 #include "DkImageContainer.h"
+#include "DkImageKernels.h"
 #include "DkImageStorage.h"
 #include "DkSettings.h"
 #include "DkStatusBar.h"
@@ -144,7 +145,7 @@ bool DkFolderScrollBar::getCurrentDisplaySetting()
     return mDisplaySettingsBits->testBit(DkSettingsManager::param().app().currentAppMode);
 }
 
-void DkFolderScrollBar::updateDir(QVector<QSharedPointer<DkImageContainerT>> images)
+void DkFolderScrollBar::updateDir(DkImageList images)
 {
     setMaximum(images.size() - 1);
 }
@@ -289,7 +290,7 @@ DkThumbsSaver::DkThumbsSaver(QWidget *parent)
     mNumSaved = 0;
 }
 
-void DkThumbsSaver::processDir(QVector<QSharedPointer<DkImageContainerT>> images, bool forceSave)
+void DkThumbsSaver::processDir(DkImageList images, bool forceSave)
 {
     if (images.empty())
         return;
@@ -297,7 +298,7 @@ void DkThumbsSaver::processDir(QVector<QSharedPointer<DkImageContainerT>> images
     mStop = false;
     mNumSaved = 0;
 
-    mPd = new QProgressDialog(tr("\nCreating thumbnails...\n") + images.first()->filePath(), tr("Cancel"), 0, (int)images.size(), DkUtils::getMainWindow());
+    mPd = new QProgressDialog(tr("\nCreating thumbnails...\n") + images.filePath(0), tr("Cancel"), 0, (int)images.size(), DkUtils::getMainWindow());
     mPd->setWindowTitle(tr("Thumbnails"));
 
     // pd->setWindowModality(Qt::WindowModal);
@@ -308,7 +309,13 @@ void DkThumbsSaver::processDir(QVector<QSharedPointer<DkImageContainerT>> images
     mPd->show();
 
     this->mForceSave = forceSave;
-    this->mImages = images;
+
+    // the thumbnails are saved only - so we do not need the image containers
+    mThumbs.clear();
+    mThumbs.reserve(images.size());
+    for (int idx = 0; idx < images.size(); idx++)
+        mThumbs << QSharedPointer<DkThumbNailT>(new DkThumbNailT(images.filePath(idx)));
+
     loadNext();
 }
 
@@ -317,7 +324,7 @@ void DkThumbsSaver::thumbLoaded(bool)
     mNumSaved++;
     emit numFilesSignal(mNumSaved);
 
-    if (mNumSaved == mImages.size() || mStop) {
+    if (mNumSaved == mThumbs.size() || mStop) {
         if (mPd) {
             mPd->close();
             mPd->deleteLater();
@@ -335,9 +342,9 @@ void DkThumbsSaver::loadNext()
 
     int force = (mForceSave) ? DkThumbNail::force_save_thumb : DkThumbNail::save_thumb;
 
-    for (int idx = 0; idx < mImages.size(); idx++) {
-        connect(mImages.at(idx)->getThumb().data(), &DkThumbNailT::thumbLoadedSignal, this, &DkThumbsSaver::thumbLoaded);
-        mImages.at(idx)->getThumb()->fetchThumb(force);
+    for (int idx = 0; idx < mThumbs.size(); idx++) {
+        connect(mThumbs.at(idx).data(), &DkThumbNailT::thumbLoadedSignal, this, &DkThumbsSaver::thumbLoaded);
+        mThumbs.at(idx)->fetchThumb(force, QSharedPointer<QByteArray>(), DkThumbsThreadPool::priority_background);
     }
 }
 
@@ -2197,6 +2204,142 @@ void DkCropWidget::setVisible(bool visible)
     DkEditableRect::setVisible(visible);
 }
 
+// DkHistogramData -------------------------------------------------------------------
+/**
+ * Computes the histogram of img.
+ * The image is split into stripes that are counted in parallel (each with its own histogram)
+ * and merged afterwards. Returns an empty histogram (numPixels == 0) if it was cancelled.
+ * @param img the image
+ * @param cancel if set to 1 by the caller, the computation is stopped
+ * @return DkHistogramData the histogram
+ **/
+DkHistogramData DkHistogramData::compute(const QImage &img, QSharedPointer<QAtomicInt> cancel)
+{
+    DkTimer dt;
+
+    if (img.isNull())
+        return DkHistogramData();
+
+    const int numStripes = qMax(1, QThread::idealThreadCount());
+    const int stripeHeight = qMax(64, (img.height() + numStripes - 1) / numStripes);
+
+    QVector<DkHistogramData> stripeData((img.height() + stripeHeight - 1) / stripeHeight);
+    DkHistogramData *sd = stripeData.data();
+
+    QVector<QFuture<void>> stripes;
+    for (int y = 0, sIdx = 0; y < img.height(); y += stripeHeight, sIdx++) {
+        int yEnd = qMin(y + stripeHeight, img.height());
+
+        stripes << QtConcurrent::run(DkImage::stripePool(), [&img, &cancel, sd, sIdx, y, yEnd] {
+            if (cancel && cancel->loadRelaxed())
+                return;
+
+            computeRows(img, y, yEnd, sd[sIdx]);
+        });
+    }
+
+    for (QFuture<void> &f : stripes)
+        f.waitForFinished();
+
+    if (cancel && cancel->loadRelaxed())
+        return DkHistogramData();
+
+    DkHistogramData data;
+    for (const DkHistogramData &d : stripeData)
+        data.add(d);
+
+    data.numPixels = img.width() * img.height();
+    data.isGray = img.depth() == 8;
+
+    // gray values are counted in the first channel
+    if (data.isGray) {
+        for (int idx = 0; idx < 256; idx++) {
+            data.hist[1][idx] = data.hist[0][idx];
+            data.hist[2][idx] = data.hist[0][idx];
+        }
+        data.numSaturatedPixels = data.hist[0][255];
+    }
+
+    qDebug() << "[DkHistogram] histogram of" << img.size() << "computed in" << dt;
+
+    return data;
+}
+
+/**
+ * Computes the histogram of a downscaled version (~1 MP) of img.
+ * The counts are scaled to the size of img. Small images are not downscaled.
+ * @param img the image
+ * @param cancel if set to 1 by the caller, the computation is stopped
+ * @return DkHistogramData the (approximated) histogram - isPreview is true if it was downscaled
+ **/
+DkHistogramData DkHistogramData::computePreview(const QImage &img, QSharedPointer<QAtomicInt> cancel)
+{
+    const double previewPixels = 1024.0 * 1024.0;
+
+    if (img.isNull() || (double)img.width() * img.height() <= previewPixels)
+        return compute(img, cancel);
+
+    double s = std::sqrt(previewPixels / ((double)img.width() * img.height()));
+    QSize ps(qMax(qRound(img.width() * s), 1), qMax(qRound(img.height() * s), 1));
+
+    // nearest neighbor subsampling keeps the pixel values
+    DkHistogramData data = compute(img.scaled(ps, Qt::IgnoreAspectRatio, Qt::FastTransformation), cancel);
+
+    if (data.numPixels == 0)
+        return data;
+
+    double f = (double)img.width() * img.height() / data.numPixels;
+
+    for (int cIdx = 0; cIdx < 3; cIdx++) {
+        for (int idx = 0; idx < 256; idx++)
+            data.hist[cIdx][idx] = qRound(data.hist[cIdx][idx] * f);
+    }
+
+    data.numZeroPixels = qRound(data.numZeroPixels * f);
+    data.numSaturatedPixels = qRound(data.numSaturatedPixels * f);
+    data.numPixels = img.width() * img.height();
+    data.isPreview = true;
+
+    return data;
+}
+
+void DkHistogramData::add(const DkHistogramData &other)
+{
+    for (int cIdx = 0; cIdx < 3; cIdx++) {
+        for (int idx = 0; idx < 256; idx++)
+            hist[cIdx][idx] += other.hist[cIdx][idx];
+    }
+
+    numPixels += other.numPixels;
+    numZeroPixels += other.numZeroPixels;
+    numSaturatedPixels += other.numSaturatedPixels;
+}
+
+void DkHistogramData::computeRows(const QImage &img, int yStart, int yEnd, DkHistogramData &data)
+{
+    const int w = img.width();
+
+    for (int rIdx = yStart; rIdx < yEnd; rIdx++) {
+        const uchar *ptr = img.constScanLine(rIdx);
+
+        // 8 bit images
+        if (img.depth() == 8) {
+            for (int cIdx = 0; cIdx < w; cIdx++)
+                data.hist[0][ptr[cIdx]]++;
+        }
+        // 24 bit images
+        else if (img.depth() == 24) {
+            DkImageKernels::histogram(ptr, w, 3, data.hist[0], data.hist[1], data.hist[2]);
+            DkImageKernels::countBlackWhite(ptr, w, 3, data.numZeroPixels, data.numSaturatedPixels);
+        }
+        // 32 bit images (QRgb is stored as BGRA)
+        else if (img.depth() == 32) {
+            DkImageKernels::histogram(ptr, w, 4, data.hist[2], data.hist[1], data.hist[0]);
+            DkImageKernels::countBlackWhite(ptr, w, 4, data.numZeroPixels, data.numSaturatedPixels);
+        }
+    }
+}
+
 // Image histogram  -------------------------------------------------------------------
 DkHistogram::DkHistogram(QWidget *parent)
     : DkFadeWidget(parent)
@@ -2215,10 +2358,14 @@ DkHistogram::DkHistogram(QWidget *parent)
 
     mContextMenu = new QMenu(tr("Histogram Settings"));
     mContextMenu->addAction(showStats);
+
+    connect(&mPreviewWatcher, &QFutureWatcher<DkHistogramData>::finished, this, &DkHistogram::previewComputed);
+    connect(&mHistogramWatcher, &QFutureWatcher<DkHistogramData>::finished, this, &DkHistogram::histogramComputed);
 }
 
 DkHistogram::~DkHistogram()
 {
+    cancelComputation();
 }
 
 /**
@@ -2321,101 +2468,97 @@ void DkHistogram::loadSettings()
 }
 
 /**
- * Goes through the image and counts pixels values. They are used to create the image histogram.
+ * Computes the histogram of the currently displayed image in the background.
+ * Large images show the histogram of a downscaled version first,
+ * the exact histogram is computed afterwards.
  * @param currently displayed image
  **/
 void DkHistogram::drawHistogram(QImage imgQt)
 {
     if (!isVisible() || imgQt.isNull()) {
+        cancelComputation();
+        mImgKey = 0;
         setPainted(false);
         return;
     }
 
-    DkTimer dt;
+    // we already have (or compute) the histogram of this image
+    if (imgQt.cacheKey() == mImgKey)
+        return;
 
-    // clear histogram values
-    mNumZeroPixels = 0;
-    mNumSaturatedPixels = 0;
-    mMaxBinValue = -1;
-    mMinBinValue = 256;
-    mMaxValue = 0;
-    mNumPixels = imgQt.width() * imgQt.height();
+    cancelComputation();
+    mImgKey = imgQt.cacheKey();
+    mHistogramImg = imgQt;
 
-    for (int idx = 0; idx < 256; idx++) {
-        mHist[0][idx] = 0;
-        mHist[1][idx] = 0;
-        mHist[2][idx] = 0;
-    }
+    mCancelToken = QSharedPointer<QAtomicInt>(new QAtomicInt(0));
+    mPreviewWatcher.setFuture(QtConcurrent::run(&DkHistogramData::computePreview, imgQt, mCancelToken));
+}
 
-    // count pixel- and total values, for
-    // 8 bit images
-    if (imgQt.depth() == 8) {
-        qDebug() << "8 bit histogram -------------------";
-
-        for (int rIdx = 0; rIdx < imgQt.height(); rIdx++) {
-            const unsigned char *pixel = imgQt.constScanLine(rIdx);
-
-            for (int cIdx = 0; cIdx < imgQt.width(); cIdx++, pixel++) {
-                mHist[0][*pixel]++;
-                mHist[1][*pixel]++;
-                mHist[2][*pixel]++;
-
-                if (*pixel == 255)
-                    mNumSaturatedPixels++;
-                if (*pixel < mMinBinValue)
-                    mMinBinValue = *pixel;
-                if (*pixel > mMaxBinValue)
-                    mMaxBinValue = *pixel;
-            }
-        }
-    }
-    // 24 bit images
-    else if (imgQt.depth() == 24) {
-        for (int rIdx = 0; rIdx < imgQt.height(); rIdx++) {
-            const unsigned char *pixel = imgQt.constScanLine(rIdx);
-            for (int cIdx = 0; cIdx < imgQt.width(); cIdx++) {
-                // If I understood the api correctly, the first bits are 0 if we have 24bpp & < 8 bits per channel
-                unsigned char pixR = *pixel;
-                mHist[0][*pixel]++;
-                pixel++;
-                unsigned char pixG = *pixel;
-                mHist[1][*pixel]++;
-                pixel++;
-                unsigned char pixB = *pixel;
-                mHist[2][*pixel]++;
-                pixel++;
-
-                if (pixR == 0 && pixG == 0 && pixB == 0) {
-                    mNumZeroPixels++;
-                } else if (pixR == 255 && pixG == 255 && pixB == 255) {
-                    mNumSaturatedPixels++;
-                }
-            }
-        }
+void DkHistogram::previewComputed()
+{
+    // the image changed in the meantime
+    if (!mCancelToken || mCancelToken->loadRelaxed())
+        return;
+
+    DkHistogramData data = mPreviewWatcher.result();
+
+    if (isVisible())
+        setHistogram(data);
+
+    // refine
+    if (data.isPreview && !mHistogramImg.isNull())
+        mHistogramWatcher.setFuture(QtConcurrent::run(&DkHistogramData::compute, mHistogramImg, mCancelToken));
+    else
+        finishComputation();
+}
+
+void DkHistogram::histogramComputed()
+{
+    // the image changed in the meantime
+    if (!mCancelToken || mCancelToken->loadRelaxed())
+        return;
+
+    finishComputation();
+
+    if (isVisible())
+        setHistogram(mHistogramWatcher.result());
+}
+
+void DkHistogram::cancelComputation()
+{
+    if (mCancelToken)
+        mCancelToken->storeRelaxed(1);
+
+    finishComputation();
+}
+
+void DkHistogram::finishComputation()
+{
+    mCancelToken.clear();
+    mHistogramImg = QImage();
+}
+
+void DkHistogram::setHistogram(const DkHistogramData &data)
+{
+    if (data.numPixels == 0) {
+        setPainted(false);
+        update();
+        return;
     }
-    // 32 bit images
-    else if (imgQt.depth() == 32) {
-        for (int rIdx = 0; rIdx < imgQt.height(); rIdx++) {
-            const QRgb *pixel = (QRgb *)(imgQt.constScanLine(rIdx));
-
-            for (int cIdx = 0; cIdx < imgQt.width(); cIdx++, pixel++) {
-                size_t pixR = static_cast<size_t>(qRed(*pixel));
-                size_t pixG = static_cast<size_t>(qGreen(*pixel));
-                size_t pixB = static_cast<size_t>(qBlue(*pixel));
-
-                mHist[0][pixR]++;
-                mHist[1][pixG]++;
-                mHist[2][pixB]++;
-
-                if (pixR == 0 && pixG == 0 && pixB == 0) {
-                    mNumZeroPixels++;
-                } else if (pixR == 255 && pixG == 255 && pixB == 255) {
-                    mNumSaturatedPixels++;
-                }
-            }
-        }
+
+    for (int idx = 0; idx < 256; idx++) {
+        mHist[0][idx] = data.hist[0][idx];
+        mHist[1][idx] = data.hist[1][idx];
+        mHist[2][idx] = data.hist[2][idx];
     }
 
+    mNumPixels = data.numPixels;
+    mNumZeroPixels = data.numZeroPixels;
+    mNumSaturatedPixels = data.numSaturatedPixels;
+    mMaxBinValue = -1;
+    mMinBinValue = 256;
+    mMaxValue = 0;
+
     // determine extreme values from the histogram
     mNumDistinctValues = 0;
 
@@ -2429,11 +2572,15 @@ void DkHistogram::drawHistogram(QImage imgQt)
 
         if (mHist[0][idx] || mHist[1][idx] || mHist[2][idx]) {
             mNumDistinctValues++;
+
+            if (data.isGray) {
+                mMinBinValue = qMin(mMinBinValue, idx);
+                mMaxBinValue = qMax(mMaxBinValue, idx);
+            }
         }
     }
 
     setPainted(true);
-    qDebug() << "drawing the histogram took me: " << dt;
     update();
 }
 
@@ -2442,6 +2589,8 @@ void DkHistogram::drawHistogram(QImage imgQt)
  **/
 void DkHistogram::clearHistogram()
 {
+    cancelComputation();
+    mImgKey = 0;
     setPainted(false);
     update();
 }
@@ -30,6 +30,7 @@
 #include "DkQt5Compat.h"
 
 #pragma warning(push, 0) // no warnings from includes - begin
+#include <QAtomicInt>
 #include <QDockWidget>
 #include <QFileIconProvider>
 #include <QFileSystemModel>
@@ -40,6 +41,7 @@
 #include <QPointer>
 #include <QProgressBar>
 #include <QPushButton>
+#include <QSharedPointer>
 #include <QSlider>
 #include <QSortFilterProxyModel>
 #pragma warning(pop) // no warnings from includes - end
@@ -317,7 +319,7 @@ public:
     bool getCurrentDisplaySetting();
 
 public slots:
-    void updateDir(QVector<QSharedPointer<DkImageContainerT>> images);
+    void updateDir(DkImageList images);
 
     virtual void show(bool saveSettings = true);
     virtual void hide(bool saveSettings = true);
@@ -356,7 +358,7 @@ class DkThumbsSaver : public DkFadeWidget
 public:
     DkThumbsSaver(QWidget *parent = 0);
 
-    void processDir(QVector<QSharedPointer<DkImageContainerT>> images, bool forceSave);
+    void processDir(DkImageList images, bool forceSave);
 
 signals:
     void numFilesSignal(int currentFileIdx);
@@ -372,7 +374,7 @@ protected:
     bool mStop = false;
     bool mForceSave = false;
     int mNumSaved = false;
-    QVector<QSharedPointer<DkImageContainerT>> mImages;
+    QVector<QSharedPointer<DkThumbNailT>> mThumbs;
 };
 
 class DkFileSystemModel : public QFileSystemModel
@@ -691,6 +693,25 @@ protected:
     DkCropToolBar *cropToolbar;
 };
 
+// Image histogram values
+class DkHistogramData
+{
+public:
+    int hist[3][256] = {}; /// 3 channels 256 bin. channels duplicated when gray
+    int numPixels = 0; /// image pixel count
+    int numZeroPixels = 0; /// pixels with zero value
+    int numSaturatedPixels = 0; /// pixels saturating RGB 8bit
+    bool isGray = false; /// 8 bit image
+    bool isPreview = false; /// computed from a downscaled image
+
+    static DkHistogramData compute(const QImage &img, QSharedPointer<QAtomicInt> cancel = QSharedPointer<QAtomicInt>());
+    static DkHistogramData computePreview(const QImage &img, QSharedPointer<QAtomicInt> cancel = QSharedPointer<QAtomicInt>());
+
+protected:
+    void add(const DkHistogramData &other);
+    static void computeRows(const QImage &img, int yStart, int yEnd, DkHistogramData &data);
+};
+
 // Image histogram display
 class DkHistogram : public DkFadeWidget
 {
@@ -714,6 +735,8 @@ public:
 
 public slots:
     void onToggleStatsTriggered(bool show);
+    void previewComputed();
+    void histogramComputed();
 
 protected:
     virtual void mousePressEvent(QMouseEvent *event) override;
@@ -723,6 +746,9 @@ protected:
     virtual void contextMenuEvent(QContextMenuEvent *event) override;
 
     void loadSettings();
+    void setHistogram(const DkHistogramData &data);
+    void cancelComputation();
+    void finishComputation();
 
 private:
     int mHist[3][256]; /// 3 channels 256 bin. channels duplicated when gray
@@ -739,6 +765,12 @@ private:
     DisplayMode mDisplayMode = DisplayMode::histogram_mode_simple; /// determins shown histogram type
 
     QMenu *mContextMenu = 0;
+
+    QFutureWatcher<DkHistogramData> mPreviewWatcher;
+    QFutureWatcher<DkHistogramData> mHistogramWatcher;
+    QImage mHistogramImg; /// the image whose exact histogram is computed
+    QSharedPointer<QAtomicInt> mCancelToken;
+    qint64 mImgKey = 0; /// cache key of the image that is shown (or computed)
 };
 
 class DkFileInfo
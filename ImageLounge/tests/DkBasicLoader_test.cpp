@@ -0,0 +1,355 @@
+#include "../src/DkCore/DkBasicLoader.h"
+#include "../src/DkCore/DkSettings.h"
+#include <QFile>
+#include <QTemporaryDir>
+#include <gtest/gtest.h>
+
+#ifdef WITH_LIBTIFF
+#include <tiffio.h>
+#endif
+
+using nmc::DkImageDecoder;
+using nmc::DkSettingsManager;
+using nmc::DkTiffFile;
+
+// an ftyp box with the given brands - the first one is the major brand
+static QByteArray ftypHeader(const QList<QByteArray> &brands) {
+  QByteArray header(4, '\0');
+  header += "ftyp" + brands.first() + QByteArray(4, '\0');
+  for (int idx = 1; idx < brands.size(); idx++)
+    header += brands[idx];
+
+  header[3] = (char)header.size();
+  return header;
+}
+
+TEST(DkImageDecoderTest, AvifBrands) {
+  // the Qt plugins might be missing - but generic HEIF brands must not route AVIF files to HEIF
+  DkImageDecoder d = DkImageDecoder::identify(ftypHeader({"mif1", "mif1", "avif", "miaf"}), "avif");
+  EXPECT_TRUE(d.isNull() || d.format() == "avif");
+
+  d = DkImageDecoder::identify(ftypHeader({"msf1", "msf1", "avis"}), "avif");
+  EXPECT_TRUE(d.isNull() || d.format() == "avif");
+
+  d = DkImageDecoder::identify(ftypHeader({"mif1", "mif1", "heic"}), "heic");
+  EXPECT_TRUE(d.isNull() || d.format() == "heif");
+}
+
+static DkTiffFile::Directory directory(int width, int height) {
+  DkTiffFile::Directory dir;
+  dir.size = QSize(width, height);
+  return dir;
+}
+
+TEST(DkTiffFileTest, LevelSize) {
+  QSize size(1000, 601);
+
+  EXPECT_EQ(DkTiffFile::levelSize(size, 0), size);
+  EXPECT_EQ(DkTiffFile::levelSize(size, 1), QSize(500, 301));
+  EXPECT_EQ(DkTiffFile::levelSize(size, 2), QSize(250, 151));
+  EXPECT_EQ(DkTiffFile::levelSize(size, 3), QSize(125, 76));
+}
+
+TEST(DkTiffFileTest, LevelDirectory) {
+  QVector<DkTiffFile::Directory> dirs;
+  dirs << directory(4000, 3000) << directory(2000, 1500) << directory(1000, 750) << directory(500, 375);
+
+  QSize size = dirs.first().size;
+  EXPECT_EQ(DkTiffFile::levelDirectory(dirs, size), 0);
+  EXPECT_EQ(DkTiffFile::levelDirectory(dirs, DkTiffFile::levelSize(size, 2)), 2);
+  EXPECT_EQ(DkTiffFile::levelDirectory(dirs, DkTiffFile::levelSize(size, 4)), 3);
+
+  // the smallest directory that is still larger than the level
+  EXPECT_EQ(DkTiffFile::levelDirectory(dirs, QSize(1200, 900)), 1);
+
+  // none is large enough
+  dirs.removeFirst();
+  EXPECT_EQ(DkTiffFile::levelDirectory(dirs, size), -1);
+}
+
+TEST(DkTiffFileTest, DirectoryRect) {
+  EXPECT_EQ(DkTiffFile::directoryRect(QRect(10, 20, 100, 50), QSize(1000, 750), QSize(2000, 1500)), QRect(20, 40, 200, 100));
+  EXPECT_EQ(DkTiffFile::directoryRect(QRect(10, 20, 100, 50), QSize(1000, 750), QSize(1000, 750)), QRect(10, 20, 100, 50));
+
+  // partially covered pixels are included
+  EXPECT_EQ(DkTiffFile::directoryRect(QRect(1, 1, 1, 1), QSize(3, 3), QSize(4, 4)), QRect(1, 1, 2, 2));
+}
+
+TEST(DkTiffFileTest, LevelStep) {
+  EXPECT_EQ(DkTiffFile::levelStep(QSize(4000, 3000), QSize(1000, 750)), 4);
+  EXPECT_EQ(DkTiffFile::levelStep(QSize(1000, 750), QSize(1000, 750)), 1);
+
+  // never sample below the level's size
+  EXPECT_EQ(DkTiffFile::levelStep(QSize(4000, 3000), QSize(1001, 750)), 2);
+}
+
+TEST(DkTiffFileTest, Units) {
+  QVector<QRect> units = DkTiffFile::units(QRect(300, 100, 200, 50), QSize(256, 64));
+  EXPECT_EQ(units, QVector<QRect>({QRect(256, 64, 256, 64), QRect(256, 128, 256, 64)}));
+
+  // strips span the image width
+  units = DkTiffFile::units(QRect(0, 10, 100, 30), QSize(100, 16));
+  EXPECT_EQ(units, QVector<QRect>({QRect(0, 0, 100, 16), QRect(0, 16, 100, 16), QRect(0, 32, 100, 16)}));
+
+  EXPECT_TRUE(DkTiffFile::units(QRect(), QSize(256, 64)).isEmpty());
+  EXPECT_TRUE(DkTiffFile::units(QRect(0, 0, 10, 10), QSize()).isEmpty());
+}
+
+TEST(DkTiffFileTest, Sampling) {
+  QRect region(10, 10, 100, 100);
+
+  EXPECT_EQ(DkTiffFile::firstSample(region, QRect(64, 10, 10, 10), 4), QPoint(66, 10));
+  EXPECT_EQ(DkTiffFile::firstSample(region, region, 4), region.topLeft());
+  EXPECT_EQ(DkTiffFile::firstSample(region, QRect(64, 10, 10, 10), 1), QPoint(64, 10));
+
+  EXPECT_EQ(DkTiffFile::sampledSize(QRect(0, 0, 10, 7), 4), QSize(3, 2));
+  EXPECT_EQ(DkTiffFile::sampledSize(QRect(0, 0, 10, 7), 1), QSize(10, 7));
+}
+
+#ifdef WITH_LIBTIFF
+// the layout of a TIFF that is written by libtiff
+struct TiffSpec {
+  int width = 40;
+  int height = 24;
+  uint16_t spp = 3;
+  uint16_t bps = 8;
+  uint16_t photometric = PHOTOMETRIC_RGB;
+  uint16_t extraSample = EXTRASAMPLE_UNSPECIFIED; // only used if spp is 2 or 4
+  int tileSize = 0; // 0 writes strips
+  int rowsPerStrip = 4;
+};
+
+// the test pattern - sample c of pixel (x, y)
+static int sampleValue(int x, int y, int c, int bps) {
+  int v = (x * 7 + y * 13 + c * 50) % 256;
+  return bps == 16 ? v * 256 + c : v;
+}
+
+class DkTiffDecoderTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    mKeep16Bit = DkSettingsManager::param().resources().keep16BitTiff;
+    DkSettingsManager::param().resources().keep16BitTiff = false;
+  }
+
+  void TearDown() override {
+    DkSettingsManager::param().resources().keep16BitTiff = mKeep16Bit;
+  }
+
+  // writes a TIFF with libtiff and returns the file's buffer
+  QSharedPointer<QByteArray> writeTiff(const TiffSpec &spec) {
+    QString filePath = mDir.filePath("test.tif");
+    TIFF *tiff = TIFFOpen(filePath.toLocal8Bit().constData(), "w");
+    EXPECT_NE(tiff, nullptr);
+
+    if (!tiff)
+      return QSharedPointer<QByteArray>(new QByteArray());
+
+    TIFFSetField(tiff, TIFFTAG_IMAGEWIDTH, spec.width);
+    TIFFSetField(tiff, TIFFTAG_IMAGELENGTH, spec.height);
+    TIFFSetField(tiff, TIFFTAG_SAMPLESPERPIXEL, spec.spp);
+    TIFFSetField(tiff, TIFFTAG_BITSPERSAMPLE, spec.bps);
+    TIFFSetField(tiff, TIFFTAG_PHOTOMETRIC, spec.photometric);
+    TIFFSetField(tiff, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+    TIFFSetField(tiff, TIFFTAG_COMPRESSION, COMPRESSION_NONE);
+
+    if (spec.spp == 2 || spec.spp == 4) {
+      uint16_t extra = spec.extraSample;
+      TIFFSetField(tiff, TIFFTAG_EXTRASAMPLES, 1, &extra);
+    }
+
+    const int pixelBytes = spec.spp * spec.bps / 8;
+    auto fill = [&](QByteArray &buffer, int x0, int y0, int w, int h) {
+      buffer.fill(0, w * h * pixelBytes);
+
+      for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+          for (int c = 0; c < spec.spp; c++) {
+            // padding of partial tiles
+            if (x0 + x >= spec.width || y0 + y >= spec.height)
+              continue;
+
+            int v = sampleValue(x0 + x, y0 + y, c, spec.bps);
+            int idx = (y * w + x) * spec.spp + c;
+
+            if (spec.bps == 16)
+              reinterpret_cast<uint16_t *>(buffer.data())[idx] = static_cast<uint16_t>(v);
+            else
+              reinterpret_cast<uint8_t *>(buffer.data())[idx] = static_cast<uint8_t>(v);
+          }
+        }
+      }
+    };
+
+    QByteArray buffer;
+
+    if (spec.tileSize > 0) {
+      TIFFSetField(tiff, TIFFTAG_TILEWIDTH, spec.tileSize);
+      TIFFSetField(tiff, TIFFTAG_TILELENGTH, spec.tileSize);
+
+      for (int y = 0; y < spec.height; y += spec.tileSize) {
+        for (int x = 0; x < spec.width; x += spec.tileSize) {
+          fill(buffer, x, y, spec.tileSize, spec.tileSize);
+          TIFFWriteTile(tiff, buffer.data(), x, y, 0, 0);
+        }
+      }
+    } else {
+      TIFFSetField(tiff, TIFFTAG_ROWSPERSTRIP, spec.rowsPerStrip);
+
+      for (int y = 0; y < spec.height; y += spec.rowsPerStrip) {
+        int rows = qMin(spec.rowsPerStrip, spec.height - y);
+        fill(buffer, 0, y, spec.width, rows);
+        TIFFWriteEncodedStrip(tiff, TIFFComputeStrip(tiff, y, 0), buffer.data(), buffer.size());
+      }
+    }
+
+    TIFFClose(tiff);
+
+    QFile file(filePath);
+    EXPECT_TRUE(file.open(QIODevice::ReadOnly));
+
+    return QSharedPointer<QByteArray>(new QByteArray(file.readAll()));
+  }
+
+  QImage readPage(const TiffSpec &spec) {
+    DkTiffFile tiffFile(mDir.filePath("test.tif"), writeTiff(spec));
+    EXPECT_TRUE(tiffFile.isOpen());
+
+    QImage img;
+    EXPECT_TRUE(tiffFile.readPage(1, img));
+
+    return img;
+  }
+
+  // the pixel as it is stored (premultiplied formats are not converted)
+  static QRgb rawPixel(const QImage &img, int x, int y) {
+    return reinterpret_cast<const QRgb *>(img.constScanLine(y))[x];
+  }
+
+  QTemporaryDir mDir;
+  bool mKeep16Bit = false;
+};
+
+TEST_F(DkTiffDecoderTest, Strips) {
+  TiffSpec spec;
+  QImage img = readPage(spec);
+
+  ASSERT_EQ(img.size(), QSize(spec.width, spec.height));
+  EXPECT_EQ(img.format(), QImage::Format_RGB32);
+
+  // the strips are decoded in parallel
+  for (int y = 0; y < spec.height; y++) {
+    for (int x = 0; x < spec.width; x++) {
+      QRgb p = img.pixel(x, y);
+      ASSERT_EQ(qRed(p), sampleValue(x, y, 0, 8));
+      ASSERT_EQ(qGreen(p), sampleValue(x, y, 1, 8));
+      ASSERT_EQ(qBlue(p), sampleValue(x, y, 2, 8));
+    }
+  }
+}
+
+TEST_F(DkTiffDecoderTest, Tiles) {
+  TiffSpec spec;
+  spec.tileSize = 16; // the last column and row of tiles are partial
+  QImage img = readPage(spec);
+
+  ASSERT_EQ(img.size(), QSize(spec.width, spec.height));
+
+  for (int y = 0; y < spec.height; y++) {
+    for (int x = 0; x < spec.width; x++) {
+      QRgb p = img.pixel(x, y);
+      ASSERT_EQ(qRed(p), sampleValue(x, y, 0, 8));
+      ASSERT_EQ(qGreen(p), sampleValue(x, y, 1, 8));
+      ASSERT_EQ(qBlue(p), sampleValue(x, y, 2, 8));
+    }
+  }
+}
+
+TEST_F(DkTiffDecoderTest, MinIsWhite) {
+  TiffSpec spec;
+  spec.spp = 1;
+  spec.photometric = PHOTOMETRIC_MINISWHITE;
+  QImage img = readPage(spec);
+
+  ASSERT_EQ(img.format(), QImage::Format_Grayscale8);
+  EXPECT_EQ(img.constScanLine(3)[5], 255 - sampleValue(5, 3, 0, 8));
+
+  // the color is inverted - alpha is not
+  spec.spp = 2;
+  spec.extraSample = EXTRASAMPLE_UNASSALPHA;
+  img = readPage(spec);
+
+  ASSERT_EQ(img.format(), QImage::Format_ARGB32);
+  QRgb p = rawPixel(img, 5, 3);
+  EXPECT_EQ(qRed(p), 255 - sampleValue(5, 3, 0, 8));
+  EXPECT_EQ(qBlue(p), 255 - sampleValue(5, 3, 0, 8));
+  EXPECT_EQ(qAlpha(p), sampleValue(5, 3, 1, 8));
+}
+
+TEST_F(DkTiffDecoderTest, SixteenBit) {
+  TiffSpec spec;
+  spec.bps = 16;
+  QImage img = readPage(spec);
+
+  // reduced to 8 bit by default
+  ASSERT_EQ(img.format(), QImage::Format_RGB32);
+  QRgb p = img.pixel(7, 5);
+  EXPECT_EQ(qRed(p), sampleValue(7, 5, 0, 16) >> 8);
+  EXPECT_EQ(qGreen(p), sampleValue(7, 5, 1, 16) >> 8);
+  EXPECT_EQ(qBlue(p), sampleValue(7, 5, 2, 16) >> 8);
+
+  DkSettingsManager::param().resources().keep16BitTiff = true;
+  img = readPage(spec);
+
+  ASSERT_EQ(img.format(), QImage::Format_RGBX64);
+  QRgba64 p64 = reinterpret_cast<const QRgba64 *>(img.constScanLine(5))[7];
+  EXPECT_EQ(p64.red(), sampleValue(7, 5, 0, 16));
+  EXPECT_EQ(p64.green(), sampleValue(7, 5, 1, 16));
+  EXPECT_EQ(p64.blue(), sampleValue(7, 5, 2, 16));
+}
+
+TEST_F(DkTiffDecoderTest, Alpha) {
+  TiffSpec spec;
+  spec.spp = 4;
+  spec.extraSample = EXTRASAMPLE_UNASSALPHA;
+  QImage img = readPage(spec);
+
+  ASSERT_EQ(img.format(), QImage::Format_ARGB32);
+  QRgb p = rawPixel(img, 2, 9);
+  EXPECT_EQ(qRed(p), sampleValue(2, 9, 0, 8));
+  EXPECT_EQ(qAlpha(p), sampleValue(2, 9, 3, 8));
+
+  // associated alpha is stored as is
+  spec.extraSample = EXTRASAMPLE_ASSOCALPHA;
+  img = readPage(spec);
+
+  ASSERT_EQ(img.format(), QImage::Format_ARGB32_Premultiplied);
+  p = rawPixel(img, 2, 9);
+  EXPECT_EQ(qGreen(p), sampleValue(2, 9, 1, 8));
+  EXPECT_EQ(qAlpha(p), sampleValue(2, 9, 3, 8));
+}
+
+TEST_F(DkTiffDecoderTest, Region) {
+  TiffSpec spec;
+  spec.tileSize = 16;
+  DkTiffFile tiffFile(mDir.filePath("test.tif"), writeTiff(spec));
+
+  EXPECT_TRUE(tiffFile.canReadRegions(1));
+  EXPECT_EQ(tiffFile.pageSize(1), QSize(spec.width, spec.height));
+
+  QImage img;
+  ASSERT_TRUE(tiffFile.readRegion(1, img, QRect(10, 4, 20, 12)));
+  ASSERT_EQ(img.size(), QSize(20, 12));
+  EXPECT_EQ(qRed(img.pixel(0, 0)), sampleValue(10, 4, 0, 8));
+  EXPECT_EQ(qBlue(img.pixel(19, 11)), sampleValue(29, 15, 2, 8));
+
+  // level 1 samples every other pixel of the page
+  ASSERT_TRUE(tiffFile.readRegion(1, img, QRect(4, 2, 8, 6), 1));
+  ASSERT_EQ(img.size(), QSize(8, 6));
+  EXPECT_EQ(qRed(img.pixel(0, 0)), sampleValue(8, 4, 0, 8));
+  EXPECT_EQ(qGreen(img.pixel(3, 2)), sampleValue(14, 8, 1, 8));
+
+  // outside of the level
+  EXPECT_FALSE(tiffFile.readRegion(1, img, QRect(100, 100, 8, 8)));
+}
+#endif
@@ -0,0 +1,133 @@
+#include "../src/DkCore/DkImageKernels.h"
+#include <gtest/gtest.h>
+#include <random>
+#include <vector>
+
+using nmc::DkImageKernels;
+
+static std::vector<uchar> randomBuffer(int size, uchar minVal = 0, uchar maxVal = 255) {
+  std::mt19937 rng(42);
+  std::uniform_int_distribution<int> dist(minVal, maxVal);
+
+  std::vector<uchar> buffer(size);
+  for (uchar &v : buffer)
+    v = (uchar)dist(rng);
+
+  return buffer;
+}
+
+class DkImageKernelsTest : public ::testing::Test {
+protected:
+  void TearDown() override {
+    DkImageKernels::setInstructionSet(DkImageKernels::bestInstructionSet());
+  }
+};
+
+TEST_F(DkImageKernelsTest, MinMaxMatchesScalar) {
+  for (int numBytes : {0, 4, 12, 60, 1000, 4100}) {
+    std::vector<uchar> buffer = randomBuffer(numBytes, 20, 230);
+
+    // alpha values must be ignored
+    for (int idx = 3; idx < numBytes; idx += 4)
+      buffer[idx] = idx % 8 == 3 ? 0 : 255;
+
+    for (bool skipAlpha : {false, true}) {
+      uchar minRef = 255, maxRef = 0;
+      DkImageKernels::setInstructionSet(DkImageKernels::is_scalar);
+      DkImageKernels::minMax(buffer.data(), numBytes, skipAlpha, minRef, maxRef);
+
+      uchar minVal = 255, maxVal = 0;
+      DkImageKernels::setInstructionSet(DkImageKernels::bestInstructionSet());
+      DkImageKernels::minMax(buffer.data(), numBytes, skipAlpha, minVal, maxVal);
+
+      EXPECT_EQ(minRef, minVal);
+      EXPECT_EQ(maxRef, maxVal);
+
+      if (skipAlpha && numBytes > 0) {
+        EXPECT_GE(minVal, 20);
+        EXPECT_LE(maxVal, 230);
+      }
+    }
+  }
+}
+
+TEST_F(DkImageKernelsTest, Threshold) {
+  const std::vector<uchar> src = randomBuffer(1037);
+
+  for (double thr : {-1.0, 0.0, 100.0, 127.5, 254.9, 255.0}) {
+    std::vector<uchar> buffer = src;
+    DkImageKernels::threshold(buffer.data(), (int)buffer.size(), thr);
+
+    for (size_t idx = 0; idx < src.size(); idx++)
+      ASSERT_EQ(buffer[idx], src[idx] > thr ? 255 : 0) << "thr: " << thr << " value: " << (int)src[idx];
+  }
+}
+
+TEST_F(DkImageKernelsTest, AlphaUsed) {
+  for (int numPixels : {1, 3, 4, 9, 33, 513}) {
+    std::vector<uchar> buffer = randomBuffer(numPixels * 4);
+
+    for (int idx = 3; idx < numPixels * 4; idx += 4)
+      buffer[idx] = 255;
+
+    EXPECT_FALSE(DkImageKernels::alphaUsed(buffer.data(), numPixels));
+
+    // the last pixel is handled by the remainder loops
+    buffer[(numPixels - 1) * 4 + 3] = 254;
+    EXPECT_TRUE(DkImageKernels::alphaUsed(buffer.data(), numPixels));
+
+    buffer[(numPixels - 1) * 4 + 3] = 255;
+    buffer[3] = 0;
+    EXPECT_TRUE(DkImageKernels::alphaUsed(buffer.data(), numPixels));
+  }
+}
+
+TEST_F(DkImageKernelsTest, ApplyLut) {
+  std::vector<uchar> lut(4 * 256);
+  for (int idx = 0; idx < 256; idx++) {
+    lut[idx] = (uchar)(255 - idx);
+    lut[256 + idx] = (uchar)idx;
+    lut[512 + idx] = (uchar)(idx / 2);
+    lut[768 + idx] = 7;
+  }
+
+  const std::vector<uchar> src = randomBuffer(4 * 17);
+  std::vector<uchar> buffer = src;
+  DkImageKernels::applyLut(buffer.data(), 17, 4, lut.data());
+
+  for (size_t idx = 0; idx < src.size(); idx++)
+    EXPECT_EQ(buffer[idx], lut[(idx % 4) * 256 + src[idx]]);
+}
+
+TEST_F(DkImageKernelsTest, CountBlackWhiteMatchesScalar) {
+  for (int numPixels : {0, 1, 7, 64, 1001}) {
+    std::vector<uchar> buffer = randomBuffer(numPixels * 4);
+
+    // alpha must be ignored
+    for (int idx = 0; idx < numPixels; idx++) {
+      uchar v = idx % 3 == 0 ? 0 : idx % 3 == 1 ? 255 : buffer[idx * 4];
+      if (idx % 5 != 4)
+        buffer[idx * 4] = buffer[idx * 4 + 1] = buffer[idx * 4 + 2] = v;
+    }
+
+    for (int channels : {3, 4}) {
+      int pixels = numPixels * 4 / channels;
+
+      int blackRef = 0, whiteRef = 0;
+      DkImageKernels::setInstructionSet(DkImageKernels::is_scalar);
+      DkImageKernels::countBlackWhite(buffer.data(), pixels, channels, blackRef, whiteRef);
+
+      int black = 0, white = 0;
+      DkImageKernels::setInstructionSet(DkImageKernels::bestInstructionSet());
+      DkImageKernels::countBlackWhite(buffer.data(), pixels, channels, black, white);
+
+      EXPECT_EQ(blackRef, black);
+      EXPECT_EQ(whiteRef, white);
+
+      if (channels == 4 && numPixels > 7) {
+        EXPECT_GT(black, 0);
+        EXPECT_GT(white, 0);
+      }
+    }
+  }
+}
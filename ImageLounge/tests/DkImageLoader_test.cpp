@@ -0,0 +1,189 @@
+#include "../src/DkCore/DkImageLoader.h"
+#include "../src/DkCore/DkSettings.h"
+#include <gtest/gtest.h>
+
+using nmc::DkPrefetchPlanner;
+using nmc::DkSettingsManager;
+
+// exposes the navigation state - the interval depends on the wall clock
+class TestPrefetchPlanner : public DkPrefetchPlanner {
+public:
+  void setInterval(double ms) { mInterval = ms; }
+  int step() const { return mStep; }
+  int confidence() const { return mConfidence; }
+};
+
+class DkPrefetchPlannerTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    auto &p = DkSettingsManager::param();
+    mSkipImgs = p.global().skipImgs;
+    mLoop = p.global().loop;
+    mMaxImagesCached = p.resources().maxImagesCached;
+
+    p.global().skipImgs = 10;
+    p.global().loop = true;
+    p.resources().maxImagesCached = 5;
+  }
+
+  void TearDown() override {
+    auto &p = DkSettingsManager::param();
+    p.global().skipImgs = mSkipImgs;
+    p.global().loop = mLoop;
+    p.resources().maxImagesCached = mMaxImagesCached;
+  }
+
+  int mSkipImgs = 0;
+  bool mLoop = false;
+  int mMaxImagesCached = 0;
+};
+
+TEST_F(DkPrefetchPlannerTest, DefaultPlan) {
+  TestPrefetchPlanner planner;
+
+  // no navigation yet: one image ahead and one behind
+  DkPrefetchPlanner::Plan p = planner.plan(5, 20, "jpg", 0);
+  EXPECT_EQ(p.decode, QVector<int>({6, 4}));
+  EXPECT_EQ(p.fetch, QVector<int>({7, 8, 9, 10}));
+
+  // nothing to plan
+  EXPECT_TRUE(planner.plan(0, 1, "jpg", 0).decode.isEmpty());
+  EXPECT_TRUE(planner.plan(-1, 20, "jpg", 0).decode.isEmpty());
+}
+
+TEST_F(DkPrefetchPlannerTest, Direction) {
+  TestPrefetchPlanner planner;
+
+  planner.navigated(5, 20);
+  planner.navigated(4, 20);
+  planner.navigated(3, 20);
+  planner.setInterval(-1);
+
+  EXPECT_EQ(planner.step(), -1);
+  EXPECT_EQ(planner.confidence(), 2);
+
+  // we are sure about the direction: prefetch backwards
+  DkPrefetchPlanner::Plan p = planner.plan(3, 20, "jpg", 0);
+  EXPECT_EQ(p.decode, QVector<int>({2, 4}));
+  EXPECT_EQ(p.fetch, QVector<int>({1, 0, 19, 18}));
+
+  DkSettingsManager::param().global().loop = false;
+  p = planner.plan(3, 20, "jpg", 0);
+  EXPECT_EQ(p.fetch, QVector<int>({1, 0}));
+}
+
+TEST_F(DkPrefetchPlannerTest, JumpsAndLoops) {
+  TestPrefetchPlanner planner;
+
+  // jumps (e.g. the scrollbar) do not change the direction
+  planner.navigated(0, 100);
+  planner.navigated(50, 100);
+  EXPECT_EQ(planner.step(), 1);
+  EXPECT_EQ(planner.confidence(), 0);
+
+  // stepping back from the first to the last image is a step of -1
+  planner.navigated(0, 20);
+  planner.navigated(19, 20);
+  EXPECT_EQ(planner.step(), -1);
+  EXPECT_EQ(planner.confidence(), 1);
+}
+
+TEST_F(DkPrefetchPlannerTest, DecodeTime) {
+  DkPrefetchPlanner planner;
+  EXPECT_EQ(planner.decodeTime("jpg"), 100);
+
+  planner.addDecodeTime("JPG", 20);
+  planner.addDecodeTime("cr2", 300);
+  EXPECT_EQ(planner.decodeTime("jpg"), 20);
+
+  // unknown formats get the mean of all formats
+  EXPECT_EQ(planner.decodeTime("png"), 160);
+
+  // the decode time is a running mean
+  planner.addDecodeTime("jpg", 120);
+  EXPECT_EQ(planner.decodeTime("jpg"), 50);
+}
+
+TEST_F(DkPrefetchPlannerTest, CostBasedPlan) {
+  DkSettingsManager::param().resources().maxImagesCached = 8;
+
+  TestPrefetchPlanner planner;
+  planner.addDecodeTime("cr2", 200);
+  planner.addDecodeTime("jpg", 20);
+
+  // fast navigation through slow files: decode more images ahead
+  planner.setInterval(50);
+  DkPrefetchPlanner::Plan p = planner.plan(5, 20, "cr2", 0);
+  EXPECT_EQ(p.decode, QVector<int>({6, 7, 8, 9, 10, 4, 3}));
+  EXPECT_EQ(p.fetch, QVector<int>({11, 12, 13}));
+
+  // fast files need fewer images ahead
+  p = planner.plan(5, 20, "jpg", 0);
+  EXPECT_EQ(p.decode, QVector<int>({6, 7, 4}));
+
+  // the number of decoded images is bound by the cache size
+  planner.setInterval(1);
+  p = planner.plan(5, 20, "cr2", 0);
+  EXPECT_EQ(p.decode, QVector<int>({6, 7, 8, 9, 10, 11, 12, 4}));
+  EXPECT_EQ(p.fetch, QVector<int>({13}));
+
+  DkSettingsManager::param().resources().maxImagesCached = 1;
+  p = planner.plan(5, 20, "cr2", 0);
+  EXPECT_EQ(p.decode, QVector<int>({6}));
+  EXPECT_TRUE(p.fetch.isEmpty());
+}
+
+using nmc::DkImageContainerT;
+using nmc::DkImageList;
+
+TEST(DkImageListTest, CreatesContainersOnAccess) {
+  DkImageList images;
+  images.append(QString("/tmp/a.jpg"));
+  images.append(QString("/tmp/b.jpg"));
+
+  ASSERT_EQ(images.size(), 2);
+  EXPECT_EQ(images.filePath(1), QString("/tmp/b.jpg"));
+  EXPECT_EQ(images.numCreated(), 0);
+  EXPECT_TRUE(images.created(0).isNull());
+
+  QSharedPointer<DkImageContainerT> img = images.at(0);
+  ASSERT_FALSE(img.isNull());
+  EXPECT_EQ(img->filePath(), QString("/tmp/a.jpg"));
+  EXPECT_EQ(images.at(0), img);
+  EXPECT_EQ(images.numCreated(), 1);
+}
+
+TEST(DkImageListTest, CopiesShareContainers) {
+  DkImageList images;
+  images.append(QString("/tmp/a.jpg"));
+  images.append(QString("/tmp/b.jpg"));
+
+  DkImageList copy = images;
+  QSharedPointer<DkImageContainerT> img = copy.at(1);
+  EXPECT_EQ(images.created(1), img);
+
+  // modifying the list does not change its copies
+  images.removeAt(0);
+  EXPECT_EQ(images.size(), 1);
+  EXPECT_EQ(copy.size(), 2);
+  EXPECT_EQ(images.created(0), img);
+
+  DkImageList reversed = copy.reordered({1, 0});
+  EXPECT_EQ(reversed.filePath(0), QString("/tmp/b.jpg"));
+  EXPECT_EQ(reversed.created(0), img);
+}
+
+TEST(DkImageListTest, ReleasesIdleContainers) {
+  DkImageList images;
+  images.append(QString("/tmp/a.jpg"));
+
+  QWeakPointer<DkImageContainerT> img = images.at(0);
+  EXPECT_TRUE(images.release(0));
+  EXPECT_TRUE(images.created(0).isNull());
+  EXPECT_TRUE(img.isNull());
+
+  // edited images are kept
+  images.at(0)->setEdited(true);
+  EXPECT_FALSE(images.release(0));
+  EXPECT_FALSE(images.created(0).isNull());
+}
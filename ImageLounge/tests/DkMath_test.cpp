@@ -0,0 +1,61 @@
+#include "../src/DkCore/DkMath.h"
+#include <gtest/gtest.h>
+
+using nmc::DkPrefixSum;
+
+TEST(DkPrefixSumTest, Sums) {
+  DkPrefixSum ps({3, 0, 5, 2, 7});
+
+  EXPECT_EQ(ps.size(), 5);
+  EXPECT_EQ(ps.sum(0), 0);
+  EXPECT_EQ(ps.sum(1), 3);
+  EXPECT_EQ(ps.sum(3), 8);
+  EXPECT_EQ(ps.sum(5), 17);
+  EXPECT_EQ(ps.total(), 17);
+}
+
+TEST(DkPrefixSumTest, SetValue) {
+  DkPrefixSum ps({3, 0, 5, 2, 7});
+
+  ps.setValue(1, 4);
+  EXPECT_EQ(ps.value(1), 4);
+  EXPECT_EQ(ps.sum(1), 3);
+  EXPECT_EQ(ps.sum(2), 7);
+  EXPECT_EQ(ps.total(), 21);
+
+  ps.setValue(4, 0);
+  EXPECT_EQ(ps.sum(4), 14);
+  EXPECT_EQ(ps.total(), 14);
+}
+
+TEST(DkPrefixSumTest, Find) {
+  DkPrefixSum ps({3, 0, 5, 2, 7});
+
+  EXPECT_EQ(ps.find(-1), 0);
+  EXPECT_EQ(ps.find(0), 0);
+  EXPECT_EQ(ps.find(2), 0);
+  EXPECT_EQ(ps.find(3), 2); // the empty value 1 does not take any space
+  EXPECT_EQ(ps.find(7), 2);
+  EXPECT_EQ(ps.find(8), 3);
+  EXPECT_EQ(ps.find(16), 4);
+  EXPECT_EQ(ps.find(100), 5);
+
+  EXPECT_EQ(DkPrefixSum().find(10), 0);
+}
+
+TEST(DkPrefixSumTest, MatchesLinearSum) {
+  QVector<qint64> values;
+  for (int idx = 0; idx < 100; idx++)
+    values << (idx * 37) % 11;
+
+  DkPrefixSum ps(values);
+  ps.setValue(42, 13);
+  values[42] = 13;
+
+  qint64 s = 0;
+  for (int idx = 0; idx <= values.size(); idx++) {
+    EXPECT_EQ(ps.sum(idx), s);
+    if (idx < values.size())
+      s += values[idx];
+  }
+}
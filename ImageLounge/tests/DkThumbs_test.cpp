@@ -0,0 +1,147 @@
+#include "../src/DkCore/DkSettings.h"
+#include "../src/DkCore/DkThumbs.h"
+#include <QFile>
+#include <QTemporaryDir>
+#include <gtest/gtest.h>
+
+using nmc::DkSettingsManager;
+using nmc::DkThumbCache;
+
+// a cache in its own directory
+class TestThumbCache : public DkThumbCache {
+public:
+  TestThumbCache(const QString &dirPath) : DkThumbCache(dirPath) {}
+
+  int numEntries() const { return mIndex.size(); }
+  qint64 packSize() const { return mPack.size(); }
+
+  void compact(qint64 maxSize) {
+    QMutexLocker locker(&mMutex);
+    DkThumbCache::compact(maxSize);
+  }
+};
+
+class DkThumbCacheTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    auto &p = DkSettingsManager::param();
+    mCacheSize = p.resources().thumbCacheSize;
+    mPrivateMode = p.app().privateMode;
+
+    p.resources().thumbCacheSize = 16;
+    p.app().privateMode = false;
+  }
+
+  void TearDown() override {
+    auto &p = DkSettingsManager::param();
+    p.resources().thumbCacheSize = mCacheSize;
+    p.app().privateMode = mPrivateMode;
+  }
+
+  QString cachePath() const { return mDir.filePath("cache"); }
+
+  // the cache checks the size and modification date of the image file
+  QString createFile(const QString &name, const QByteArray &content = "image") {
+    QString filePath = mDir.filePath(name);
+    QFile file(filePath);
+    EXPECT_TRUE(file.open(QIODevice::WriteOnly));
+    file.write(content);
+
+    return filePath;
+  }
+
+  static QImage thumb(const QColor &color) {
+    QImage img(64, 48, QImage::Format_RGB32);
+    img.fill(color);
+    return img;
+  }
+
+  QTemporaryDir mDir;
+  int mCacheSize = 0;
+  bool mPrivateMode = false;
+};
+
+TEST_F(DkThumbCacheTest, RoundTrip) {
+  QString filePath = createFile("a.jpg");
+
+  {
+    TestThumbCache cache(cachePath());
+    cache.insert(filePath, thumb(Qt::red), 128);
+
+    QImage img = cache.find(filePath, 128);
+    ASSERT_EQ(img.size(), QSize(64, 48));
+    EXPECT_GT(qRed(img.pixel(10, 10)), 200);
+  }
+
+  // the index is written when the cache is destroyed
+  {
+    TestThumbCache cache(cachePath());
+    EXPECT_EQ(cache.numEntries(), 0); // nothing is read before the first access
+
+    QImage img = cache.find(filePath, 64);
+    ASSERT_EQ(img.size(), QSize(64, 48));
+    EXPECT_EQ(cache.numEntries(), 1);
+
+    // the cached thumbnail is too small
+    EXPECT_TRUE(cache.find(filePath, 256).isNull());
+    EXPECT_EQ(cache.numEntries(), 0);
+    cache.save();
+  }
+
+  TestThumbCache cache(cachePath());
+  EXPECT_TRUE(cache.find(filePath, 64).isNull());
+}
+
+TEST_F(DkThumbCacheTest, ChangedFile) {
+  QString filePath = createFile("a.jpg");
+
+  TestThumbCache cache(cachePath());
+  cache.insert(filePath, thumb(Qt::green), 128);
+  ASSERT_FALSE(cache.find(filePath, 128).isNull());
+
+  // the file size changed
+  createFile("a.jpg", "another image");
+  EXPECT_TRUE(cache.find(filePath, 128).isNull());
+  EXPECT_EQ(cache.numEntries(), 0);
+}
+
+TEST_F(DkThumbCacheTest, Compaction) {
+  QString a = createFile("a.jpg");
+  QString b = createFile("b.jpg");
+  QString c = createFile("c.jpg");
+
+  TestThumbCache cache(cachePath());
+  cache.insert(a, thumb(Qt::red), 128);
+  cache.insert(b, thumb(Qt::green), 128);
+  cache.insert(c, thumb(Qt::blue), 128);
+  ASSERT_EQ(cache.numEntries(), 3);
+
+  // b is the least recently used thumbnail
+  ASSERT_FALSE(cache.find(a, 128).isNull());
+
+  qint64 size = cache.packSize();
+  cache.compact(size - 1);
+
+  EXPECT_EQ(cache.numEntries(), 2);
+  EXPECT_LT(cache.packSize(), size);
+  EXPECT_TRUE(cache.find(b, 128).isNull());
+
+  // the remaining thumbnails are moved
+  QImage img = cache.find(c, 128);
+  ASSERT_FALSE(img.isNull());
+  EXPECT_GT(qBlue(img.pixel(10, 10)), 200);
+  EXPECT_GT(qRed(cache.find(a, 128).pixel(10, 10)), 200);
+}
+
+TEST_F(DkThumbCacheTest, PrivateMode) {
+  QString filePath = createFile("a.jpg");
+  DkSettingsManager::param().app().privateMode = true;
+
+  TestThumbCache cache(cachePath());
+  cache.insert(filePath, thumb(Qt::red), 128);
+  cache.save();
+
+  EXPECT_EQ(cache.numEntries(), 0);
+  EXPECT_TRUE(cache.find(filePath, 128).isNull());
+  EXPECT_FALSE(QFile::exists(cachePath() + "/thumbs.idx"));
+}
@@ -45,3 +45,24 @@ TEST(DkFileNameConverterTest, OldIndex) {
   EXPECT_EQ(fourPad.convert("test.jpg", 11).toStdString(),
             std::string("00011"));
 }
+
+TEST(DkUtilsTest, NaturalSortKey) {
+  using nmc::DkNaturalSortKey;
+  using nmc::DkUtils;
+
+  EXPECT_LT(DkNaturalSortKey("img4.png"), DkNaturalSortKey("img10.png"));
+  EXPECT_LT(DkNaturalSortKey("img12.png"), DkNaturalSortKey("img101.png"));
+  EXPECT_LT(DkNaturalSortKey("a.png"), DkNaturalSortKey("B1.png"));
+  EXPECT_LT(DkNaturalSortKey("IMG_2.JPG"), DkNaturalSortKey("img_10.jpg"));
+  EXPECT_EQ(DkNaturalSortKey("img.png").compare(DkNaturalSortKey("img.png")), 0);
+  EXPECT_LT(DkNaturalSortKey("2.png"), DkNaturalSortKey("10.png"));
+  EXPECT_LT(DkNaturalSortKey("img007.png"), DkNaturalSortKey("img10.png"));
+  EXPECT_LT(DkNaturalSortKey("img99.png"), DkNaturalSortKey("img100.png"));
+  EXPECT_LT(DkNaturalSortKey("img2a.png"), DkNaturalSortKey("img2b.png"));
+  EXPECT_LT(DkNaturalSortKey("img 2 3.png"), DkNaturalSortKey("img 2 10.png"));
+
+  EXPECT_EQ(DkUtils::randomSortKey("img.png", 42),
+            DkUtils::randomSortKey("img.png", 42));
+  EXPECT_NE(DkUtils::randomSortKey("img.png", 42),
+            DkUtils::randomSortKey("img.png", 43));
+}